@@ -13,11 +13,18 @@
 #include <sys/mman.h>
 #include <sys/param.h>
 #include <sys/errno.h>
+#include <sys/time.h>
+#include <time.h>
 #include "esp_err.h"
 #include "esp_log.h"
 #include "linux/videodev2.h"
 #include "esp_video_init.h"
 #include "app_video.h"
+#include "cam_stats.h"
+#include "cam_trace.h"
+#include "esp_timer.h"
+#include "frame_pacer.h"
+#include "pixfmt.h"
 #include "sdkconfig.h"
 
 static const char *TAG = "app_video";
@@ -26,6 +33,9 @@ static const char *TAG = "app_video";
 #define MIN_BUFFER_COUNT                (2)
 #define VIDEO_TASK_STACK_SIZE           (4 * 1024)
 #define VIDEO_TASK_PRIORITY             (6)
+#define V4L2_FMT_STR                    "%c%c%c%c"
+#define V4L2_FMT_STR_ARG(f)             (char)((f) & 0xFF), (char)(((f) >> 8) & 0xFF), \
+                                        (char)(((f) >> 16) & 0xFF), (char)(((f) >> 24) & 0xFF)
 
 typedef struct {
     uint8_t *camera_buffer[MAX_BUFFER_COUNT];
@@ -38,15 +48,54 @@ typedef struct {
     TaskHandle_t video_stream_task_handle;
     bool video_task_delete;
     SemaphoreHandle_t video_stop_sem;
+    int video_fd;
+    uint32_t pixfmt;
+    uint32_t fps;
+    uint32_t buf_count;
+    bool streaming;
+    video_mode_t pending_mode;          // handed to the stream task
+    bool switch_pending;                // under switch_lock
+    esp_err_t switch_err;
+    SemaphoreHandle_t switch_lock;
+    SemaphoreHandle_t switch_done;
+    volatile uint32_t out_fps;          // app_video_set_frame_rate(), 0 = all frames
+    volatile uint32_t decimate_fps;     // what the stream task paces to
+    frame_pacer_t pacer;
+    app_video_frame_info_t info;        // of the frame in v4l2_buf
+    bool have_sequence;                 // info.sequence seen since STREAMON
 } app_video_t;
 
 static app_video_t app_camera_video;
 
-int app_video_open(char *dev, video_fmt_t init_fmt)
+static video_mode_req_t s_req = {
+    .width = CONFIG_P4_CAPTURE_WIDTH,
+    .height = CONFIG_P4_CAPTURE_HEIGHT,
+    .fps = CONFIG_P4_CAPTURE_FPS,
+    .max_mb_s = CONFIG_P4_CAPTURE_MAX_MB_S,
+#if CONFIG_P4_CAPTURE_FORMAT_RGB565
+    .pixfmt = APP_VIDEO_FMT_RGB565,
+#endif
+};
+
+void app_video_set_capture_size(uint32_t width, uint32_t height)
+{
+    s_req.width = width;
+    s_req.height = height;
+}
+
+void app_video_set_mode_request(const video_mode_req_t *req)
+{
+    s_req = *req;
+}
+
+void app_video_get_mode_request(video_mode_req_t *req)
+{
+    *req = s_req;
+}
+
+static int open_device(char *dev)
 {
-    struct v4l2_format default_format;
     struct v4l2_capability capability;
-    const int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
     int fd = open(dev, O_RDONLY);
     if (fd < 0) {
@@ -56,7 +105,8 @@ int app_video_open(char *dev, video_fmt_t init_fmt)
 
     if (ioctl(fd, VIDIOC_QUERYCAP, &capability)) {
         ESP_LOGE(TAG, "failed to get capability");
-        goto exit_0;
+        close(fd);
+        return -1;
     }
 
     ESP_LOGI(TAG, "version: %d.%d.%d", (uint16_t)(capability.version >> 16),
@@ -65,19 +115,29 @@ int app_video_open(char *dev, video_fmt_t init_fmt)
     ESP_LOGI(TAG, "driver:  %s", capability.driver);
     ESP_LOGI(TAG, "card:    %s", capability.card);
     ESP_LOGI(TAG, "bus:     %s", capability.bus_info);
+    return fd;
+}
+
+// Applies a mode, 0 width or height keeping the current one, and checks
+// the driver kept the format: some drivers answer S_FMT with the nearest
+// one they have.
+static esp_err_t configure_mode(int fd, const video_mode_t *mode)
+{
+    struct v4l2_format default_format;
+    const int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
     memset(&default_format, 0, sizeof(struct v4l2_format));
     default_format.type = type;
     if (ioctl(fd, VIDIOC_G_FMT, &default_format) != 0) {
         ESP_LOGE(TAG, "failed to get format");
-        goto exit_0;
+        return ESP_FAIL;
     }
 
     ESP_LOGI(TAG, "width=%" PRIu32 " height=%" PRIu32, default_format.fmt.pix.width, default_format.fmt.pix.height);
 
-    uint32_t req_width = CONFIG_P4_CAPTURE_WIDTH;
-    uint32_t req_height = CONFIG_P4_CAPTURE_HEIGHT;
-    bool need_set = default_format.fmt.pix.pixelformat != init_fmt;
+    uint32_t req_width = mode->width;
+    uint32_t req_height = mode->height;
+    bool need_set = default_format.fmt.pix.pixelformat != mode->pixfmt;
     if (req_width > 0 && req_width != default_format.fmt.pix.width) {
         need_set = true;
     }
@@ -90,32 +150,205 @@ int app_video_open(char *dev, video_fmt_t init_fmt)
             .type = type,
             .fmt.pix.width = (req_width > 0) ? req_width : default_format.fmt.pix.width,
             .fmt.pix.height = (req_height > 0) ? req_height : default_format.fmt.pix.height,
-            .fmt.pix.pixelformat = init_fmt,
+            .fmt.pix.pixelformat = mode->pixfmt,
         };
 
         if (ioctl(fd, VIDIOC_S_FMT, &format) != 0) {
             ESP_LOGE(TAG, "failed to set format");
-            goto exit_0;
+            return ESP_FAIL;
         }
 
         if (ioctl(fd, VIDIOC_G_FMT, &default_format) != 0) {
             ESP_LOGE(TAG, "failed to get format after set");
-            goto exit_0;
+            return ESP_FAIL;
+        }
+        if (default_format.fmt.pix.pixelformat != mode->pixfmt) {
+            ESP_LOGW(TAG, "format " V4L2_FMT_STR " not taken", V4L2_FMT_STR_ARG(mode->pixfmt));
+            return ESP_ERR_NOT_SUPPORTED;
         }
     }
 
     app_camera_video.camera_buf_hes = default_format.fmt.pix.width;
     app_camera_video.camera_buf_ves = default_format.fmt.pix.height;
+    app_camera_video.pixfmt = mode->pixfmt;
+    app_camera_video.fps = mode->fps;
+    return ESP_OK;
+}
+
+static void add_mode(video_mode_t *modes, size_t *n, size_t max, uint32_t pixfmt, uint32_t width, uint32_t height)
+{
+    if (*n >= max || width == 0 || height == 0) {
+        return;
+    }
+    for (size_t i = 0; i < *n; i++) {
+        if (modes[i].pixfmt == pixfmt && modes[i].width == width && modes[i].height == height) {
+            return;
+        }
+    }
+    modes[(*n)++] = (video_mode_t) {
+        .pixfmt = pixfmt,
+        .width = width,
+        .height = height,
+    };
+}
+
+static uint32_t max_fps(int fd, const video_mode_t *mode)
+{
+    struct v4l2_frmivalenum ival = {
+        .pixel_format = mode->pixfmt,
+        .width = mode->width,
+        .height = mode->height,
+    };
+    uint32_t best = 0;
+    for (ival.index = 0; ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0; ival.index++) {
+        const struct v4l2_fract *f = ival.type == V4L2_FRMIVAL_TYPE_DISCRETE ? &ival.discrete : &ival.stepwise.min;
+        if (f->numerator > 0) {
+            best = MAX(best, f->denominator / f->numerator);
+        }
+        if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+            break;
+        }
+    }
+    return best;
+}
+
+static void enum_sizes(int fd, uint32_t pixfmt, video_mode_t *modes, size_t *n, size_t max)
+{
+    struct v4l2_frmsizeenum size = {
+        .pixel_format = pixfmt,
+    };
+
+    if (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) != 0) {
+        // No size enumeration: offer the current size and the requested
+        // one, which is what S_FMT was always given.
+        struct v4l2_format format = {
+            .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        };
+        if (ioctl(fd, VIDIOC_G_FMT, &format) == 0) {
+            add_mode(modes, n, max, pixfmt, format.fmt.pix.width, format.fmt.pix.height);
+        }
+        add_mode(modes, n, max, pixfmt, s_req.width, s_req.height);
+        return;
+    }
 
+    if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+        do {
+            add_mode(modes, n, max, pixfmt, size.discrete.width, size.discrete.height);
+            size.index++;
+        } while (ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0);
+        return;
+    }
+
+    // Stepwise or continuous: the largest size, plus the requested one
+    // when it lies on the grid.
+    const struct v4l2_frmsize_stepwise *sw = &size.stepwise;
+    add_mode(modes, n, max, pixfmt, sw->max_width, sw->max_height);
+    uint32_t w = s_req.width, h = s_req.height;
+    if (w >= sw->min_width && w <= sw->max_width && h >= sw->min_height && h <= sw->max_height &&
+        (sw->step_width == 0 || (w - sw->min_width) % sw->step_width == 0) &&
+        (sw->step_height == 0 || (h - sw->min_height) % sw->step_height == 0)) {
+        add_mode(modes, n, max, pixfmt, w, h);
+    }
+}
+
+size_t app_video_enum_modes(int video_fd, video_mode_t *modes, size_t max)
+{
+    size_t n = 0;
+    struct v4l2_fmtdesc desc = {
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+    };
+    for (desc.index = 0; n < max && ioctl(video_fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++) {
+        enum_sizes(video_fd, desc.pixelformat, modes, &n, max);
+    }
+    for (size_t i = 0; i < n; i++) {
+        modes[i].fps = max_fps(video_fd, &modes[i]);
+    }
+    return n;
+}
+
+int app_video_open(char *dev, video_fmt_t init_fmt)
+{
+    int fd = open_device(dev);
+    if (fd < 0) {
+        return -1;
+    }
+
+    video_mode_t mode = {
+        .pixfmt = init_fmt,
+        .width = s_req.width,
+        .height = s_req.height,
+    };
+    if (configure_mode(fd, &mode) != ESP_OK) {
+        close(fd);
+        return -1;
+    }
+
+    app_camera_video.video_fd = fd;
     app_camera_video.video_stop_sem = xSemaphoreCreateBinary();
+    app_camera_video.switch_lock = xSemaphoreCreateMutex();
+    app_camera_video.switch_done = xSemaphoreCreateBinary();
 
     return fd;
-exit_0:
+}
+
+int app_video_open_any(char *dev, const uint32_t *fmts, size_t count, uint32_t *out_fmt)
+{
+    int fd = open_device(dev);
+    if (fd < 0) {
+        return -1;
+    }
+
+    video_mode_t modes[VIDEO_MODE_MAX];
+    size_t n = app_video_enum_modes(fd, modes, VIDEO_MODE_MAX);
+    for (size_t i = 0; i < n; i++) {
+        ESP_LOGD(TAG, "mode " V4L2_FMT_STR " %" PRIu32 "x%" PRIu32 " @%" PRIu32,
+                 V4L2_FMT_STR_ARG(modes[i].pixfmt), modes[i].width, modes[i].height, modes[i].fps);
+    }
+
+    // A mode the driver lists but refuses is dropped and the pick redone.
+    video_mode_t mode;
+    while (video_mode_pick(modes, n, &s_req, fmts, count, &mode) == ESP_OK) {
+        if (configure_mode(fd, &mode) == ESP_OK) {
+            ESP_LOGI(TAG, "capture mode " V4L2_FMT_STR " %" PRIu32 "x%" PRIu32 " @%" PRIu32 " fps",
+                     V4L2_FMT_STR_ARG(mode.pixfmt), app_camera_video.camera_buf_hes,
+                     app_camera_video.camera_buf_ves, mode.fps);
+            if (out_fmt) {
+                *out_fmt = mode.pixfmt;
+            }
+            app_camera_video.video_fd = fd;
+            app_camera_video.video_stop_sem = xSemaphoreCreateBinary();
+            app_camera_video.switch_lock = xSemaphoreCreateMutex();
+            app_camera_video.switch_done = xSemaphoreCreateBinary();
+            return fd;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (memcmp(&modes[i], &mode, sizeof(mode)) == 0) {
+                modes[i] = modes[--n];
+                break;
+            }
+        }
+    }
+
+    ESP_LOGE(TAG, "no usable capture mode");
     close(fd);
     return -1;
 }
 
-esp_err_t app_video_set_bufs(int video_fd, uint32_t fb_num, const void **fb)
+esp_err_t app_video_get_mode(video_mode_t *out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = (video_mode_t) {
+        .pixfmt = app_camera_video.pixfmt,
+        .width = app_camera_video.camera_buf_hes,
+        .height = app_camera_video.camera_buf_ves,
+        .fps = app_camera_video.fps,
+    };
+    return ESP_OK;
+}
+
+static esp_err_t request_bufs(int video_fd, uint32_t fb_num, const void **fb)
 {
     if (fb_num > MAX_BUFFER_COUNT) {
         ESP_LOGE(TAG, "buffer num is too large");
@@ -173,13 +406,40 @@ esp_err_t app_video_set_bufs(int video_fd, uint32_t fb_num, const void **fb)
         }
     }
 
+    app_camera_video.buf_count = fb_num;
     return ESP_OK;
 
 errout_req_bufs:
-    close(video_fd);
     return ESP_FAIL;
 }
 
+esp_err_t app_video_set_bufs(int video_fd, uint32_t fb_num, const void **fb)
+{
+    esp_err_t err = request_bufs(video_fd, fb_num, fb);
+    if (err != ESP_OK) {
+        close(video_fd);
+    }
+    return err;
+}
+
+// esp_video hands out its own buffers from mmap(); REQBUFS with a count of
+// 0 frees them, after which the old pointers must not be used.
+static esp_err_t release_bufs(int video_fd)
+{
+    struct v4l2_requestbuffers req = {
+        .count = 0,
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+        .memory = app_camera_video.camera_mem_mode,
+    };
+    if (ioctl(video_fd, VIDIOC_REQBUFS, &req) != 0) {
+        ESP_LOGE(TAG, "release bufs failed");
+        return ESP_FAIL;
+    }
+    memset(app_camera_video.camera_buffer, 0, sizeof(app_camera_video.camera_buffer));
+    app_camera_video.buf_count = 0;
+    return ESP_OK;
+}
+
 esp_err_t app_video_get_bufs(int fb_num, void **fb)
 {
     if (fb_num > MAX_BUFFER_COUNT) {
@@ -208,7 +468,9 @@ static inline esp_err_t video_receive_video_frame(int video_fd)
     app_camera_video.v4l2_buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     app_camera_video.v4l2_buf.memory = app_camera_video.camera_mem_mode;
 
+    CAM_TRACE_BEGIN(DQBUF);
     int res = ioctl(video_fd, VIDIOC_DQBUF, &(app_camera_video.v4l2_buf));
+    CAM_TRACE_END(DQBUF, app_camera_video.v4l2_buf.index);
     if (res != 0) {
         ESP_LOGE(TAG, "failed to receive video frame");
         goto errout;
@@ -222,9 +484,6 @@ errout:
 
 static inline void video_operation_video_frame(int video_fd)
 {
-    app_camera_video.v4l2_buf.m.userptr = (unsigned long)app_camera_video.camera_buffer[app_camera_video.v4l2_buf.index];
-    app_camera_video.v4l2_buf.length = app_camera_video.camera_buf_size;
-
     uint8_t buf_index = app_camera_video.v4l2_buf.index;
 
     app_camera_video.user_camera_video_frame_operation_cb(
@@ -232,13 +491,20 @@ static inline void video_operation_video_frame(int video_fd)
         buf_index,
         app_camera_video.camera_buf_hes,
         app_camera_video.camera_buf_ves,
-        app_camera_video.camera_buf_size
+        app_camera_video.camera_buf_size,
+        &app_camera_video.info
     );
 }
 
 static inline esp_err_t video_free_video_frame(int video_fd)
 {
-    if (ioctl(video_fd, VIDIOC_QBUF, &(app_camera_video.v4l2_buf)) != 0) {
+    app_camera_video.v4l2_buf.m.userptr = (unsigned long)app_camera_video.camera_buffer[app_camera_video.v4l2_buf.index];
+    app_camera_video.v4l2_buf.length = app_camera_video.camera_buf_size;
+
+    CAM_TRACE_BEGIN(QBUF);
+    int res = ioctl(video_fd, VIDIOC_QBUF, &(app_camera_video.v4l2_buf));
+    CAM_TRACE_END(QBUF, app_camera_video.v4l2_buf.index);
+    if (res != 0) {
         ESP_LOGE(TAG, "failed to free video frame");
         goto errout;
     }
@@ -258,6 +524,9 @@ static inline esp_err_t video_stream_start(int video_fd)
         ESP_LOGE(TAG, "failed to start stream");
         goto errout;
     }
+    app_camera_video.streaming = true;
+    // Drivers restart the sequence count at STREAMON.
+    app_camera_video.have_sequence = false;
 
     struct v4l2_format format = {0};
     format.type = type;
@@ -281,6 +550,7 @@ static inline esp_err_t video_stream_stop(int video_fd)
         ESP_LOGE(TAG, "failed to stop stream");
         goto errout;
     }
+    app_camera_video.streaming = false;
 
     return ESP_OK;
 
@@ -288,20 +558,227 @@ errout:
     return ESP_FAIL;
 }
 
+// Asks the sensor for the output rate (the mode's rate when 0). True when it
+// now runs at most 5% above it, so nothing needs dropping.
+static bool sensor_set_rate(int video_fd, uint32_t fps)
+{
+    struct v4l2_streamparm parm = {
+        .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+    };
+    if (ioctl(video_fd, VIDIOC_G_PARM, &parm) != 0 ||
+        !(parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+        return false;
+    }
+    uint32_t want = fps ? fps : app_camera_video.fps;
+    if (want == 0) {
+        return false;
+    }
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = want;
+    if (ioctl(video_fd, VIDIOC_S_PARM, &parm) != 0 || ioctl(video_fd, VIDIOC_G_PARM, &parm) != 0) {
+        return false;
+    }
+    // Drivers round to the nearest interval they have.
+    const struct v4l2_fract *t = &parm.parm.capture.timeperframe;
+    return fps && t->denominator > 0 && (uint64_t)t->denominator * 100 <= (uint64_t)t->numerator * fps * 105;
+}
+
+// With the stream off: sensor first, then decimation for whatever is left.
+static void apply_rate(int video_fd)
+{
+    uint32_t fps = app_camera_video.out_fps;
+    bool sensor = sensor_set_rate(video_fd, fps);
+    app_camera_video.decimate_fps = sensor ? 0 : fps;
+    if (fps) {
+        ESP_LOGI(TAG, "output %" PRIu32 " fps by %s", fps, sensor ? "sensor frame interval" : "dropping frames");
+    }
+}
+
+esp_err_t app_video_set_frame_rate(int video_fd, uint32_t fps, bool *out_decimating)
+{
+    app_camera_video.out_fps = fps;
+    if (app_camera_video.streaming) {
+        // Drivers refuse S_PARM while streaming; the next mode switch or
+        // start tries the sensor again.
+        app_camera_video.decimate_fps = fps;
+    } else {
+        apply_rate(video_fd);
+    }
+    if (out_decimating) {
+        *out_decimating = app_camera_video.decimate_fps != 0;
+    }
+    return ESP_OK;
+}
+
+// Runs between frames on the stream task, or directly when not streaming.
+// Falls back to the old mode if the new one does not take. When even that
+// fails the stream is left stopped; the stream task keeps running, so a
+// later switch can start it again.
+static esp_err_t apply_mode(int video_fd, const video_mode_t *mode)
+{
+    video_mode_t old;
+    app_video_get_mode(&old);
+    bool was_streaming = app_camera_video.streaming;
+    // A stream left stopped by a failed switch is restarted by the next one.
+    bool restart = was_streaming || app_camera_video.video_stream_task_handle;
+    uint32_t buf_count = app_camera_video.buf_count;
+    esp_err_t ret;
+
+    if (was_streaming && video_stream_stop(video_fd) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (buf_count && release_bufs(video_fd) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = configure_mode(video_fd, mode);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "mode switch failed, restoring %" PRIu32 "x%" PRIu32, old.width, old.height);
+        ret = configure_mode(video_fd, &old);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "old mode not restored, stream stopped");
+            goto errout_stopped;
+        }
+    }
+    // S_FMT may have reset the frame interval.
+    apply_rate(video_fd);
+    if (buf_count) {
+        ret = request_bufs(video_fd, buf_count, NULL);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "no capture buffers after mode switch, stream stopped");
+            goto errout_stopped;
+        }
+    }
+    if (restart) {
+        ret = video_stream_start(video_fd);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "stream not restarted after mode switch");
+            return ret;
+        }
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "switched to " V4L2_FMT_STR " %" PRIu32 "x%" PRIu32,
+                 V4L2_FMT_STR_ARG(mode->pixfmt), app_camera_video.camera_buf_hes, app_camera_video.camera_buf_ves);
+    }
+    return err;
+
+errout_stopped:
+    // Kept so the next switch frees whatever was allocated and tries again.
+    app_camera_video.buf_count = buf_count;
+    return ret;
+}
+
+// Capture time of the dequeued frame on the esp_timer clock. The driver
+// stamps the buffer when the frame completes, on the monotonic clock or the
+// wall clock per its flags; the age of that stamp carries over to esp_timer,
+// so SNTP steps of the wall clock do not matter.
+static int64_t frame_timestamp_us(int64_t now_us)
+{
+    const struct v4l2_buffer *b = &app_camera_video.v4l2_buf;
+    if (b->timestamp.tv_sec == 0 && b->timestamp.tv_usec == 0) {
+        return now_us;
+    }
+    int64_t stamp_us = (int64_t)b->timestamp.tv_sec * 1000000 + b->timestamp.tv_usec;
+    int64_t clock_us;
+    if ((b->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        clock_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    } else {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        clock_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+    // A stamp from the future or older than the buffer queue could hold
+    // means a clock we do not understand; DQBUF time is the best left.
+    int64_t age_us = clock_us - stamp_us;
+    if (age_us < 0 || age_us > 1000000) {
+        return now_us;
+    }
+    return now_us - age_us;
+}
+
+// Right after DQBUF: stamp the frame and count frames the sensor pipeline
+// lost before we saw them, from gaps in the driver's sequence numbers.
+static void take_frame_info(void)
+{
+    app_video_frame_info_t *info = &app_camera_video.info;
+    uint32_t seq = app_camera_video.v4l2_buf.sequence;
+    if (app_camera_video.have_sequence && seq - info->sequence > 1) {
+        cam_stats_add(CAM_STAT_DROP_SENSOR, seq - info->sequence - 1);
+    }
+    app_camera_video.have_sequence = true;
+    info->sequence = seq;
+    info->dqbuf_us = esp_timer_get_time();
+    info->ts_us = frame_timestamp_us(info->dqbuf_us);
+}
+
+// Decimation runs before the callback, so a dropped frame costs a DQBUF
+// and a QBUF and nothing else.
+static bool pace_frame(void)
+{
+    uint32_t fps = app_camera_video.decimate_fps;
+    if (fps != app_camera_video.pacer.fps) {
+        frame_pacer_init(&app_camera_video.pacer, fps);
+    }
+    if (frame_pacer_take(&app_camera_video.pacer, app_camera_video.info.ts_us)) {
+        return true;
+    }
+    cam_stats_inc(CAM_STAT_FRAMES_DECIMATED);
+    return false;
+}
+
+// Claims a pending app_video_switch_mode() request, unless the caller timed
+// out and withdrew it first.
+static bool take_switch(video_mode_t *mode)
+{
+    xSemaphoreTake(app_camera_video.switch_lock, portMAX_DELAY);
+    bool taken = app_camera_video.switch_pending;
+    if (taken) {
+        *mode = app_camera_video.pending_mode;
+        app_camera_video.switch_pending = false;
+    }
+    xSemaphoreGive(app_camera_video.switch_lock);
+    return taken;
+}
+
 static void video_stream_task(void *arg)
 {
-    int video_fd = *((int *)arg);
+    (void)arg;
+    int video_fd = app_camera_video.video_fd;
 
     while (1) {
-        ESP_ERROR_CHECK(video_receive_video_frame(video_fd));
+        if (app_camera_video.streaming) {
+            ESP_ERROR_CHECK(video_receive_video_frame(video_fd));
+            take_frame_info();
 
-        video_operation_video_frame(video_fd);
+            if (pace_frame()) {
+                video_operation_video_frame(video_fd);
+            }
 
-        ESP_ERROR_CHECK(video_free_video_frame(video_fd));
+            ESP_ERROR_CHECK(video_free_video_frame(video_fd));
+        } else {
+            // A failed mode switch stopped the stream; wait for another
+            // switch or for the stop request.
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+
+        video_mode_t mode;
+        if (take_switch(&mode)) {
+            app_camera_video.switch_err = apply_mode(video_fd, &mode);
+            xSemaphoreGive(app_camera_video.switch_done);
+        }
 
         if (app_camera_video.video_task_delete) {
             app_camera_video.video_task_delete = false;
-            ESP_ERROR_CHECK(video_stream_stop(video_fd));
+            if (app_camera_video.streaming) {
+                ESP_ERROR_CHECK(video_stream_stop(video_fd));
+            }
+            app_camera_video.video_stream_task_handle = NULL;
+            if (take_switch(&mode)) {
+                app_camera_video.switch_err = ESP_ERR_INVALID_STATE;
+                xSemaphoreGive(app_camera_video.switch_done);
+            }
             xSemaphoreGive(app_camera_video.video_stop_sem);
             vTaskDelete(NULL);
         }
@@ -309,11 +786,46 @@ static void video_stream_task(void *arg)
     vTaskDelete(NULL);
 }
 
+esp_err_t app_video_switch_mode(int video_fd, const video_mode_t *mode, uint32_t timeout_ms)
+{
+    if (!mode || pixfmt_frame_size(mode->pixfmt, mode->width, mode->height) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Caller-provided buffers were sized for the old mode.
+    if (app_camera_video.buf_count && app_camera_video.camera_mem_mode != V4L2_MEMORY_MMAP) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!app_camera_video.video_stream_task_handle) {
+        return apply_mode(video_fd, mode);
+    }
+
+    xSemaphoreTake(app_camera_video.switch_done, 0);
+    xSemaphoreTake(app_camera_video.switch_lock, portMAX_DELAY);
+    app_camera_video.pending_mode = *mode;
+    app_camera_video.switch_pending = true;
+    xSemaphoreGive(app_camera_video.switch_lock);
+    if (xSemaphoreTake(app_camera_video.switch_done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        // Withdraw the request so it is not applied behind the caller's back.
+        // Too late if the stream task already took it: then wait for it.
+        xSemaphoreTake(app_camera_video.switch_lock, portMAX_DELAY);
+        bool withdrawn = app_camera_video.switch_pending;
+        app_camera_video.switch_pending = false;
+        xSemaphoreGive(app_camera_video.switch_lock);
+        if (withdrawn) {
+            return ESP_ERR_TIMEOUT;
+        }
+        xSemaphoreTake(app_camera_video.switch_done, portMAX_DELAY);
+    }
+    return app_camera_video.switch_err;
+}
+
 esp_err_t app_video_stream_task_start(int video_fd, int core_id)
 {
+    app_camera_video.video_fd = video_fd;
+    frame_pacer_init(&app_camera_video.pacer, app_camera_video.decimate_fps);
     video_stream_start(video_fd);
 
-    BaseType_t result = xTaskCreatePinnedToCore(video_stream_task, "video stream task", VIDEO_TASK_STACK_SIZE, &video_fd, VIDEO_TASK_PRIORITY, &app_camera_video.video_stream_task_handle, core_id);
+    BaseType_t result = xTaskCreatePinnedToCore(video_stream_task, "video stream task", VIDEO_TASK_STACK_SIZE, NULL, VIDEO_TASK_PRIORITY, &app_camera_video.video_stream_task_handle, core_id);
 
     if (result != pdPASS) {
         ESP_LOGE(TAG, "failed to create video stream task");
@@ -349,5 +861,21 @@ esp_err_t app_video_register_frame_operation_cb(app_video_frame_operation_cb_t o
 esp_err_t app_video_close(int video_fd)
 {
     close(video_fd);
+    // Created by every app_video_open().
+    if (app_camera_video.video_stop_sem) {
+        vSemaphoreDelete(app_camera_video.video_stop_sem);
+        app_camera_video.video_stop_sem = NULL;
+    }
+    if (app_camera_video.switch_lock) {
+        vSemaphoreDelete(app_camera_video.switch_lock);
+        app_camera_video.switch_lock = NULL;
+    }
+    if (app_camera_video.switch_done) {
+        vSemaphoreDelete(app_camera_video.switch_done);
+        app_camera_video.switch_done = NULL;
+    }
+    app_camera_video.buf_count = 0;
+    app_camera_video.out_fps = 0;
+    app_camera_video.decimate_fps = 0;
     return ESP_OK;
 }
@@ -8,7 +8,16 @@
 
 #include "esp_err.h"
 #include "linux/videodev2.h"
+#include "video_mode.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+// Host build: frames come from app_video_sim.c instead of esp_video.
+#define APP_VIDEO_DEVICE_NAME "/dev/video-sim"
+#else
 #include "esp_video_device.h"
+#define APP_VIDEO_DEVICE_NAME ESP_VIDEO_MIPI_CSI_DEVICE_NAME
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,7 +33,14 @@ typedef enum {
     APP_VIDEO_FMT_YUV420 = V4L2_PIX_FMT_YUV420,
 } video_fmt_t;
 
-typedef void (*app_video_frame_operation_cb_t)(uint8_t *camera_buf, uint8_t camera_buf_index, uint32_t camera_buf_hes, uint32_t camera_buf_ves, size_t camera_buf_len);
+/** @brief When and which sensor frame a callback's buffer holds. */
+typedef struct {
+    int64_t ts_us;          // capture time on the esp_timer clock, from the driver's buffer timestamp
+    int64_t dqbuf_us;       // esp_timer time VIDIOC_DQBUF returned the buffer
+    uint32_t sequence;      // driver frame counter; gaps are frames the sensor pipeline dropped
+} app_video_frame_info_t;
+
+typedef void (*app_video_frame_operation_cb_t)(uint8_t *camera_buf, uint8_t camera_buf_index, uint32_t camera_buf_hes, uint32_t camera_buf_ves, size_t camera_buf_len, const app_video_frame_info_t *info);
 
 /**
  * @brief Opens a specified video capture device and configures its format.
@@ -41,6 +57,92 @@ typedef void (*app_video_frame_operation_cb_t)(uint8_t *camera_buf, uint8_t came
  */
 int app_video_open(char *dev, video_fmt_t init_fmt);
 
+/**
+ * @brief Open the capture device in the mode that best fits the request.
+ *
+ * Like app_video_open(), but the mode is negotiated: the driver's formats,
+ * frame sizes and frame rates are enumerated (app_video_enum_modes()) and
+ * video_mode_pick() chooses among those in @p fmts for the current mode
+ * request. A mode the driver lists but will not switch to is dropped and
+ * the next best one tried.
+ *
+ * @param fmts Acceptable video_fmt_t values, best first.
+ * @param out_fmt Optional; set to the format in use.
+ * @return File descriptor, or -1 when no mode works.
+ */
+int app_video_open_any(char *dev, const uint32_t *fmts, size_t count, uint32_t *out_fmt);
+
+/**
+ * @brief Set the resolution requested by the next open.
+ *
+ * Starts at CONFIG_P4_CAPTURE_WIDTH x CONFIG_P4_CAPTURE_HEIGHT. A value of 0
+ * keeps the sensor default for that dimension. Shorthand for changing only
+ * the size in the mode request.
+ */
+void app_video_set_capture_size(uint32_t width, uint32_t height);
+
+/**
+ * @brief Set the mode request used by app_video_open_any().
+ *
+ * Starts from CONFIG_P4_CAPTURE_WIDTH/HEIGHT/FPS/MAX_MB_S (and
+ * CONFIG_P4_CAPTURE_FORMAT); see video_mode_req_t.
+ */
+void app_video_set_mode_request(const video_mode_req_t *req);
+
+/** @brief Current mode request. */
+void app_video_get_mode_request(video_mode_req_t *req);
+
+/**
+ * @brief List the capture modes the device offers.
+ *
+ * One entry per format (VIDIOC_ENUM_FMT) and frame size
+ * (VIDIOC_ENUM_FRAMESIZES), with the best rate from
+ * VIDIOC_ENUM_FRAMEINTERVALS or 0 when the driver does not say. Stepwise
+ * sizes contribute their maximum and, when on the grid, the requested size;
+ * a driver without size enumeration contributes its current size.
+ *
+ * @return Number of modes written, at most @p max.
+ */
+size_t app_video_enum_modes(int video_fd, video_mode_t *modes, size_t max);
+
+/** @brief Mode the device is in: format, frame size and nominal fps. */
+esp_err_t app_video_get_mode(video_mode_t *out);
+
+/**
+ * @brief Change the capture mode without closing the device.
+ *
+ * While streaming, the stream task makes the change between two frames:
+ * it stops the stream, frees and re-requests the driver buffers at the new
+ * size and restarts, so the frame callback simply sees the new size and
+ * format from the next frame on. If the driver refuses the mode the old one
+ * is restored. If the driver fails while doing so (no buffers, old mode
+ * refused too), the error is returned and the stream stays stopped until a
+ * later switch succeeds. Only works with driver (mmap) buffers.
+ *
+ * @param timeout_ms How long to wait for the stream task to get to it. On
+ *        timeout the request is withdrawn and the mode left as it was; if the
+ *        task had already started on it, the call waits for the result.
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED (refused, or user buffers),
+ *         ESP_ERR_INVALID_STATE (stream stopped meanwhile), ESP_ERR_TIMEOUT
+ *         (withdrawn, nothing changed), or ESP_FAIL from the driver with the
+ *         stream left stopped.
+ */
+esp_err_t app_video_switch_mode(int video_fd, const video_mode_t *mode, uint32_t timeout_ms);
+
+/**
+ * @brief Limit the rate frames reach the frame callback to @p fps.
+ *
+ * Before the stream starts the sensor is asked for that frame interval
+ * (VIDIOC_S_PARM). When it has no interval control, rounds too far off, or
+ * the stream is already running, surplus frames are dropped right after
+ * DQBUF instead, picked by capture timestamp so the kept ones are evenly
+ * spaced (see frame_pacer.h). The rate survives mode switches.
+ *
+ * @param fps            0 for every frame at the mode's rate.
+ * @param out_decimating Optional; true when frames are being dropped.
+ */
+esp_err_t app_video_set_frame_rate(int video_fd, uint32_t fps, bool *out_decimating);
+
 /**
  * @brief Set up video capture buffers.
  *
@@ -0,0 +1,528 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host build (IDF linux target) replacement for app_video.c: a simulated
+ * capture device behind the same API. Frames are read from a raw RGB565
+ * file (CONFIG_P4_SIM_FRAMES_FILE, looped) or generated as a moving test
+ * pattern, and delivered at CONFIG_P4_SIM_FPS from a FreeRTOS task exactly
+ * like the V4L2 dequeue loop does on target. Like the ISP it can output
+ * RGB565, YUV422 or YUV420 (pixfmt.h); the conversion runs in this task, so
+ * it does not count as encode time. It offers a few common sizes plus the
+ * requested one, and switches mode between frames like app_video.c.
+ *
+ * Make a frames file with e.g.
+ *   ffmpeg -i in.mp4 -vf scale=640:480 -pix_fmt rgb565le -f rawvideo frames.rgb565
+ */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "app_video.h"
+#include "pixfmt.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "app_video_sim";
+
+#define MAX_BUFFER_COUNT                (6)
+#define MIN_BUFFER_COUNT                (2)
+#define VIDEO_TASK_STACK_SIZE           (4 * 1024)
+#define VIDEO_TASK_PRIORITY             (6)
+#define SIM_DEFAULT_WIDTH               (640)
+#define SIM_DEFAULT_HEIGHT              (480)
+#define SIM_FD                          (0x5100)
+
+typedef struct {
+    uint8_t *camera_buffer[MAX_BUFFER_COUNT];
+    bool owns_buffers;
+    uint32_t buf_count;
+    size_t camera_buf_size;
+    uint32_t camera_buf_hes;
+    uint32_t camera_buf_ves;
+    uint32_t pixfmt;
+    uint32_t fps;               // pacing; 0 = as fast as taken
+    volatile uint32_t out_fps;  // app_video_set_frame_rate(), 0 = mode rate
+    uint16_t *rgb;              // source frame before conversion to pixfmt
+    FILE *frames_file;
+    uint32_t sequence;
+    app_video_frame_operation_cb_t user_camera_video_frame_operation_cb;
+    TaskHandle_t video_stream_task_handle;
+    volatile bool video_task_delete;
+    SemaphoreHandle_t video_stop_sem;
+    video_mode_t pending_mode;  // handed to the stream task
+    bool switch_pending;        // under switch_lock
+    esp_err_t switch_err;
+    SemaphoreHandle_t switch_lock;
+    SemaphoreHandle_t switch_done;
+} app_video_sim_t;
+
+static app_video_sim_t app_camera_video;
+
+static video_mode_req_t s_req = {
+    .width = CONFIG_P4_CAPTURE_WIDTH,
+    .height = CONFIG_P4_CAPTURE_HEIGHT,
+    .fps = CONFIG_P4_CAPTURE_FPS,
+    .max_mb_s = CONFIG_P4_CAPTURE_MAX_MB_S,
+#if CONFIG_P4_CAPTURE_FORMAT_RGB565
+    .pixfmt = APP_VIDEO_FMT_RGB565,
+#endif
+};
+
+// What the simulated sensor offers, in every output format.
+static const uint32_t s_sim_fmts[] = { APP_VIDEO_FMT_RGB565, APP_VIDEO_FMT_YUV422, APP_VIDEO_FMT_YUV420 };
+static const uint32_t s_sim_sizes[][2] = { { 320, 240 }, { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+
+void app_video_set_capture_size(uint32_t width, uint32_t height)
+{
+    s_req.width = width;
+    s_req.height = height;
+}
+
+void app_video_set_mode_request(const video_mode_req_t *req)
+{
+    s_req = *req;
+}
+
+void app_video_get_mode_request(video_mode_req_t *req)
+{
+    *req = s_req;
+}
+
+size_t app_video_enum_modes(int video_fd, video_mode_t *modes, size_t max)
+{
+    (void)video_fd;
+    size_t n = 0;
+    for (size_t f = 0; f < sizeof(s_sim_fmts) / sizeof(s_sim_fmts[0]); f++) {
+        // Any size is fine here; list the requested one next to the table.
+        for (size_t i = 0; i <= sizeof(s_sim_sizes) / sizeof(s_sim_sizes[0]); i++) {
+            uint32_t w = i ? s_sim_sizes[i - 1][0] : s_req.width;
+            uint32_t h = i ? s_sim_sizes[i - 1][1] : s_req.height;
+            if (w == 0 || h == 0 || n >= max) continue;
+            if (s_sim_fmts[f] != APP_VIDEO_FMT_RGB565 && ((w | h) & 1)) continue;
+            if (i == 0) {
+                bool listed = false;
+                for (size_t k = 0; k < sizeof(s_sim_sizes) / sizeof(s_sim_sizes[0]); k++) {
+                    listed |= s_sim_sizes[k][0] == w && s_sim_sizes[k][1] == h;
+                }
+                if (listed) continue;
+            }
+            modes[n++] = (video_mode_t) {
+                .pixfmt = s_sim_fmts[f],
+                .width = w,
+                .height = h,
+                .fps = CONFIG_P4_SIM_FPS,
+            };
+        }
+    }
+    return n;
+}
+
+// Size the frame and the buffers this side owns for a mode.
+static esp_err_t set_mode(const video_mode_t *mode)
+{
+    size_t size = pixfmt_frame_size(mode->pixfmt, mode->width, mode->height);
+    if (size == 0) {
+        ESP_LOGE(TAG, "Simulated device has no %s output", pixfmt_name(mode->pixfmt));
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (mode->pixfmt != APP_VIDEO_FMT_RGB565 && ((mode->width | mode->height) & 1)) {
+        ESP_LOGE(TAG, "YUV output needs an even width and height");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (app_camera_video.buf_count && !app_camera_video.owns_buffers && size > app_camera_video.camera_buf_size) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    free(app_camera_video.rgb);
+    app_camera_video.rgb = NULL;
+    if (mode->pixfmt != APP_VIDEO_FMT_RGB565) {
+        app_camera_video.rgb = (uint16_t *)malloc((size_t)mode->width * mode->height * 2);
+        if (!app_camera_video.rgb) {
+            ESP_LOGE(TAG, "No memory for the source frame");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (app_camera_video.owns_buffers) {
+        for (uint32_t i = 0; i < app_camera_video.buf_count; i++) {
+            uint8_t *buf = (uint8_t *)realloc(app_camera_video.camera_buffer[i], size);
+            if (!buf) {
+                ESP_LOGE(TAG, "No memory for frame buffers");
+                return ESP_ERR_NO_MEM;
+            }
+            app_camera_video.camera_buffer[i] = buf;
+        }
+    }
+
+    app_camera_video.camera_buf_hes = mode->width;
+    app_camera_video.camera_buf_ves = mode->height;
+    app_camera_video.camera_buf_size = size;
+    app_camera_video.pixfmt = mode->pixfmt;
+    app_camera_video.fps = mode->fps;
+    return ESP_OK;
+}
+
+static int open_mode(char *dev, const video_mode_t *mode)
+{
+    if (set_mode(mode) != ESP_OK) {
+        return -1;
+    }
+    app_camera_video.sequence = 0;
+
+    const char *path = CONFIG_P4_SIM_FRAMES_FILE;
+    if (path[0] != '\0') {
+        app_camera_video.frames_file = fopen(path, "rb");
+        if (!app_camera_video.frames_file) {
+            ESP_LOGW(TAG, "Cannot open %s, using test pattern", path);
+        }
+    }
+
+    ESP_LOGI(TAG, "%s: %" PRIu32 "x%" PRIu32 " %s @ %" PRIu32 " fps from %s", dev,
+             app_camera_video.camera_buf_hes, app_camera_video.camera_buf_ves, pixfmt_name(mode->pixfmt),
+             app_camera_video.fps, app_camera_video.frames_file ? path : "test pattern");
+
+    app_camera_video.video_stop_sem = xSemaphoreCreateBinary();
+    app_camera_video.switch_lock = xSemaphoreCreateMutex();
+    app_camera_video.switch_done = xSemaphoreCreateBinary();
+    return SIM_FD;
+}
+
+int app_video_open(char *dev, video_fmt_t init_fmt)
+{
+    video_mode_t mode = {
+        .pixfmt = init_fmt,
+        .width = s_req.width > 0 ? s_req.width : SIM_DEFAULT_WIDTH,
+        .height = s_req.height > 0 ? s_req.height : SIM_DEFAULT_HEIGHT,
+        .fps = CONFIG_P4_SIM_FPS,
+    };
+    return open_mode(dev, &mode);
+}
+
+int app_video_open_any(char *dev, const uint32_t *fmts, size_t count, uint32_t *out_fmt)
+{
+    video_mode_t modes[VIDEO_MODE_MAX];
+    size_t n = app_video_enum_modes(SIM_FD, modes, VIDEO_MODE_MAX);
+
+    // Same default size as app_video_open() when none is asked for.
+    video_mode_req_t req = s_req;
+    if (req.width == 0 || req.height == 0) {
+        req.width = SIM_DEFAULT_WIDTH;
+        req.height = SIM_DEFAULT_HEIGHT;
+    }
+
+    video_mode_t mode;
+    if (video_mode_pick(modes, n, &req, fmts, count, &mode) != ESP_OK) {
+        ESP_LOGE(TAG, "no usable capture mode");
+        return -1;
+    }
+    int fd = open_mode(dev, &mode);
+    if (fd >= 0 && out_fmt) {
+        *out_fmt = mode.pixfmt;
+    }
+    return fd;
+}
+
+esp_err_t app_video_get_mode(video_mode_t *out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = (video_mode_t) {
+        .pixfmt = app_camera_video.pixfmt,
+        .width = app_camera_video.camera_buf_hes,
+        .height = app_camera_video.camera_buf_ves,
+        .fps = app_camera_video.fps,
+    };
+    return ESP_OK;
+}
+
+esp_err_t app_video_switch_mode(int video_fd, const video_mode_t *mode, uint32_t timeout_ms)
+{
+    (void)video_fd;
+    if (!mode || pixfmt_frame_size(mode->pixfmt, mode->width, mode->height) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (app_camera_video.buf_count && !app_camera_video.owns_buffers) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (!app_camera_video.video_stream_task_handle) {
+        return set_mode(mode);
+    }
+
+    xSemaphoreTake(app_camera_video.switch_done, 0);
+    xSemaphoreTake(app_camera_video.switch_lock, portMAX_DELAY);
+    app_camera_video.pending_mode = *mode;
+    app_camera_video.switch_pending = true;
+    xSemaphoreGive(app_camera_video.switch_lock);
+    if (xSemaphoreTake(app_camera_video.switch_done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        // Withdrawn unless the stream task already took it, as in app_video.c.
+        xSemaphoreTake(app_camera_video.switch_lock, portMAX_DELAY);
+        bool withdrawn = app_camera_video.switch_pending;
+        app_camera_video.switch_pending = false;
+        xSemaphoreGive(app_camera_video.switch_lock);
+        if (withdrawn) {
+            return ESP_ERR_TIMEOUT;
+        }
+        xSemaphoreTake(app_camera_video.switch_done, portMAX_DELAY);
+    }
+    return app_camera_video.switch_err;
+}
+
+// The simulated sensor takes any frame interval, even while streaming, so
+// it never needs to drop frames.
+esp_err_t app_video_set_frame_rate(int video_fd, uint32_t fps, bool *out_decimating)
+{
+    (void)video_fd;
+    app_camera_video.out_fps = fps;
+    if (out_decimating) {
+        *out_decimating = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_video_set_bufs(int video_fd, uint32_t fb_num, const void **fb)
+{
+    (void)video_fd;
+    if (fb_num > MAX_BUFFER_COUNT) {
+        ESP_LOGE(TAG, "buffer num is too large");
+        return ESP_FAIL;
+    } else if (fb_num < MIN_BUFFER_COUNT) {
+        ESP_LOGE(TAG, "At least two buffers are required");
+        return ESP_FAIL;
+    }
+
+    app_camera_video.owns_buffers = fb == NULL;
+    for (uint32_t i = 0; i < fb_num; i++) {
+        if (fb) {
+            app_camera_video.camera_buffer[i] = (uint8_t *)fb[i];
+        } else {
+            app_camera_video.camera_buffer[i] = (uint8_t *)malloc(app_camera_video.camera_buf_size);
+        }
+        if (!app_camera_video.camera_buffer[i]) {
+            ESP_LOGE(TAG, "frame buffer is NULL");
+            return ESP_FAIL;
+        }
+    }
+    app_camera_video.buf_count = fb_num;
+    return ESP_OK;
+}
+
+esp_err_t app_video_get_bufs(int fb_num, void **fb)
+{
+    if (fb_num > MAX_BUFFER_COUNT || fb_num < MIN_BUFFER_COUNT || (uint32_t)fb_num > app_camera_video.buf_count) {
+        ESP_LOGE(TAG, "bad buffer count");
+        return ESP_FAIL;
+    }
+    for (int i = 0; i < fb_num; i++) {
+        fb[i] = app_camera_video.camera_buffer[i];
+    }
+    return ESP_OK;
+}
+
+// Diagonal colour gradient scrolling one pixel per frame, with a bright bar
+// sweeping down so consecutive frames differ like real video.
+static void fill_test_pattern(uint16_t *px, uint32_t w, uint32_t h, uint32_t seq)
+{
+    uint32_t bar = (seq * 4) % h;
+    for (uint32_t y = 0; y < h; y++) {
+        bool in_bar = y >= bar && y < bar + 16;
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t r = ((x + seq) * 31 / w) & 0x1F;
+            uint32_t g = ((y + x / 2) * 63 / (h + w / 2)) & 0x3F;
+            uint32_t b = (((x ^ y) >> 3) + seq) & 0x1F;
+            px[y * w + x] = in_bar ? 0xFFFF : (uint16_t)(r << 11 | g << 5 | b);
+        }
+    }
+}
+
+static void fill_rgb565(uint8_t *buf)
+{
+    size_t size = (size_t)app_camera_video.camera_buf_hes * app_camera_video.camera_buf_ves * 2;
+    FILE *f = app_camera_video.frames_file;
+    if (f) {
+        size_t n = fread(buf, 1, size, f);
+        if (n < size) {
+            rewind(f);
+            n = fread(buf, 1, size, f);
+        }
+        if (n == size) return;
+        ESP_LOGW(TAG, "Frames file shorter than one frame, using test pattern");
+        fclose(f);
+        app_camera_video.frames_file = NULL;
+    }
+    fill_test_pattern((uint16_t *)buf, app_camera_video.camera_buf_hes, app_camera_video.camera_buf_ves,
+                      app_camera_video.sequence);
+}
+
+static void fill_frame(uint8_t *buf)
+{
+    if (!app_camera_video.rgb) {
+        fill_rgb565(buf);
+        return;
+    }
+    fill_rgb565((uint8_t *)app_camera_video.rgb);
+    pixfmt_from_rgb565(app_camera_video.pixfmt, app_camera_video.rgb, buf,
+                       app_camera_video.camera_buf_hes, app_camera_video.camera_buf_ves);
+}
+
+// Claims a pending switch request unless the caller already withdrew it.
+static bool take_switch(video_mode_t *mode)
+{
+    xSemaphoreTake(app_camera_video.switch_lock, portMAX_DELAY);
+    bool taken = app_camera_video.switch_pending;
+    if (taken) {
+        *mode = app_camera_video.pending_mode;
+        app_camera_video.switch_pending = false;
+    }
+    xSemaphoreGive(app_camera_video.switch_lock);
+    return taken;
+}
+
+static void video_stream_task(void *arg)
+{
+    (void)arg;
+    int64_t next_us = esp_timer_get_time();
+    uint32_t index = 0;
+
+    while (!app_camera_video.video_task_delete) {
+        uint8_t *buf = app_camera_video.camera_buffer[index];
+        fill_frame(buf);
+
+        // Sensor pacing at the mode's rate; with P4_SIM_FPS = 0 frames come
+        // as fast as the pipeline takes them, which is what throughput runs
+        // want.
+        uint32_t fps = app_camera_video.fps;
+        if (app_camera_video.out_fps && (fps == 0 || app_camera_video.out_fps < fps)) {
+            fps = app_camera_video.out_fps;
+        }
+        const int64_t period_us = fps > 0 ? 1000000 / fps : 0;
+        if (period_us > 0) {
+            next_us += period_us;
+            int64_t wait_us = next_us - esp_timer_get_time();
+            if (wait_us > 0) {
+                vTaskDelay(pdMS_TO_TICKS((wait_us + 999) / 1000));
+            } else {
+                next_us = esp_timer_get_time();
+            }
+        } else {
+            taskYIELD();
+        }
+
+        // Stamped when the paced frame is "exposed", like a sensor would.
+        int64_t now_us = esp_timer_get_time();
+        const app_video_frame_info_t info = {
+            .ts_us = now_us,
+            .dqbuf_us = now_us,
+            .sequence = app_camera_video.sequence,
+        };
+        app_camera_video.user_camera_video_frame_operation_cb(
+            buf, (uint8_t)index,
+            app_camera_video.camera_buf_hes,
+            app_camera_video.camera_buf_ves,
+            app_camera_video.camera_buf_size,
+            &info);
+
+        app_camera_video.sequence++;
+        index = (index + 1) % app_camera_video.buf_count;
+
+        video_mode_t mode;
+        if (take_switch(&mode)) {
+            video_mode_t old;
+            app_video_get_mode(&old);
+            esp_err_t err = set_mode(&mode);
+            if (err != ESP_OK) {
+                ESP_ERROR_CHECK(set_mode(&old));
+            } else {
+                ESP_LOGI(TAG, "switched to %s %" PRIu32 "x%" PRIu32, pixfmt_name(app_camera_video.pixfmt),
+                         app_camera_video.camera_buf_hes, app_camera_video.camera_buf_ves);
+            }
+            app_camera_video.switch_err = err;
+            xSemaphoreGive(app_camera_video.switch_done);
+        }
+    }
+
+    ESP_LOGI(TAG, "Video Stream Stop");
+    video_mode_t mode;
+    if (take_switch(&mode)) {
+        app_camera_video.switch_err = ESP_ERR_INVALID_STATE;
+        xSemaphoreGive(app_camera_video.switch_done);
+    }
+    app_camera_video.video_stream_task_handle = NULL;
+    app_camera_video.video_task_delete = false;
+    xSemaphoreGive(app_camera_video.video_stop_sem);
+    vTaskDelete(NULL);
+}
+
+esp_err_t app_video_stream_task_start(int video_fd, int core_id)
+{
+    (void)video_fd;
+    (void)core_id;
+    ESP_LOGI(TAG, "Video Stream Start");
+
+    BaseType_t result = xTaskCreate(video_stream_task, "video stream task", VIDEO_TASK_STACK_SIZE, NULL,
+                                    VIDEO_TASK_PRIORITY, &app_camera_video.video_stream_task_handle);
+    if (result != pdPASS) {
+        ESP_LOGE(TAG, "failed to create video stream task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t app_video_stream_task_stop(int video_fd)
+{
+    (void)video_fd;
+    app_camera_video.video_task_delete = true;
+    return ESP_OK;
+}
+
+esp_err_t app_video_wait_video_stop(void)
+{
+    return xSemaphoreTake(app_camera_video.video_stop_sem, portMAX_DELAY) == pdTRUE ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t app_video_register_frame_operation_cb(app_video_frame_operation_cb_t operation_cb)
+{
+    app_camera_video.user_camera_video_frame_operation_cb = operation_cb;
+    return ESP_OK;
+}
+
+esp_err_t app_video_close(int video_fd)
+{
+    (void)video_fd;
+    if (app_camera_video.owns_buffers) {
+        for (uint32_t i = 0; i < app_camera_video.buf_count; i++) {
+            free(app_camera_video.camera_buffer[i]);
+            app_camera_video.camera_buffer[i] = NULL;
+        }
+    }
+    app_camera_video.buf_count = 0;
+    app_camera_video.out_fps = 0;
+    free(app_camera_video.rgb);
+    app_camera_video.rgb = NULL;
+    if (app_camera_video.frames_file) {
+        fclose(app_camera_video.frames_file);
+        app_camera_video.frames_file = NULL;
+    }
+    if (app_camera_video.video_stop_sem) {
+        vSemaphoreDelete(app_camera_video.video_stop_sem);
+        app_camera_video.video_stop_sem = NULL;
+    }
+    if (app_camera_video.switch_lock) {
+        vSemaphoreDelete(app_camera_video.switch_lock);
+        app_camera_video.switch_lock = NULL;
+    }
+    if (app_camera_video.switch_done) {
+        vSemaphoreDelete(app_camera_video.switch_done);
+        app_camera_video.switch_done = NULL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,591 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "cam_bench.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "app_video.h"
+#include "cam_report.h"
+#include "cam_stats.h"
+#include "flash_store.h"
+#include "flash_uploader.h"
+#include "frame_encoder.h"
+#include "mqtt_video.h"
+#include "pixfmt.h"
+#include "video_packetizer.h"
+#include "video_streamer.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
+#endif
+
+#if CONFIG_P4_BENCH
+
+static const char *TAG = "cam_bench";
+
+#define BENCH_TASK_STACK_SIZE   (12 * 1024)
+#define BENCH_TASK_PRIORITY     (5)
+#define BENCH_JSON_MAX          (16 * 1024)
+#define BENCH_MAX_ENTRIES       (8)         // per configured list
+#define BENCH_WARMUP_FRAMES     (2)
+#define BENCH_CLIP_ID           (0xBE7C)    // flash stage file names
+#define BENCH_CONNECT_MS        (10000)
+#define BENCH_DRAIN_MS          (10000)
+
+#if CONFIG_P4_WIRE_MQTT5
+#define BENCH_WIRE "mqtt5"
+#elif CONFIG_P4_WIRE_VID1
+#define BENCH_WIRE "vid1"
+#else
+#define BENCH_WIRE "vid0"
+#endif
+
+#if CONFIG_P4_CODEC_H264
+#define BENCH_CODEC "h264"
+#else
+#define BENCH_CODEC "mjpeg"
+#endif
+
+#if CONFIG_P4_MQTT_PUBLISH_SYNC
+#define BENCH_PUBLISH "sync"
+#else
+#define BENCH_PUBLISH "sender_task"
+#endif
+
+#if CONFIG_P4_MQTT_COALESCE
+#define BENCH_COALESCE "true"
+#else
+#define BENCH_COALESCE "false"
+#endif
+
+#if CONFIG_P4_JPEG_SUBSAMPLE_420
+#define BENCH_REF_420 true
+#else
+#define BENCH_REF_420 false
+#endif
+
+typedef struct {
+    json_out_t json;
+    uint32_t *us;           // per-frame samples, CONFIG_P4_BENCH_FRAMES
+    uint8_t *ref;           // reference JPEG for the stages after encode
+    uint32_t ref_size;
+    uint16_t ref_w;
+    uint16_t ref_h;
+} bench_t;
+
+// count per second over us; 0 for an empty interval so the JSON stays valid.
+static double per_s(double count, double us)
+{
+    return us > 0.0 ? count * 1e6 / us : 0.0;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts the samples; returns the mean.
+static double out_samples(json_out_t *o, uint32_t *us, uint32_t n)
+{
+    if (n == 0) return 0.0;
+    qsort(us, n, sizeof(us[0]), cmp_u32);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) sum += us[i];
+    double mean = (double)sum / n;
+    json_out(o, "\"n\":%u,\"mean_us\":%.1f,\"min_us\":%u,\"p50_us\":%u,\"p95_us\":%u,\"max_us\":%u",
+        (unsigned)n, mean, (unsigned)us[0], (unsigned)us[n / 2], (unsigned)us[(n * 95) / 100],
+        (unsigned)us[n - 1]);
+    return mean;
+}
+
+static void *frame_alloc(size_t len)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return malloc(len);
+#else
+    // Cache-line aligned PSRAM, like the camera buffers the encoder reads.
+    return heap_caps_aligned_alloc(64, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+}
+
+// Gradients, hard edges and mild noise: compresses like a camera scene
+// rather than like a flat test card, and is the same on every run.
+static void fill_frame(uint16_t *px, uint32_t w, uint32_t h)
+{
+    uint32_t rng = 0x2545F491u;
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            int noise = (int)(rng & 7) - 4;
+            int r = (int)(x * 31 / w) + noise / 2;
+            int g = (int)(y * 63 / h) + noise;
+            int b = ((x / 48) ^ (y / 48)) & 1 ? 24 + noise / 2 : 6 + noise / 2;
+            r = r < 0 ? 0 : (r > 31 ? 31 : r);
+            g = g < 0 ? 0 : (g > 63 ? 63 : g);
+            b = b < 0 ? 0 : (b > 31 ? 31 : b);
+            px[y * w + x] = (uint16_t)(r << 11 | g << 5 | b);
+        }
+    }
+}
+
+// The test frame never changes, so H.264 P frames would be all skips;
+// every frame is forced to an IDR to time the real work.
+static esp_err_t encode_one(const uint8_t *frame, size_t len, uint32_t *us, uint32_t *size)
+{
+    const uint8_t *jpeg = NULL;
+    frame_encoder_request_keyframe();
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = frame_encoder_encode(frame, len, &jpeg, size, NULL);
+    *us = (uint32_t)(esp_timer_get_time() - t0);
+    return err;
+}
+
+// Every input format the encoder takes, so the report compares capturing
+// YUV against RGB565. The test frame is converted up front, as the ISP
+// would have done it.
+static void bench_encode(bench_t *b)
+{
+    uint32_t ws[BENCH_MAX_ENTRIES], hs[BENCH_MAX_ENTRIES], qs[BENCH_MAX_ENTRIES];
+    int nres = cam_report_parse_list(CONFIG_P4_BENCH_RESOLUTIONS, ws, hs, BENCH_MAX_ENTRIES);
+    int nq = cam_report_parse_list(CONFIG_P4_BENCH_QUALITIES, qs, NULL, BENCH_MAX_ENTRIES);
+    const uint32_t *fmts = NULL;
+    size_t nfmt = frame_encoder_input_formats(&fmts);
+    json_out_t *o = &b->json;
+    bool first = true;
+
+    json_out(o, ",\"encode\":[");
+    for (int r = 0; r < nres; r++) {
+        size_t rgb_len = (size_t)ws[r] * hs[r] * 2;
+        uint16_t *rgb = (uint16_t *)malloc(rgb_len);
+        uint8_t *frame = (uint8_t *)frame_alloc(rgb_len);    // no format is larger
+        if (!rgb || !frame) {
+            ESP_LOGE(TAG, "No memory for a %" PRIu32 "x%" PRIu32 " frame", ws[r], hs[r]);
+            json_out(o, "%s{\"w\":%u,\"h\":%u,\"error\":\"%s\"}", first ? "" : ",",
+                (unsigned)ws[r], (unsigned)hs[r], esp_err_to_name(ESP_ERR_NO_MEM));
+            first = false;
+            free(rgb);
+            free(frame);
+            continue;
+        }
+        fill_frame(rgb, ws[r], hs[r]);
+
+        for (size_t f = 0; f < nfmt; f++) {
+            const char *fmt = pixfmt_name(fmts[f]);
+            size_t len = pixfmt_frame_size(fmts[f], ws[r], hs[r]);
+            esp_err_t conv = pixfmt_from_rgb565(fmts[f], rgb, frame, ws[r], hs[r]);
+            for (int ss = 0; ss < 2; ss++) {
+                bool s420 = ss == 0;
+                for (int q = 0; q < nq; q++) {
+                    json_out(o, "%s{\"w\":%u,\"h\":%u,\"fmt\":\"%s\",\"in_bytes\":%u,\"ss\":\"%s\",\"q\":%u,",
+                        first ? "" : ",", (unsigned)ws[r], (unsigned)hs[r], fmt, (unsigned)len,
+                        s420 ? "420" : "422", (unsigned)qs[q]);
+                    first = false;
+
+                    esp_err_t err = conv;
+                    if (err == ESP_OK) err = frame_encoder_set_quality((int)qs[q], s420);
+                    if (err == ESP_OK) err = frame_encoder_open(ws[r], hs[r], fmts[f]);
+                    uint32_t us = 0, size = 0;
+                    for (int i = 0; i < BENCH_WARMUP_FRAMES && err == ESP_OK; i++) {
+                        err = encode_one(frame, len, &us, &size);
+                    }
+                    uint32_t n = 0;
+                    uint64_t bytes = 0;
+                    for (; n < CONFIG_P4_BENCH_FRAMES && err == ESP_OK; n++) {
+                        err = encode_one(frame, len, &b->us[n], &size);
+                        bytes += size;
+                    }
+                    if (err != ESP_OK) {
+                        json_out(o, "\"error\":\"%s\"}", esp_err_to_name(err));
+                        continue;
+                    }
+                    double mean = out_samples(o, b->us, n);
+                    json_out(o, ",\"bytes\":%u,\"fps\":%.1f,\"mpix_s\":%.2f}", (unsigned)(bytes / n),
+                        per_s(1, mean), per_s((double)ws[r] * hs[r], mean) / 1e6);
+                    ESP_LOGI(TAG, "encode %" PRIu32 "x%" PRIu32 " %s %s q%" PRIu32 ": %.2f ms, %u bytes",
+                             ws[r], hs[r], fmt, s420 ? "420" : "422", qs[q], mean / 1000.0,
+                             (unsigned)(bytes / n));
+                }
+            }
+        }
+        free(rgb);
+        free(frame);
+    }
+    json_out(o, "]");
+}
+
+// Reference frame for the later stages: the capture size at the configured
+// quality, in the format capture would negotiate, so those numbers match
+// what the camera would send.
+static esp_err_t make_reference(bench_t *b)
+{
+    uint32_t w = CONFIG_P4_CAPTURE_WIDTH ? CONFIG_P4_CAPTURE_WIDTH : 640;
+    uint32_t h = CONFIG_P4_CAPTURE_HEIGHT ? CONFIG_P4_CAPTURE_HEIGHT : 480;
+#if CONFIG_P4_CAPTURE_FORMAT_RGB565
+    uint32_t fmt = APP_VIDEO_FMT_RGB565;
+#else
+    const uint32_t *fmts = NULL;
+    frame_encoder_input_formats(&fmts);
+    uint32_t fmt = fmts[0];
+#endif
+    size_t len = pixfmt_frame_size(fmt, w, h);
+    uint16_t *rgb = (uint16_t *)malloc((size_t)w * h * 2);
+    uint8_t *frame = (uint8_t *)frame_alloc(len);
+    if (!rgb || !frame) {
+        free(rgb);
+        free(frame);
+        return ESP_ERR_NO_MEM;
+    }
+    fill_frame(rgb, w, h);
+
+    const uint8_t *jpeg = NULL;
+    uint32_t size = 0;
+    esp_err_t err = pixfmt_from_rgb565(fmt, rgb, frame, w, h);
+    if (err == ESP_OK) err = frame_encoder_set_quality(CONFIG_P4_JPEG_QUALITY, BENCH_REF_420);
+    if (err == ESP_OK) err = frame_encoder_open(w, h, fmt);
+    frame_encoder_request_keyframe();
+    if (err == ESP_OK) err = frame_encoder_encode(frame, len, &jpeg, &size, NULL);
+    if (err == ESP_OK) {
+        b->ref = (uint8_t *)malloc(size);
+        if (b->ref) {
+            memcpy(b->ref, jpeg, size);
+            b->ref_size = size;
+            b->ref_w = (uint16_t)w;
+            b->ref_h = (uint16_t)h;
+        } else {
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+    free(rgb);
+    free(frame);
+    // Release the engine; the end-to-end stage opens it again.
+    frame_encoder_close();
+    return err;
+}
+
+typedef struct {
+    size_t wire;
+    uint32_t chunks;
+} count_sink_t;
+
+static esp_err_t count_sink(const uint8_t *pkt, size_t len, uint16_t chunk_id, void *ctx)
+{
+    (void)pkt;
+    (void)chunk_id;
+    count_sink_t *c = (count_sink_t *)ctx;
+    c->wire += len;
+    c->chunks++;
+    return ESP_OK;
+}
+
+static void bench_packetize(bench_t *b)
+{
+    uint32_t sizes[BENCH_MAX_ENTRIES];
+    int nsizes = cam_report_parse_list(CONFIG_P4_BENCH_CHUNK_SIZES, sizes, NULL, BENCH_MAX_ENTRIES);
+    json_out_t *o = &b->json;
+    video_frame_meta_t meta = {
+        .clip_id = BENCH_CLIP_ID,
+        .width = b->ref_w,
+        .height = b->ref_h,
+        .fourcc = frame_encoder_fourcc(),
+        .keyframe = true,
+    };
+
+    json_out(o, ",\"packetize\":[");
+    for (int s = 0; s < nsizes; s++) {
+        json_out(o, "%s{\"chunk\":%u,", s ? "," : "", (unsigned)sizes[s]);
+        esp_err_t err = ESP_OK;
+        count_sink_t count = { 0 };
+        for (int i = 0; i < BENCH_WARMUP_FRAMES && err == ESP_OK; i++) {
+            err = video_packetizer_emit(&meta, b->ref, b->ref_size, sizes[s], count_sink, &count);
+        }
+        uint32_t n = 0;
+        for (; n < CONFIG_P4_BENCH_FRAMES && err == ESP_OK; n++) {
+            count = (count_sink_t){ 0 };
+            meta.frame_id = n;
+            int64_t t0 = esp_timer_get_time();
+            err = video_packetizer_emit(&meta, b->ref, b->ref_size, sizes[s], count_sink, &count);
+            b->us[n] = (uint32_t)(esp_timer_get_time() - t0);
+        }
+        if (err != ESP_OK) {
+            json_out(o, "\"error\":\"%s\"}", esp_err_to_name(err));
+            continue;
+        }
+        double mean = out_samples(o, b->us, n);
+        json_out(o, ",\"chunks\":%u,\"overhead_pct\":%.2f,\"mb_s\":%.2f}", (unsigned)count.chunks,
+            100.0 * (double)(count.wire - b->ref_size) / b->ref_size, per_s(b->ref_size, mean) / 1e6);
+        ESP_LOGI(TAG, "packetize chunk %" PRIu32 ": %.1f us/frame, %.1f MB/s", sizes[s], mean,
+                 per_s(b->ref_size, mean) / 1e6);
+    }
+    json_out(o, "]");
+}
+
+// Writes CONFIG_P4_BENCH_FLASH_FRAMES files; returns how many exist for the
+// upload stage to consume.
+static uint32_t bench_flash(bench_t *b)
+{
+    json_out_t *o = &b->json;
+    json_out(o, ",\"flash\":{");
+
+    esp_err_t err = flash_store_init();
+    uint32_t n = 0;
+    for (; n < CONFIG_P4_BENCH_FLASH_FRAMES && err == ESP_OK; n++) {
+        int64_t t0 = esp_timer_get_time();
+        err = flash_store_write_frame(BENCH_CLIP_ID, n, 0, b->ref_w, b->ref_h, b->ref, b->ref_size);
+        b->us[n] = (uint32_t)(esp_timer_get_time() - t0);
+    }
+    if (err != ESP_OK) {
+        // The frame that failed is not on flash.
+        if (n) n--;
+        json_out(o, "\"error\":\"%s\",\"written\":%u}", esp_err_to_name(err), (unsigned)n);
+        return n;
+    }
+    double mean = out_samples(o, b->us, n);
+    double mb_s = per_s(b->ref_size, mean) / 1e6;
+    json_out(o, ",\"bytes\":%u,\"mb_s\":%.3f}", (unsigned)b->ref_size, mb_s);
+    ESP_LOGI(TAG, "flash: %.2f ms/frame, %.3f MB/s", mean / 1000.0, mb_s);
+    return n;
+}
+
+static void remove_flash_frames(bench_t *b, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        flash_store_remove_frame(BENCH_CLIP_ID, i, 0, b->ref_w, b->ref_h);
+    }
+}
+
+static void bench_upload(bench_t *b, uint32_t stored, bool connected)
+{
+    json_out_t *o = &b->json;
+    if (!connected || stored == 0) {
+        json_out(o, ",\"upload\":{\"skipped\":\"%s\"}", connected ? "no frames" : "disconnected");
+        remove_flash_frames(b, stored);
+        return;
+    }
+
+    uint32_t frames = 0;
+    size_t bytes = 0;
+    uint32_t retries = 0;
+    int64_t t0 = esp_timer_get_time();
+    int64_t end = t0 + (int64_t)BENCH_DRAIN_MS * 1000;
+    while (frames < stored && esp_timer_get_time() < end) {
+        uint32_t f = 0;
+        size_t sz = 0;
+        esp_err_t err = flash_uploader_run_once(&f, &sz);
+        frames += f;
+        bytes += sz;
+        if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_STATE) {
+            retries++;
+            vTaskDelay(1);
+        } else if (err != ESP_OK || f == 0) {
+            break;
+        }
+    }
+    mqtt_video_wait_idle(BENCH_DRAIN_MS);
+    double us = (double)(esp_timer_get_time() - t0);
+    remove_flash_frames(b, stored);
+
+    json_out(o, ",\"upload\":{\"frames\":%u,\"of\":%u,\"bytes\":%u,\"backpressure\":%u,\"ms\":%.1f,"
+        "\"fps\":%.1f,\"mb_s\":%.3f}",
+        (unsigned)frames, (unsigned)stored, (unsigned)bytes, (unsigned)retries, us / 1000.0,
+        per_s(frames, us), per_s(bytes, us) / 1e6);
+    ESP_LOGI(TAG, "upload: %" PRIu32 "/%" PRIu32 " frames, %.3f MB/s", frames, stored, per_s(bytes, us) / 1e6);
+}
+
+static void bench_mqtt(bench_t *b, bool connected)
+{
+    json_out_t *o = &b->json;
+    if (!connected) {
+        json_out(o, ",\"mqtt\":{\"skipped\":\"disconnected\"}");
+        return;
+    }
+
+    video_frame_meta_t meta = {
+        .clip_id = BENCH_CLIP_ID,
+        .width = b->ref_w,
+        .height = b->ref_h,
+        .fourcc = frame_encoder_fourcc(),
+        .keyframe = true,
+    };
+    uint32_t frames = 0, dropped = 0, errors = 0;
+    uint64_t bytes = 0;
+    int64_t t0 = esp_timer_get_time();
+    int64_t end = t0 + (int64_t)CONFIG_P4_BENCH_NET_SECONDS * 1000000;
+    while (esp_timer_get_time() < end) {
+        meta.frame_id++;
+        meta.ts_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+        esp_err_t err = video_packetizer_publish_jpeg(&meta, b->ref, b->ref_size);
+        if (err == ESP_OK) {
+            frames++;
+            bytes += b->ref_size;
+        } else if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_STATE) {
+            // Backpressure: what the camera would drop; give the socket time.
+            dropped++;
+            vTaskDelay(1);
+        } else {
+            errors++;
+            vTaskDelay(1);
+        }
+    }
+    mqtt_video_wait_idle(BENCH_DRAIN_MS);
+    double us = (double)(esp_timer_get_time() - t0);
+
+    json_out(o, ",\"mqtt\":{\"frames\":%u,\"dropped\":%u,\"errors\":%u,\"bytes\":%llu,\"ms\":%.1f,"
+        "\"fps\":%.1f,\"goodput_mbps\":%.2f}",
+        (unsigned)frames, (unsigned)dropped, (unsigned)errors, (unsigned long long)bytes, us / 1000.0,
+        per_s(frames, us), per_s(bytes * 8.0, us) / 1e6);
+    ESP_LOGI(TAG, "mqtt: %.1f fps, %.2f Mbit/s goodput, %" PRIu32 " dropped", per_s(frames, us),
+             per_s(bytes * 8.0, us) / 1e6, dropped);
+}
+
+// The real capture path for CONFIG_P4_BENCH_NET_SECONDS, read back through
+// the stats counters.
+static void bench_e2e(bench_t *b, bool connected)
+{
+    json_out_t *o = &b->json;
+    if (!connected) {
+        json_out(o, ",\"e2e\":{\"skipped\":\"disconnected\"}");
+        return;
+    }
+
+    uint32_t cap0 = cam_stats_read(CAM_STAT_FRAMES_CAPTURED);
+    uint32_t sent0 = cam_stats_read(CAM_STAT_FRAMES_SENT);
+    uint32_t bytes0 = cam_stats_read(CAM_STAT_BYTES_SENT);
+    uint32_t drop0 = cam_report_drops_total();
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = capture_video_seconds(CONFIG_P4_BENCH_NET_SECONDS);
+    mqtt_video_wait_idle(BENCH_DRAIN_MS);
+    double us = (double)(esp_timer_get_time() - t0);
+    if (err != ESP_OK) {
+        json_out(o, ",\"e2e\":{\"error\":\"%s\"}", esp_err_to_name(err));
+        return;
+    }
+
+    uint32_t cap = cam_stats_read(CAM_STAT_FRAMES_CAPTURED) - cap0;
+    uint32_t sent = cam_stats_read(CAM_STAT_FRAMES_SENT) - sent0;
+    uint32_t bytes = cam_stats_read(CAM_STAT_BYTES_SENT) - bytes0;
+    uint32_t dropped = cam_report_drops_total() - drop0;
+    json_out(o, ",\"e2e\":{\"captured\":%u,\"sent\":%u,\"dropped\":%u,\"ms\":%.1f,\"captured_fps\":%.1f,"
+        "\"sent_fps\":%.1f,\"wire_mbps\":%.2f}",
+        (unsigned)cap, (unsigned)sent, (unsigned)dropped, us / 1000.0, per_s(cap, us), per_s(sent, us),
+        per_s(bytes * 8.0, us) / 1e6);
+    ESP_LOGI(TAG, "e2e: captured %.1f fps, sent %.1f fps", per_s(cap, us), per_s(sent, us));
+}
+
+static const char *app_version(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return "host";
+#else
+    return esp_app_get_description()->version;
+#endif
+}
+
+static esp_err_t bench_all(void)
+{
+    bench_t b = { 0 };
+    b.json.buf = (char *)malloc(BENCH_JSON_MAX);
+    b.json.len = BENCH_JSON_MAX;
+    b.us = (uint32_t *)malloc(sizeof(uint32_t) * CONFIG_P4_BENCH_FRAMES);
+    if (!b.json.buf || !b.us) {
+        free(b.json.buf);
+        free(b.us);
+        return ESP_ERR_NO_MEM;
+    }
+
+    json_out_t *o = &b.json;
+    json_out(o, "{\"bench\":1,\"target\":\"%s\",\"idf\":\"%s\",\"app\":\"%s\",\"codec\":\"%s\",\"wire\":\"%s\","
+        "\"publish\":\"%s\",\"coalesce\":%s,\"frames\":%d",
+        CONFIG_IDF_TARGET, esp_get_idf_version(), app_version(), BENCH_CODEC, BENCH_WIRE, BENCH_PUBLISH,
+        BENCH_COALESCE, CONFIG_P4_BENCH_FRAMES);
+
+    bench_encode(&b);
+
+    esp_err_t err = make_reference(&b);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Reference frame failed: %s", esp_err_to_name(err));
+        json_out(o, ",\"error\":\"reference frame: %s\"", esp_err_to_name(err));
+    } else {
+        json_out(o, ",\"ref\":{\"w\":%u,\"h\":%u,\"q\":%d,\"bytes\":%u}", (unsigned)b.ref_w, (unsigned)b.ref_h,
+            CONFIG_P4_JPEG_QUALITY, (unsigned)b.ref_size);
+        bench_packetize(&b);
+        uint32_t stored = bench_flash(&b);
+        bool connected = mqtt_video_wait_connected(BENCH_CONNECT_MS);
+        if (!connected) {
+            ESP_LOGW(TAG, "MQTT not connected, skipping the network stages");
+        }
+        bench_upload(&b, stored, connected);
+        bench_mqtt(&b, connected);
+        bench_e2e(&b, connected);
+    }
+    json_out(o, "}");
+    if (o->off + 1 >= o->len) {
+        ESP_LOGW(TAG, "Report truncated at %u bytes", (unsigned)o->len);
+    }
+
+    printf("\n=== CAM BENCH BEGIN ===\n%s\n=== CAM BENCH END ===\n", o->buf);
+    fflush(stdout);
+    if (mqtt_video_publish_aux(CONFIG_P4_BENCH_TOPIC, o->buf, o->off) == ESP_OK) {
+        mqtt_video_wait_idle(BENCH_DRAIN_MS);
+        ESP_LOGI(TAG, "Report published to %s", CONFIG_P4_BENCH_TOPIC);
+    }
+
+    free(b.ref);
+    free(b.us);
+    free(b.json.buf);
+    return err;
+}
+
+typedef struct {
+    SemaphoreHandle_t done;
+    esp_err_t err;
+} bench_run_t;
+
+static void bench_task(void *arg)
+{
+    bench_run_t *run = (bench_run_t *)arg;
+    run->err = bench_all();
+    xSemaphoreGive(run->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t cam_bench_run(void)
+{
+    bench_run_t run = { .done = xSemaphoreCreateBinary(), .err = ESP_FAIL };
+    if (!run.done) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(bench_task, "cam bench", BENCH_TASK_STACK_SIZE, &run, BENCH_TASK_PRIORITY, NULL) != pdPASS) {
+        vSemaphoreDelete(run.done);
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(run.done, portMAX_DELAY);
+    vSemaphoreDelete(run.done);
+    return run.err;
+}
+
+#else  // !CONFIG_P4_BENCH
+
+esp_err_t cam_bench_run(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CAM_BENCH_H
+#define CAM_BENCH_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Run the benchmark suite (CONFIG_P4_BENCH) and report the results.
+ *
+ * Stages, each on a synthetic frame so runs are comparable: JPEG encode per
+ * resolution, subsampling and quality; packetizing per chunk size without
+ * the network; flash frame writes; the flash uploader pass; MQTT goodput
+ * through the full publish path; and a short end-to-end capture. The JSON
+ * report goes to the console between "=== CAM BENCH BEGIN/END ===" lines and
+ * to CONFIG_P4_BENCH_TOPIC (tools/mqtt_cam_bench.py).
+ *
+ * Runs in its own task, as the main task stack is too small, and blocks
+ * until it is done. MQTT must be initialised; the network stages are
+ * reported as skipped when the broker is not reachable.
+ */
+esp_err_t cam_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
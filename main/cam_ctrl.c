@@ -0,0 +1,213 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "cam_ctrl.h"
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "app_video.h"
+#include "cam_report.h"
+#include "mqtt_video.h"
+#include "pixfmt.h"
+#include "video_streamer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "cam_ctrl";
+
+#define CTRL_TASK_STACK_SIZE    (4 * 1024)
+#define CTRL_TASK_PRIORITY      (3)
+#define CTRL_QUEUE_DEPTH        (4)
+#define CTRL_MSG_MAX            (256)
+#define CTRL_REPLY_MAX          (2048)  // room for VIDEO_MODE_MAX modes
+
+typedef struct {
+    char text[CTRL_MSG_MAX];    // NUL-terminated
+} ctrl_msg_t;
+
+static QueueHandle_t s_queue;
+
+static const uint32_t s_fmts[] = { APP_VIDEO_FMT_RGB565, APP_VIDEO_FMT_YUV422, APP_VIDEO_FMT_YUV420 };
+
+// Commands are flat objects of strings and numbers, so finding "key" followed
+// by a colon is enough; no nesting or escapes to worry about.
+static const char *json_value(const char *s, const char *key)
+{
+    size_t n = strlen(key);
+    for (const char *p = strchr(s, '"'); p; p = strchr(p + 1, '"')) {
+        if (strncmp(p + 1, key, n) != 0 || p[n + 1] != '"') continue;
+        const char *v = p + n + 2;
+        while (isspace((unsigned char)*v)) v++;
+        if (*v != ':') continue;
+        v++;
+        while (isspace((unsigned char)*v)) v++;
+        return v;
+    }
+    return NULL;
+}
+
+static bool json_str(const char *s, const char *key, char *dst, size_t len)
+{
+    const char *v = json_value(s, key);
+    if (!v || *v != '"') return false;
+    v++;
+    const char *end = strchr(v, '"');
+    if (!end || (size_t)(end - v) >= len) return false;
+    memcpy(dst, v, (size_t)(end - v));
+    dst[end - v] = '\0';
+    return true;
+}
+
+static bool json_uint(const char *s, const char *key, uint32_t *dst)
+{
+    const char *v = json_value(s, key);
+    if (!v || !isdigit((unsigned char)*v)) return false;
+    *dst = (uint32_t)strtoul(v, NULL, 10);
+    return true;
+}
+
+static void out_mode(json_out_t *o, const video_mode_t *m)
+{
+    json_out(o, "\"fmt\":\"%s\",\"w\":%" PRIu32 ",\"h\":%" PRIu32 ",\"fps\":%" PRIu32 ",\"mb_s\":%" PRIu32,
+        pixfmt_name(m->pixfmt), m->width, m->height, m->fps, video_mode_mb_s(m, m->fps));
+}
+
+static void reply(json_out_t *o)
+{
+    esp_err_t err = mqtt_video_publish_aux(CONFIG_P4_MQTT_CTRL_TOPIC, o->buf, o->off);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Reply not sent: %s", esp_err_to_name(err));
+    }
+}
+
+static void cmd_mode(const char *msg, json_out_t *o)
+{
+    video_mode_req_t req;
+    app_video_get_mode_request(&req);
+    json_uint(msg, "w", &req.width);
+    json_uint(msg, "h", &req.height);
+    json_uint(msg, "fps", &req.fps);
+    json_uint(msg, "max_mb_s", &req.max_mb_s);
+
+    char name[16];
+    if (json_str(msg, "fmt", name, sizeof(name))) {
+        req.pixfmt = 0;
+        for (size_t i = 0; i < sizeof(s_fmts) / sizeof(s_fmts[0]); i++) {
+            if (strcmp(name, pixfmt_name(s_fmts[i])) == 0) req.pixfmt = s_fmts[i];
+        }
+        if (!req.pixfmt && strcmp(name, "any") != 0) {
+            json_out(o, "{\"event\":\"mode\",\"ok\":false,\"err\":\"unknown fmt %s\"}", name);
+            return;
+        }
+    }
+
+    video_mode_t mode;
+    esp_err_t err = video_streamer_set_mode(&req, &mode);
+    ESP_LOGI(TAG, "Mode request %" PRIu32 "x%" PRIu32 " fps>=%" PRIu32 " <=%" PRIu32 " MB/s: %s",
+             req.width, req.height, req.fps, req.max_mb_s, esp_err_to_name(err));
+    if (err != ESP_OK) {
+        json_out(o, "{\"event\":\"mode\",\"ok\":false,\"err\":\"%s\"}", esp_err_to_name(err));
+        return;
+    }
+    // Width 0: not capturing, the request waits for the next capture.
+    json_out(o, "{\"event\":\"mode\",\"ok\":true,\"active\":%s,", mode.width ? "true" : "false");
+    out_mode(o, &mode);
+    json_out(o, "}");
+}
+
+static void cmd_modes(json_out_t *o)
+{
+    video_mode_t *modes = (video_mode_t *)malloc(VIDEO_MODE_MAX * sizeof(video_mode_t));
+    size_t n = modes ? video_streamer_list_modes(modes, VIDEO_MODE_MAX) : 0;
+    video_mode_req_t req;
+    app_video_get_mode_request(&req);
+
+    json_out(o, "{\"event\":\"modes\",\"req\":{\"fmt\":\"%s\",\"w\":%" PRIu32 ",\"h\":%" PRIu32
+        ",\"fps\":%" PRIu32 ",\"max_mb_s\":%" PRIu32 "}",
+        req.pixfmt ? pixfmt_name(req.pixfmt) : "any", req.width, req.height, req.fps, req.max_mb_s);
+    video_mode_t cur;
+    if (video_streamer_get_mode(&cur)) {
+        json_out(o, ",\"cur\":{");
+        out_mode(o, &cur);
+        json_out(o, "}");
+    }
+    json_out(o, ",\"modes\":[");
+    for (size_t i = 0; i < n; i++) {
+        json_out(o, "%s{", i ? "," : "");
+        out_mode(o, &modes[i]);
+        json_out(o, "}");
+    }
+    json_out(o, "]}");
+    free(modes);
+}
+
+static void ctrl_task(void *arg)
+{
+    (void)arg;
+    static ctrl_msg_t msg;
+    static char buf[CTRL_REPLY_MAX];
+
+    while (true) {
+        if (xQueueReceive(s_queue, &msg, portMAX_DELAY) != pdTRUE) continue;
+
+        char cmd[16];
+        if (!json_str(msg.text, "cmd", cmd, sizeof(cmd))) continue;
+
+        json_out_t o = { .buf = buf, .len = sizeof(buf), .off = 0 };
+        if (strcmp(cmd, "mode") == 0) {
+            cmd_mode(msg.text, &o);
+        } else if (strcmp(cmd, "modes") == 0) {
+            cmd_modes(&o);
+        } else {
+            ESP_LOGW(TAG, "Unknown command %s", cmd);
+            json_out(&o, "{\"event\":\"%s\",\"ok\":false,\"err\":\"unknown cmd\"}", cmd);
+        }
+        reply(&o);
+    }
+}
+
+// MQTT task context: copy and hand over, commands may block on a mode switch.
+static void on_ctrl(const char *data, size_t len)
+{
+    if (len >= CTRL_MSG_MAX) {
+        ESP_LOGW(TAG, "Control message of %u bytes ignored", (unsigned)len);
+        return;
+    }
+    ctrl_msg_t msg;
+    memcpy(msg.text, data, len);
+    msg.text[len] = '\0';
+    if (xQueueSend(s_queue, &msg, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Control queue full, message dropped");
+    }
+}
+
+esp_err_t cam_ctrl_start(void)
+{
+    if (s_queue) return ESP_OK;
+    if (CONFIG_P4_MQTT_CTRL_TOPIC[0] == '\0') return ESP_ERR_INVALID_ARG;
+
+    s_queue = xQueueCreate(CTRL_QUEUE_DEPTH, sizeof(ctrl_msg_t));
+    if (!s_queue) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(ctrl_task, "cam ctrl", CTRL_TASK_STACK_SIZE, NULL, CTRL_TASK_PRIORITY, NULL) != pdPASS) {
+        vQueueDelete(s_queue);
+        s_queue = NULL;
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = mqtt_video_set_ctrl_handler(CONFIG_P4_MQTT_CTRL_TOPIC, on_ctrl);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Listening on %s", CONFIG_P4_MQTT_CTRL_TOPIC);
+    }
+    return err;
+}
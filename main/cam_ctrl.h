@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CAM_CTRL_H
+#define CAM_CTRL_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Take commands from CONFIG_P4_MQTT_CTRL_TOPIC.
+ *
+ * Messages are flat JSON objects with a "cmd" key; anything else on the
+ * topic (including the camera's own replies) is ignored. Replies go to the
+ * same topic with an "event" key:
+ *
+ *   {"cmd":"mode","w":1280,"h":720,"fps":30,"max_mb_s":60,"fmt":"yuv420"}
+ *       Change the capture mode request; omitted keys keep their value,
+ *       0 (or "fmt":"any") means no constraint. During a capture the camera
+ *       switches right away. Reply {"event":"mode","ok":true,...} with the
+ *       mode in use, or "ok":false and "err".
+ *   {"cmd":"modes"}
+ *       Reply {"event":"modes","modes":[...]} with what the camera offers
+ *       (empty when not capturing) and the current request.
+ *
+ * Must be called after mqtt_video_init().
+ */
+esp_err_t cam_ctrl_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
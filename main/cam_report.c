@@ -0,0 +1,58 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "cam_report.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cam_stats.h"
+
+void json_out(json_out_t *o, const char *fmt, ...)
+{
+    if (o->off + 1 >= o->len) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->off, o->len - o->off, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        o->off += (size_t)n;
+        if (o->off >= o->len) o->off = o->len - 1;
+    }
+}
+
+int cam_report_parse_list(const char *s, uint32_t *first, uint32_t *second, int max)
+{
+    int n = 0;
+    while (*s && n < max) {
+        char *end;
+        uint32_t a = strtoul(s, &end, 10);
+        if (end == s) break;
+        s = end;
+        uint32_t b = 1;
+        if (second) {
+            if (*s != 'x') break;
+            b = strtoul(s + 1, &end, 10);
+            if (end == s + 1) break;
+            s = end;
+        }
+        if (a && b) {
+            first[n] = a;
+            if (second) second[n] = b;
+            n++;
+        }
+        while (*s == ',' || *s == ' ') s++;
+    }
+    return n;
+}
+
+uint32_t cam_report_drops_total(void)
+{
+    // Flash write failures count too: the frame is lost either way.
+    return cam_stats_read(CAM_STAT_DROP_ENCODE) + cam_stats_read(CAM_STAT_DROP_DISCONNECTED) +
+           cam_stats_read(CAM_STAT_DROP_BACKPRESSURE) + cam_stats_read(CAM_STAT_DROP_SENDER_QUEUE) +
+           cam_stats_read(CAM_STAT_DROP_PARTIAL) + cam_stats_read(CAM_STAT_DROP_FLASH);
+}
@@ -0,0 +1,41 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CAM_REPORT_H
+#define CAM_REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** JSON written into a caller's buffer; output past the end is cut off. */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t off;
+} json_out_t;
+
+/** @brief Append printf-style text; buf stays NUL-terminated. */
+void json_out(json_out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Parse a Kconfig list: "640x480,1280x720" when second is given,
+ * "30,50,80" otherwise. Zero entries are skipped.
+ *
+ * @return Entries stored, at most max.
+ */
+int cam_report_parse_list(const char *s, uint32_t *first, uint32_t *second, int max);
+
+/** @brief Frames lost for any reason after capture, summed over the CAM_STAT_DROP_* counters. */
+uint32_t cam_report_drops_total(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
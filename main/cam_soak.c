@@ -0,0 +1,410 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "cam_soak.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "app_video.h"
+#include "cam_report.h"
+#include "cam_stats.h"
+#include "flash_store.h"
+#include "flash_uploader.h"
+#include "frame_encoder.h"
+#include "mqtt_video.h"
+#include "video_streamer.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#else
+#include "esp_heap_caps.h"
+#endif
+
+#if CONFIG_P4_SOAK
+
+static const char *TAG = "cam_soak";
+
+#define SOAK_TASK_STACK_SIZE    (8 * 1024)
+#define SOAK_TASK_PRIORITY      (5)
+#define SOAK_JSON_MAX           (1024)
+#define SOAK_MAX_ENTRIES        (8)         // per configured list
+#define SOAK_CONNECT_MS         (60000)
+#define SOAK_DRAIN_MS           (30000)
+
+#if CONFIG_P4_JPEG_SUBSAMPLE_420
+#define SOAK_420 true
+#else
+#define SOAK_420 false
+#endif
+
+typedef enum {
+    SOAK_MQTT = 0,
+    SOAK_RECONNECT,         // MQTT after dropping and re-establishing the connection
+    SOAK_FLASH,             // record to flash, then upload everything
+    SOAK_TRANSPORT_COUNT,
+} soak_transport_t;
+
+static const char *const s_transport_names[SOAK_TRANSPORT_COUNT] = {
+    [SOAK_MQTT] = "mqtt",
+    [SOAK_RECONNECT] = "reconnect",
+    [SOAK_FLASH] = "flash",
+};
+
+typedef struct {
+    size_t internal_used;
+    size_t internal_free;
+    size_t internal_largest;    // 0 where the allocator cannot tell (host)
+    size_t internal_min;
+    size_t psram_used;
+    size_t psram_free;
+    size_t psram_largest;
+} soak_heap_t;
+
+typedef struct {
+    uint32_t captured;
+    uint32_t delivered;         // sent over MQTT, or written to flash
+    uint32_t dropped;
+    uint32_t uploaded;          // flash phases
+    double ms;
+    double fps;                 // delivered per second
+} soak_phase_t;
+
+typedef struct {
+    uint32_t w[SOAK_MAX_ENTRIES];
+    uint32_t h[SOAK_MAX_ENTRIES];
+    uint32_t q[SOAK_MAX_ENTRIES];
+    soak_transport_t t[SOAK_TRANSPORT_COUNT];
+    int nres;
+    int nq;
+    int nt;
+    int combos;
+    float *fps_base;            // per combination, from the first cycle
+    soak_heap_t heap_base;      // at the end of the first cycle
+    char fail[128];
+    json_out_t json;
+} soak_t;
+
+// "mqtt,reconnect,flash"; unknown names are skipped with a warning.
+static int parse_transports(const char *s, soak_transport_t *t, int max)
+{
+    int n = 0;
+    while (*s && n < max) {
+        size_t len = strcspn(s, ", ");
+        int found = -1;
+        for (int i = 0; i < SOAK_TRANSPORT_COUNT; i++) {
+            if (strlen(s_transport_names[i]) == len && strncmp(s, s_transport_names[i], len) == 0) {
+                found = i;
+            }
+        }
+        if (found >= 0) {
+            t[n++] = (soak_transport_t)found;
+        } else if (len) {
+            ESP_LOGW(TAG, "Unknown transport '%.*s'", (int)len, s);
+        }
+        s += len;
+        while (*s == ',' || *s == ' ') s++;
+    }
+    return n;
+}
+
+static void heap_snapshot(soak_heap_t *h)
+{
+    memset(h, 0, sizeof(*h));
+#if CONFIG_IDF_TARGET_LINUX
+    // glibc arena totals; the host has no PSRAM and no cheap way to find the
+    // largest free block, so only growth is checked there.
+    struct mallinfo2 mi = mallinfo2();
+    h->internal_used = mi.uordblks;
+    h->internal_free = mi.fordblks;
+#else
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+    h->internal_used = info.total_allocated_bytes;
+    h->internal_free = info.total_free_bytes;
+    h->internal_largest = info.largest_free_block;
+    h->internal_min = info.minimum_free_bytes;
+    heap_caps_get_info(&info, MALLOC_CAP_SPIRAM);
+    h->psram_used = info.total_allocated_bytes;
+    h->psram_free = info.total_free_bytes;
+    h->psram_largest = info.largest_free_block;
+#endif
+}
+
+// Publish every recorded frame; false when frames are left behind, which
+// would fill the partition over a long run.
+static bool drain_flash(uint32_t *uploaded)
+{
+    int64_t end = esp_timer_get_time() + (int64_t)SOAK_DRAIN_MS * 1000;
+    *uploaded = 0;
+    while (esp_timer_get_time() < end) {
+        uint32_t f = 0;
+        esp_err_t err = flash_uploader_run_once(&f, NULL);
+        *uploaded += f;
+        if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_STATE) {
+            vTaskDelay(1);
+        } else if (err != ESP_OK) {
+            return false;
+        } else if (f == 0) {
+            return mqtt_video_wait_idle(SOAK_DRAIN_MS);
+        }
+    }
+    return false;
+}
+
+static esp_err_t run_phase(soak_t *s, soak_transport_t t, soak_phase_t *p)
+{
+    memset(p, 0, sizeof(*p));
+
+    if (t == SOAK_RECONNECT) {
+        esp_err_t err = mqtt_video_reconnect();
+        if (err != ESP_OK) {
+            snprintf(s->fail, sizeof(s->fail), "reconnect: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+    // Flash phases need the broker too, for the upload.
+    if (!mqtt_video_wait_connected(SOAK_CONNECT_MS)) {
+        snprintf(s->fail, sizeof(s->fail), "MQTT not connected after %d ms", SOAK_CONNECT_MS);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint32_t cap0 = cam_stats_read(CAM_STAT_FRAMES_CAPTURED);
+    uint32_t sent0 = cam_stats_read(CAM_STAT_FRAMES_SENT);
+    uint32_t drop0 = cam_report_drops_total();
+    int64_t t0 = esp_timer_get_time();
+
+    esp_err_t err;
+    if (t == SOAK_FLASH) {
+        float fps = 0.0f;
+        err = record_video_seconds_to_flash(CONFIG_P4_SOAK_PHASE_SECONDS, &p->delivered, &fps);
+        p->ms = (double)(esp_timer_get_time() - t0) / 1000.0;
+        p->fps = fps;
+        if (err == ESP_OK && !drain_flash(&p->uploaded)) {
+            snprintf(s->fail, sizeof(s->fail), "flash upload left frames behind (%u of %u uploaded)",
+                     (unsigned)p->uploaded, (unsigned)p->delivered);
+            err = ESP_FAIL;
+        }
+    } else {
+        err = capture_video_seconds(CONFIG_P4_SOAK_PHASE_SECONDS);
+        p->ms = (double)(esp_timer_get_time() - t0) / 1000.0;
+        // Frames still queued at the end are part of this phase.
+        mqtt_video_wait_idle(SOAK_DRAIN_MS);
+        p->delivered = cam_stats_read(CAM_STAT_FRAMES_SENT) - sent0;
+        p->fps = p->ms > 0.0 ? p->delivered * 1000.0 / p->ms : 0.0;
+    }
+    p->captured = cam_stats_read(CAM_STAT_FRAMES_CAPTURED) - cap0;
+    p->dropped = cam_report_drops_total() - drop0;
+    if (err != ESP_OK && !s->fail[0]) {
+        snprintf(s->fail, sizeof(s->fail), "capture: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static size_t growth(size_t now, size_t base)
+{
+    return now > base ? now - base : 0;
+}
+
+// Fills s->fail with the first limit the phase breaks.
+static void check_phase(soak_t *s, int combo, bool baseline_done, const soak_phase_t *p,
+                        const soak_heap_t *h)
+{
+    if (p->captured && p->dropped * 100.0 / p->captured > CONFIG_P4_SOAK_MAX_DROP_PCT) {
+        snprintf(s->fail, sizeof(s->fail), "dropped %u of %u frames", (unsigned)p->dropped,
+                 (unsigned)p->captured);
+        return;
+    }
+    if (!baseline_done) return;
+
+    const soak_heap_t *b = &s->heap_base;
+    size_t grown = growth(h->internal_used, b->internal_used);
+    if (grown > (size_t)CONFIG_P4_SOAK_MAX_HEAP_GROWTH_KB * 1024) {
+        snprintf(s->fail, sizeof(s->fail), "internal heap grew %u bytes", (unsigned)grown);
+        return;
+    }
+    grown = growth(h->psram_used, b->psram_used);
+    if (grown > (size_t)CONFIG_P4_SOAK_MAX_PSRAM_GROWTH_KB * 1024) {
+        snprintf(s->fail, sizeof(s->fail), "PSRAM grew %u bytes", (unsigned)grown);
+        return;
+    }
+    const size_t now_largest[2] = { h->internal_largest, h->psram_largest };
+    const size_t base_largest[2] = { b->internal_largest, b->psram_largest };
+    for (int i = 0; i < 2; i++) {
+        if (!base_largest[i]) continue;
+        size_t shrink = growth(base_largest[i], now_largest[i]);
+        if (shrink * 100 > base_largest[i] * (size_t)CONFIG_P4_SOAK_MAX_LARGEST_SHRINK_PCT) {
+            snprintf(s->fail, sizeof(s->fail), "%s largest free block %u -> %u bytes",
+                     i ? "PSRAM" : "internal", (unsigned)base_largest[i], (unsigned)now_largest[i]);
+            return;
+        }
+    }
+    float base_fps = s->fps_base[combo];
+    if (base_fps > 0.0f && p->fps < base_fps * (100 - CONFIG_P4_SOAK_MAX_FPS_DRIFT_PCT) / 100.0) {
+        snprintf(s->fail, sizeof(s->fail), "fps %.1f vs %.1f in the first cycle", p->fps, base_fps);
+    }
+}
+
+static void report_phase(soak_t *s, int phase, int64_t start_us, uint32_t w, uint32_t h, uint32_t q,
+                         soak_transport_t t, const soak_phase_t *p, const soak_heap_t *hp)
+{
+    json_out_t *o = &s->json;
+    o->off = 0;
+    json_out(o, "{\"soak\":1,\"phase\":%d,\"cycle\":%d,\"elapsed_s\":%lld,\"w\":%u,\"h\":%u,\"q\":%u,"
+        "\"transport\":\"%s\",\"ms\":%.0f,\"captured\":%u,\"delivered\":%u,\"dropped\":%u",
+        phase, phase / s->combos + 1, (long long)((esp_timer_get_time() - start_us) / 1000000),
+        (unsigned)w, (unsigned)h, (unsigned)q, s_transport_names[t], p->ms, (unsigned)p->captured,
+        (unsigned)p->delivered, (unsigned)p->dropped);
+    if (t == SOAK_FLASH) json_out(o, ",\"uploaded\":%u", (unsigned)p->uploaded);
+    json_out(o, ",\"fps\":%.2f,\"heap\":{\"internal_used\":%u,\"internal_free\":%u,\"internal_largest\":%u,"
+        "\"internal_min\":%u,\"psram_used\":%u,\"psram_free\":%u,\"psram_largest\":%u}",
+        p->fps, (unsigned)hp->internal_used, (unsigned)hp->internal_free,
+        (unsigned)hp->internal_largest, (unsigned)hp->internal_min, (unsigned)hp->psram_used,
+        (unsigned)hp->psram_free, (unsigned)hp->psram_largest);
+    if (s->fail[0]) {
+        json_out(o, ",\"status\":\"fail\",\"fail\":\"%s\"}", s->fail);
+    } else {
+        json_out(o, ",\"status\":\"ok\"}");
+    }
+
+    printf("SOAK %s\n", o->buf);
+    fflush(stdout);
+    mqtt_video_publish_aux(CONFIG_P4_SOAK_TOPIC, o->buf, o->off);
+    ESP_LOGI(TAG, "Phase %d %ux%u q%u %s: %.1f fps, %u dropped, internal used %u, psram used %u%s%s",
+             phase, (unsigned)w, (unsigned)h, (unsigned)q, s_transport_names[t], p->fps,
+             (unsigned)p->dropped, (unsigned)hp->internal_used, (unsigned)hp->psram_used,
+             s->fail[0] ? ": " : "", s->fail);
+}
+
+static esp_err_t soak_all(void)
+{
+    soak_t s = { 0 };
+    s.nres = cam_report_parse_list(CONFIG_P4_SOAK_RESOLUTIONS, s.w, s.h, SOAK_MAX_ENTRIES);
+    s.nq = cam_report_parse_list(CONFIG_P4_SOAK_QUALITIES, s.q, NULL, SOAK_MAX_ENTRIES);
+    s.nt = parse_transports(CONFIG_P4_SOAK_TRANSPORTS, s.t, SOAK_TRANSPORT_COUNT);
+    if (!s.nres || !s.nq || !s.nt) {
+        ESP_LOGE(TAG, "Empty resolution, quality or transport list");
+        return ESP_ERR_INVALID_ARG;
+    }
+    s.combos = s.nres * s.nq * s.nt;
+    s.fps_base = (float *)calloc(s.combos, sizeof(float));
+    s.json.buf = (char *)malloc(SOAK_JSON_MAX);
+    s.json.len = SOAK_JSON_MAX;
+    if (!s.fps_base || !s.json.buf) {
+        free(s.fps_base);
+        free(s.json.buf);
+        return ESP_ERR_NO_MEM;
+    }
+    if (CONFIG_P4_CAPTURE_FRAMES > 0) {
+        ESP_LOGW(TAG, "P4_CAPTURE_FRAMES=%d ends every phase early", CONFIG_P4_CAPTURE_FRAMES);
+    }
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < s.nt; i++) {
+        if (s.t[i] == SOAK_FLASH) err = flash_store_init();
+    }
+    if (err != ESP_OK) {
+        snprintf(s.fail, sizeof(s.fail), "flash init: %s", esp_err_to_name(err));
+    }
+
+    ESP_LOGI(TAG, "Soak: %d combinations of %d s, %d min (0 = forever)", s.combos,
+             CONFIG_P4_SOAK_PHASE_SECONDS, CONFIG_P4_SOAK_MINUTES);
+    const int64_t start_us = esp_timer_get_time();
+    const int64_t end_us = start_us + (int64_t)CONFIG_P4_SOAK_MINUTES * 60 * 1000000;
+    int phase = 0;
+
+    while (err == ESP_OK && (CONFIG_P4_SOAK_MINUTES == 0 || esp_timer_get_time() < end_us)) {
+        int combo = phase % s.combos;
+        uint32_t qi = combo % s.nq;
+        uint32_t ri = (combo / s.nq) % s.nres;
+        soak_transport_t t = s.t[combo / (s.nq * s.nres)];
+
+        app_video_set_capture_size(s.w[ri], s.h[ri]);
+        frame_encoder_set_quality((int)s.q[qi], SOAK_420);
+
+        soak_phase_t p;
+        soak_heap_t h;
+        err = run_phase(&s, t, &p);
+        heap_snapshot(&h);
+
+        bool baseline_done = phase >= s.combos;
+        if (err == ESP_OK) {
+            check_phase(&s, combo, baseline_done, &p, &h);
+            if (s.fail[0]) err = ESP_FAIL;
+        }
+        if (!baseline_done) {
+            s.fps_base[combo] = (float)p.fps;
+            if (combo == s.combos - 1) s.heap_base = h;
+        }
+        report_phase(&s, phase, start_us, s.w[ri], s.h[ri], s.q[qi], t, &p, &h);
+        phase++;
+    }
+
+    json_out_t *o = &s.json;
+    o->off = 0;
+    json_out(o, "{\"soak\":1,\"summary\":1,\"phases\":%d,\"elapsed_s\":%lld,\"status\":\"%s\"",
+        phase, (long long)((esp_timer_get_time() - start_us) / 1000000), err == ESP_OK ? "ok" : "fail");
+    if (s.fail[0]) json_out(o, ",\"fail\":\"%s\"", s.fail);
+    json_out(o, "}");
+    printf("SOAK %s\n", o->buf);
+    fflush(stdout);
+    if (mqtt_video_publish_aux(CONFIG_P4_SOAK_TOPIC, o->buf, o->off) == ESP_OK) {
+        mqtt_video_wait_idle(SOAK_DRAIN_MS);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Soak passed: %d phases", phase);
+    } else {
+        ESP_LOGE(TAG, "Soak failed after %d phases: %s", phase, s.fail);
+    }
+
+    free(s.fps_base);
+    free(s.json.buf);
+    return err == ESP_OK ? ESP_OK : ESP_FAIL;
+}
+
+typedef struct {
+    SemaphoreHandle_t done;
+    esp_err_t err;
+} soak_run_t;
+
+static void soak_task(void *arg)
+{
+    soak_run_t *run = (soak_run_t *)arg;
+    run->err = soak_all();
+    xSemaphoreGive(run->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t cam_soak_run(void)
+{
+    soak_run_t run = { .done = xSemaphoreCreateBinary(), .err = ESP_FAIL };
+    if (!run.done) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(soak_task, "cam soak", SOAK_TASK_STACK_SIZE, &run, SOAK_TASK_PRIORITY, NULL) != pdPASS) {
+        vSemaphoreDelete(run.done);
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(run.done, portMAX_DELAY);
+    vSemaphoreDelete(run.done);
+    return run.err;
+}
+
+#else  // !CONFIG_P4_SOAK
+
+esp_err_t cam_soak_run(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CAM_SOAK_H
+#define CAM_SOAK_H
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Run the sustained-capture soak test (CONFIG_P4_SOAK).
+ *
+ * Captures in phases of CONFIG_P4_SOAK_PHASE_SECONDS, stepping through every
+ * combination of the configured resolutions, JPEG qualities and transports
+ * (MQTT, MQTT after a forced reconnect, flash recording plus upload). After
+ * each phase it samples heap usage, the largest free block, dropped frames
+ * and delivered fps. The first full cycle is the baseline; any later phase
+ * that grows the heap, fragments it, or loses fps beyond the configured
+ * limits fails the run. One JSON line per phase goes to the console,
+ * prefixed "SOAK ", and to CONFIG_P4_SOAK_TOPIC (tools/mqtt_cam_soak.py).
+ *
+ * Runs in its own task and blocks until CONFIG_P4_SOAK_MINUTES have passed
+ * or a check fails; returns ESP_FAIL in the latter case.
+ */
+esp_err_t cam_soak_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
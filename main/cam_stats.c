@@ -0,0 +1,332 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "cam_stats.h"
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "frame_pool.h"
+#include "mqtt_video.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#endif
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && !CONFIG_IDF_TARGET_LINUX
+#define STATS_TASK_CPU 1
+#else
+#define STATS_TASK_CPU 0
+#endif
+
+static const char *TAG = "cam_stats";
+
+#define STATS_TASK_STACK_SIZE   (4 * 1024)
+#define STATS_TASK_PRIORITY     (2)
+#define STATS_JSON_MAX          (1024)
+#define STATS_MAX_TASKS         (32)    // uxTaskGetSystemState() reports nothing above this
+#define STATS_TOP_TASKS         (6)
+#define HIST_BUCKETS            (92)    // log-linear, 4 per octave, up to 2^24 us
+
+// One slot per core, each on its own cache lines, so the hot path never
+// contends with the other core.
+typedef struct {
+    _Atomic uint32_t count[CAM_STAT_COUNT];
+    _Atomic uint32_t hist[CAM_STAT_HIST_COUNT][HIST_BUCKETS];
+    _Atomic uint32_t hist_max[CAM_STAT_HIST_COUNT];
+} __attribute__((aligned(64))) core_slot_t;
+
+static core_slot_t s_slots[portNUM_PROCESSORS];
+
+// Snapshot state, owned by the caller of cam_stats_format_json().
+static struct {
+    uint32_t count[CAM_STAT_COUNT];
+    uint64_t total[CAM_STAT_COUNT];
+    uint32_t hist[CAM_STAT_HIST_COUNT][HIST_BUCKETS];
+    int64_t last_us;
+#if STATS_TASK_CPU
+    TaskStatus_t *tasks;
+    struct {
+        UBaseType_t number;
+        configRUN_TIME_COUNTER_TYPE runtime;
+    } prev[STATS_MAX_TASKS];
+    UBaseType_t prev_count;
+    configRUN_TIME_COUNTER_TYPE prev_total;
+#endif
+} s_snap;
+
+static inline core_slot_t *this_slot(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return &s_slots[0];
+#else
+    return &s_slots[esp_cpu_get_core_id()];
+#endif
+}
+
+void cam_stats_add(cam_stat_t id, uint32_t n)
+{
+    if (id >= CAM_STAT_COUNT) return;
+    atomic_fetch_add_explicit(&this_slot()->count[id], n, memory_order_relaxed);
+}
+
+uint32_t cam_stats_read(cam_stat_t id)
+{
+    if (id >= CAM_STAT_COUNT) return 0;
+    uint32_t sum = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        sum += atomic_load_explicit(&s_slots[c].count[id], memory_order_relaxed);
+    }
+    return sum;
+}
+
+// Values below 4 get their own bucket; above that each power of two is
+// split in four, so a reported percentile is within 25% of the real one.
+static inline int hist_bucket(uint32_t us)
+{
+    if (us < 4) return (int)us;
+    int e = 31 - __builtin_clz(us);
+    int b = 4 * (e - 1) + (int)((us >> (e - 2)) & 3u);
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+static inline uint32_t hist_upper_us(int b)
+{
+    if (b < 4) return (uint32_t)b;
+    int e = b / 4 + 1;
+    return ((uint32_t)(5 + b % 4) << (e - 2)) - 1;
+}
+
+void cam_stats_record_us(cam_stat_hist_t id, uint32_t us)
+{
+    if (id >= CAM_STAT_HIST_COUNT) return;
+    core_slot_t *s = this_slot();
+    atomic_fetch_add_explicit(&s->hist[id][hist_bucket(us)], 1, memory_order_relaxed);
+
+    uint32_t max = atomic_load_explicit(&s->hist_max[id], memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&s->hist_max[id], &max, us,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t off;
+} json_out_t;
+
+static void out(json_out_t *o, const char *fmt, ...)
+{
+    if (o->off + 1 >= o->len) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o->buf + o->off, o->len - o->off, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        o->off += (size_t)n;
+        if (o->off >= o->len) o->off = o->len - 1;
+    }
+}
+
+// Percentiles over the histogram deltas since the previous snapshot,
+// reported as the upper bucket edge clamped to the observed max.
+static void out_hist(json_out_t *o, const char *name, cam_stat_hist_t id)
+{
+    uint32_t delta[HIST_BUCKETS];
+    uint32_t n = 0;
+    uint32_t max = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        uint32_t sum = 0;
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            sum += atomic_load_explicit(&s_slots[c].hist[id][b], memory_order_relaxed);
+        }
+        delta[b] = sum - s_snap.hist[id][b];
+        s_snap.hist[id][b] = sum;
+        n += delta[b];
+    }
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        uint32_t m = atomic_exchange_explicit(&s_slots[c].hist_max[id], 0, memory_order_relaxed);
+        if (m > max) max = m;
+    }
+
+    static const uint8_t pcts[] = { 50, 90, 99 };
+    uint32_t at[3] = { 0 };
+    for (int i = 0; i < 3 && n; i++) {
+        uint32_t want = (n * pcts[i] + 99) / 100;
+        uint32_t seen = 0;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            seen += delta[b];
+            if (seen >= want) {
+                uint32_t edge = hist_upper_us(b);
+                at[i] = edge < max ? edge : max;
+                break;
+            }
+        }
+    }
+    out(o, ",\"%s\":{\"n\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}", name,
+        (unsigned)n, (unsigned)at[0], (unsigned)at[1], (unsigned)at[2], (unsigned)max);
+}
+
+#if STATS_TASK_CPU
+// Per-task share of one core over the last period, busiest first.
+static void out_tasks(json_out_t *o)
+{
+    if (!s_snap.tasks) {
+        s_snap.tasks = (TaskStatus_t *)calloc(STATS_MAX_TASKS, sizeof(TaskStatus_t));
+        if (!s_snap.tasks) return;
+    }
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t count = uxTaskGetSystemState(s_snap.tasks, STATS_MAX_TASKS, &total);
+    configRUN_TIME_COUNTER_TYPE period = total - s_snap.prev_total;
+
+    uint32_t pct10[STATS_MAX_TASKS];
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *t = &s_snap.tasks[i];
+        configRUN_TIME_COUNTER_TYPE before = t->ulRunTimeCounter;
+        for (UBaseType_t j = 0; j < s_snap.prev_count; j++) {
+            if (s_snap.prev[j].number == t->xTaskNumber) {
+                before = s_snap.prev[j].runtime;
+                break;
+            }
+        }
+        pct10[i] = period ? (uint32_t)((uint64_t)(t->ulRunTimeCounter - before) * 1000 / period) : 0;
+    }
+
+    out(o, ",\"tasks\":[");
+    bool used[STATS_MAX_TASKS] = { 0 };
+    for (int k = 0; k < STATS_TOP_TASKS; k++) {
+        int best = -1;
+        for (UBaseType_t i = 0; i < count; i++) {
+            if (!used[i] && (best < 0 || pct10[i] > pct10[best])) best = (int)i;
+        }
+        if (best < 0) break;
+        used[best] = true;
+        out(o, "%s[\"%s\",%u.%u]", k ? "," : "", s_snap.tasks[best].pcTaskName,
+            (unsigned)(pct10[best] / 10), (unsigned)(pct10[best] % 10));
+    }
+    out(o, "]");
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        s_snap.prev[i].number = s_snap.tasks[i].xTaskNumber;
+        s_snap.prev[i].runtime = s_snap.tasks[i].ulRunTimeCounter;
+    }
+    s_snap.prev_count = count;
+    s_snap.prev_total = total;
+}
+#endif
+
+size_t cam_stats_format_json(char *buf, size_t len)
+{
+    if (!buf || len == 0) return 0;
+    json_out_t o = { buf, len, 0 };
+    buf[0] = '\0';
+
+    int64_t now_us = esp_timer_get_time();
+    uint32_t period_ms = s_snap.last_us ? (uint32_t)((now_us - s_snap.last_us) / 1000) : 0;
+    s_snap.last_us = now_us;
+
+    // 32-bit slots wrap; folding the per-period delta into 64-bit totals
+    // keeps byte counts exact as long as a period sends less than 4 GiB.
+    for (int id = 0; id < CAM_STAT_COUNT; id++) {
+        uint32_t sum = 0;
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            sum += atomic_load_explicit(&s_slots[c].count[id], memory_order_relaxed);
+        }
+        s_snap.total[id] += (uint32_t)(sum - s_snap.count[id]);
+        s_snap.count[id] = sum;
+    }
+    const uint64_t *t = s_snap.total;
+
+    out(&o, "{\"up_ms\":%llu,\"period_ms\":%u", (unsigned long long)(now_us / 1000), (unsigned)period_ms);
+    out(&o, ",\"frames\":{\"captured\":%llu,\"encoded\":%llu,\"sent\":%llu,\"decimated\":%llu}",
+        (unsigned long long)t[CAM_STAT_FRAMES_CAPTURED], (unsigned long long)t[CAM_STAT_FRAMES_ENCODED],
+        (unsigned long long)t[CAM_STAT_FRAMES_SENT], (unsigned long long)t[CAM_STAT_FRAMES_DECIMATED]);
+    out(&o, ",\"dropped\":{\"encode\":%llu,\"disconnected\":%llu,\"backpressure\":%llu,"
+        "\"sender_queue\":%llu,\"partial\":%llu,\"flash\":%llu,\"sensor\":%llu}",
+        (unsigned long long)t[CAM_STAT_DROP_ENCODE], (unsigned long long)t[CAM_STAT_DROP_DISCONNECTED],
+        (unsigned long long)t[CAM_STAT_DROP_BACKPRESSURE], (unsigned long long)t[CAM_STAT_DROP_SENDER_QUEUE],
+        (unsigned long long)t[CAM_STAT_DROP_PARTIAL], (unsigned long long)t[CAM_STAT_DROP_FLASH],
+        (unsigned long long)t[CAM_STAT_DROP_SENSOR]);
+    out(&o, ",\"chunks\":%llu,\"bytes\":%llu",
+        (unsigned long long)t[CAM_STAT_CHUNKS_SENT], (unsigned long long)t[CAM_STAT_BYTES_SENT]);
+
+    out_hist(&o, "encode_us", CAM_STAT_HIST_ENCODE);
+    out_hist(&o, "publish_us", CAM_STAT_HIST_PUBLISH);
+
+#if !CONFIG_IDF_TARGET_LINUX
+    out(&o, ",\"heap\":{\"internal_free\":%u,\"internal_min\":%u,\"psram_free\":%u,\"psram_min\":%u}",
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+#endif
+
+    out(&o, ",\"pools\":[");
+    for (int i = 0; i < FRAME_POOL_COUNT; i++) {
+        frame_pool_stats_t ps = { 0 };
+        frame_pool_get_stats((frame_pool_id_t)i, &ps);
+        out(&o, "%s[%u,%u,%u]", i ? "," : "", (unsigned)ps.high_water, (unsigned)ps.block_count,
+            (unsigned)ps.alloc_fail);
+    }
+    out(&o, "]");
+
+#if STATS_TASK_CPU
+    out_tasks(&o);
+#endif
+
+    out(&o, "}");
+    return o.off;
+}
+
+#if CONFIG_P4_STATS_PERIOD_MS > 0
+static void stats_task(void *arg)
+{
+    (void)arg;
+    char *buf = (char *)malloc(STATS_JSON_MAX);
+    if (!buf) {
+        ESP_LOGE(TAG, "No memory for stats buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    cam_stats_format_json(buf, STATS_JSON_MAX);  // baseline for the first period
+    TickType_t last = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(CONFIG_P4_STATS_PERIOD_MS));
+        size_t n = cam_stats_format_json(buf, STATS_JSON_MAX);
+        esp_err_t err = mqtt_video_publish_aux(CONFIG_P4_STATS_TOPIC, buf, n);
+        if (err != ESP_OK) {
+            ESP_LOGD(TAG, "Stats publish failed: %s", esp_err_to_name(err));
+        }
+    }
+}
+#endif
+
+esp_err_t cam_stats_start(void)
+{
+#if CONFIG_P4_STATS_PERIOD_MS > 0
+    static TaskHandle_t s_task;
+    if (s_task) return ESP_OK;
+
+    BaseType_t ok = xTaskCreate(stats_task, "cam stats", STATS_TASK_STACK_SIZE, NULL,
+                                STATS_TASK_PRIORITY, &s_task);
+    if (ok != pdPASS) {
+        s_task = NULL;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Publishing stats to %s every %d ms", CONFIG_P4_STATS_TOPIC, CONFIG_P4_STATS_PERIOD_MS);
+#endif
+    return ESP_OK;
+}
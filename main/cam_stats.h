@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CAM_STATS_H
+#define CAM_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    CAM_STAT_FRAMES_CAPTURED = 0,
+    CAM_STAT_FRAMES_ENCODED,
+    CAM_STAT_FRAMES_SENT,
+    CAM_STAT_FRAMES_DECIMATED,   // dropped on purpose to meet the output rate
+    CAM_STAT_DROP_ENCODE,        // encoder setup or encode failed
+    CAM_STAT_DROP_DISCONNECTED,  // MQTT not connected at admission
+    CAM_STAT_DROP_BACKPRESSURE,  // send buffer full or in-flight budget exhausted
+    CAM_STAT_DROP_SENDER_QUEUE,  // sender task queue or frame pool full
+    CAM_STAT_DROP_PARTIAL,       // admitted but aborted mid-frame
+    CAM_STAT_DROP_FLASH,         // flash write failed
+    CAM_STAT_DROP_SENSOR,        // gaps in the driver's frame sequence
+    CAM_STAT_CHUNKS_SENT,
+    CAM_STAT_BYTES_SENT,
+    CAM_STAT_COUNT,
+} cam_stat_t;
+
+typedef enum {
+    CAM_STAT_HIST_ENCODE = 0,    // frame_encoder_encode()
+    CAM_STAT_HIST_PUBLISH,       // one frame through video_packetizer_publish_jpeg()
+    CAM_STAT_HIST_COUNT,
+} cam_stat_hist_t;
+
+/**
+ * @brief Add n to a counter.
+ *
+ * Each core has its own slot, so concurrent callers on different cores never
+ * share a cache line; the add is a relaxed atomic in case the task migrates.
+ */
+void cam_stats_add(cam_stat_t id, uint32_t n);
+
+static inline void cam_stats_inc(cam_stat_t id)
+{
+    cam_stats_add(id, 1);
+}
+
+/** @brief Current value of a counter summed over cores. Wraps at 2^32; take differences. */
+uint32_t cam_stats_read(cam_stat_t id);
+
+/** @brief Record one duration in a log-linear histogram. Lock-free like cam_stats_add(). */
+void cam_stats_record_us(cam_stat_hist_t id, uint32_t us);
+
+/**
+ * @brief Start the task that publishes a JSON snapshot to CONFIG_P4_STATS_TOPIC
+ *        every CONFIG_P4_STATS_PERIOD_MS. Counters work without it.
+ */
+esp_err_t cam_stats_start(void);
+
+/**
+ * @brief Format the snapshot since the previous call as JSON.
+ *
+ * Counters are totals since boot, percentiles and CPU shares cover the time
+ * since the previous call. Only the stats task should call this.
+ *
+ * @return Length written, excluding the terminator (truncated to len - 1).
+ */
+size_t cam_stats_format_json(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
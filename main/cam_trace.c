@@ -0,0 +1,298 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "cam_trace.h"
+
+#if CONFIG_P4_TRACE
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_video.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#endif
+
+static const char *TAG = "cam_trace";
+
+#define TRACE_FRAGMENT_MAX  1024    // MQTT sink message payload, header excluded
+#define TRACE_LINE_MAX      192
+
+// 16 bytes; start/dur are in cycles (microseconds on the host build). A
+// SYNC event carries the esp_timer time matching its start in dur:arg.
+typedef struct {
+    uint32_t start;
+    uint32_t dur;
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t arg;
+} trace_event_t;
+
+typedef struct {
+    trace_event_t *ev;
+    _Atomic uint32_t head;      // total events written; slot = head & mask
+    volatile uint32_t sync_head;
+} trace_ring_t;
+
+static trace_ring_t s_rings[portNUM_PROCESSORS];
+static uint32_t s_mask;
+static atomic_bool s_paused;
+
+static const char *const s_names[CAM_TRACE_ID_COUNT] = {
+    [CAM_TRACE_SYNC] = "sync",
+    [CAM_TRACE_FRAME] = "frame",
+    [CAM_TRACE_DQBUF] = "VIDIOC_DQBUF",
+    [CAM_TRACE_QBUF] = "VIDIOC_QBUF",
+    [CAM_TRACE_ENCODE] = "jpeg_encode",
+    [CAM_TRACE_PUBLISH_CHUNK] = "publish_chunk",
+    [CAM_TRACE_FLASH_OPEN] = "fopen",
+    [CAM_TRACE_FLASH_WRITE] = "fwrite",
+    [CAM_TRACE_FLASH_CLOSE] = "fclose",
+};
+
+static inline int this_core(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 0;
+#else
+    return esp_cpu_get_core_id();
+#endif
+}
+
+static inline uint32_t ticks_per_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 1;
+#else
+    return esp_rom_get_cpu_ticks_per_us();
+#endif
+}
+
+esp_err_t cam_trace_init(void)
+{
+    if (s_mask) return ESP_OK;
+
+    // Power of two so the hot path can mask instead of divide.
+    uint32_t n = 1;
+    while (n * 2 <= (uint32_t)CONFIG_P4_TRACE_EVENTS) n *= 2;
+
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+#if CONFIG_IDF_TARGET_LINUX
+        s_rings[c].ev = (trace_event_t *)calloc(n, sizeof(trace_event_t));
+#else
+        s_rings[c].ev = (trace_event_t *)heap_caps_calloc(n, sizeof(trace_event_t),
+                                                          MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_rings[c].ev) {
+            s_rings[c].ev = (trace_event_t *)calloc(n, sizeof(trace_event_t));
+        }
+#endif
+        if (!s_rings[c].ev) {
+            ESP_LOGE(TAG, "No memory for %u trace events", (unsigned)n);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_mask = n - 1;
+    ESP_LOGI(TAG, "Trace rings: %d x %u events", portNUM_PROCESSORS, (unsigned)n);
+    return ESP_OK;
+}
+
+static inline void put(trace_ring_t *r, uint32_t start, uint32_t dur, uint16_t id, uint32_t arg)
+{
+    // Only tasks on this core (and their preemption) share the ring, so the
+    // atomic add is uncontended in practice.
+    uint32_t i = atomic_fetch_add_explicit(&r->head, 1, memory_order_relaxed);
+    trace_event_t *e = &r->ev[i & s_mask];
+    e->start = start;
+    e->dur = dur;
+    e->id = id;
+    e->arg = arg;
+}
+
+void cam_trace_record(cam_trace_id_t id, uint32_t start, uint32_t arg)
+{
+    uint32_t now = cam_trace_now();
+    if (!s_mask || atomic_load_explicit(&s_paused, memory_order_relaxed)) return;
+
+    trace_ring_t *r = &s_rings[this_core()];
+
+    // Keep a SYNC in the newest half of the ring so every event left in it
+    // can be placed on the shared esp_timer time line.
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->sync_head >= (s_mask + 1) / 2 || head == 0) {
+        uint64_t us = (uint64_t)esp_timer_get_time();
+        r->sync_head = head;
+        put(r, cam_trace_now(), (uint32_t)(us >> 32), CAM_TRACE_SYNC, (uint32_t)us);
+    }
+    put(r, start, now - start, (uint16_t)id, arg);
+}
+
+typedef struct {
+    int (*write)(const char *data, size_t len, void *ctx);
+    void *ctx;
+    int err;
+} dump_out_t;
+
+static void emit(dump_out_t *o, const char *fmt, ...)
+{
+    if (o->err) return;
+    char line[TRACE_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n <= 0) return;
+    o->err = o->write(line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1, o->ctx);
+}
+
+esp_err_t cam_trace_dump(int (*write)(const char *data, size_t len, void *ctx), void *ctx)
+{
+    if (!write) return ESP_ERR_INVALID_ARG;
+    if (!s_mask) return ESP_ERR_INVALID_STATE;
+
+    atomic_store(&s_paused, true);
+    vTaskDelay(1);  // let a writer that passed the pause check finish its slot
+
+    dump_out_t o = { write, ctx, 0 };
+    const uint32_t tpu = ticks_per_us();
+    bool first = true;
+
+    emit(&o, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        emit(&o, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"core %d\"}}",
+             first ? "" : ",\n", c, c);
+        first = false;
+
+        trace_ring_t *r = &s_rings[c];
+        uint32_t head = atomic_load(&r->head);
+        uint32_t n = head < s_mask + 1 ? head : s_mask + 1;
+        bool synced = false;
+        uint32_t sync_cyc = 0;
+        int64_t sync_ns = 0;
+
+        for (uint32_t i = head - n; i != head && !o.err; i++) {
+            const trace_event_t *e = &r->ev[i & s_mask];
+            if (e->id == CAM_TRACE_SYNC) {
+                synced = true;
+                sync_cyc = e->start;
+                sync_ns = (int64_t)(((uint64_t)e->dur << 32) | e->arg) * 1000;
+                continue;
+            }
+            if (!synced || e->id >= CAM_TRACE_ID_COUNT) continue;
+
+            // Signed 32-bit delta: events up to ~2^31 cycles either side of
+            // the SYNC (seconds at P4 clocks) land correctly across a wrap.
+            int64_t ts_ns = sync_ns + (int64_t)(int32_t)(e->start - sync_cyc) * 1000 / tpu;
+            uint64_t dur_ns = (uint64_t)e->dur * 1000 / tpu;
+            emit(&o, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld.%03d,"
+                 "\"dur\":%llu.%03d,\"args\":{\"arg\":%u}}",
+                 s_names[e->id], c, (long long)(ts_ns / 1000), (int)(ts_ns % 1000),
+                 (unsigned long long)(dur_ns / 1000), (int)(dur_ns % 1000), (unsigned)e->arg);
+        }
+    }
+    emit(&o, "\n]}\n");
+
+    // Start over so the next dump covers only what happens after this one.
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        atomic_store(&s_rings[c].head, 0);
+        s_rings[c].sync_head = 0;
+    }
+    atomic_store(&s_paused, false);
+
+    return o.err ? ESP_FAIL : ESP_OK;
+}
+
+#if CONFIG_P4_TRACE_SINK_MQTT
+// Fragment header: 'C','T', flags (bit 0 = last), u16 sequence (LE).
+typedef struct {
+    uint8_t buf[5 + TRACE_FRAGMENT_MAX];
+    size_t len;
+    uint16_t seq;
+} mqtt_sink_t;
+
+static int mqtt_sink_flush(mqtt_sink_t *s, bool last)
+{
+    s->buf[0] = 'C';
+    s->buf[1] = 'T';
+    s->buf[2] = last ? 1 : 0;
+    s->buf[3] = (uint8_t)s->seq;
+    s->buf[4] = (uint8_t)(s->seq >> 8);
+    esp_err_t err = mqtt_video_publish_aux(CONFIG_P4_TRACE_TOPIC, s->buf, 5 + s->len);
+    s->seq++;
+    s->len = 0;
+    return err == ESP_OK ? 0 : -1;
+}
+
+static int mqtt_sink_write(const char *data, size_t len, void *ctx)
+{
+    mqtt_sink_t *s = (mqtt_sink_t *)ctx;
+    while (len) {
+        size_t take = TRACE_FRAGMENT_MAX - s->len;
+        if (take > len) take = len;
+        memcpy(s->buf + 5 + s->len, data, take);
+        s->len += take;
+        data += take;
+        len -= take;
+        if (s->len == TRACE_FRAGMENT_MAX && mqtt_sink_flush(s, false) != 0) return -1;
+    }
+    return 0;
+}
+#else
+static int console_write(const char *data, size_t len, void *ctx)
+{
+    (void)ctx;
+    return fwrite(data, 1, len, stdout) == len ? 0 : -1;
+}
+#endif
+
+esp_err_t cam_trace_dump_to_sink(void)
+{
+#if CONFIG_P4_TRACE_SINK_MQTT
+    mqtt_sink_t *s = (mqtt_sink_t *)calloc(1, sizeof(*s));
+    if (!s) return ESP_ERR_NO_MEM;
+    esp_err_t err = cam_trace_dump(mqtt_sink_write, s);
+    if (err == ESP_OK && mqtt_sink_flush(s, true) != 0) err = ESP_FAIL;
+    free(s);
+    if (err == ESP_OK) ESP_LOGI(TAG, "Trace dumped to %s", CONFIG_P4_TRACE_TOPIC);
+    return err;
+#else
+    printf("\n=== CAM TRACE BEGIN ===\n");
+    esp_err_t err = cam_trace_dump(console_write, NULL);
+    printf("=== CAM TRACE END ===\n");
+    fflush(stdout);
+    ESP_LOGI(TAG, "Trace dumped to console");
+    return err;
+#endif
+}
+
+#else  // !CONFIG_P4_TRACE
+
+esp_err_t cam_trace_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t cam_trace_dump(int (*write)(const char *data, size_t len, void *ctx), void *ctx)
+{
+    (void)write;
+    (void)ctx;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t cam_trace_dump_to_sink(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
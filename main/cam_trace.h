@@ -0,0 +1,93 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CAM_TRACE_H
+#define CAM_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#if CONFIG_P4_TRACE && !CONFIG_IDF_TARGET_LINUX
+#include "esp_cpu.h"
+#endif
+#if CONFIG_P4_TRACE && CONFIG_IDF_TARGET_LINUX
+#include "esp_timer.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    CAM_TRACE_SYNC = 0,      // internal: ties a core's cycle counter to esp_timer
+    CAM_TRACE_FRAME,         // whole frame callback
+    CAM_TRACE_DQBUF,
+    CAM_TRACE_QBUF,
+    CAM_TRACE_ENCODE,
+    CAM_TRACE_PUBLISH_CHUNK,
+    CAM_TRACE_FLASH_OPEN,
+    CAM_TRACE_FLASH_WRITE,
+    CAM_TRACE_FLASH_CLOSE,
+    CAM_TRACE_ID_COUNT,
+} cam_trace_id_t;
+
+/*
+ * Scoped trace points:
+ *
+ *   CAM_TRACE_BEGIN(ENCODE);
+ *   err = frame_encoder_encode(...);
+ *   CAM_TRACE_END(ENCODE, jpeg_size);
+ *
+ * Each END writes one complete event (start, duration, arg) into the
+ * current core's ring. With CONFIG_P4_TRACE off both expand to nothing.
+ */
+#if CONFIG_P4_TRACE
+
+static inline uint32_t cam_trace_now(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return (uint32_t)esp_timer_get_time();
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+void cam_trace_record(cam_trace_id_t id, uint32_t start, uint32_t arg);
+
+#define CAM_TRACE_BEGIN(name)       uint32_t cam_trace_t0_##name = cam_trace_now()
+#define CAM_TRACE_END(name, arg)    cam_trace_record(CAM_TRACE_##name, cam_trace_t0_##name, (uint32_t)(arg))
+
+#else
+
+#define CAM_TRACE_BEGIN(name)       do { } while (0)
+#define CAM_TRACE_END(name, arg)    do { } while (0)
+
+#endif
+
+/** @brief Allocate the per-core rings (CONFIG_P4_TRACE_EVENTS each). No-op when tracing is off. */
+esp_err_t cam_trace_init(void);
+
+/**
+ * @brief Write the rings as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ *
+ * Recording pauses while dumping. Output goes through write() in pieces of
+ * at most a few hundred bytes; a non-zero return aborts the dump.
+ */
+esp_err_t cam_trace_dump(int (*write)(const char *data, size_t len, void *ctx), void *ctx);
+
+/**
+ * @brief Dump to the configured sink: the console between marker lines, or
+ *        CONFIG_P4_TRACE_TOPIC as numbered fragments (tools/mqtt_cam_trace.py).
+ */
+esp_err_t cam_trace_dump_to_sink(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "coalesce_transport.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_transport_tcp.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#else
+#include "lwip/sockets.h"
+#endif
+
+static const char *TAG = "coalesce";
+
+typedef struct {
+    esp_transport_handle_t tcp;
+    SemaphoreHandle_t lock;
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    int timeout_ms;
+    bool batching;
+} coalesce_ctx_t;
+
+static coalesce_ctx_t *ctx_of(esp_transport_handle_t t)
+{
+    return (coalesce_ctx_t *)esp_transport_get_context_data(t);
+}
+
+static int write_all(coalesce_ctx_t *c, const uint8_t *data, size_t len, int timeout_ms)
+{
+    size_t off = 0;
+    while (off < len) {
+        int n = esp_transport_write(c->tcp, (const char *)data + off, (int)(len - off), timeout_ms);
+        if (n <= 0) {
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    return (int)len;
+}
+
+// Caller holds c->lock.
+static int flush_locked(coalesce_ctx_t *c)
+{
+    if (c->len == 0) return 0;
+    int ret = write_all(c, c->buf, c->len, c->timeout_ms);
+    c->len = 0;
+    return ret < 0 ? -1 : 0;
+}
+
+static int co_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    coalesce_ctx_t *c = ctx_of(t);
+    c->len = 0;
+    c->batching = false;
+
+    int ret = esp_transport_connect(c->tcp, host, port, timeout_ms);
+    if (ret < 0) return ret;
+
+    int sock = esp_transport_get_socket(c->tcp);
+    int one = 1;
+    if (c->cap > 0 && sock >= 0 && setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+        ESP_LOGW(TAG, "TCP_NODELAY not set");
+    }
+    return ret;
+}
+
+static int co_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    coalesce_ctx_t *c = ctx_of(t);
+    if (len <= 0) return len;
+
+    xSemaphoreTake(c->lock, portMAX_DELAY);
+    c->timeout_ms = timeout_ms;
+
+    int ret = len;
+    if (!c->batching || (size_t)len >= c->cap) {
+        if (flush_locked(c) < 0 || write_all(c, (const uint8_t *)buffer, (size_t)len, timeout_ms) < 0) {
+            ret = -1;
+        }
+    } else {
+        if (c->len + (size_t)len > c->cap && flush_locked(c) < 0) {
+            ret = -1;
+        } else {
+            memcpy(c->buf + c->len, buffer, (size_t)len);
+            c->len += (size_t)len;
+        }
+    }
+
+    xSemaphoreGive(c->lock);
+    return ret;
+}
+
+static int co_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    return esp_transport_read(ctx_of(t)->tcp, buffer, len, timeout_ms);
+}
+
+static int co_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return esp_transport_poll_read(ctx_of(t)->tcp, timeout_ms);
+}
+
+static int co_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return esp_transport_poll_write(ctx_of(t)->tcp, timeout_ms);
+}
+
+static int co_close(esp_transport_handle_t t)
+{
+    coalesce_ctx_t *c = ctx_of(t);
+    xSemaphoreTake(c->lock, portMAX_DELAY);
+    c->len = 0;
+    c->batching = false;
+    xSemaphoreGive(c->lock);
+    return esp_transport_close(c->tcp);
+}
+
+static int co_destroy(esp_transport_handle_t t)
+{
+    coalesce_ctx_t *c = ctx_of(t);
+    if (!c) return 0;
+    esp_transport_destroy(c->tcp);
+    vSemaphoreDelete(c->lock);
+    free(c->buf);
+    free(c);
+    esp_transport_set_context_data(t, NULL);
+    return 0;
+}
+
+esp_transport_handle_t coalesce_transport_create(size_t batch_bytes)
+{
+    coalesce_ctx_t *c = (coalesce_ctx_t *)calloc(1, sizeof(*c));
+    if (!c) return NULL;
+
+    c->cap = batch_bytes;
+    c->timeout_ms = 10000;
+    c->buf = batch_bytes ? (uint8_t *)malloc(batch_bytes) : NULL;
+    c->lock = xSemaphoreCreateMutex();
+    c->tcp = esp_transport_tcp_init();
+
+    esp_transport_handle_t t = esp_transport_init();
+    if ((batch_bytes && !c->buf) || !c->lock || !c->tcp || !t) {
+        if (t) esp_transport_destroy(t);
+        if (c->tcp) esp_transport_destroy(c->tcp);
+        if (c->lock) vSemaphoreDelete(c->lock);
+        free(c->buf);
+        free(c);
+        return NULL;
+    }
+
+    esp_transport_set_context_data(t, c);
+    esp_transport_set_func(t, co_connect, co_read, co_write, co_close, co_poll_read, co_poll_write, co_destroy);
+    esp_transport_set_default_port(t, 1883);
+    return t;
+}
+
+void coalesce_transport_begin(esp_transport_handle_t t)
+{
+    coalesce_ctx_t *c = t ? ctx_of(t) : NULL;
+    if (!c) return;
+    xSemaphoreTake(c->lock, portMAX_DELAY);
+    c->batching = true;
+    xSemaphoreGive(c->lock);
+}
+
+esp_err_t coalesce_transport_end(esp_transport_handle_t t)
+{
+    coalesce_ctx_t *c = t ? ctx_of(t) : NULL;
+    if (!c) return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(c->lock, portMAX_DELAY);
+    int ret = flush_locked(c);
+    c->batching = false;
+    xSemaphoreGive(c->lock);
+    return ret < 0 ? ESP_FAIL : ESP_OK;
+}
+
+bool coalesce_transport_writable(esp_transport_handle_t t)
+{
+    coalesce_ctx_t *c = t ? ctx_of(t) : NULL;
+    if (!c) return false;
+    xSemaphoreTake(c->lock, portMAX_DELAY);
+    bool gathered = c->len > 0;
+    xSemaphoreGive(c->lock);
+    return !gathered && esp_transport_poll_write(c->tcp, 0) > 0;
+}
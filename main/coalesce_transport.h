@@ -0,0 +1,53 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef COALESCE_TRANSPORT_H
+#define COALESCE_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Create a TCP transport that can coalesce writes.
+ *
+ * Outside a batch every write goes straight to the socket. Inside a batch,
+ * writes are gathered into a buffer of batch_bytes and sent as one large
+ * socket write when the buffer would overflow or the batch ends. The socket
+ * runs with TCP_NODELAY since batching replaces Nagle. With batch_bytes 0
+ * every write goes straight through and Nagle stays on; the transport is
+ * then only there for coalesce_transport_writable().
+ *
+ * The handle is owned by the MQTT client once passed in its config.
+ */
+esp_transport_handle_t coalesce_transport_create(size_t batch_bytes);
+
+/** @brief Start gathering writes, e.g. the chunks of one frame. */
+void coalesce_transport_begin(esp_transport_handle_t t);
+
+/** @brief Send anything gathered and stop batching. */
+esp_err_t coalesce_transport_end(esp_transport_handle_t t);
+
+/**
+ * @brief True when nothing is gathered and the socket's send buffer has
+ *        room, i.e. select() reports it writable without waiting.
+ *
+ * QoS 0 publishes never enter the MQTT outbox; the client writes them to
+ * the socket on the spot, so a send buffer still full from earlier writes
+ * is where a slow link shows up.
+ */
+bool coalesce_transport_writable(esp_transport_handle_t t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
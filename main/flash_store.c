@@ -9,17 +9,40 @@
 #include <string.h>
 
 #include "esp_log.h"
-#include "esp_spiffs.h"
+#include "cam_trace.h"
 #include "sdkconfig.h"
 
+#if CONFIG_IDF_TARGET_LINUX
+#include <errno.h>
+#include <sys/stat.h>
+#else
+#include "esp_spiffs.h"
+#endif
+
 static const char *TAG = "flash_store";
 
 #ifndef CONFIG_P4_FLASH_MOUNT_PATH
 #define CONFIG_P4_FLASH_MOUNT_PATH "/spiffs"
 #endif
 
+// flash_uploader.c tells the codec from the extension.
+#if CONFIG_P4_CODEC_H264
+#define FRAME_EXT "h264"
+#else
+#define FRAME_EXT "jpg"
+#endif
+
 esp_err_t flash_store_init(void)
 {
+#if CONFIG_IDF_TARGET_LINUX
+    // Host build: "flash" is a plain directory.
+    if (mkdir(CONFIG_P4_FLASH_MOUNT_PATH, 0755) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Cannot create %s: errno %d", CONFIG_P4_FLASH_MOUNT_PATH, errno);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Recording to host directory %s", CONFIG_P4_FLASH_MOUNT_PATH);
+    return ESP_OK;
+#else
     esp_vfs_spiffs_conf_t conf = {
         .base_path = CONFIG_P4_FLASH_MOUNT_PATH,
         .partition_label = "storage",
@@ -41,6 +64,21 @@ esp_err_t flash_store_init(void)
     }
 
     return ESP_OK;
+#endif
+}
+
+static void frame_path(char *path, size_t len, uint32_t clip_id, uint32_t frame_id,
+                       uint32_t ts_ms, uint16_t width, uint16_t height)
+{
+    snprintf(path, len,
+             "%s/clip%u_frame%u_ts%u_w%u_h%u.%s",
+             CONFIG_P4_FLASH_MOUNT_PATH,
+             (unsigned)clip_id,
+             (unsigned)frame_id,
+             (unsigned)ts_ms,
+             (unsigned)width,
+             (unsigned)height,
+             FRAME_EXT);
 }
 
 esp_err_t flash_store_write_frame(uint32_t clip_id,
@@ -54,23 +92,22 @@ esp_err_t flash_store_write_frame(uint32_t clip_id,
     if (!data || len == 0) return ESP_ERR_INVALID_ARG;
 
     char path[128];
-    snprintf(path, sizeof(path),
-             "%s/clip%u_frame%u_ts%u_w%u_h%u.jpg",
-             CONFIG_P4_FLASH_MOUNT_PATH,
-             (unsigned)clip_id,
-             (unsigned)frame_id,
-             (unsigned)ts_ms,
-             (unsigned)width,
-             (unsigned)height);
+    frame_path(path, sizeof(path), clip_id, frame_id, ts_ms, width, height);
 
+    CAM_TRACE_BEGIN(FLASH_OPEN);
     FILE *f = fopen(path, "wb");
+    CAM_TRACE_END(FLASH_OPEN, frame_id);
     if (!f) {
         ESP_LOGE(TAG, "Failed to open %s", path);
         return ESP_FAIL;
     }
 
+    CAM_TRACE_BEGIN(FLASH_WRITE);
     size_t written = fwrite(data, 1, len, f);
+    CAM_TRACE_END(FLASH_WRITE, written);
+    CAM_TRACE_BEGIN(FLASH_CLOSE);
     fclose(f);
+    CAM_TRACE_END(FLASH_CLOSE, frame_id);
 
     if (written != len) {
         ESP_LOGE(TAG, "Short write %s (%u/%u)", path, (unsigned)written, (unsigned)len);
@@ -79,3 +116,14 @@ esp_err_t flash_store_write_frame(uint32_t clip_id,
 
     return ESP_OK;
 }
+
+esp_err_t flash_store_remove_frame(uint32_t clip_id,
+                                   uint32_t frame_id,
+                                   uint32_t ts_ms,
+                                   uint16_t width,
+                                   uint16_t height)
+{
+    char path[128];
+    frame_path(path, sizeof(path), clip_id, frame_id, ts_ms, width, height);
+    return remove(path) == 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
@@ -23,6 +23,11 @@ esp_err_t flash_store_write_frame(uint32_t clip_id,
                                   uint16_t height,
                                   const uint8_t *data,
                                   size_t len);
+esp_err_t flash_store_remove_frame(uint32_t clip_id,
+                                   uint32_t frame_id,
+                                   uint32_t ts_ms,
+                                   uint16_t width,
+                                   uint16_t height);
 
 #ifdef __cplusplus
 }
@@ -18,6 +18,8 @@
 #include "freertos/task.h"
 #include "sdkconfig.h"
 #include "video_packetizer.h"
+#include "frame_pool.h"
+#include "vid_wire.h"
 
 static const char *TAG = "flash_uploader";
 
@@ -31,6 +33,20 @@ static const char *TAG = "flash_uploader";
 #define CONFIG_P4_FLASH_UPLOAD_PERIOD_MS 1000
 #endif
 
+typedef struct {
+    video_frame_meta_t meta;
+    char name[64];
+} recorded_t;
+
+static int by_frame(const void *a, const void *b)
+{
+    const video_frame_meta_t *x = &((const recorded_t *)a)->meta;
+    const video_frame_meta_t *y = &((const recorded_t *)b)->meta;
+    if (x->clip_id != y->clip_id) return x->clip_id < y->clip_id ? -1 : 1;
+    if (x->frame_id != y->frame_id) return x->frame_id < y->frame_id ? -1 : 1;
+    return 0;
+}
+
 static bool parse_meta(const char *name, video_frame_meta_t *meta)
 {
     if (!name || !meta) return false;
@@ -40,15 +56,24 @@ static bool parse_meta(const char *name, video_frame_meta_t *meta)
     unsigned ts_ms = 0;
     unsigned width = 0;
     unsigned height = 0;
+    char ext[8] = "";
 
     int matched = sscanf(
         name,
-        "clip%u_frame%u_ts%u_w%u_h%u.jpg",
-        &clip_id, &frame_id, &ts_ms, &width, &height
+        "clip%u_frame%u_ts%u_w%u_h%u.%7s",
+        &clip_id, &frame_id, &ts_ms, &width, &height, ext
     );
 
-    if (matched != 5) return false;
+    if (matched != 6) return false;
 
+    memset(meta, 0, sizeof(*meta));
+    if (strcmp(ext, "jpg") == 0) {
+        meta->fourcc = VID_FOURCC_MJPG;
+    } else if (strcmp(ext, "h264") == 0) {
+        meta->fourcc = VID_FOURCC_H264;
+    } else {
+        return false;
+    }
     meta->clip_id = clip_id;
     meta->frame_id = frame_id;
     meta->ts_ms = ts_ms;
@@ -57,7 +82,7 @@ static bool parse_meta(const char *name, video_frame_meta_t *meta)
     return true;
 }
 
-static esp_err_t publish_file(const char *path, const video_frame_meta_t *meta)
+static esp_err_t publish_file(const char *path, const video_frame_meta_t *meta, size_t *out_size)
 {
     struct stat st;
     if (stat(path, &st) != 0 || st.st_size <= 0) {
@@ -67,7 +92,10 @@ static esp_err_t publish_file(const char *path, const video_frame_meta_t *meta)
     FILE *f = fopen(path, "rb");
     if (!f) return ESP_FAIL;
 
-    uint8_t *buf = (uint8_t *)malloc((size_t)st.st_size);
+    uint8_t *buf = (uint8_t *)frame_pool_alloc(FRAME_POOL_PSRAM, (size_t)st.st_size);
+    if (!buf) {
+        buf = (uint8_t *)malloc((size_t)st.st_size);
+    }
     if (!buf) {
         fclose(f);
         return ESP_ERR_NO_MEM;
@@ -76,46 +104,110 @@ static esp_err_t publish_file(const char *path, const video_frame_meta_t *meta)
     size_t read = fread(buf, 1, (size_t)st.st_size, f);
     fclose(f);
     if (read != (size_t)st.st_size) {
-        free(buf);
+        frame_pool_free(buf);
         return ESP_FAIL;
     }
 
-    esp_err_t err = video_packetizer_publish_jpeg(meta, buf, (uint32_t)read);
-    free(buf);
+    video_frame_meta_t m = *meta;
+    m.keyframe = m.fourcc != VID_FOURCC_H264 || vid_h264_is_keyframe(buf, read);
+    esp_err_t err = video_packetizer_publish_jpeg(&m, buf, (uint32_t)read);
+    frame_pool_free(buf);
+    *out_size = read;
     return err;
 }
 
-static void uploader_task(void *arg)
+// Recorded frames in (clip_id, frame_id) order. readdir() gives storage or
+// hash order, and receivers drop frames older than the last one they took;
+// H.264 P frames also only decode after the frame before them.
+static esp_err_t list_recorded(recorded_t **out, size_t *out_n)
 {
-    (void)arg;
-    const TickType_t delay = pdMS_TO_TICKS(CONFIG_P4_FLASH_UPLOAD_PERIOD_MS);
+    DIR *d = opendir(CONFIG_P4_FLASH_MOUNT_PATH);
+    if (!d) {
+        ESP_LOGW(TAG, "No flash directory");
+        return ESP_ERR_NOT_FOUND;
+    }
 
-    while (true) {
-        DIR *d = opendir(CONFIG_P4_FLASH_MOUNT_PATH);
-        if (!d) {
-            ESP_LOGW(TAG, "No flash directory");
-            vTaskDelay(delay);
+    recorded_t *list = NULL;
+    size_t n = 0, cap = 0;
+    esp_err_t ret = ESP_OK;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= sizeof(list->name)) continue;
+
+        video_frame_meta_t meta;
+        if (!parse_meta(ent->d_name, &meta)) {
             continue;
         }
-
-        struct dirent *ent;
-        while ((ent = readdir(d)) != NULL) {
-            if (ent->d_name[0] == '.') continue;
-
-            video_frame_meta_t meta;
-            if (!parse_meta(ent->d_name, &meta)) {
-                continue;
+        if (n == cap) {
+            size_t grow = cap ? cap * 2 : 32;
+            recorded_t *bigger = (recorded_t *)realloc(list, grow * sizeof(*list));
+            if (!bigger) {
+                ret = ESP_ERR_NO_MEM;
+                break;
             }
+            list = bigger;
+            cap = grow;
+        }
+        list[n].meta = meta;
+        strcpy(list[n].name, ent->d_name);
+        n++;
+    }
+    closedir(d);
 
-            char path[128];
-            snprintf(path, sizeof(path), "%s/%s", CONFIG_P4_FLASH_MOUNT_PATH, ent->d_name);
+    if (ret != ESP_OK) {
+        free(list);
+        return ret;
+    }
+    if (n > 1) {
+        qsort(list, n, sizeof(*list), by_frame);
+    }
+    *out = list;
+    *out_n = n;
+    return ESP_OK;
+}
 
-            if (publish_file(path, &meta) == ESP_OK) {
-                unlink(path);
-            }
+esp_err_t flash_uploader_run_once(uint32_t *out_frames, size_t *out_bytes)
+{
+    uint32_t frames = 0;
+    size_t bytes = 0;
+
+    recorded_t *list = NULL;
+    size_t n = 0;
+    esp_err_t ret = list_recorded(&list, &n);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        char path[128];
+        snprintf(path, sizeof(path), "%s/%s", CONFIG_P4_FLASH_MOUNT_PATH, list[i].name);
+
+        size_t size = 0;
+        esp_err_t err = publish_file(path, &list[i].meta, &size);
+        if (err == ESP_OK) {
+            unlink(path);
+            frames++;
+            bytes += size;
+        } else if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_STATE) {
+            // Backpressure: keep the file and retry on the next pass.
+            ret = err;
+            break;
         }
+    }
 
-        closedir(d);
+    free(list);
+    if (out_frames) *out_frames = frames;
+    if (out_bytes) *out_bytes = bytes;
+    return ret;
+}
+
+static void uploader_task(void *arg)
+{
+    (void)arg;
+    const TickType_t delay = pdMS_TO_TICKS(CONFIG_P4_FLASH_UPLOAD_PERIOD_MS);
+
+    while (true) {
+        flash_uploader_run_once(NULL, NULL);
         vTaskDelay(delay);
     }
 }
@@ -6,6 +6,9 @@
 #ifndef FLASH_UPLOADER_H
 #define FLASH_UPLOADER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -14,6 +17,13 @@ extern "C" {
 
 esp_err_t flash_uploader_start(void);
 
+/**
+ * One synchronous upload pass over the flash directory: publish and delete
+ * every recorded frame, in (clip_id, frame_id) order. Stops early with ESP_ERR_NO_MEM or
+ * ESP_ERR_INVALID_STATE on MQTT backpressure; the remaining files stay.
+ */
+esp_err_t flash_uploader_run_once(uint32_t *out_frames, size_t *out_bytes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,268 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "frame_crop.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_video.h"
+#include "pixfmt.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/ppa.h"
+#include "esp_cache.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+static const char *TAG = "frame_crop";
+#endif
+
+#define SCALE_ONE   16          // the PPA scales in 1/16 steps
+#define SCALE_MAX   (256 * SCALE_ONE - 1)
+
+// Smallest block that keeps chroma whole, and its bytes per line: 1x1 for
+// RGB565, 2x1 (Y0 U Y1 V) for YUV422, 2x2 (U Y Y over V Y Y) for YUV420.
+typedef struct {
+    uint32_t w;
+    uint32_t h;
+    uint32_t bytes;
+} unit_t;
+
+static bool fmt_unit(uint32_t fmt, unit_t *u)
+{
+    switch (fmt) {
+    case APP_VIDEO_FMT_RGB565: *u = (unit_t){ 1, 1, 2 }; return true;
+    case APP_VIDEO_FMT_YUV422: *u = (unit_t){ 2, 1, 4 }; return true;
+    case APP_VIDEO_FMT_YUV420: *u = (unit_t){ 2, 2, 3 }; return true;
+    default: return false;
+    }
+}
+
+static const char *parse_size(const char *s, uint32_t *w, uint32_t *h)
+{
+    char *end;
+    *w = strtoul(s, &end, 10);
+    if (end == s || (*end != 'x' && *end != 'X')) return NULL;
+    s = end + 1;
+    *h = strtoul(s, &end, 10);
+    return end == s ? NULL : end;
+}
+
+int frame_roi_parse(const char *spec, frame_roi_t *rois, int max)
+{
+    int n = 0;
+    const char *s = spec;
+    while (*s) {
+        if (*s == ';' || *s == ' ') {
+            s++;
+            continue;
+        }
+        if (n >= max) return -1;
+        frame_roi_t r = { 0 };
+        char *end;
+        r.x = strtoul(s, &end, 10);
+        if (end == s || *end != ',') return -1;
+        s = end + 1;
+        r.y = strtoul(s, &end, 10);
+        if (end == s || *end != ',') return -1;
+        s = parse_size(end + 1, &r.w, &r.h);
+        if (!s) return -1;
+        if (*s == '@') {
+            s = parse_size(s + 1, &r.out_w, &r.out_h);
+            if (!s) return -1;
+        }
+        if (*s && *s != ';') return -1;
+        rois[n++] = r;
+    }
+    return n;
+}
+
+// Largest step count at or below the wanted one whose output is a whole
+// number of units, so out / in is exactly steps / SCALE_ONE.
+static uint32_t fit_scale(uint32_t in, uint32_t *out, uint32_t unit)
+{
+    uint32_t steps = (uint32_t)(((uint64_t)*out * SCALE_ONE) / in);
+    if (steps > SCALE_MAX) steps = SCALE_MAX;
+    for (; steps > 0; steps--) {
+        uint64_t px = (uint64_t)in * steps;
+        if (px % SCALE_ONE == 0 && (px / SCALE_ONE) % unit == 0) break;
+    }
+    if (steps == 0) steps = SCALE_ONE;
+    *out = (uint32_t)((uint64_t)in * steps / SCALE_ONE);
+    return steps;
+}
+
+esp_err_t frame_roi_fit(frame_roi_t *roi, uint32_t fmt, uint32_t width, uint32_t height)
+{
+    unit_t u;
+    if (!fmt_unit(fmt, &u)) return ESP_ERR_NOT_SUPPORTED;
+    if (roi->x >= width || roi->y >= height) return ESP_ERR_INVALID_SIZE;
+
+    roi->x -= roi->x % u.w;
+    roi->y -= roi->y % u.h;
+    if (roi->w > width - roi->x) roi->w = width - roi->x;
+    if (roi->h > height - roi->y) roi->h = height - roi->y;
+    roi->w -= roi->w % u.w;
+    roi->h -= roi->h % u.h;
+    if (roi->w == 0 || roi->h == 0) return ESP_ERR_INVALID_SIZE;
+
+    if (roi->out_w == 0 || roi->out_h == 0) {
+        roi->out_w = roi->w;
+        roi->out_h = roi->h;
+    }
+    fit_scale(roi->w, &roi->out_w, u.w);
+    fit_scale(roi->h, &roi->out_h, u.h);
+    return ESP_OK;
+}
+
+static void crop_cpu(const uint8_t *src, uint32_t width, const unit_t *u, const frame_roi_t *roi, uint8_t *dst)
+{
+    const size_t src_stride = (size_t)width / u->w * u->bytes;
+    const size_t dst_stride = (size_t)roi->out_w / u->w * u->bytes;
+    const uint8_t *origin = src + (size_t)roi->y * src_stride + (size_t)roi->x / u->w * u->bytes;
+
+    if (roi->out_w == roi->w && roi->out_h == roi->h) {
+        for (uint32_t l = 0; l < roi->h; l++) {
+            memcpy(dst + l * dst_stride, origin + l * src_stride, dst_stride);
+        }
+        return;
+    }
+
+    // Nearest neighbour on whole units, 16.16 fixed point steps.
+    const uint32_t in_w = roi->w / u->w, in_h = roi->h / u->h;
+    const uint32_t out_w = roi->out_w / u->w, out_h = roi->out_h / u->h;
+    const uint32_t step_x = (in_w << 16) / out_w, step_y = (in_h << 16) / out_h;
+    for (uint32_t j = 0; j < out_h; j++) {
+        uint32_t sj = (j * step_y) >> 16;
+        for (uint32_t l = 0; l < u->h; l++) {
+            const uint8_t *s = origin + ((size_t)sj * u->h + l) * src_stride;
+            uint8_t *d = dst + ((size_t)j * u->h + l) * dst_stride;
+            for (uint32_t i = 0; i < out_w; i++) {
+                memcpy(d, s + (size_t)((i * step_x) >> 16) * u->bytes, u->bytes);
+                d += u->bytes;
+            }
+        }
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static ppa_client_handle_t s_ppa;
+static bool s_ppa_failed;       // warned once, CPU from then on
+
+static size_t cache_align(void)
+{
+    size_t align = 0;
+    esp_cache_get_alignment(MALLOC_CAP_SPIRAM, &align);
+    return align ? align : 64;
+}
+
+// The PPA has no packed 4:2:2 mode; anything but ESP_OK falls back to the CPU.
+static esp_err_t crop_ppa(const uint8_t *src, uint32_t fmt, uint32_t width, uint32_t height,
+                          const frame_roi_t *roi, uint8_t *dst, size_t dst_len)
+{
+    ppa_srm_color_mode_t cm;
+    if (fmt == APP_VIDEO_FMT_RGB565) {
+        cm = PPA_SRM_COLOR_MODE_RGB565;
+    } else if (fmt == APP_VIDEO_FMT_YUV420) {
+        cm = PPA_SRM_COLOR_MODE_YUV420;
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (s_ppa_failed) return ESP_FAIL;
+
+    if (!s_ppa) {
+        ppa_client_config_t cfg = {
+            .oper_type = PPA_OPERATION_SRM,
+            .max_pending_trans_num = 1,
+        };
+        esp_err_t err = ppa_register_client(&cfg, &s_ppa);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "PPA unavailable, cropping on the CPU: %s", esp_err_to_name(err));
+            s_ppa_failed = true;
+            return err;
+        }
+    }
+
+    size_t align = cache_align();
+    ppa_srm_oper_config_t op = {
+        .in = {
+            .buffer = src,
+            .pic_w = width,
+            .pic_h = height,
+            .block_w = roi->w,
+            .block_h = roi->h,
+            .block_offset_x = roi->x,
+            .block_offset_y = roi->y,
+            .srm_cm = cm,
+        },
+        .out = {
+            .buffer = dst,
+            // frame_crop_alloc() rounded the buffer up to whole cache lines.
+            .buffer_size = (dst_len + align - 1) & ~(align - 1),
+            .pic_w = roi->out_w,
+            .pic_h = roi->out_h,
+            .srm_cm = cm,
+        },
+        .rotation_angle = PPA_SRM_ROTATION_ANGLE_0,
+        // Exact: frame_roi_fit() left whole 1/16 steps.
+        .scale_x = (float)roi->out_w / (float)roi->w,
+        .scale_y = (float)roi->out_h / (float)roi->h,
+        .mode = PPA_TRANS_MODE_BLOCKING,
+    };
+    esp_err_t err = ppa_do_scale_rotate_mirror(s_ppa, &op);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "PPA crop failed, cropping on the CPU: %s", esp_err_to_name(err));
+        s_ppa_failed = true;
+    }
+    return err;
+}
+#endif
+
+uint8_t *frame_crop_alloc(size_t len)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return (uint8_t *)malloc(len);
+#else
+    // The PPA writes whole cache lines.
+    size_t align = cache_align();
+    return (uint8_t *)heap_caps_aligned_calloc(align, 1, (len + align - 1) & ~(align - 1),
+                                               MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+}
+
+void frame_crop_free(uint8_t *buf)
+{
+    free(buf);
+}
+
+esp_err_t frame_crop(const uint8_t *src, uint32_t fmt, uint32_t width, uint32_t height,
+                     const frame_roi_t *roi, uint8_t *dst, size_t dst_len)
+{
+    unit_t u;
+    if (!src || !roi || !dst) return ESP_ERR_INVALID_ARG;
+    if (!fmt_unit(fmt, &u)) return ESP_ERR_NOT_SUPPORTED;
+    if (roi->x + roi->w > width || roi->y + roi->h > height) return ESP_ERR_INVALID_SIZE;
+    if (dst_len < pixfmt_frame_size(fmt, roi->out_w, roi->out_h)) return ESP_ERR_INVALID_SIZE;
+
+#if !CONFIG_IDF_TARGET_LINUX
+    if (crop_ppa(src, fmt, width, height, roi, dst, dst_len) == ESP_OK) return ESP_OK;
+#endif
+    crop_cpu(src, width, &u, roi, dst);
+    return ESP_OK;
+}
+
+void frame_crop_close(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    if (s_ppa) {
+        ppa_unregister_client(s_ppa);
+        s_ppa = NULL;
+    }
+    s_ppa_failed = false;
+#endif
+}
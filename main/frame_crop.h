@@ -0,0 +1,75 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef FRAME_CROP_H
+#define FRAME_CROP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_ROI_MAX   4
+
+/** @brief A region of the captured frame and the size it is encoded at. */
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+    uint32_t w;
+    uint32_t h;
+    uint32_t out_w;             // == w unless zoomed or scaled down
+    uint32_t out_h;
+} frame_roi_t;
+
+/**
+ * @brief Parse a region list: "x,y,WxH" entries separated by ';', each
+ *        optionally followed by "@WxH" for the output size.
+ *
+ * "160,120,320x240;0,0,640x480@320x240" is a 320x240 window in the middle
+ * of a VGA frame plus the whole frame at half size.
+ *
+ * @return Number of regions (0 for an empty list), or -1 on a syntax error.
+ */
+int frame_roi_parse(const char *spec, frame_roi_t *rois, int max);
+
+/**
+ * @brief Fit a region to a frame of @p fmt, width x height.
+ *
+ * Clips it to the frame, rounds position and sizes down to whole chroma
+ * blocks and the output size to a scale the crop engine can do, so the
+ * host and target produce the same sizes.
+ *
+ * @return ESP_ERR_INVALID_SIZE when nothing of the region is left.
+ */
+esp_err_t frame_roi_fit(frame_roi_t *roi, uint32_t fmt, uint32_t width, uint32_t height);
+
+/** @brief Buffer the crop engine can write an output of @p len bytes to. */
+uint8_t *frame_crop_alloc(size_t len);
+void frame_crop_free(uint8_t *buf);
+
+/**
+ * @brief Copy a fitted region of @p src to @p dst at roi->out_w x roi->out_h.
+ *
+ * On target the PPA does it (RGB565 and YUV420); other formats and the
+ * host build use a CPU copy with nearest-neighbour scaling.
+ *
+ * @param dst From frame_crop_alloc(), at least pixfmt_frame_size() of the
+ *            output.
+ */
+esp_err_t frame_crop(const uint8_t *src, uint32_t fmt, uint32_t width, uint32_t height,
+                     const frame_roi_t *roi, uint8_t *dst, size_t dst_len);
+
+/** @brief Release the crop engine; the next frame_crop() takes it again. */
+void frame_crop_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Frame encoder used by the capture path, MJPEG or H.264 (CONFIG_P4_CODEC).
+ * On the ESP32-P4 these are the JPEG hardware engine (frame_encoder_hw.c)
+ * and the H.264 hardware encoder (frame_encoder_h264_hw.c); the host build
+ * uses software encoders (frame_encoder_sw.c, frame_encoder_h264_sw.c).
+ * Quality and subsampling come from CONFIG_P4_JPEG_QUALITY and
+ * CONFIG_P4_JPEG_SUBSAMPLE_420; H.264 maps quality to a QP and inserts an
+ * IDR every CONFIG_P4_H264_GOP frames.
+ *
+ * Input is whatever capture negotiated from frame_encoder_input_formats();
+ * layouts are described in pixfmt.h.
+ */
+
+/**
+ * @brief Capture formats this encoder takes (APP_VIDEO_FMT_* codes), best
+ *        first. YUV formats skip the encoder's own colour conversion; RGB565
+ *        is always last and always accepted.
+ *
+ * @return Number of entries in @p fmts.
+ */
+size_t frame_encoder_input_formats(const uint32_t **fmts);
+
+/**
+ * @brief Prepare the encoder for frames of the given size and format.
+ *
+ * Cheap when nothing changed; a resolution change keeps the output buffer
+ * if it is already large enough.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED for a format not in the input list.
+ */
+esp_err_t frame_encoder_open(uint32_t width, uint32_t height, uint32_t pixfmt);
+
+/**
+ * @brief Encode one frame in the format given to frame_encoder_open().
+ *
+ * @param out Set to the encoder-owned JPEG or Annex B buffer, valid until
+ *            the next call.
+ * @param out_keyframe Optional; set when the frame decodes on its own (every
+ *            JPEG, H.264 IDR pictures, which carry SPS and PPS in front).
+ */
+esp_err_t frame_encoder_encode(const uint8_t *frame, size_t len,
+                               const uint8_t **out, uint32_t *out_size, bool *out_keyframe);
+
+/**
+ * @brief Make the next encoded frame a keyframe. Safe from any task; used
+ *        after a drop so receivers can resume. No-op for MJPEG.
+ */
+void frame_encoder_request_keyframe(void);
+
+/** @brief VID_FOURCC_MJPG or VID_FOURCC_H264 (vid_wire.h). */
+uint32_t frame_encoder_fourcc(void);
+
+/**
+ * @brief Override CONFIG_P4_JPEG_QUALITY and CONFIG_P4_JPEG_SUBSAMPLE_420
+ *        for the following frames. Kept across close/open.
+ */
+esp_err_t frame_encoder_set_quality(int quality, bool subsample_420);
+
+void frame_encoder_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
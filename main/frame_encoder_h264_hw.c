@@ -0,0 +1,314 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * H.264 on the ESP32-P4 hardware encoder (esp_h264 component). The engine
+ * takes O_UYY_E_VYY 4:2:0 input (odd lines U Y Y, even lines V Y Y), the
+ * ISP's YUV420 layout, which only needs its range narrowing; RGB565 frames
+ * are converted in full. Rate control aims at
+ * CONFIG_P4_H264_BITRATE_KBPS without going below the QP derived from the
+ * quality setting.
+ */
+#include "frame_encoder.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "esp_h264_alloc.h"
+#include "esp_h264_enc_single.h"
+#include "esp_h264_enc_single_hw.h"
+#include "esp_h264_enc_param_hw.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "app_video.h"
+#include "pixfmt.h"
+#include "vid_wire.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "enc_h264_hw";
+
+#define H264_ALIGN          64      // DMA alignment of the in/out buffers
+#define H264_FPS            30      // rate control only; timestamps come from the capture path
+#define H264_QP_HEADROOM    10      // rate control may raise the QP this far above the quality one
+#define H264_GOP            (CONFIG_P4_H264_GOP ? CONFIG_P4_H264_GOP : 255)
+
+static struct {
+    esp_h264_enc_handle_t engine;
+    esp_h264_enc_param_hw_handle_t param;   // NULL when the engine gave none
+    bool idr_forced;            // the GOP was just restarted for an IDR
+    bool idr_by_restart;        // restarting the GOP gave no IDR; restart the engine instead
+    uint8_t *yuv;
+    size_t yuv_size;
+    uint8_t *buf;
+    size_t buf_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixfmt;
+    int quality;
+    uint32_t pts;
+    bool restart;               // reopen: new QP range for a quality change, or the engine failed
+} s_enc = {
+    .quality = CONFIG_P4_JPEG_QUALITY,
+};
+
+static atomic_bool s_want_idr;
+
+static int quality_to_qp(int quality)
+{
+    int qp = 46 - quality * 36 / 100;
+    return qp < 10 ? 10 : qp > 51 ? 51 : qp;
+}
+
+static void free_engine(void)
+{
+    if (s_enc.engine) {
+        esp_h264_enc_close(s_enc.engine);
+        esp_h264_enc_del(s_enc.engine);
+        s_enc.engine = NULL;
+        s_enc.param = NULL;
+    }
+}
+
+// A freshly opened engine starts with an IDR.
+static esp_err_t start_engine(void)
+{
+    free_engine();
+    int qp = quality_to_qp(s_enc.quality);
+    esp_h264_enc_cfg_hw_t cfg = {
+        .pic_type = ESP_H264_RAW_FMT_O_UYY_E_VYY,
+        .gop = H264_GOP,
+        .fps = H264_FPS,
+        .res = {
+            .width = (uint16_t)s_enc.width,
+            .height = (uint16_t)s_enc.height,
+        },
+        .rc = {
+            .bitrate = CONFIG_P4_H264_BITRATE_KBPS * 1000,
+            .qp_min = (uint8_t)qp,
+            .qp_max = (uint8_t)(qp + H264_QP_HEADROOM > 51 ? 51 : qp + H264_QP_HEADROOM),
+        },
+    };
+    esp_h264_err_t ret = esp_h264_enc_hw_new(&cfg, &s_enc.engine);
+    if (ret == ESP_H264_ERR_OK) {
+        ret = esp_h264_enc_open(s_enc.engine);
+    }
+    if (ret != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "H.264 engine start failed (%d)", (int)ret);
+        if (s_enc.engine) {
+            esp_h264_enc_del(s_enc.engine);
+            s_enc.engine = NULL;
+        }
+        return ESP_FAIL;
+    }
+    if (esp_h264_enc_hw_get_param_hd(s_enc.engine, &s_enc.param) != ESP_H264_ERR_OK) {
+        s_enc.param = NULL;
+    }
+    s_enc.restart = false;
+    return ESP_OK;
+}
+
+// Setting the GOP starts a new one, so the next picture is an IDR, and the
+// engine keeps its rate control state; tearing it down and opening a new
+// one costs far more and restarts rate control cold. The engine is only
+// restarted when it has no parameter handle or the GOP restart did not
+// give an IDR (see frame_encoder_encode()).
+static esp_err_t force_idr(void)
+{
+    if (s_enc.param && !s_enc.idr_by_restart &&
+        esp_h264_enc_set_gop(&s_enc.param->base, H264_GOP) == ESP_H264_ERR_OK) {
+        s_enc.idr_forced = true;
+        return ESP_OK;
+    }
+    return start_engine();
+}
+
+static void free_buffers(void)
+{
+    if (s_enc.yuv) {
+        esp_h264_free(s_enc.yuv);
+        s_enc.yuv = NULL;
+    }
+    if (s_enc.buf) {
+        esp_h264_free(s_enc.buf);
+        s_enc.buf = NULL;
+    }
+    s_enc.yuv_size = 0;
+    s_enc.buf_size = 0;
+}
+
+static const uint32_t s_input_fmts[] = { APP_VIDEO_FMT_YUV420, APP_VIDEO_FMT_RGB565 };
+
+size_t frame_encoder_input_formats(const uint32_t **fmts)
+{
+    *fmts = s_input_fmts;
+    return sizeof(s_input_fmts) / sizeof(s_input_fmts[0]);
+}
+
+esp_err_t frame_encoder_open(uint32_t width, uint32_t height, uint32_t pixfmt)
+{
+    if (width == 0 || height == 0) return ESP_ERR_INVALID_ARG;
+    if (pixfmt != APP_VIDEO_FMT_YUV420 && pixfmt != APP_VIDEO_FMT_RGB565) return ESP_ERR_NOT_SUPPORTED;
+    s_enc.pixfmt = pixfmt;
+    if (s_enc.engine && s_enc.width == width && s_enc.height == height && !s_enc.restart) {
+        return ESP_OK;
+    }
+    // The engine codes whole macroblocks and has no cropping.
+    if ((width | height) & 15) {
+        ESP_LOGE(TAG, "%" PRIu32 "x%" PRIu32 " is not a multiple of 16", width, height);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t yuv_need = (size_t)width * height * 3 / 2;
+    if (!s_enc.yuv || s_enc.yuv_size < yuv_need) {
+        free_buffers();
+        uint32_t actual = 0;
+        s_enc.yuv = (uint8_t *)esp_h264_aligned_calloc(H264_ALIGN, 1, yuv_need, &actual,
+                                                        MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+        s_enc.yuv_size = s_enc.yuv ? actual : 0;
+        // An I picture never comes close to the raw size at sane QPs.
+        s_enc.buf = (uint8_t *)esp_h264_aligned_calloc(H264_ALIGN, 1, yuv_need, &actual,
+                                                        MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+        s_enc.buf_size = s_enc.buf ? actual : 0;
+        if (!s_enc.yuv || !s_enc.buf) {
+            ESP_LOGE(TAG, "H.264 buffer alloc failed");
+            free_buffers();
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_enc.width = width;
+    s_enc.height = height;
+    esp_err_t err = start_engine();
+    if (err != ESP_OK) return err;
+    atomic_store(&s_want_idr, false);
+    ESP_LOGI(TAG, "H.264 engine %" PRIu32 "x%" PRIu32 " %s qp>=%d gop=%d %d kbit/s", width, height,
+             pixfmt_name(pixfmt), quality_to_qp(s_enc.quality), CONFIG_P4_H264_GOP,
+             CONFIG_P4_H264_BITRATE_KBPS);
+    return ESP_OK;
+}
+
+// RGB565 to limited-range BT.601 O_UYY_E_VYY: each 2x2 block puts its Cb
+// before the pair on the first line and its Cr before the pair on the second.
+static void convert(const uint16_t *px)
+{
+    const uint32_t W = s_enc.width, H = s_enc.height;
+    uint8_t *o = s_enc.yuv;
+    for (uint32_t y = 0; y < H; y += 2) {
+        uint8_t *l0 = o + (size_t)y * W * 3 / 2;
+        uint8_t *l1 = l0 + W * 3 / 2;
+        for (uint32_t x = 0; x < W; x += 2) {
+            int sr = 0, sg = 0, sb = 0;
+            uint8_t luma[4];
+            for (int k = 0; k < 4; k++) {
+                uint16_t p = px[(y + (k >> 1)) * W + x + (k & 1)];
+                int r = (p >> 11) & 0x1F, g = (p >> 5) & 0x3F, b = p & 0x1F;
+                r = (r << 3) | (r >> 2);
+                g = (g << 2) | (g >> 4);
+                b = (b << 3) | (b >> 2);
+                luma[k] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                sr += r;
+                sg += g;
+                sb += b;
+            }
+            *l0++ = (uint8_t)(((-38 * sr - 74 * sg + 112 * sb + 512) >> 10) + 128);
+            *l0++ = luma[0];
+            *l0++ = luma[1];
+            *l1++ = (uint8_t)(((112 * sr - 94 * sg - 18 * sb + 512) >> 10) + 128);
+            *l1++ = luma[2];
+            *l1++ = luma[3];
+        }
+    }
+}
+
+esp_err_t frame_encoder_encode(const uint8_t *frame, size_t len,
+                               const uint8_t **out, uint32_t *out_size, bool *out_keyframe)
+{
+    if (!s_enc.engine) return ESP_ERR_INVALID_STATE;
+    if (len < pixfmt_frame_size(s_enc.pixfmt, s_enc.width, s_enc.height)) return ESP_ERR_INVALID_SIZE;
+
+    if (s_enc.restart) {
+        esp_err_t err = start_engine();
+        if (err != ESP_OK) return err;
+        atomic_store(&s_want_idr, false);
+    } else if (atomic_exchange(&s_want_idr, false)) {
+        esp_err_t err = force_idr();
+        if (err != ESP_OK) return err;
+    }
+
+    // YUV420 still goes through s_enc.yuv for the range change, but that is
+    // a table lookup per byte rather than the colour conversion.
+    if (s_enc.pixfmt == APP_VIDEO_FMT_YUV420) {
+        pixfmt_yuv420_to_limited(frame, s_enc.yuv, s_enc.width, s_enc.height);
+    } else {
+        convert((const uint16_t *)frame);
+    }
+    esp_h264_enc_in_frame_t in = {
+        .raw_data = {
+            .buffer = s_enc.yuv,
+            .len = (uint32_t)((size_t)s_enc.width * s_enc.height * 3 / 2),
+        },
+        .pts = s_enc.pts++,
+    };
+    esp_h264_enc_out_frame_t enc_out = {
+        .raw_data = {
+            .buffer = s_enc.buf,
+            .len = (uint32_t)s_enc.buf_size,
+        },
+    };
+    esp_h264_err_t ret = esp_h264_enc_process(s_enc.engine, &in, &enc_out);
+    if (ret != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "H.264 encode failed (%d)", (int)ret);
+        // The engine state is unknown; the next frame starts over.
+        s_enc.idr_forced = false;
+        s_enc.restart = true;
+        return ESP_FAIL;
+    }
+
+    bool idr = enc_out.frame_type == ESP_H264_FRAME_TYPE_IDR;
+    if (s_enc.idr_forced && !idr) {
+        ESP_LOGW(TAG, "GOP restart gave no IDR, restarting the engine for IDRs instead");
+        s_enc.idr_by_restart = true;
+        atomic_store(&s_want_idr, true);
+    }
+    s_enc.idr_forced = false;
+
+    *out = s_enc.buf;
+    *out_size = enc_out.length;
+    if (out_keyframe) *out_keyframe = idr;
+    return ESP_OK;
+}
+
+esp_err_t frame_encoder_set_quality(int quality, bool subsample_420)
+{
+    (void)subsample_420;    // the engine is 4:2:0 only
+    if (quality < 1 || quality > 100) return ESP_ERR_INVALID_ARG;
+    if (quality != s_enc.quality) {
+        s_enc.quality = quality;
+        s_enc.restart = s_enc.engine != NULL;
+    }
+    return ESP_OK;
+}
+
+void frame_encoder_request_keyframe(void)
+{
+    atomic_store(&s_want_idr, true);
+}
+
+uint32_t frame_encoder_fourcc(void)
+{
+    return VID_FOURCC_H264;
+}
+
+void frame_encoder_close(void)
+{
+    free_engine();
+    free_buffers();
+    s_enc.width = 0;
+    s_enc.height = 0;
+    s_enc.pixfmt = 0;
+    s_enc.restart = false;
+}
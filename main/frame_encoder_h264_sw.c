@@ -0,0 +1,1375 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * H.264 encoder for the host build: YUV420 or RGB565 in, Constrained Baseline out
+ * (CAVLC, one slice per picture, in-loop deblocking off, constant QP from
+ * the quality setting). IDR pictures are all Intra 16x16; P pictures pick
+ * P_Skip, a full-pel 16x16 motion vector or Intra 16x16 per macroblock.
+ * Macroblocks that would code larger than raw fall back to I_PCM. Like the
+ * JPEG one, simple rather than fast.
+ */
+#include "frame_encoder.h"
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "app_video.h"
+#include "pixfmt.h"
+#include "vid_wire.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "enc_h264_sw";
+
+#define MAX_FRAME_NUM       256     // log2_max_frame_num = 8
+#define PCM_BITS            (384 * 8)
+#define MB_SLACK_BYTES      2048    // worst case coded macroblock before the I_PCM fallback
+#define ME_RANGE            32      // full-pel search window, each direction
+
+#define MB_TYPE_I16         1       // + pred mode + 4 * chroma cbp + 12 * (luma cbp != 0)
+#define MB_TYPE_I_PCM       25
+#define MB_TYPE_P_INTRA     5       // intra mb_type offset in P slices
+
+enum { PRED_V = 0, PRED_H, PRED_DC };
+
+typedef struct {
+    int8_t ref;                 // 0 inter or skip, -1 intra
+    int16_t mvx;                // quarter pel
+    int16_t mvy;
+} mb_mv_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t bits;
+    bool overflow;
+} bitw_t;
+
+static struct {
+    bool ready;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixfmt;
+    int mbw;
+    int mbh;
+    int quality;
+    int qp;
+    uint32_t frame_num;
+    uint32_t since_idr;
+    uint16_t idr_id;
+    bool have_ref;
+    uint8_t *src[3];            // Y, Cb, Cr of the input, MB aligned
+    uint8_t *cur[3];            // reconstruction being coded
+    uint8_t *ref[3];            // previous reconstruction
+    uint8_t *nz[3];             // total_coeff per 4x4 block, for nC
+    mb_mv_t *mv;
+    uint8_t *rbsp;
+    size_t rbsp_cap;
+    uint8_t *buf;
+    size_t buf_size;
+} s_enc = {
+    .quality = CONFIG_P4_JPEG_QUALITY,
+};
+
+static atomic_bool s_want_idr;
+
+// ---------------------------------------------------------------------------
+// Tables (ITU-T H.264 clause 8.5 and 9.2)
+
+static const uint8_t s_zigzag[16] = { 0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15 };
+
+// Raster position in 4x4 units of luma4x4BlkIdx.
+static const uint8_t s_blk_x[16] = { 0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 0, 1, 2, 3, 2, 3 };
+static const uint8_t s_blk_y[16] = { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 3, 3, 2, 2, 3, 3 };
+
+// Forward quantisation multipliers and dequantisation scales per QP % 6,
+// for positions (even, even), (odd, odd) and the rest.
+static const int s_mf[6][3] = {
+    { 13107, 5243, 8066 }, { 11916, 4660, 7490 }, { 10082, 4194, 6554 },
+    { 9362, 3647, 5825 }, { 8192, 3355, 5243 }, { 7282, 2893, 4559 },
+};
+static const int s_v[6][3] = {
+    { 10, 16, 13 }, { 11, 18, 14 }, { 13, 20, 16 }, { 14, 23, 18 }, { 16, 25, 20 }, { 18, 29, 23 },
+};
+
+static const uint8_t s_chroma_qp[52] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,
+    26, 27, 28, 29, 29, 30, 31, 32, 32, 33, 34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38, 39, 39, 39, 39,
+};
+
+// coded_block_pattern -> codeNum for inter macroblocks (Table 9-4).
+static const uint8_t s_cbp_inter_code[48] = {
+    0, 2, 3, 7, 4, 8, 17, 13, 5, 18, 9, 14, 10, 15, 16, 11,
+    1, 32, 33, 36, 34, 37, 44, 40, 35, 45, 38, 41, 39, 42, 43, 19,
+    6, 24, 25, 20, 26, 21, 46, 28, 27, 47, 22, 29, 23, 30, 31, 12,
+};
+
+// coeff_token [nC table][total_coeff * 4 + trailing_ones]
+static const uint8_t s_ct_len[4][68] = {
+    {
+        1, 0, 0, 0, 6, 2, 0, 0, 8, 6, 3, 0, 9, 8, 7, 5, 10, 9, 8, 6,
+        11, 10, 9, 7, 13, 11, 10, 8, 13, 13, 11, 9, 13, 13, 13, 10,
+        14, 14, 13, 11, 14, 14, 14, 13, 15, 15, 14, 14, 15, 15, 15, 14,
+        16, 15, 15, 15, 16, 16, 16, 15, 16, 16, 16, 16, 16, 16, 16, 16,
+    },
+    {
+        2, 0, 0, 0, 6, 2, 0, 0, 6, 5, 3, 0, 7, 6, 6, 4, 8, 6, 6, 4,
+        8, 7, 7, 5, 9, 8, 8, 6, 11, 9, 9, 6, 11, 11, 11, 7,
+        12, 11, 11, 9, 12, 12, 12, 11, 12, 12, 12, 11, 13, 13, 13, 12,
+        13, 13, 13, 13, 13, 14, 13, 13, 14, 14, 14, 13, 14, 14, 14, 14,
+    },
+    {
+        4, 0, 0, 0, 6, 4, 0, 0, 6, 5, 4, 0, 6, 5, 5, 4, 7, 5, 5, 4,
+        7, 5, 5, 4, 7, 6, 6, 4, 7, 6, 6, 4, 8, 7, 7, 5,
+        8, 8, 7, 6, 9, 8, 8, 7, 9, 9, 8, 8, 9, 9, 9, 8,
+        10, 9, 9, 9, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+    },
+    {
+        6, 0, 0, 0, 6, 6, 0, 0, 6, 6, 6, 0, 6, 6, 6, 6, 6, 6, 6, 6,
+        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+        6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    },
+};
+static const uint8_t s_ct_code[4][68] = {
+    {
+        1, 0, 0, 0, 5, 1, 0, 0, 7, 4, 1, 0, 7, 6, 5, 3, 7, 6, 5, 3,
+        7, 6, 5, 4, 15, 6, 5, 4, 11, 14, 5, 4, 8, 10, 13, 4,
+        15, 14, 9, 4, 11, 10, 13, 12, 15, 14, 9, 12, 11, 10, 13, 8,
+        15, 1, 9, 12, 11, 14, 13, 8, 7, 10, 9, 12, 4, 6, 5, 8,
+    },
+    {
+        3, 0, 0, 0, 11, 2, 0, 0, 7, 7, 3, 0, 7, 10, 9, 5, 7, 6, 5, 4,
+        4, 6, 5, 6, 7, 6, 5, 8, 15, 6, 5, 4, 11, 14, 13, 4,
+        15, 10, 9, 4, 11, 14, 13, 12, 8, 10, 9, 8, 15, 14, 13, 12,
+        11, 10, 9, 12, 7, 11, 6, 8, 9, 8, 10, 1, 7, 6, 5, 4,
+    },
+    {
+        15, 0, 0, 0, 15, 14, 0, 0, 11, 15, 13, 0, 8, 12, 14, 12, 15, 10, 11, 11,
+        11, 8, 9, 10, 9, 14, 13, 9, 8, 10, 9, 8, 15, 14, 13, 13,
+        11, 14, 10, 12, 15, 10, 13, 12, 11, 14, 9, 12, 8, 10, 13, 8,
+        13, 7, 9, 12, 9, 12, 11, 10, 5, 8, 7, 6, 1, 4, 3, 2,
+    },
+    {
+        3, 0, 0, 0, 0, 1, 0, 0, 4, 5, 6, 0, 8, 9, 10, 11, 12, 13, 14, 15,
+        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+        32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+        48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+    },
+};
+static const uint8_t s_ct_dc_len[20] = { 2, 0, 0, 0, 6, 1, 0, 0, 6, 6, 3, 0, 6, 7, 7, 6, 6, 8, 8, 7 };
+static const uint8_t s_ct_dc_code[20] = { 1, 0, 0, 0, 7, 1, 0, 0, 4, 6, 1, 0, 3, 3, 2, 5, 2, 3, 2, 0 };
+
+// total_zeros [total_coeff - 1][total_zeros]
+static const uint8_t s_tz_len[15][16] = {
+    { 1, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9 },
+    { 3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6, 6, 6, 6 },
+    { 4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 6, 5, 6 },
+    { 5, 3, 4, 4, 3, 3, 3, 4, 3, 4, 5, 5, 5 },
+    { 4, 4, 4, 3, 3, 3, 3, 3, 4, 5, 4, 5 },
+    { 6, 5, 3, 3, 3, 3, 3, 3, 4, 3, 6 },
+    { 6, 5, 3, 3, 3, 2, 3, 4, 3, 6 },
+    { 6, 4, 5, 3, 2, 2, 3, 3, 6 },
+    { 6, 6, 4, 2, 2, 3, 2, 5 },
+    { 5, 5, 3, 2, 2, 2, 4 },
+    { 4, 4, 3, 3, 1, 3 },
+    { 4, 4, 2, 1, 3 },
+    { 3, 3, 1, 2 },
+    { 2, 2, 1 },
+    { 1, 1 },
+};
+static const uint8_t s_tz_code[15][16] = {
+    { 1, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1 },
+    { 7, 6, 5, 4, 3, 5, 4, 3, 2, 3, 2, 3, 2, 1, 0 },
+    { 5, 7, 6, 5, 4, 3, 4, 3, 2, 3, 2, 1, 1, 0 },
+    { 3, 7, 5, 4, 6, 5, 4, 3, 3, 2, 2, 1, 0 },
+    { 5, 4, 3, 7, 6, 5, 4, 3, 2, 1, 1, 0 },
+    { 1, 1, 7, 6, 5, 4, 3, 2, 1, 1, 0 },
+    { 1, 1, 5, 4, 3, 3, 2, 1, 1, 0 },
+    { 1, 1, 1, 3, 3, 2, 2, 1, 0 },
+    { 1, 0, 1, 3, 2, 1, 1, 1 },
+    { 1, 0, 1, 3, 2, 1, 1 },
+    { 0, 1, 1, 2, 1, 3 },
+    { 0, 1, 1, 1, 1 },
+    { 0, 1, 1, 1 },
+    { 0, 1, 1 },
+    { 0, 1 },
+};
+static const uint8_t s_tz_dc_len[3][4] = { { 1, 2, 3, 3 }, { 1, 2, 2 }, { 1, 1 } };
+static const uint8_t s_tz_dc_code[3][4] = { { 1, 1, 1, 0 }, { 1, 1, 0 }, { 1, 0 } };
+
+// run_before [min(zeros_left, 7) - 1][run_before]
+static const uint8_t s_run_len[7][15] = {
+    { 1, 1 },
+    { 1, 2, 2 },
+    { 2, 2, 2, 2 },
+    { 2, 2, 2, 3, 3 },
+    { 2, 2, 3, 3, 3, 3 },
+    { 2, 3, 3, 3, 3, 3, 3 },
+    { 3, 3, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11 },
+};
+static const uint8_t s_run_code[7][15] = {
+    { 1, 0 },
+    { 1, 1, 0 },
+    { 3, 2, 1, 0 },
+    { 3, 2, 1, 1, 0 },
+    { 3, 2, 3, 2, 1, 0 },
+    { 3, 0, 1, 3, 2, 5, 4 },
+    { 7, 6, 5, 4, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+};
+
+// ---------------------------------------------------------------------------
+// Bit writer. Bytes are cleared as they are entered so a rewind (I_PCM
+// fallback) only has to move the position back.
+
+static void put_bits(bitw_t *w, uint32_t v, int n)
+{
+    for (int i = n - 1; i >= 0; i--) {
+        size_t byte = w->bits >> 3;
+        if (byte >= w->cap) {
+            w->overflow = true;
+            return;
+        }
+        int shift = 7 - (int)(w->bits & 7);
+        if (shift == 7) w->buf[byte] = 0;
+        w->buf[byte] |= (uint8_t)(((v >> i) & 1u) << shift);
+        w->bits++;
+    }
+}
+
+static void put_ue(bitw_t *w, uint32_t v)
+{
+    uint32_t x = v + 1;
+    int len = 32 - __builtin_clz(x);
+    put_bits(w, 0, len - 1);
+    put_bits(w, x, len);
+}
+
+static void put_se(bitw_t *w, int v)
+{
+    put_ue(w, v > 0 ? (uint32_t)(2 * v - 1) : (uint32_t)(-2 * v));
+}
+
+static void rewind_bits(bitw_t *w, size_t bits)
+{
+    w->bits = bits;
+    if (bits & 7) w->buf[bits >> 3] &= (uint8_t)(0xFF << (8 - (bits & 7)));
+}
+
+static void put_trailing_bits(bitw_t *w)
+{
+    put_bits(w, 1, 1);
+    while (w->bits & 7) put_bits(w, 0, 1);
+}
+
+// Append one NAL unit in Annex B form, inserting emulation prevention bytes.
+static bool put_nal(size_t *pos, uint8_t header, const uint8_t *rbsp, size_t len)
+{
+    if (*pos + 5 + len + len / 2 > s_enc.buf_size) return false;
+    uint8_t *o = s_enc.buf + *pos;
+    *o++ = 0;
+    *o++ = 0;
+    *o++ = 0;
+    *o++ = 1;
+    *o++ = header;
+    int zeros = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (zeros == 2 && rbsp[i] <= 3) {
+            *o++ = 3;
+            zeros = 0;
+        }
+        *o++ = rbsp[i];
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+    *pos = (size_t)(o - s_enc.buf);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Parameter sets and slice header
+
+static int level_idc(void)
+{
+    int mbs = s_enc.mbw * s_enc.mbh;
+    if (mbs <= 1620) return 30;
+    if (mbs <= 3600) return 31;
+    if (mbs <= 5120) return 32;
+    if (mbs <= 8192) return 40;
+    return 51;
+}
+
+static void write_sps(bitw_t *w)
+{
+    put_bits(w, 66, 8);             // profile_idc: Baseline
+    put_bits(w, 0xC0, 8);           // constraint_set0/1: Constrained Baseline
+    put_bits(w, (uint32_t)level_idc(), 8);
+    put_ue(w, 0);                   // seq_parameter_set_id
+    put_ue(w, 4);                   // log2_max_frame_num_minus4
+    put_ue(w, 2);                   // pic_order_cnt_type: output order = decode order
+    put_ue(w, 1);                   // max_num_ref_frames
+    put_bits(w, 0, 1);              // gaps_in_frame_num_value_allowed_flag
+    put_ue(w, (uint32_t)s_enc.mbw - 1);
+    put_ue(w, (uint32_t)s_enc.mbh - 1);
+    put_bits(w, 1, 1);              // frame_mbs_only_flag
+    put_bits(w, 1, 1);              // direct_8x8_inference_flag
+    uint32_t crop_r = ((uint32_t)s_enc.mbw * 16 - s_enc.width) / 2;
+    uint32_t crop_b = ((uint32_t)s_enc.mbh * 16 - s_enc.height) / 2;
+    put_bits(w, crop_r || crop_b, 1);
+    if (crop_r || crop_b) {
+        put_ue(w, 0);
+        put_ue(w, crop_r);
+        put_ue(w, 0);
+        put_ue(w, crop_b);
+    }
+    put_bits(w, 0, 1);              // vui_parameters_present_flag
+    put_trailing_bits(w);
+}
+
+static void write_pps(bitw_t *w)
+{
+    put_ue(w, 0);                   // pic_parameter_set_id
+    put_ue(w, 0);                   // seq_parameter_set_id
+    put_bits(w, 0, 1);              // entropy_coding_mode_flag: CAVLC
+    put_bits(w, 0, 1);              // bottom_field_pic_order_in_frame_present_flag
+    put_ue(w, 0);                   // num_slice_groups_minus1
+    put_ue(w, 0);                   // num_ref_idx_l0_default_active_minus1
+    put_ue(w, 0);                   // num_ref_idx_l1_default_active_minus1
+    put_bits(w, 0, 1);              // weighted_pred_flag
+    put_bits(w, 0, 2);              // weighted_bipred_idc
+    put_se(w, 0);                   // pic_init_qp_minus26
+    put_se(w, 0);                   // pic_init_qs_minus26
+    put_se(w, 0);                   // chroma_qp_index_offset
+    put_bits(w, 1, 1);              // deblocking_filter_control_present_flag
+    put_bits(w, 0, 1);              // constrained_intra_pred_flag
+    put_bits(w, 0, 1);              // redundant_pic_cnt_present_flag
+    put_trailing_bits(w);
+}
+
+static void write_slice_header(bitw_t *w, bool idr)
+{
+    put_ue(w, 0);                   // first_mb_in_slice
+    put_ue(w, idr ? 7 : 5);         // slice_type: all I / all P
+    put_ue(w, 0);                   // pic_parameter_set_id
+    put_bits(w, s_enc.frame_num, 8);
+    if (idr) {
+        put_ue(w, s_enc.idr_id);
+    } else {
+        put_bits(w, 0, 1);          // num_ref_idx_active_override_flag
+        put_bits(w, 0, 1);          // ref_pic_list_modification_flag_l0
+    }
+    if (idr) {
+        put_bits(w, 0, 1);          // no_output_of_prior_pics_flag
+        put_bits(w, 0, 1);          // long_term_reference_flag
+    } else {
+        put_bits(w, 0, 1);          // adaptive_ref_pic_marking_mode_flag
+    }
+    put_se(w, s_enc.qp - 26);       // slice_qp_delta
+    put_ue(w, 1);                   // disable_deblocking_filter_idc
+}
+
+// ---------------------------------------------------------------------------
+// Transform and quantisation (clause 8.5.12 for the inverse)
+
+static inline int clip_u8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline int pos_class(int i)
+{
+    int u = i >> 2, v = i & 3;
+    if (!(u & 1) && !(v & 1)) return 0;
+    if ((u & 1) && (v & 1)) return 1;
+    return 2;
+}
+
+static void fdct4(const int in[16], int out[16])
+{
+    int t[16];
+    for (int i = 0; i < 4; i++) {
+        const int *r = in + i * 4;
+        int s03 = r[0] + r[3], d03 = r[0] - r[3], s12 = r[1] + r[2], d12 = r[1] - r[2];
+        t[i * 4 + 0] = s03 + s12;
+        t[i * 4 + 1] = 2 * d03 + d12;
+        t[i * 4 + 2] = s03 - s12;
+        t[i * 4 + 3] = d03 - 2 * d12;
+    }
+    for (int j = 0; j < 4; j++) {
+        int s03 = t[j] + t[12 + j], d03 = t[j] - t[12 + j];
+        int s12 = t[4 + j] + t[8 + j], d12 = t[4 + j] - t[8 + j];
+        out[j] = s03 + s12;
+        out[4 + j] = 2 * d03 + d12;
+        out[8 + j] = s03 - s12;
+        out[12 + j] = d03 - 2 * d12;
+    }
+}
+
+// Rows first, then columns, as the decoder does; adds (x + 32) >> 6 to pred.
+static void idct4_add(const int d[16], uint8_t *dst, int stride)
+{
+    int t[16];
+    for (int i = 0; i < 4; i++) {
+        const int *r = d + i * 4;
+        int e0 = r[0] + r[2], e1 = r[0] - r[2], e2 = (r[1] >> 1) - r[3], e3 = r[1] + (r[3] >> 1);
+        t[i * 4 + 0] = e0 + e3;
+        t[i * 4 + 1] = e1 + e2;
+        t[i * 4 + 2] = e1 - e2;
+        t[i * 4 + 3] = e0 - e3;
+    }
+    for (int j = 0; j < 4; j++) {
+        int g0 = t[j] + t[8 + j], g1 = t[j] - t[8 + j];
+        int g2 = (t[4 + j] >> 1) - t[12 + j], g3 = t[4 + j] + (t[12 + j] >> 1);
+        int h[4] = { g0 + g3, g1 + g2, g1 - g2, g0 - g3 };
+        for (int i = 0; i < 4; i++) {
+            uint8_t *p = dst + i * stride + j;
+            *p = (uint8_t)clip_u8(*p + ((h[i] + 32) >> 6));
+        }
+    }
+}
+
+// Baseline streams must keep level_prefix <= 15; this bound keeps every
+// level codable whatever the suffix length.
+#define LEVEL_MAX 2063
+
+static inline int quant(int w, int mf, int f, int qbits)
+{
+    int a = w < 0 ? -w : w;
+    int l = (a * mf + f) >> qbits;
+    if (l > LEVEL_MAX) l = LEVEL_MAX;
+    return w < 0 ? -l : l;
+}
+
+// Quantise the AC (or, from first = 0, all) coefficients of one block in
+// place and return how many are non-zero.
+static int quant4(int c[16], int qp, bool intra, int first)
+{
+    const int qbits = 15 + qp / 6;
+    const int f = (1 << qbits) / (intra ? 3 : 6);
+    int nz = 0;
+    for (int i = first; i < 16; i++) {
+        c[i] = quant(c[i], s_mf[qp % 6][pos_class(i)], f, qbits);
+        nz += c[i] != 0;
+    }
+    return nz;
+}
+
+static void dequant4(int c[16], int qp, int first)
+{
+    for (int i = first; i < 16; i++) {
+        c[i] = (c[i] * s_v[qp % 6][pos_class(i)]) << (qp / 6);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// CAVLC (clause 9.2)
+
+// coeff holds max_coeff levels in scan order; nc < 0 selects chroma DC.
+static void put_residual(bitw_t *w, const int *coeff, int max_coeff, int nc)
+{
+    int level[16], run[16];
+    int total = 0, trailing = 0, zeros = 0;
+    int last = -1;
+    for (int i = max_coeff - 1; i >= 0; i--) {
+        if (coeff[i]) {
+            if (last < 0) last = i;
+            level[total] = coeff[i];
+            run[total] = 0;
+            total++;
+        } else if (last >= 0) {
+            run[total - 1]++;
+            zeros++;
+        }
+    }
+    for (int i = 0; i < total && i < 3; i++) {
+        if (level[i] != 1 && level[i] != -1) break;
+        trailing++;
+    }
+
+    int idx = total * 4 + trailing;
+    if (nc < 0) {
+        put_bits(w, s_ct_dc_code[idx], s_ct_dc_len[idx]);
+    } else {
+        int t = nc < 2 ? 0 : nc < 4 ? 1 : nc < 8 ? 2 : 3;
+        put_bits(w, s_ct_code[t][idx], s_ct_len[t][idx]);
+    }
+    if (total == 0) return;
+
+    int suffix_len = total > 10 && trailing < 3 ? 1 : 0;
+    for (int i = 0; i < total; i++) {
+        int l = level[i];
+        if (i < trailing) {
+            put_bits(w, l < 0, 1);
+            continue;
+        }
+        int code = l > 0 ? 2 * l - 2 : -2 * l - 1;
+        if (i == trailing && trailing < 3) code -= 2;
+        if (suffix_len == 0) {
+            if (code < 14) {
+                put_bits(w, 1, code + 1);
+            } else if (code < 30) {
+                put_bits(w, 1, 15);
+                put_bits(w, (uint32_t)(code - 14), 4);
+            } else {
+                put_bits(w, 1, 16);
+                put_bits(w, (uint32_t)(code - 30), 12);
+            }
+            suffix_len = 1;
+        } else {
+            if (code < (15 << suffix_len)) {
+                put_bits(w, 1, (code >> suffix_len) + 1);
+                put_bits(w, (uint32_t)code & ((1u << suffix_len) - 1), suffix_len);
+            } else {
+                put_bits(w, 1, 16);
+                put_bits(w, (uint32_t)(code - (15 << suffix_len)), 12);
+            }
+        }
+        int a = l < 0 ? -l : l;
+        if (a > (3 << (suffix_len - 1)) && suffix_len < 6) suffix_len++;
+    }
+
+    if (total < max_coeff) {
+        if (nc < 0) {
+            put_bits(w, s_tz_dc_code[total - 1][zeros], s_tz_dc_len[total - 1][zeros]);
+        } else {
+            put_bits(w, s_tz_code[total - 1][zeros], s_tz_len[total - 1][zeros]);
+        }
+    }
+    for (int i = 0; i < total - 1 && zeros > 0; i++) {
+        int t = zeros > 7 ? 6 : zeros - 1;
+        put_bits(w, s_run_code[t][run[i]], s_run_len[t][run[i]]);
+        zeros -= run[i];
+    }
+}
+
+// nC from the left and upper neighbours in a plane's 4x4 total_coeff grid.
+static int pred_nc(int plane, int gx, int gy)
+{
+    int stride = plane ? s_enc.mbw * 2 : s_enc.mbw * 4;
+    const uint8_t *nz = s_enc.nz[plane];
+    bool a = gx > 0, b = gy > 0;
+    int na = a ? nz[gy * stride + gx - 1] : 0;
+    int nb = b ? nz[(gy - 1) * stride + gx] : 0;
+    if (a && b) return (na + nb + 1) >> 1;
+    return na + nb;
+}
+
+static inline void set_nz(int plane, int gx, int gy, int n)
+{
+    int stride = plane ? s_enc.mbw * 2 : s_enc.mbw * 4;
+    s_enc.nz[plane][gy * stride + gx] = (uint8_t)n;
+}
+
+// ---------------------------------------------------------------------------
+// Macroblock coding. Levels are computed and the reconstruction written
+// first, then the syntax is emitted, so the I_PCM fallback can replace both.
+
+typedef struct {
+    int luma_dc[16];            // Intra 16x16 only, zigzag order
+    int luma[16][16];           // per luma4x4BlkIdx, zigzag order (AC from index 1 for Intra 16x16)
+    int chroma_dc[2][4];
+    int chroma_ac[2][4][16];    // zigzag order, AC from index 1
+    int cbp_luma;               // 8x8 bitmask; 0 or 15 for Intra 16x16
+    int cbp_chroma;             // 0, 1 (DC only) or 2
+    int luma_nz[16];
+    int chroma_nz[2][4];
+} mb_coeffs_t;
+
+static inline int px_stride(int plane)
+{
+    return plane ? s_enc.mbw * 8 : s_enc.mbw * 16;
+}
+
+// Residual of a 4x4 block at (x, y) in plane against pred (stride 16).
+static void residual4(int plane, int x, int y, const uint8_t *pred, int pred_stride, int out[16])
+{
+    const int stride = px_stride(plane);
+    const uint8_t *s = s_enc.src[plane] + y * stride + x;
+    int r[16];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) r[i * 4 + j] = s[i * stride + j] - pred[i * pred_stride + j];
+    }
+    fdct4(r, out);
+}
+
+static inline void to_zigzag(const int raster[16], int zz[16])
+{
+    for (int i = 0; i < 16; i++) zz[i] = raster[s_zigzag[i]];
+}
+
+static inline void from_zigzag(const int zz[16], int raster[16])
+{
+    for (int i = 0; i < 16; i++) raster[s_zigzag[i]] = zz[i];
+}
+
+// Chroma of one macroblock against pred[2][64] (stride 8); writes the
+// reconstruction and fills the chroma part of c.
+static void code_chroma(int mbx, int mby, uint8_t pred[2][64], bool intra, mb_coeffs_t *c)
+{
+    const int qpc = s_chroma_qp[s_enc.qp];
+    const int qbits = 15 + qpc / 6;
+    const int f = (1 << qbits) / (intra ? 3 : 6);
+    const int stride = px_stride(1);
+    bool any_dc = false, any_ac = false;
+
+    for (int p = 0; p < 2; p++) {
+        int dct[4][16];
+        for (int b = 0; b < 4; b++) {
+            residual4(1 + p, mbx * 8 + (b & 1) * 4, mby * 8 + (b >> 1) * 4, pred[p] + (b >> 1) * 32 + (b & 1) * 4,
+                      8, dct[b]);
+        }
+        // 2x2 Hadamard of the DC terms.
+        int d0 = dct[0][0], d1 = dct[1][0], d2 = dct[2][0], d3 = dct[3][0];
+        int h[4] = { d0 + d1 + d2 + d3, d0 - d1 + d2 - d3, d0 + d1 - d2 - d3, d0 - d1 - d2 + d3 };
+        for (int i = 0; i < 4; i++) {
+            c->chroma_dc[p][i] = quant(h[i], s_mf[qpc % 6][0], 2 * f, qbits + 1);
+            any_dc |= c->chroma_dc[p][i] != 0;
+        }
+        for (int b = 0; b < 4; b++) {
+            c->chroma_nz[p][b] = quant4(dct[b], qpc, intra, 1);
+            any_ac |= c->chroma_nz[p][b] != 0;
+            to_zigzag(dct[b], c->chroma_ac[p][b]);
+        }
+    }
+    c->cbp_chroma = any_ac ? 2 : any_dc ? 1 : 0;
+
+    // Reconstruct exactly as a decoder would.
+    for (int p = 0; p < 2; p++) {
+        const int *l = c->chroma_dc[p];
+        int f4[4] = { l[0] + l[1] + l[2] + l[3], l[0] - l[1] + l[2] - l[3],
+                      l[0] + l[1] - l[2] - l[3], l[0] - l[1] - l[2] + l[3] };
+        for (int b = 0; b < 4; b++) {
+            int d[16];
+            if (c->cbp_chroma == 2) {
+                from_zigzag(c->chroma_ac[p][b], d);
+            } else {
+                memset(d, 0, sizeof(d));
+            }
+            dequant4(d, qpc, 1);
+            d[0] = ((f4[b] * 16 * s_v[qpc % 6][0]) << (qpc / 6)) >> 5;
+            uint8_t *dst = s_enc.cur[1 + p] + (mby * 8 + (b >> 1) * 4) * stride + mbx * 8 + (b & 1) * 4;
+            for (int i = 0; i < 4; i++) memcpy(dst + i * stride, pred[p] + ((b >> 1) * 4 + i) * 8 + (b & 1) * 4, 4);
+            idct4_add(d, dst, stride);
+        }
+    }
+}
+
+static void put_chroma(bitw_t *w, int mbx, int mby, mb_coeffs_t *c)
+{
+    if (c->cbp_chroma) {
+        for (int p = 0; p < 2; p++) put_residual(w, c->chroma_dc[p], 4, -1);
+    }
+    for (int p = 0; p < 2; p++) {
+        for (int b = 0; b < 4; b++) {
+            int gx = mbx * 2 + (b & 1), gy = mby * 2 + (b >> 1);
+            if (c->cbp_chroma == 2) {
+                put_residual(w, c->chroma_ac[p][b] + 1, 15, pred_nc(1 + p, gx, gy));
+                set_nz(1 + p, gx, gy, c->chroma_nz[p][b]);
+            } else {
+                set_nz(1 + p, gx, gy, 0);
+            }
+        }
+    }
+}
+
+// Intra 16x16 luma prediction from the reconstruction; false when mode
+// needs a neighbour that is not there.
+static bool pred_luma16(int mbx, int mby, int mode, uint8_t pred[256])
+{
+    const int stride = px_stride(0);
+    const uint8_t *cur = s_enc.cur[0] + mby * 16 * stride + mbx * 16;
+    const bool left = mbx > 0, top = mby > 0;
+    if ((mode == PRED_V && !top) || (mode == PRED_H && !left)) return false;
+
+    if (mode == PRED_V) {
+        for (int y = 0; y < 16; y++) memcpy(pred + y * 16, cur - stride, 16);
+    } else if (mode == PRED_H) {
+        for (int y = 0; y < 16; y++) memset(pred + y * 16, cur[y * stride - 1], 16);
+    } else {
+        int sum = 0, dc = 128;
+        for (int i = 0; i < 16; i++) {
+            if (top) sum += cur[i - stride];
+            if (left) sum += cur[i * stride - 1];
+        }
+        if (top && left) dc = (sum + 16) >> 5;
+        else if (top || left) dc = (sum + 8) >> 4;
+        memset(pred, dc, 256);
+    }
+    return true;
+}
+
+// Chroma DC prediction (intra_chroma_pred_mode 0) per 4x4 block.
+static void pred_chroma_dc(int mbx, int mby, uint8_t pred[2][64])
+{
+    const int stride = px_stride(1);
+    const bool left = mbx > 0, top = mby > 0;
+    for (int p = 0; p < 2; p++) {
+        const uint8_t *cur = s_enc.cur[1 + p] + mby * 8 * stride + mbx * 8;
+        for (int b = 0; b < 4; b++) {
+            int xo = (b & 1) * 4, yo = (b >> 1) * 4;
+            int st = 0, sl = 0;
+            for (int i = 0; i < 4; i++) {
+                if (top) st += cur[xo + i - stride];
+                if (left) sl += cur[(yo + i) * stride - 1];
+            }
+            int dc = 128;
+            if (xo == yo) {
+                if (top && left) dc = (st + sl + 4) >> 3;
+                else if (left) dc = (sl + 2) >> 2;
+                else if (top) dc = (st + 2) >> 2;
+            } else if (xo > 0) {
+                if (top) dc = (st + 2) >> 2;
+                else if (left) dc = (sl + 2) >> 2;
+            } else {
+                if (left) dc = (sl + 2) >> 2;
+                else if (top) dc = (st + 2) >> 2;
+            }
+            for (int y = 0; y < 4; y++) memset(pred[p] + (yo + y) * 8 + xo, dc, 4);
+        }
+    }
+}
+
+static int sad16(int mbx, int mby, const uint8_t *pred)
+{
+    const int stride = px_stride(0);
+    const uint8_t *s = s_enc.src[0] + mby * 16 * stride + mbx * 16;
+    int sad = 0;
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 16; x++) sad += abs(s[y * stride + x] - pred[y * 16 + x]);
+    }
+    return sad;
+}
+
+static int best_intra_mode(int mbx, int mby, int *out_sad)
+{
+    uint8_t pred[256];
+    int best = PRED_DC, best_sad = 1 << 30;
+    for (int mode = PRED_V; mode <= PRED_DC; mode++) {
+        if (!pred_luma16(mbx, mby, mode, pred)) continue;
+        int sad = sad16(mbx, mby, pred);
+        if (sad < best_sad) {
+            best_sad = sad;
+            best = mode;
+        }
+    }
+    *out_sad = best_sad;
+    return best;
+}
+
+// Intra 16x16: levels, reconstruction and nothing else.
+static void code_intra16(int mbx, int mby, int mode, mb_coeffs_t *c)
+{
+    const int qp = s_enc.qp;
+    const int stride = px_stride(0);
+    uint8_t pred[256];
+    uint8_t cpred[2][64];
+    pred_luma16(mbx, mby, mode, pred);
+
+    int dct[16][16];
+    int dc[16];
+    for (int b = 0; b < 16; b++) {
+        int bx = s_blk_x[b], by = s_blk_y[b];
+        residual4(0, mbx * 16 + bx * 4, mby * 16 + by * 4, pred + by * 64 + bx * 4, 16, dct[b]);
+        dc[by * 4 + bx] = dct[b][0];
+    }
+
+    // 4x4 Hadamard of the DC terms, halved.
+    int t[16], hd[16];
+    for (int i = 0; i < 4; i++) {
+        int *r = dc + i * 4;
+        int s01 = r[0] + r[1], d01 = r[0] - r[1], s23 = r[2] + r[3], d23 = r[2] - r[3];
+        t[i * 4 + 0] = s01 + s23;
+        t[i * 4 + 1] = s01 - s23;
+        t[i * 4 + 2] = d01 - d23;
+        t[i * 4 + 3] = d01 + d23;
+    }
+    for (int j = 0; j < 4; j++) {
+        int s01 = t[j] + t[4 + j], d01 = t[j] - t[4 + j], s23 = t[8 + j] + t[12 + j], d23 = t[8 + j] - t[12 + j];
+        hd[j] = (s01 + s23) / 2;
+        hd[4 + j] = (s01 - s23) / 2;
+        hd[8 + j] = (d01 - d23) / 2;
+        hd[12 + j] = (d01 + d23) / 2;
+    }
+    const int qbits = 15 + qp / 6;
+    const int f = (1 << qbits) / 3;
+    int dcq[16];
+    for (int i = 0; i < 16; i++) dcq[i] = quant(hd[i], s_mf[qp % 6][0], 2 * f, qbits + 1);
+    to_zigzag(dcq, c->luma_dc);
+
+    bool any_ac = false;
+    for (int b = 0; b < 16; b++) {
+        c->luma_nz[b] = quant4(dct[b], qp, true, 1);
+        any_ac |= c->luma_nz[b] != 0;
+        to_zigzag(dct[b], c->luma[b]);
+    }
+    c->cbp_luma = any_ac ? 15 : 0;
+
+    // Inverse DC Hadamard and scaling (clause 8.5.10).
+    int ft[16], fd[16];
+    for (int i = 0; i < 4; i++) {
+        int *r = dcq + i * 4;
+        int s01 = r[0] + r[1], d01 = r[0] - r[1], s23 = r[2] + r[3], d23 = r[2] - r[3];
+        ft[i * 4 + 0] = s01 + s23;
+        ft[i * 4 + 1] = s01 - s23;
+        ft[i * 4 + 2] = d01 - d23;
+        ft[i * 4 + 3] = d01 + d23;
+    }
+    for (int j = 0; j < 4; j++) {
+        int s01 = ft[j] + ft[4 + j], d01 = ft[j] - ft[4 + j], s23 = ft[8 + j] + ft[12 + j], d23 = ft[8 + j] - ft[12 + j];
+        fd[j] = s01 + s23;
+        fd[4 + j] = s01 - s23;
+        fd[8 + j] = d01 - d23;
+        fd[12 + j] = d01 + d23;
+    }
+    const int ls = 16 * s_v[qp % 6][0];
+    for (int i = 0; i < 16; i++) {
+        if (qp >= 36) {
+            fd[i] = (fd[i] * ls) << (qp / 6 - 6);
+        } else {
+            fd[i] = (fd[i] * ls + (1 << (5 - qp / 6))) >> (6 - qp / 6);
+        }
+    }
+
+    for (int b = 0; b < 16; b++) {
+        int bx = s_blk_x[b], by = s_blk_y[b];
+        int d[16];
+        if (any_ac) {
+            from_zigzag(c->luma[b], d);
+        } else {
+            memset(d, 0, sizeof(d));
+        }
+        dequant4(d, qp, 1);
+        d[0] = fd[by * 4 + bx];
+        uint8_t *dst = s_enc.cur[0] + (mby * 16 + by * 4) * stride + mbx * 16 + bx * 4;
+        for (int i = 0; i < 4; i++) memcpy(dst + i * stride, pred + (by * 4 + i) * 16 + bx * 4, 4);
+        idct4_add(d, dst, stride);
+    }
+
+    pred_chroma_dc(mbx, mby, cpred);
+    code_chroma(mbx, mby, cpred, true, c);
+}
+
+static void put_intra16(bitw_t *w, int mbx, int mby, int mode, bool p_slice, mb_coeffs_t *c)
+{
+    int type = MB_TYPE_I16 + mode + 4 * c->cbp_chroma + (c->cbp_luma ? 12 : 0);
+    put_ue(w, (uint32_t)(type + (p_slice ? MB_TYPE_P_INTRA : 0)));
+    put_ue(w, 0);                   // intra_chroma_pred_mode: DC
+    put_se(w, 0);                   // mb_qp_delta
+
+    put_residual(w, c->luma_dc, 16, pred_nc(0, mbx * 4, mby * 4));
+    for (int b = 0; b < 16; b++) {
+        int gx = mbx * 4 + s_blk_x[b], gy = mby * 4 + s_blk_y[b];
+        if (c->cbp_luma) {
+            put_residual(w, c->luma[b] + 1, 15, pred_nc(0, gx, gy));
+            set_nz(0, gx, gy, c->luma_nz[b]);
+        } else {
+            set_nz(0, gx, gy, 0);
+        }
+    }
+    put_chroma(w, mbx, mby, c);
+}
+
+// Motion compensated prediction for a full-pel luma vector (quarter-pel
+// units, multiple of 4); chroma uses the 1/8-pel bilinear filter.
+static void pred_inter(int mbx, int mby, int mvx, int mvy, uint8_t luma[256], uint8_t chroma[2][64])
+{
+    const int w = s_enc.mbw * 16, h = s_enc.mbh * 16;
+    const int stride = px_stride(0);
+    for (int y = 0; y < 16; y++) {
+        int sy = mby * 16 + y + (mvy >> 2);
+        sy = sy < 0 ? 0 : sy >= h ? h - 1 : sy;
+        for (int x = 0; x < 16; x++) {
+            int sx = mbx * 16 + x + (mvx >> 2);
+            sx = sx < 0 ? 0 : sx >= w ? w - 1 : sx;
+            luma[y * 16 + x] = s_enc.ref[0][sy * stride + sx];
+        }
+    }
+
+    const int cw = w / 2, ch = h / 2, cs = px_stride(1);
+    const int fx = mvx & 7, fy = mvy & 7;
+    for (int p = 0; p < 2; p++) {
+        const uint8_t *r = s_enc.ref[1 + p];
+        for (int y = 0; y < 8; y++) {
+            int y0 = mby * 8 + y + (mvy >> 3);
+            int ya = y0 < 0 ? 0 : y0 >= ch ? ch - 1 : y0;
+            int yb = y0 + 1 < 0 ? 0 : y0 + 1 >= ch ? ch - 1 : y0 + 1;
+            for (int x = 0; x < 8; x++) {
+                int x0 = mbx * 8 + x + (mvx >> 3);
+                int xa = x0 < 0 ? 0 : x0 >= cw ? cw - 1 : x0;
+                int xb = x0 + 1 < 0 ? 0 : x0 + 1 >= cw ? cw - 1 : x0 + 1;
+                int v = (8 - fx) * (8 - fy) * r[ya * cs + xa] + fx * (8 - fy) * r[ya * cs + xb] +
+                        (8 - fx) * fy * r[yb * cs + xa] + fx * fy * r[yb * cs + xb];
+                chroma[p][y * 8 + x] = (uint8_t)((v + 32) >> 6);
+            }
+        }
+    }
+}
+
+// Luma SAD of a full-pel candidate, straight from the reference.
+static int sad_mv(int mbx, int mby, int dx, int dy)
+{
+    const int stride = px_stride(0);
+    const uint8_t *s = s_enc.src[0] + mby * 16 * stride + mbx * 16;
+    const uint8_t *r = s_enc.ref[0] + (mby * 16 + dy) * stride + mbx * 16 + dx;
+    int sad = 0;
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 16; x++) sad += abs(s[y * stride + x] - r[y * stride + x]);
+    }
+    return sad;
+}
+
+// Neighbour vector for prediction: false when outside the picture.
+static bool neighbour(int mbx, int mby, mb_mv_t *out)
+{
+    if (mbx < 0 || mby < 0 || mbx >= s_enc.mbw) {
+        *out = (mb_mv_t){ -1, 0, 0 };
+        return false;
+    }
+    *out = s_enc.mv[mby * s_enc.mbw + mbx];
+    if (out->ref < 0) out->mvx = out->mvy = 0;
+    return true;
+}
+
+static inline int median3(int a, int b, int c)
+{
+    int mx = a > b ? a : b, mn = a < b ? a : b;
+    return c > mx ? mx : c < mn ? mn : c;
+}
+
+// Motion vector predictor for a 16x16 partition (clause 8.4.1.3), and the
+// P_Skip vector (clause 8.4.1.1).
+static void predict_mv(int mbx, int mby, int *px, int *py, int *skip_x, int *skip_y)
+{
+    mb_mv_t a, b, c;
+    bool has_a = neighbour(mbx - 1, mby, &a);
+    bool has_b = neighbour(mbx, mby - 1, &b);
+    bool has_c = neighbour(mbx + 1, mby - 1, &c);
+    if (!has_c) has_c = neighbour(mbx - 1, mby - 1, &c);
+
+    mb_mv_t pa = a, pb = b, pc = c;
+    if (!has_b && !has_c && has_a) pb = pc = pa;
+    int matches = (pa.ref == 0) + (pb.ref == 0) + (pc.ref == 0);
+    if (matches == 1) {
+        const mb_mv_t *m = pa.ref == 0 ? &pa : pb.ref == 0 ? &pb : &pc;
+        *px = m->mvx;
+        *py = m->mvy;
+    } else {
+        *px = median3(pa.mvx, pb.mvx, pc.mvx);
+        *py = median3(pa.mvy, pb.mvy, pc.mvy);
+    }
+
+    if (!has_a || !has_b || (a.ref == 0 && a.mvx == 0 && a.mvy == 0) ||
+        (b.ref == 0 && b.mvx == 0 && b.mvy == 0)) {
+        *skip_x = *skip_y = 0;
+    } else {
+        *skip_x = *px;
+        *skip_y = *py;
+    }
+}
+
+// Full-pel search around the predictor and zero: coarse to fine cross steps.
+static void motion_search(int mbx, int mby, int pmx, int pmy, int *best_dx, int *best_dy, int *best_sad)
+{
+    const int max_x = (s_enc.mbw - 1 - mbx) * 16, min_x = -mbx * 16;
+    const int max_y = (s_enc.mbh - 1 - mby) * 16, min_y = -mby * 16;
+    const int cand[2][2] = { { 0, 0 }, { pmx / 4, pmy / 4 } };
+
+    int bx = 0, by = 0, bs = 1 << 30;
+    for (int i = 0; i < 2; i++) {
+        int dx = cand[i][0], dy = cand[i][1];
+        if (dx < min_x || dx > max_x || dy < min_y || dy > max_y) continue;
+        if (dx < -ME_RANGE || dx > ME_RANGE || dy < -ME_RANGE || dy > ME_RANGE) continue;
+        int s = sad_mv(mbx, mby, dx, dy);
+        if (s < bs) {
+            bs = s;
+            bx = dx;
+            by = dy;
+        }
+    }
+    for (int step = 8; step >= 1; step /= 2) {
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            const int d[4][2] = { { step, 0 }, { -step, 0 }, { 0, step }, { 0, -step } };
+            for (int i = 0; i < 4; i++) {
+                int dx = bx + d[i][0], dy = by + d[i][1];
+                if (dx < min_x || dx > max_x || dy < min_y || dy > max_y) continue;
+                if (dx < -ME_RANGE || dx > ME_RANGE || dy < -ME_RANGE || dy > ME_RANGE) continue;
+                int s = sad_mv(mbx, mby, dx, dy);
+                if (s < bs) {
+                    bs = s;
+                    bx = dx;
+                    by = dy;
+                    moved = true;
+                }
+            }
+        }
+    }
+    *best_dx = bx;
+    *best_dy = by;
+    *best_sad = bs;
+}
+
+// Inter 16x16 levels and reconstruction for vector (mvx, mvy).
+static void code_inter(int mbx, int mby, int mvx, int mvy, mb_coeffs_t *c)
+{
+    const int qp = s_enc.qp;
+    const int stride = px_stride(0);
+    uint8_t pred[256];
+    uint8_t cpred[2][64];
+    pred_inter(mbx, mby, mvx, mvy, pred, cpred);
+
+    c->cbp_luma = 0;
+    for (int b = 0; b < 16; b++) {
+        int bx = s_blk_x[b], by = s_blk_y[b];
+        int dct[16];
+        residual4(0, mbx * 16 + bx * 4, mby * 16 + by * 4, pred + by * 64 + bx * 4, 16, dct);
+        c->luma_nz[b] = quant4(dct, qp, false, 0);
+        if (c->luma_nz[b]) c->cbp_luma |= 1 << (b / 4);
+        to_zigzag(dct, c->luma[b]);
+    }
+    for (int b = 0; b < 16; b++) {
+        int bx = s_blk_x[b], by = s_blk_y[b];
+        uint8_t *dst = s_enc.cur[0] + (mby * 16 + by * 4) * stride + mbx * 16 + bx * 4;
+        for (int i = 0; i < 4; i++) memcpy(dst + i * stride, pred + (by * 4 + i) * 16 + bx * 4, 4);
+        if (c->luma_nz[b]) {
+            int d[16];
+            from_zigzag(c->luma[b], d);
+            dequant4(d, qp, 0);
+            idct4_add(d, dst, stride);
+        }
+    }
+    code_chroma(mbx, mby, cpred, false, c);
+}
+
+static void put_inter(bitw_t *w, int mbx, int mby, int mvdx, int mvdy, mb_coeffs_t *c)
+{
+    put_ue(w, 0);                   // mb_type: P_L0_16x16
+    put_se(w, mvdx);
+    put_se(w, mvdy);
+    put_ue(w, s_cbp_inter_code[c->cbp_luma | (c->cbp_chroma << 4)]);
+    if (c->cbp_luma || c->cbp_chroma) put_se(w, 0);
+
+    for (int b = 0; b < 16; b++) {
+        int gx = mbx * 4 + s_blk_x[b], gy = mby * 4 + s_blk_y[b];
+        if (c->cbp_luma & (1 << (b / 4))) {
+            put_residual(w, c->luma[b], 16, pred_nc(0, gx, gy));
+            set_nz(0, gx, gy, c->luma_nz[b]);
+        } else {
+            set_nz(0, gx, gy, 0);
+        }
+    }
+    put_chroma(w, mbx, mby, c);
+}
+
+static void set_mb_nz(int mbx, int mby, int n)
+{
+    for (int i = 0; i < 16; i++) set_nz(0, mbx * 4 + (i & 3), mby * 4 + (i >> 2), n);
+    for (int p = 1; p <= 2; p++) {
+        for (int i = 0; i < 4; i++) set_nz(p, mbx * 2 + (i & 1), mby * 2 + (i >> 1), n);
+    }
+}
+
+static void put_pcm(bitw_t *w, int mbx, int mby, bool p_slice)
+{
+    put_ue(w, p_slice ? MB_TYPE_P_INTRA + MB_TYPE_I_PCM : MB_TYPE_I_PCM);
+    while (w->bits & 7) put_bits(w, 0, 1);
+    for (int p = 0; p < 3; p++) {
+        const int n = p ? 8 : 16, stride = px_stride(p);
+        for (int y = 0; y < n; y++) {
+            size_t off = (size_t)(mby * n + y) * stride + mbx * n;
+            for (int x = 0; x < n; x++) put_bits(w, s_enc.src[p][off + x], 8);
+            memcpy(s_enc.cur[p] + off, s_enc.src[p] + off, n);
+        }
+    }
+    set_mb_nz(mbx, mby, 16);
+}
+
+static bool all_zero(const mb_coeffs_t *c)
+{
+    return c->cbp_luma == 0 && c->cbp_chroma == 0;
+}
+
+static void encode_slice(bitw_t *w, bool idr)
+{
+    mb_coeffs_t c;
+    uint32_t skip_run = 0;
+
+    for (int mby = 0; mby < s_enc.mbh; mby++) {
+        for (int mbx = 0; mbx < s_enc.mbw; mbx++) {
+            mb_mv_t *mv = &s_enc.mv[mby * s_enc.mbw + mbx];
+            int intra_sad;
+            int mode = best_intra_mode(mbx, mby, &intra_sad);
+            bool intra = idr;
+            int pmx = 0, pmy = 0, smx = 0, smy = 0, dx = 0, dy = 0;
+
+            if (!idr) {
+                predict_mv(mbx, mby, &pmx, &pmy, &smx, &smy);
+
+                // P_Skip when the skip vector needs no residual at all.
+                code_inter(mbx, mby, smx, smy, &c);
+                if (all_zero(&c)) {
+                    *mv = (mb_mv_t){ 0, (int16_t)smx, (int16_t)smy };
+                    set_mb_nz(mbx, mby, 0);
+                    skip_run++;
+                    continue;
+                }
+
+                int inter_sad;
+                motion_search(mbx, mby, pmx, pmy, &dx, &dy, &inter_sad);
+                intra = intra_sad + 256 < inter_sad;
+            }
+
+            if (!idr) put_ue(w, skip_run);
+            skip_run = 0;
+            size_t mark = w->bits;
+
+            if (intra) {
+                code_intra16(mbx, mby, mode, &c);
+                put_intra16(w, mbx, mby, mode, !idr, &c);
+                *mv = (mb_mv_t){ -1, 0, 0 };
+            } else {
+                code_inter(mbx, mby, dx * 4, dy * 4, &c);
+                put_inter(w, mbx, mby, dx * 4 - pmx, dy * 4 - pmy, &c);
+                *mv = (mb_mv_t){ 0, (int16_t)(dx * 4), (int16_t)(dy * 4) };
+            }
+            if (w->bits - mark > PCM_BITS + 16) {
+                rewind_bits(w, mark);
+                put_pcm(w, mbx, mby, !idr);
+                *mv = (mb_mv_t){ -1, 0, 0 };
+            }
+        }
+    }
+    // The I slice never skips, so this is P only.
+    if (skip_run) put_ue(w, skip_run);
+    put_trailing_bits(w);
+}
+
+// ---------------------------------------------------------------------------
+
+static int quality_to_qp(int quality)
+{
+    int qp = 46 - quality * 36 / 100;
+    return qp < 10 ? 10 : qp > 51 ? 51 : qp;
+}
+
+// RGB565 to limited-range BT.601 4:2:0, edges replicated up to MB size.
+static void convert(const uint16_t *px)
+{
+    const uint32_t W = s_enc.width, H = s_enc.height;
+    const int ys = px_stride(0), cs = px_stride(1);
+    for (int y = 0; y < s_enc.mbh * 8; y++) {
+        for (int x = 0; x < s_enc.mbw * 8; x++) {
+            int sr = 0, sg = 0, sb = 0;
+            for (int k = 0; k < 4; k++) {
+                uint32_t sx = (uint32_t)(2 * x + (k & 1)), sy = (uint32_t)(2 * y + (k >> 1));
+                if (sx >= W) sx = W - 1;
+                if (sy >= H) sy = H - 1;
+                uint16_t p = px[sy * W + sx];
+                int r = (p >> 11) & 0x1F, g = (p >> 5) & 0x3F, b = p & 0x1F;
+                r = (r << 3) | (r >> 2);
+                g = (g << 2) | (g >> 4);
+                b = (b << 3) | (b >> 2);
+                s_enc.src[0][(2 * y + (k >> 1)) * ys + 2 * x + (k & 1)] =
+                    (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                sr += r;
+                sg += g;
+                sb += b;
+            }
+            s_enc.src[1][y * cs + x] = (uint8_t)(((-38 * sr - 74 * sg + 112 * sb + 512) >> 10) + 128);
+            s_enc.src[2][y * cs + x] = (uint8_t)(((112 * sr - 94 * sg - 18 * sb + 512) >> 10) + 128);
+        }
+    }
+}
+
+// Full-range O_UYY_E_VYY (pixfmt.h) to limited-range planes, edges
+// replicated up to MB size.
+static void convert_yuv420(const uint8_t *frame)
+{
+    const uint32_t W = s_enc.width, H = s_enc.height;
+    const int ys = px_stride(0), cs = px_stride(1);
+    const uint8_t *ly, *lc;
+    pixfmt_limited_luts(&ly, &lc);
+    for (int y = 0; y < s_enc.mbh * 8; y++) {
+        uint32_t sy = (uint32_t)y * 2 < H ? (uint32_t)y * 2 : H - 2;
+        const uint8_t *l0 = frame + (size_t)sy * W * 3 / 2;
+        const uint8_t *l1 = l0 + W * 3 / 2;
+        for (int x = 0; x < s_enc.mbw * 8; x++) {
+            uint32_t sx = (uint32_t)x * 2 < W ? (uint32_t)x * 2 : W - 2;
+            const size_t g = (size_t)sx / 2 * 3;
+            uint8_t *d = s_enc.src[0] + 2 * y * ys + 2 * x;
+            d[0] = ly[l0[g + 1]];
+            d[1] = ly[l0[g + 2]];
+            d[ys] = ly[l1[g + 1]];
+            d[ys + 1] = ly[l1[g + 2]];
+            s_enc.src[1][y * cs + x] = lc[l0[g]];
+            s_enc.src[2][y * cs + x] = lc[l1[g]];
+        }
+    }
+}
+
+static const uint32_t s_input_fmts[] = { APP_VIDEO_FMT_YUV420, APP_VIDEO_FMT_RGB565 };
+
+size_t frame_encoder_input_formats(const uint32_t **fmts)
+{
+    *fmts = s_input_fmts;
+    return sizeof(s_input_fmts) / sizeof(s_input_fmts[0]);
+}
+
+static void free_planes(void)
+{
+    for (int p = 0; p < 3; p++) {
+        free(s_enc.src[p]);
+        free(s_enc.cur[p]);
+        free(s_enc.ref[p]);
+        free(s_enc.nz[p]);
+        s_enc.src[p] = s_enc.cur[p] = s_enc.ref[p] = s_enc.nz[p] = NULL;
+    }
+    free(s_enc.mv);
+    s_enc.mv = NULL;
+}
+
+esp_err_t frame_encoder_open(uint32_t width, uint32_t height, uint32_t pixfmt)
+{
+    if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) return ESP_ERR_INVALID_ARG;
+    if (pixfmt != APP_VIDEO_FMT_YUV420 && pixfmt != APP_VIDEO_FMT_RGB565) return ESP_ERR_NOT_SUPPORTED;
+    // Cropping works in 2-pixel units for 4:2:0.
+    if ((width | height) & 1) return ESP_ERR_INVALID_ARG;
+    s_enc.pixfmt = pixfmt;
+    if (s_enc.ready && s_enc.width == width && s_enc.height == height) return ESP_OK;
+
+    free_planes();
+    s_enc.ready = false;
+    s_enc.mbw = (int)(width + 15) / 16;
+    s_enc.mbh = (int)(height + 15) / 16;
+    const size_t mbs = (size_t)s_enc.mbw * s_enc.mbh;
+    for (int p = 0; p < 3; p++) {
+        size_t n = p ? mbs * 64 : mbs * 256;
+        s_enc.src[p] = (uint8_t *)malloc(n);
+        s_enc.cur[p] = (uint8_t *)malloc(n);
+        s_enc.ref[p] = (uint8_t *)malloc(n);
+        s_enc.nz[p] = (uint8_t *)calloc(p ? mbs * 4 : mbs * 16, 1);
+        if (!s_enc.src[p] || !s_enc.cur[p] || !s_enc.ref[p] || !s_enc.nz[p]) {
+            free_planes();
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_enc.mv = (mb_mv_t *)calloc(mbs, sizeof(mb_mv_t));
+
+    // I_PCM bounds every macroblock, plus room for the one being tried.
+    size_t rbsp_need = mbs * (PCM_BITS / 8 + 8) + MB_SLACK_BYTES + 256;
+    size_t buf_need = rbsp_need + rbsp_need / 2 + 64;
+    if (!s_enc.rbsp || s_enc.rbsp_cap < rbsp_need) {
+        free(s_enc.rbsp);
+        s_enc.rbsp = (uint8_t *)malloc(rbsp_need);
+        s_enc.rbsp_cap = s_enc.rbsp ? rbsp_need : 0;
+    }
+    if (!s_enc.buf || s_enc.buf_size < buf_need) {
+        free(s_enc.buf);
+        s_enc.buf = (uint8_t *)malloc(buf_need);
+        s_enc.buf_size = s_enc.buf ? buf_need : 0;
+    }
+    if (!s_enc.mv || !s_enc.rbsp || !s_enc.buf) {
+        free_planes();
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_enc.width = width;
+    s_enc.height = height;
+    s_enc.qp = quality_to_qp(s_enc.quality);
+    s_enc.have_ref = false;
+    s_enc.ready = true;
+    ESP_LOGI(TAG, "Software H.264 %" PRIu32 "x%" PRIu32 " %s qp=%d gop=%d", width, height,
+             pixfmt_name(pixfmt), s_enc.qp, CONFIG_P4_H264_GOP);
+    return ESP_OK;
+}
+
+esp_err_t frame_encoder_set_quality(int quality, bool subsample_420)
+{
+    (void)subsample_420;    // always 4:2:0
+    if (quality < 1 || quality > 100) return ESP_ERR_INVALID_ARG;
+    s_enc.quality = quality;
+    s_enc.qp = quality_to_qp(quality);
+    return ESP_OK;
+}
+
+void frame_encoder_request_keyframe(void)
+{
+    atomic_store(&s_want_idr, true);
+}
+
+uint32_t frame_encoder_fourcc(void)
+{
+    return VID_FOURCC_H264;
+}
+
+esp_err_t frame_encoder_encode(const uint8_t *frame, size_t len,
+                               const uint8_t **out, uint32_t *out_size, bool *out_keyframe)
+{
+    if (!s_enc.ready) return ESP_ERR_INVALID_STATE;
+    if (len < pixfmt_frame_size(s_enc.pixfmt, s_enc.width, s_enc.height)) return ESP_ERR_INVALID_SIZE;
+
+    bool idr = !s_enc.have_ref || atomic_exchange(&s_want_idr, false) ||
+               (CONFIG_P4_H264_GOP > 0 && s_enc.since_idr >= CONFIG_P4_H264_GOP);
+    if (s_enc.pixfmt == APP_VIDEO_FMT_YUV420) {
+        convert_yuv420(frame);
+    } else {
+        convert((const uint16_t *)frame);
+    }
+
+    size_t pos = 0;
+    bitw_t w = { .buf = s_enc.rbsp, .cap = s_enc.rbsp_cap };
+    if (idr) {
+        s_enc.frame_num = 0;
+        s_enc.since_idr = 0;
+        s_enc.idr_id++;
+        write_sps(&w);
+        put_nal(&pos, 0x67, w.buf, w.bits / 8);
+        w.bits = 0;
+        write_pps(&w);
+        put_nal(&pos, 0x68, w.buf, w.bits / 8);
+        w.bits = 0;
+    } else {
+        s_enc.frame_num = (s_enc.frame_num + 1) % MAX_FRAME_NUM;
+    }
+
+    write_slice_header(&w, idr);
+    encode_slice(&w, idr);
+    if (w.overflow || !put_nal(&pos, idr ? 0x65 : 0x41, w.buf, w.bits / 8)) {
+        ESP_LOGE(TAG, "Output buffer too small (%u bytes)", (unsigned)s_enc.buf_size);
+        atomic_store(&s_want_idr, true);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (int p = 0; p < 3; p++) {
+        uint8_t *t = s_enc.ref[p];
+        s_enc.ref[p] = s_enc.cur[p];
+        s_enc.cur[p] = t;
+    }
+    s_enc.have_ref = true;
+    s_enc.since_idr++;
+
+    *out = s_enc.buf;
+    *out_size = (uint32_t)pos;
+    if (out_keyframe) *out_keyframe = idr;
+    return ESP_OK;
+}
+
+void frame_encoder_close(void)
+{
+    free_planes();
+    free(s_enc.rbsp);
+    free(s_enc.buf);
+    s_enc.rbsp = NULL;
+    s_enc.buf = NULL;
+    s_enc.rbsp_cap = 0;
+    s_enc.buf_size = 0;
+    s_enc.width = 0;
+    s_enc.height = 0;
+    s_enc.ready = false;
+}
@@ -0,0 +1,158 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "frame_encoder.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "driver/jpeg_encode.h"
+#include "esp_log.h"
+#include "app_video.h"
+#include "pixfmt.h"
+#include "vid_wire.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "enc_hw";
+
+static struct {
+    jpeg_encoder_handle_t engine;
+    uint8_t *buf;
+    size_t buf_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixfmt;
+    int quality;
+    jpeg_down_sampling_type_t sub_sample;
+} s_enc = {
+    .quality = CONFIG_P4_JPEG_QUALITY,
+#if CONFIG_P4_JPEG_SUBSAMPLE_420
+    .sub_sample = JPEG_DOWN_SAMPLING_YUV420,
+#else
+    .sub_sample = JPEG_DOWN_SAMPLING_YUV422,
+#endif
+};
+
+// YUV422 goes straight into the DCT; RGB565 is converted by the engine.
+static const uint32_t s_input_fmts[] = { APP_VIDEO_FMT_YUV422, APP_VIDEO_FMT_RGB565 };
+
+size_t frame_encoder_input_formats(const uint32_t **fmts)
+{
+    *fmts = s_input_fmts;
+    return sizeof(s_input_fmts) / sizeof(s_input_fmts[0]);
+}
+
+esp_err_t frame_encoder_open(uint32_t width, uint32_t height, uint32_t pixfmt)
+{
+    if (pixfmt != APP_VIDEO_FMT_YUV422 && pixfmt != APP_VIDEO_FMT_RGB565) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_enc.pixfmt = pixfmt;
+    if (s_enc.engine && s_enc.width == width && s_enc.height == height) {
+        return ESP_OK;
+    }
+
+    if (!s_enc.engine) {
+        jpeg_encode_engine_cfg_t eng_cfg = {
+            .intr_priority = 0,
+            .timeout_ms = 200,
+        };
+
+        esp_err_t err = jpeg_new_encoder_engine(&eng_cfg, &s_enc.engine);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "JPEG encoder init failed: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    // Resolution changes reuse the output buffer when it is already large
+    // enough, so switching modes does not churn PSRAM.
+    size_t need = (size_t)width * height * 2;
+    if (!s_enc.buf || s_enc.buf_size < need) {
+        if (s_enc.buf) {
+            free(s_enc.buf);
+            s_enc.buf = NULL;
+            s_enc.buf_size = 0;
+        }
+
+        size_t out_size = 0;
+        jpeg_encode_memory_alloc_cfg_t out_cfg = {
+            .buffer_direction = JPEG_ENC_ALLOC_OUTPUT_BUFFER,
+        };
+
+        s_enc.buf = jpeg_alloc_encoder_mem(need, &out_cfg, &out_size);
+        if (!s_enc.buf || out_size == 0) {
+            ESP_LOGE(TAG, "JPEG output buffer alloc failed");
+            jpeg_del_encoder_engine(s_enc.engine);
+            s_enc.engine = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+        s_enc.buf_size = out_size;
+    }
+
+    s_enc.width = width;
+    s_enc.height = height;
+    return ESP_OK;
+}
+
+esp_err_t frame_encoder_encode(const uint8_t *frame, size_t len,
+                               const uint8_t **out, uint32_t *out_size, bool *out_keyframe)
+{
+    if (!s_enc.engine) return ESP_ERR_INVALID_STATE;
+    if (len < pixfmt_frame_size(s_enc.pixfmt, s_enc.width, s_enc.height)) return ESP_ERR_INVALID_SIZE;
+
+    // The engine only subsamples when it does the colour conversion itself;
+    // YUV422 input is coded as 4:2:2 whatever the setting says.
+    bool yuv = s_enc.pixfmt == APP_VIDEO_FMT_YUV422;
+    jpeg_encode_cfg_t enc_cfg = {
+        .src_type = yuv ? JPEG_ENCODE_IN_FORMAT_YUV422 : JPEG_ENCODE_IN_FORMAT_RGB565,
+        .sub_sample = yuv ? JPEG_DOWN_SAMPLING_YUV422 : s_enc.sub_sample,
+        .image_quality = s_enc.quality,
+        .width = s_enc.width,
+        .height = s_enc.height,
+    };
+
+    esp_err_t err = jpeg_encoder_process(s_enc.engine, &enc_cfg, frame, len,
+                                         s_enc.buf, s_enc.buf_size, out_size);
+    if (err != ESP_OK) return err;
+
+    *out = s_enc.buf;
+    if (out_keyframe) *out_keyframe = true;
+    return ESP_OK;
+}
+
+// Every JPEG is a keyframe.
+void frame_encoder_request_keyframe(void)
+{
+}
+
+uint32_t frame_encoder_fourcc(void)
+{
+    return VID_FOURCC_MJPG;
+}
+
+esp_err_t frame_encoder_set_quality(int quality, bool subsample_420)
+{
+    if (quality < 1 || quality > 100) return ESP_ERR_INVALID_ARG;
+    s_enc.quality = quality;
+    s_enc.sub_sample = subsample_420 ? JPEG_DOWN_SAMPLING_YUV420 : JPEG_DOWN_SAMPLING_YUV422;
+    return ESP_OK;
+}
+
+void frame_encoder_close(void)
+{
+    if (s_enc.engine) {
+        jpeg_del_encoder_engine(s_enc.engine);
+        s_enc.engine = NULL;
+    }
+    if (s_enc.buf) {
+        free(s_enc.buf);
+        s_enc.buf = NULL;
+    }
+    s_enc.buf_size = 0;
+    s_enc.width = 0;
+    s_enc.height = 0;
+    s_enc.pixfmt = 0;
+}
@@ -0,0 +1,489 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Baseline JPEG encoder for the host build: YUV420, YUV422 or RGB565 in
+ * (pixfmt.h), YCbCr 4:2:0 or 4:2:2 out,
+ * standard (Annex K) quantisation and Huffman tables, IJG quality scaling.
+ * Simple rather than fast; it only has to keep up with simulated capture.
+ */
+#include "frame_encoder.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "app_video.h"
+#include "pixfmt.h"
+#include "vid_wire.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "enc_sw";
+
+#define MCU_W 16
+#define MCU_H_MAX 16    // 4:2:0; 4:2:2 uses 8
+
+static const uint8_t s_zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static const uint8_t s_q_luma[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+static const uint8_t s_q_chroma[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+static const uint8_t s_dc_luma_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t s_dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t s_dc_vals[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t s_ac_luma_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t s_ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const uint8_t s_ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t s_ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t size[256];
+} huff_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    uint32_t acc;
+    int nbits;
+    bool overflow;
+} bitw_t;
+
+static struct {
+    uint8_t *buf;
+    size_t buf_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixfmt;
+    bool ready;
+    int quality;
+    int mcu_h;
+    uint8_t q[2][64];           // natural order
+    float fq[2][64];            // 1 / q, natural order
+    float cos_tab[8][8];
+    huff_t dc[2];
+    huff_t ac[2];
+} s_enc;
+
+static void build_huff(huff_t *h, const uint8_t bits[16], const uint8_t *vals)
+{
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++) {
+            h->code[vals[k]] = code++;
+            h->size[vals[k]] = (uint8_t)len;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+static void build_quant(uint8_t out[64], const uint8_t base[64], int quality)
+{
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        int q = (base[i] * scale + 50) / 100;
+        out[i] = (uint8_t)(q < 1 ? 1 : (q > 255 ? 255 : q));
+    }
+}
+
+static void init_quant(int quality)
+{
+    build_quant(s_enc.q[0], s_q_luma, quality);
+    build_quant(s_enc.q[1], s_q_chroma, quality);
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < 64; i++) {
+            s_enc.fq[t][i] = 1.0f / (float)s_enc.q[t][i];
+        }
+    }
+    s_enc.quality = quality;
+}
+
+static void init_tables(void)
+{
+    if (!s_enc.quality) {
+        init_quant(CONFIG_P4_JPEG_QUALITY);
+        s_enc.mcu_h = CONFIG_P4_JPEG_SUBSAMPLE_420 ? 16 : 8;
+    }
+    for (int x = 0; x < 8; x++) {
+        for (int u = 0; u < 8; u++) {
+            float cu = u == 0 ? (float)M_SQRT1_2 : 1.0f;
+            s_enc.cos_tab[u][x] = 0.5f * cu * cosf((float)((2 * x + 1) * u) * (float)M_PI / 16.0f);
+        }
+    }
+    build_huff(&s_enc.dc[0], s_dc_luma_bits, s_dc_vals);
+    build_huff(&s_enc.dc[1], s_dc_chroma_bits, s_dc_vals);
+    build_huff(&s_enc.ac[0], s_ac_luma_bits, s_ac_luma_vals);
+    build_huff(&s_enc.ac[1], s_ac_chroma_bits, s_ac_chroma_vals);
+}
+
+static inline void put_byte(bitw_t *w, uint8_t b)
+{
+    if (w->len < w->cap) {
+        w->buf[w->len++] = b;
+    } else {
+        w->overflow = true;
+    }
+}
+
+static void put_bytes(bitw_t *w, const uint8_t *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++) put_byte(w, p[i]);
+}
+
+static inline void put_bits(bitw_t *w, uint32_t bits, int n)
+{
+    w->acc = (w->acc << n) | (bits & ((1u << n) - 1));
+    w->nbits += n;
+    while (w->nbits >= 8) {
+        uint8_t b = (uint8_t)(w->acc >> (w->nbits - 8));
+        put_byte(w, b);
+        if (b == 0xFF) put_byte(w, 0x00);
+        w->nbits -= 8;
+    }
+}
+
+static void flush_bits(bitw_t *w)
+{
+    if (w->nbits > 0) put_bits(w, 0x7F, 8 - w->nbits);
+}
+
+static void put_marker_u16(bitw_t *w, uint16_t v)
+{
+    put_byte(w, (uint8_t)(v >> 8));
+    put_byte(w, (uint8_t)v);
+}
+
+static void write_headers(bitw_t *w)
+{
+    static const uint8_t jfif[] = {
+        0xFF, 0xD8,                                     // SOI
+        0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01, 0x00,
+        0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+    };
+    put_bytes(w, jfif, sizeof(jfif));
+
+    put_marker_u16(w, 0xFFDB);
+    put_marker_u16(w, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        put_byte(w, (uint8_t)t);
+        for (int i = 0; i < 64; i++) put_byte(w, s_enc.q[t][s_zigzag[i]]);
+    }
+
+    put_marker_u16(w, 0xFFC0);
+    put_marker_u16(w, 17);
+    put_byte(w, 8);
+    put_marker_u16(w, (uint16_t)s_enc.height);
+    put_marker_u16(w, (uint16_t)s_enc.width);
+    put_byte(w, 3);
+    put_byte(w, 1);
+    put_byte(w, (uint8_t)(((MCU_W / 8) << 4) | (s_enc.mcu_h / 8)));
+    put_byte(w, 0);
+    put_byte(w, 2);
+    put_byte(w, 0x11);
+    put_byte(w, 1);
+    put_byte(w, 3);
+    put_byte(w, 0x11);
+    put_byte(w, 1);
+
+    const struct {
+        uint8_t id;
+        const uint8_t *bits;
+        const uint8_t *vals;
+        int nvals;
+    } dht[] = {
+        { 0x00, s_dc_luma_bits, s_dc_vals, 12 },
+        { 0x10, s_ac_luma_bits, s_ac_luma_vals, 162 },
+        { 0x01, s_dc_chroma_bits, s_dc_vals, 12 },
+        { 0x11, s_ac_chroma_bits, s_ac_chroma_vals, 162 },
+    };
+    for (size_t i = 0; i < sizeof(dht) / sizeof(dht[0]); i++) {
+        put_marker_u16(w, 0xFFC4);
+        put_marker_u16(w, (uint16_t)(3 + 16 + dht[i].nvals));
+        put_byte(w, dht[i].id);
+        put_bytes(w, dht[i].bits, 16);
+        put_bytes(w, dht[i].vals, dht[i].nvals);
+    }
+
+    static const uint8_t sos[] = {
+        0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00,
+    };
+    put_bytes(w, sos, sizeof(sos));
+}
+
+static inline int bit_len(int v)
+{
+    int n = 0;
+    for (v = v < 0 ? -v : v; v; v >>= 1) n++;
+    return n;
+}
+
+// Level-shifted samples in, DC predictor updated.
+static void encode_block(bitw_t *w, const float in[64], int table, int *pred)
+{
+    float tmp[64];
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float s = 0.0f;
+            for (int x = 0; x < 8; x++) s += s_enc.cos_tab[u][x] * in[y * 8 + x];
+            tmp[y * 8 + u] = s;
+        }
+    }
+
+    int coef[64];
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            float s = 0.0f;
+            for (int y = 0; y < 8; y++) s += s_enc.cos_tab[v][y] * tmp[y * 8 + u];
+            coef[v * 8 + u] = (int)lrintf(s * s_enc.fq[table][v * 8 + u]);
+        }
+    }
+
+    const huff_t *dc = &s_enc.dc[table];
+    const huff_t *ac = &s_enc.ac[table];
+
+    int diff = coef[0] - *pred;
+    *pred = coef[0];
+    int n = bit_len(diff);
+    put_bits(w, dc->code[n], dc->size[n]);
+    if (n) put_bits(w, (uint32_t)(diff < 0 ? diff - 1 : diff), n);
+
+    int run = 0;
+    for (int i = 1; i < 64; i++) {
+        int c = coef[s_zigzag[i]];
+        if (c == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            put_bits(w, ac->code[0xF0], ac->size[0xF0]);
+            run -= 16;
+        }
+        n = bit_len(c);
+        int sym = (run << 4) | n;
+        put_bits(w, ac->code[sym], ac->size[sym]);
+        put_bits(w, (uint32_t)(c < 0 ? c - 1 : c), n);
+        run = 0;
+    }
+    if (run) put_bits(w, ac->code[0x00], ac->size[0x00]);
+}
+
+static inline void rgb565_to_ycc(uint16_t p, float *y, float *cb, float *cr)
+{
+    float r = (float)(((p >> 11) & 0x1F) * 255 / 31);
+    float g = (float)(((p >> 5) & 0x3F) * 255 / 63);
+    float b = (float)((p & 0x1F) * 255 / 31);
+    *y = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+    *cb = -0.168736f * r - 0.331264f * g + 0.5f * b;
+    *cr = 0.5f * r - 0.418688f * g - 0.081312f * b;
+}
+
+// Level-shifted Y, Cb, Cr of one pixel; YUV input is already full range.
+static inline void load_ycc(const uint8_t *frame, uint32_t x, uint32_t y, float *Y, float *Cb, float *Cr)
+{
+    const uint32_t W = s_enc.width;
+    if (s_enc.pixfmt == APP_VIDEO_FMT_YUV422) {
+        const uint8_t *p = frame + ((size_t)y * W + (x & ~1u)) * 2;
+        *Y = (float)p[(x & 1) * 2] - 128.0f;
+        *Cb = (float)p[1] - 128.0f;
+        *Cr = (float)p[3] - 128.0f;
+    } else if (s_enc.pixfmt == APP_VIDEO_FMT_YUV420) {
+        const uint8_t *l0 = frame + (size_t)(y & ~1u) * W * 3 / 2;
+        const uint8_t *l1 = l0 + W * 3 / 2;
+        size_t g = (size_t)(x >> 1) * 3;
+        *Y = (float)(y & 1 ? l1 : l0)[g + 1 + (x & 1)] - 128.0f;
+        *Cb = (float)l0[g] - 128.0f;
+        *Cr = (float)l1[g] - 128.0f;
+    } else {
+        rgb565_to_ycc(((const uint16_t *)frame)[(size_t)y * W + x], Y, Cb, Cr);
+    }
+}
+
+static const uint32_t s_input_fmts[] = {
+    APP_VIDEO_FMT_YUV420, APP_VIDEO_FMT_YUV422, APP_VIDEO_FMT_RGB565,
+};
+
+size_t frame_encoder_input_formats(const uint32_t **fmts)
+{
+    *fmts = s_input_fmts;
+    return sizeof(s_input_fmts) / sizeof(s_input_fmts[0]);
+}
+
+esp_err_t frame_encoder_open(uint32_t width, uint32_t height, uint32_t pixfmt)
+{
+    if (width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF) return ESP_ERR_INVALID_ARG;
+    if (pixfmt_frame_size(pixfmt, width, height) == 0) return ESP_ERR_NOT_SUPPORTED;
+    if (pixfmt != APP_VIDEO_FMT_RGB565 && ((width | height) & 1)) return ESP_ERR_INVALID_ARG;
+    s_enc.pixfmt = pixfmt;
+    if (s_enc.ready && s_enc.width == width && s_enc.height == height) return ESP_OK;
+
+    // Worst case is far below raw RGB565 at sane qualities; overflow is
+    // reported rather than truncated.
+    size_t need = (size_t)width * height * 2 + 1024;
+    if (!s_enc.buf || s_enc.buf_size < need) {
+        free(s_enc.buf);
+        s_enc.buf = (uint8_t *)malloc(need);
+        s_enc.buf_size = s_enc.buf ? need : 0;
+        if (!s_enc.buf) return ESP_ERR_NO_MEM;
+    }
+    if (!s_enc.ready) init_tables();
+
+    s_enc.width = width;
+    s_enc.height = height;
+    s_enc.ready = true;
+    ESP_LOGI(TAG, "Software JPEG %" PRIu32 "x%" PRIu32 " %s q=%d", width, height, pixfmt_name(pixfmt),
+             s_enc.quality);
+    return ESP_OK;
+}
+
+esp_err_t frame_encoder_set_quality(int quality, bool subsample_420)
+{
+    if (quality < 1 || quality > 100) return ESP_ERR_INVALID_ARG;
+    init_quant(quality);
+    s_enc.mcu_h = subsample_420 ? 16 : 8;
+    return ESP_OK;
+}
+
+esp_err_t frame_encoder_encode(const uint8_t *frame, size_t len,
+                               const uint8_t **out, uint32_t *out_size, bool *out_keyframe)
+{
+    if (!s_enc.ready) return ESP_ERR_INVALID_STATE;
+    const uint32_t W = s_enc.width;
+    const uint32_t H = s_enc.height;
+    if (len < pixfmt_frame_size(s_enc.pixfmt, W, H)) return ESP_ERR_INVALID_SIZE;
+
+    bitw_t w = { .buf = s_enc.buf, .cap = s_enc.buf_size };
+    write_headers(&w);
+
+    const int mcu_h = s_enc.mcu_h;
+    int pred[3] = { 0, 0, 0 };
+    float Y[MCU_H_MAX * MCU_W], Cb[MCU_H_MAX * MCU_W], Cr[MCU_H_MAX * MCU_W];
+    float blk[64];
+
+    for (uint32_t my = 0; my < H; my += mcu_h) {
+        for (uint32_t mx = 0; mx < W; mx += MCU_W) {
+            // Edge MCUs replicate the last row/column.
+            for (int y = 0; y < mcu_h; y++) {
+                uint32_t sy = my + y < H ? my + y : H - 1;
+                for (int x = 0; x < MCU_W; x++) {
+                    uint32_t sx = mx + x < W ? mx + x : W - 1;
+                    load_ycc(frame, sx, sy, &Y[y * MCU_W + x], &Cb[y * MCU_W + x], &Cr[y * MCU_W + x]);
+                }
+            }
+
+            for (int by = 0; by < mcu_h; by += 8) {
+                for (int bx = 0; bx < MCU_W; bx += 8) {
+                    for (int i = 0; i < 64; i++) blk[i] = Y[(by + i / 8) * MCU_W + bx + i % 8];
+                    encode_block(&w, blk, 0, &pred[0]);
+                }
+            }
+
+            // One chroma block per MCU, averaged over the subsampled area.
+            const int sy = mcu_h / 8;
+            for (int c = 0; c < 2; c++) {
+                const float *src = c == 0 ? Cb : Cr;
+                for (int i = 0; i < 64; i++) {
+                    int y0 = (i / 8) * sy, x0 = (i % 8) * 2;
+                    float s = 0.0f;
+                    for (int dy = 0; dy < sy; dy++) {
+                        s += src[(y0 + dy) * MCU_W + x0] + src[(y0 + dy) * MCU_W + x0 + 1];
+                    }
+                    blk[i] = s / (float)(2 * sy);
+                }
+                encode_block(&w, blk, 1, &pred[1 + c]);
+            }
+        }
+    }
+
+    flush_bits(&w);
+    put_marker_u16(&w, 0xFFD9);
+    if (w.overflow) {
+        ESP_LOGE(TAG, "Output buffer too small (%u bytes)", (unsigned)s_enc.buf_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    *out = s_enc.buf;
+    *out_size = (uint32_t)w.len;
+    if (out_keyframe) *out_keyframe = true;
+    return ESP_OK;
+}
+
+// Every JPEG is a keyframe.
+void frame_encoder_request_keyframe(void)
+{
+}
+
+uint32_t frame_encoder_fourcc(void)
+{
+    return VID_FOURCC_MJPG;
+}
+
+void frame_encoder_close(void)
+{
+    free(s_enc.buf);
+    s_enc.buf = NULL;
+    s_enc.buf_size = 0;
+    s_enc.width = 0;
+    s_enc.height = 0;
+    s_enc.pixfmt = 0;
+    s_enc.ready = false;
+}
@@ -0,0 +1,37 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "frame_pacer.h"
+
+void frame_pacer_init(frame_pacer_t *p, uint32_t fps)
+{
+    *p = (frame_pacer_t) {
+        .fps = fps,
+        .interval_us = fps ? 1000000 / fps : 0,
+    };
+}
+
+bool frame_pacer_take(frame_pacer_t *p, int64_t ts_us)
+{
+    if (p->fps == 0) return true;
+
+    int64_t src_us = p->started ? ts_us - p->last_ts_us : 0;
+    p->last_ts_us = ts_us;
+    if (!p->started) {
+        p->started = true;
+        p->next_us = ts_us + p->interval_us;
+        return true;
+    }
+
+    // Keep the first frame within half a source interval of the grid
+    // point; the next source frame would be further from it.
+    if (ts_us + src_us / 2 < p->next_us) return false;
+
+    p->next_us += p->interval_us;
+    // After a stall (or a source slower than the target) restart the grid
+    // here instead of bursting to catch up.
+    if (p->next_us <= ts_us) p->next_us = ts_us + p->interval_us;
+    return true;
+}
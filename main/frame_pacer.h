@@ -0,0 +1,40 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Picks which frames of a faster source to keep for a target rate. Kept
+ * frames are the ones nearest an ideal grid of 1/fps steps laid over the
+ * capture timestamps, so the output intervals stay within half a source
+ * interval of the target and average to it exactly, e.g. 30 -> 7 fps keeps
+ * every 4th or 5th frame.
+ */
+typedef struct {
+    uint32_t fps;               // 0 = keep everything
+    int64_t interval_us;
+    int64_t next_us;            // grid point the next kept frame should be nearest
+    int64_t last_ts_us;         // previous source frame, for its interval
+    bool started;
+} frame_pacer_t;
+
+void frame_pacer_init(frame_pacer_t *p, uint32_t fps);
+
+/** @brief True when the frame captured at @p ts_us should be kept. */
+bool frame_pacer_take(frame_pacer_t *p, int64_t ts_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "frame_pool.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "frame_pool";
+
+#ifdef CONFIG_CACHE_L2_CACHE_LINE_SIZE
+#define POOL_ALIGN CONFIG_CACHE_L2_CACHE_LINE_SIZE
+#else
+#define POOL_ALIGN 64
+#endif
+
+#define POOL_NIL 0xFFFFu
+
+// The free-list head packs a 16-bit ABA tag above the 16-bit block index so
+// a single 32-bit CAS is enough on every core.
+#define HEAD_IDX(h)      ((uint16_t)((h) & 0xFFFFu))
+#define HEAD_TAG(h)      ((h) >> 16)
+#define HEAD_MAKE(t, i)  (((uint32_t)(t) << 16) | (uint32_t)(i))
+
+typedef struct {
+    const char *name;
+    uint32_t caps;
+    size_t block_size;
+    uint32_t block_count;
+    uint8_t *base;
+    uint16_t *next;
+    _Atomic uint32_t head;
+    _Atomic uint32_t in_use;
+    _Atomic uint32_t high_water;
+    _Atomic uint32_t alloc_fail;
+} frame_pool_t;
+
+static frame_pool_t s_pools[FRAME_POOL_COUNT] = {
+    [FRAME_POOL_INTERNAL] = {
+        .name = "internal",
+        .caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT,
+        .block_size = CONFIG_P4_POOL_INTERNAL_BLOCK_SIZE,
+        .block_count = CONFIG_P4_POOL_INTERNAL_BLOCKS,
+    },
+    [FRAME_POOL_PSRAM] = {
+        .name = "psram",
+        .caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+        .block_size = CONFIG_P4_POOL_PSRAM_BLOCK_SIZE,
+        .block_count = CONFIG_P4_POOL_PSRAM_BLOCKS,
+    },
+};
+
+static esp_err_t pool_setup(frame_pool_t *p)
+{
+    if (p->base) return ESP_OK;
+    if (p->block_count == 0 || p->block_count >= POOL_NIL) return ESP_ERR_INVALID_ARG;
+
+    p->block_size = (p->block_size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+
+    p->next = (uint16_t *)heap_caps_malloc(p->block_count * sizeof(uint16_t),
+                                           MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!p->next) return ESP_ERR_NO_MEM;
+
+    p->base = (uint8_t *)heap_caps_aligned_alloc(POOL_ALIGN, p->block_size * p->block_count, p->caps);
+    if (!p->base) {
+        heap_caps_free(p->next);
+        p->next = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint32_t i = 0; i < p->block_count; i++) {
+        p->next[i] = (i + 1 < p->block_count) ? (uint16_t)(i + 1) : POOL_NIL;
+    }
+    atomic_store(&p->head, HEAD_MAKE(0, 0));
+    atomic_store(&p->in_use, 0);
+    atomic_store(&p->high_water, 0);
+    atomic_store(&p->alloc_fail, 0);
+
+    ESP_LOGI(TAG, "%s pool: %u x %u bytes", p->name,
+             (unsigned)p->block_count, (unsigned)p->block_size);
+    return ESP_OK;
+}
+
+esp_err_t frame_pool_init(void)
+{
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < FRAME_POOL_COUNT; i++) {
+        esp_err_t err = pool_setup(&s_pools[i]);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "%s pool unavailable: %s", s_pools[i].name, esp_err_to_name(err));
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+static void note_in_use(frame_pool_t *p)
+{
+    uint32_t used = atomic_fetch_add_explicit(&p->in_use, 1, memory_order_relaxed) + 1;
+    uint32_t hw = atomic_load_explicit(&p->high_water, memory_order_relaxed);
+    while (used > hw &&
+           !atomic_compare_exchange_weak_explicit(&p->high_water, &hw, used,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void *frame_pool_alloc(frame_pool_id_t id, size_t len)
+{
+    if (id >= FRAME_POOL_COUNT) return NULL;
+    frame_pool_t *p = &s_pools[id];
+    if (!p->base || len > p->block_size) return NULL;
+
+    uint32_t head = atomic_load_explicit(&p->head, memory_order_acquire);
+    while (true) {
+        uint16_t idx = HEAD_IDX(head);
+        if (idx == POOL_NIL) {
+            atomic_fetch_add_explicit(&p->alloc_fail, 1, memory_order_relaxed);
+            return NULL;
+        }
+        uint32_t next = HEAD_MAKE(HEAD_TAG(head) + 1, p->next[idx]);
+        if (atomic_compare_exchange_weak_explicit(&p->head, &head, next,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            note_in_use(p);
+            return p->base + (size_t)idx * p->block_size;
+        }
+    }
+}
+
+static frame_pool_t *pool_of(const void *ptr, uint16_t *out_idx)
+{
+    const uint8_t *b = (const uint8_t *)ptr;
+    for (int i = 0; i < FRAME_POOL_COUNT; i++) {
+        frame_pool_t *p = &s_pools[i];
+        if (!p->base) continue;
+        if (b >= p->base && b < p->base + p->block_size * p->block_count) {
+            *out_idx = (uint16_t)((size_t)(b - p->base) / p->block_size);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void frame_pool_free(void *ptr)
+{
+    if (!ptr) return;
+
+    uint16_t idx = 0;
+    frame_pool_t *p = pool_of(ptr, &idx);
+    if (!p) {
+        free(ptr);
+        return;
+    }
+
+    // Count it out before it is back on the list: another core may take it
+    // the moment the CAS lands, and in_use must never pass block_count.
+    atomic_fetch_sub_explicit(&p->in_use, 1, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    do {
+        p->next[idx] = HEAD_IDX(head);
+    } while (!atomic_compare_exchange_weak_explicit(&p->head, &head,
+                                                    HEAD_MAKE(HEAD_TAG(head) + 1, idx),
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+size_t frame_pool_block_size(frame_pool_id_t id)
+{
+    if (id >= FRAME_POOL_COUNT || !s_pools[id].base) return 0;
+    return s_pools[id].block_size;
+}
+
+esp_err_t frame_pool_get_stats(frame_pool_id_t id, frame_pool_stats_t *out)
+{
+    if (id >= FRAME_POOL_COUNT || !out) return ESP_ERR_INVALID_ARG;
+    const frame_pool_t *p = &s_pools[id];
+    if (!p->base) return ESP_ERR_INVALID_STATE;
+
+    out->block_size = p->block_size;
+    out->block_count = p->block_count;
+    out->in_use = atomic_load_explicit(&p->in_use, memory_order_relaxed);
+    out->high_water = atomic_load_explicit(&p->high_water, memory_order_relaxed);
+    out->alloc_fail = atomic_load_explicit(&p->alloc_fail, memory_order_relaxed);
+    return ESP_OK;
+}
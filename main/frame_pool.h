@@ -0,0 +1,64 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    FRAME_POOL_INTERNAL = 0,   // DMA-capable internal RAM, chunk/packet sized blocks
+    FRAME_POOL_PSRAM,          // PSRAM, frame sized blocks
+    FRAME_POOL_COUNT,
+} frame_pool_id_t;
+
+typedef struct {
+    size_t block_size;
+    uint32_t block_count;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t alloc_fail;
+} frame_pool_stats_t;
+
+/**
+ * @brief Allocate the fixed-block pools sized by Kconfig.
+ *
+ * Blocks are aligned to the cache line so they can be handed to DMA engines.
+ * Safe to call more than once.
+ */
+esp_err_t frame_pool_init(void);
+
+/**
+ * @brief Take one block from a pool in O(1) without locking.
+ *
+ * @return NULL if the pool is exhausted or len exceeds the block size.
+ */
+void *frame_pool_alloc(frame_pool_id_t id, size_t len);
+
+/**
+ * @brief Return a block to the pool it came from.
+ *
+ * Pointers that do not belong to any pool are passed to free(), so callers
+ * may fall back to malloc() when frame_pool_alloc() returns NULL.
+ */
+void frame_pool_free(void *ptr);
+
+/** @brief Block size of a pool, 0 if the pool is not available. */
+size_t frame_pool_block_size(frame_pool_id_t id);
+
+esp_err_t frame_pool_get_stats(frame_pool_id_t id, frame_pool_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,22 +1,45 @@
 #include "nvs_flash.h"
-#include "esp_wifi.h"
 #include "esp_event.h"
-#include "esp_netif.h"
 #include "esp_log.h"
 #include <inttypes.h>
-#include "ethernet.h"
 #include "mqtt_video.h"
 #include "video_streamer.h"
 #include "flash_store.h"
 #include "flash_uploader.h"
+#include "frame_pool.h"
+#include "time_sync.h"
+#include "cam_stats.h"
+#include "cam_trace.h"
+#include "cam_bench.h"
+#include "cam_soak.h"
+#include "cam_ctrl.h"
 #include "sdkconfig.h"
 
+#if CONFIG_IDF_TARGET_LINUX
+#include <stdlib.h>
+#else
+#include "esp_netif.h"
+#include "ethernet.h"
+#endif
+
 #ifdef CONFIG_ESP_EXT_CONN_ENABLE
 #include "esp_extconn.h"
 #endif
 
 static const char *TAG = "app";
 
+// On target app_main returns and the idle task keeps running; the host
+// build exits instead so scripted runs terminate with a status. Flash
+// recording keeps running after a successful record for the uploader.
+static void app_done(esp_err_t err)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    exit(err == ESP_OK ? 0 : 1);
+#else
+    (void)err;
+#endif
+}
+
 void app_main(void) {
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -26,7 +49,19 @@ void app_main(void) {
         ESP_ERROR_CHECK(err);
     }
 
+    err = cam_trace_init();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Tracing disabled: %s", esp_err_to_name(err));
+    }
+
+    err = frame_pool_init();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Frame pools degraded, using heap: %s", esp_err_to_name(err));
+    }
+
+#if !CONFIG_IDF_TARGET_LINUX
     ESP_ERROR_CHECK(esp_netif_init());
+#endif
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
 #ifdef CONFIG_ESP_EXT_CONN_ENABLE
@@ -34,28 +69,61 @@ void app_main(void) {
     ESP_ERROR_CHECK(esp_extconn_init(&ext_config));
 #endif
 
+#if !CONFIG_IDF_TARGET_LINUX
     err = ethernet_start_and_wait();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Ethernet init failed: %s", esp_err_to_name(err));
+        app_done(err);
         return;
     }
+#endif
+
+#if CONFIG_P4_STAGE_TIMES
+    // Not fatal: frames just go out without stage times until synced.
+    time_sync_start(5000);
+#endif
 
     err = mqtt_video_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "MQTT init failed: %s", esp_err_to_name(err));
+        app_done(err);
         return;
     }
 
-#if CONFIG_P4_RECORD_TO_FLASH
+    err = cam_stats_start();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Stats task not started: %s", esp_err_to_name(err));
+    }
+
+    err = cam_ctrl_start();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Control topic not available: %s", esp_err_to_name(err));
+    }
+
+#if CONFIG_P4_BENCH
+    err = cam_bench_run();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Benchmark failed: %s", esp_err_to_name(err));
+    }
+    app_done(err);
+#elif CONFIG_P4_SOAK
+    err = cam_soak_run();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Soak failed: %s", esp_err_to_name(err));
+    }
+    app_done(err);
+#elif CONFIG_P4_RECORD_TO_FLASH
     err = flash_store_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Flash init failed: %s", esp_err_to_name(err));
+        app_done(err);
         return;
     }
 
     err = flash_uploader_start();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Flash uploader failed: %s", esp_err_to_name(err));
+        app_done(err);
         return;
     }
 
@@ -64,6 +132,7 @@ void app_main(void) {
     err = record_video_seconds_to_flash(CONFIG_P4_RECORD_SECONDS, &frames, &fps);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Flash record failed: %s", esp_err_to_name(err));
+        app_done(err);
         return;
     }
     ESP_LOGI(TAG, "Flash record done: frames=%" PRIu32 " fps=%.2f", frames, fps);
@@ -71,7 +140,9 @@ void app_main(void) {
     err = capture_video_seconds(CONFIG_P4_CAPTURE_SECONDS);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Video capture failed: %s", esp_err_to_name(err));
+        app_done(err);
         return;
     }
+    app_done(ESP_OK);
 #endif
 }
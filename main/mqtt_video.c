@@ -1,12 +1,88 @@
 #include "mqtt_video.h"
 
+#include <limits.h>
+#include <stdatomic.h>
+#include <string.h>
+
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mqtt_client.h"
+#include "coalesce_transport.h"
+#include "cam_stats.h"
+#include "cam_trace.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "sdkconfig.h"
 
 static const char *TAG = "mqtt_video";
 
 static esp_mqtt_client_handle_t s_client;
+static esp_transport_handle_t s_transport;
+
+#if CONFIG_P4_WIRE_MQTT5
+// Property setup and publish must not interleave between tasks.
+static SemaphoreHandle_t s_prop_lock;
+// Topic aliases live per connection. s_conn_gen moves on every connect and
+// disconnect; the first aliased publish of a generation carries the full
+// topic and maps the alias, later ones send an empty topic. The generation
+// the broker refused the alias in goes without. s_alias_gen and
+// s_alias_off_gen are under s_prop_lock.
+static atomic_uint s_conn_gen;
+static unsigned s_alias_gen = UINT_MAX;
+static unsigned s_alias_off_gen = UINT_MAX;
+#endif
+
+static atomic_bool s_connected;
+static atomic_uint s_frames_in_flight;
+static atomic_uint s_frames_sent;
+static atomic_uint s_frames_dropped;
+static atomic_uint s_frames_partial;
+static atomic_uint s_chunk_retries;
+
+static const char *s_ctrl_topic;
+static mqtt_video_ctrl_cb_t s_ctrl_cb;
+
+static void ctrl_data(const esp_mqtt_event_t *ev)
+{
+    // Messages larger than the client buffer arrive in pieces; commands
+    // are small, so only whole ones are taken.
+    if (!s_ctrl_cb || !s_ctrl_topic || ev->current_data_offset != 0 || ev->data_len != ev->total_data_len) return;
+    size_t n = strlen(s_ctrl_topic);
+    if ((size_t)ev->topic_len != n || memcmp(ev->topic, s_ctrl_topic, n) != 0) return;
+    s_ctrl_cb(ev->data, (size_t)ev->data_len);
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    (void)arg;
+    (void)base;
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+#if CONFIG_P4_WIRE_MQTT5
+        atomic_fetch_add(&s_conn_gen, 1);
+#endif
+        atomic_store(&s_connected, true);
+        ESP_LOGI(TAG, "MQTT connected");
+        if (s_ctrl_topic) {
+            esp_mqtt_client_subscribe(s_client, s_ctrl_topic, 0);
+        }
+        break;
+    case MQTT_EVENT_DATA:
+        ctrl_data((const esp_mqtt_event_t *)event_data);
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+#if CONFIG_P4_WIRE_MQTT5
+        atomic_fetch_add(&s_conn_gen, 1);
+#endif
+        atomic_store(&s_connected, false);
+        ESP_LOGW(TAG, "MQTT disconnected");
+        break;
+    default:
+        break;
+    }
+}
 
 esp_err_t mqtt_video_init(void)
 {
@@ -18,9 +94,33 @@ esp_err_t mqtt_video_init(void)
         .broker.address.uri = CONFIG_P4_MQTT_BROKER_URI,
     };
 
+#if CONFIG_P4_WIRE_MQTT5
+    cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+    s_prop_lock = xSemaphoreCreateMutex();
+    if (!s_prop_lock) return ESP_ERR_NO_MEM;
+#endif
+
+    // Plain mqtt:// brokers go through our transport, which coalesces and
+    // reports whether the socket can take more; the client owns and
+    // destroys it. Other schemes admit frames on the in-flight budget only.
+    if (strncmp(CONFIG_P4_MQTT_BROKER_URI, "mqtt://", 7) == 0) {
+#if CONFIG_P4_MQTT_COALESCE
+        s_transport = coalesce_transport_create(CONFIG_P4_MQTT_COALESCE_BYTES);
+#else
+        s_transport = coalesce_transport_create(0);
+#endif
+        if (s_transport) {
+            cfg.network.transport = s_transport;
+        } else {
+            ESP_LOGW(TAG, "Own TCP transport unavailable, no send buffer backpressure");
+        }
+    }
+
     s_client = esp_mqtt_client_init(&cfg);
     if (!s_client) return ESP_FAIL;
 
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
     esp_err_t err = esp_mqtt_client_start(s_client);
     if (err != ESP_OK) return err;
 
@@ -28,18 +128,224 @@ esp_err_t mqtt_video_init(void)
     return ESP_OK;
 }
 
+// Counts a refused frame the same way whoever asks.
+static esp_err_t refuse(esp_err_t err)
+{
+    atomic_fetch_add(&s_frames_dropped, 1);
+    cam_stats_inc(err == ESP_ERR_INVALID_STATE ? CAM_STAT_DROP_DISCONNECTED : CAM_STAT_DROP_BACKPRESSURE);
+    return err;
+}
+
+esp_err_t mqtt_video_frame_admissible(void)
+{
+    if (!s_client) return ESP_ERR_INVALID_STATE;
+    if (!atomic_load(&s_connected)) return refuse(ESP_ERR_INVALID_STATE);
+    if (atomic_load(&s_frames_in_flight) >= CONFIG_P4_MQTT_MAX_FRAMES_IN_FLIGHT) return refuse(ESP_ERR_NO_MEM);
+    if (s_transport && !coalesce_transport_writable(s_transport)) return refuse(ESP_ERR_NO_MEM);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_video_frame_begin(size_t wire_bytes)
+{
+    (void)wire_bytes;   // lwIP cannot tell how much of the send buffer is free
+    if (!s_client) return ESP_ERR_INVALID_STATE;
+
+    if (!atomic_load(&s_connected)) {
+        return refuse(ESP_ERR_INVALID_STATE);
+    }
+
+    unsigned in_flight = atomic_fetch_add(&s_frames_in_flight, 1);
+    if (in_flight >= CONFIG_P4_MQTT_MAX_FRAMES_IN_FLIGHT) {
+        atomic_fetch_sub(&s_frames_in_flight, 1);
+        return refuse(ESP_ERR_NO_MEM);
+    }
+
+    // Chunks go out at QoS 0, which the client writes to the socket at once
+    // instead of queueing in its outbox. A send buffer that has not drained
+    // since the last frame means the link is behind: dropping now costs one
+    // frame, admitting it would stall the sender inside a socket write.
+    if (s_transport && !coalesce_transport_writable(s_transport)) {
+        atomic_fetch_sub(&s_frames_in_flight, 1);
+        return refuse(ESP_ERR_NO_MEM);
+    }
+
+    if (s_transport) {
+        coalesce_transport_begin(s_transport);
+    }
+    return ESP_OK;
+}
+
+void mqtt_video_frame_end(bool complete)
+{
+    if (s_transport && coalesce_transport_end(s_transport) != ESP_OK) {
+        complete = false;
+    }
+    atomic_fetch_sub(&s_frames_in_flight, 1);
+    atomic_fetch_add(complete ? &s_frames_sent : &s_frames_partial, 1);
+    cam_stats_inc(complete ? CAM_STAT_FRAMES_SENT : CAM_STAT_DROP_PARTIAL);
+}
+
+#if CONFIG_P4_WIRE_MQTT5
+// Caller holds s_prop_lock.
+static int publish_props(const char *topic, uint16_t alias, const uint8_t *data, size_t len,
+                         const mqtt_video_user_prop_t *props, size_t prop_count)
+{
+    esp_mqtt5_publish_property_config_t property = {
+        .topic_alias = alias,
+    };
+    if (prop_count > 0) {
+        esp_mqtt5_client_set_user_property(&property.user_property,
+                                           (esp_mqtt5_user_property_item_t *)props, (uint8_t)prop_count);
+    }
+    esp_mqtt5_client_set_publish_property(s_client, &property);
+    int msg_id = esp_mqtt_client_publish(s_client, topic, (const char *)data, (int)len, 0, 0);
+    if (property.user_property) {
+        esp_mqtt5_client_delete_user_property(property.user_property);
+    }
+    return msg_id;
+}
+#endif
+
+static int publish_once(const uint8_t *data, size_t len,
+                        const mqtt_video_user_prop_t *props, size_t prop_count)
+{
+#if CONFIG_P4_WIRE_MQTT5
+    xSemaphoreTake(s_prop_lock, portMAX_DELAY);
+    unsigned gen = atomic_load(&s_conn_gen);
+    int msg_id;
+    if (gen == s_alias_off_gen) {
+        msg_id = publish_props(CONFIG_P4_MQTT_TOPIC, 0, data, len, props, prop_count);
+    } else if (gen == s_alias_gen) {
+        msg_id = publish_props("", CONFIG_P4_MQTT5_TOPIC_ALIAS, data, len, props, prop_count);
+    } else {
+        msg_id = publish_props(CONFIG_P4_MQTT_TOPIC, CONFIG_P4_MQTT5_TOPIC_ALIAS, data, len, props, prop_count);
+        if (msg_id >= 0) {
+            s_alias_gen = gen;
+        } else if (atomic_load(&s_connected)) {
+            // The client refuses aliases above the broker's Topic Alias
+            // Maximum from CONNACK, which it does not expose.
+            ESP_LOGW(TAG, "broker refused topic alias %d, sending the full topic", CONFIG_P4_MQTT5_TOPIC_ALIAS);
+            s_alias_off_gen = gen;
+            msg_id = publish_props(CONFIG_P4_MQTT_TOPIC, 0, data, len, props, prop_count);
+        }
+    }
+    xSemaphoreGive(s_prop_lock);
+    return msg_id;
+#else
+    (void)props;
+    (void)prop_count;
+    return esp_mqtt_client_publish(s_client, CONFIG_P4_MQTT_TOPIC, (const char *)data, (int)len, 0, 0);
+#endif
+}
+
+esp_err_t mqtt_video_publish_chunk_props(const uint8_t *data, size_t len,
+                                         const mqtt_video_user_prop_t *props, size_t prop_count)
+{
+    if (!s_client) return ESP_ERR_INVALID_STATE;
+
+    // A frame that was admitted by mqtt_video_frame_begin() must not lose a
+    // middle chunk to a transient rejection, so retry while still connected.
+    for (int attempt = 0; ; attempt++) {
+        CAM_TRACE_BEGIN(PUBLISH_CHUNK);
+        int msg_id = publish_once(data, len, props, prop_count);
+        CAM_TRACE_END(PUBLISH_CHUNK, len);
+        if (msg_id >= 0) {
+            cam_stats_inc(CAM_STAT_CHUNKS_SENT);
+            cam_stats_add(CAM_STAT_BYTES_SENT, (uint32_t)len);
+            return ESP_OK;
+        }
+
+        if (attempt >= CONFIG_P4_MQTT_CHUNK_RETRIES || !atomic_load(&s_connected)) {
+            return ESP_FAIL;
+        }
+        atomic_fetch_add(&s_chunk_retries, 1);
+        vTaskDelay(1);
+    }
+}
+
 esp_err_t mqtt_video_publish_chunk(const uint8_t *data, size_t len)
 {
+    return mqtt_video_publish_chunk_props(data, len, NULL, 0);
+}
+
+esp_err_t mqtt_video_get_status(mqtt_video_status_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
     if (!s_client) return ESP_ERR_INVALID_STATE;
 
-    int msg_id = esp_mqtt_client_publish(
-        s_client,
-        CONFIG_P4_MQTT_TOPIC,
-        (const char *)data,
-        (int)len,
-        0,  // qos
-        0   // retain
-    );
+    int outbox = esp_mqtt_client_get_outbox_size(s_client);
+    out->connected = atomic_load(&s_connected);
+    out->outbox_bytes = outbox > 0 ? (size_t)outbox : 0;
+    out->frames_in_flight = atomic_load(&s_frames_in_flight);
+    out->frames_sent = atomic_load(&s_frames_sent);
+    out->frames_dropped = atomic_load(&s_frames_dropped);
+    out->frames_partial = atomic_load(&s_frames_partial);
+    out->chunk_retries = atomic_load(&s_chunk_retries);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_video_publish_aux(const char *topic, const void *data, size_t len)
+{
+    if (!topic || !data) return ESP_ERR_INVALID_ARG;
+    if (!s_client || !atomic_load(&s_connected)) return ESP_ERR_INVALID_STATE;
 
-    return (msg_id >= 0) ? ESP_OK : ESP_FAIL;
+#if CONFIG_P4_WIRE_MQTT5
+    // Clear the video topic alias and any user properties for this publish;
+    // the next video chunk sets its own again.
+    xSemaphoreTake(s_prop_lock, portMAX_DELAY);
+    esp_mqtt5_publish_property_config_t property = { 0 };
+    esp_mqtt5_client_set_publish_property(s_client, &property);
+#endif
+    int msg_id = esp_mqtt_client_publish(s_client, topic, (const char *)data, (int)len, 0, 0);
+#if CONFIG_P4_WIRE_MQTT5
+    xSemaphoreGive(s_prop_lock);
+#endif
+    return msg_id >= 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t mqtt_video_set_ctrl_handler(const char *topic, mqtt_video_ctrl_cb_t cb)
+{
+    if (!topic || !cb) return ESP_ERR_INVALID_ARG;
+    if (!s_client) return ESP_ERR_INVALID_STATE;
+
+    s_ctrl_cb = cb;
+    s_ctrl_topic = topic;
+    // Otherwise MQTT_EVENT_CONNECTED subscribes.
+    if (atomic_load(&s_connected) && esp_mqtt_client_subscribe(s_client, topic, 0) < 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+bool mqtt_video_wait_connected(uint32_t timeout_ms)
+{
+    int64_t end_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (!atomic_load(&s_connected)) {
+        if (esp_timer_get_time() >= end_us) return false;
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    return true;
+}
+
+bool mqtt_video_wait_idle(uint32_t timeout_ms)
+{
+    int64_t end_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    mqtt_video_status_t st;
+    while (mqtt_video_get_status(&st) == ESP_OK && st.connected) {
+        if (st.outbox_bytes == 0 && st.frames_in_flight == 0) return true;
+        if (esp_timer_get_time() >= end_us) return false;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return false;
+}
+
+esp_err_t mqtt_video_reconnect(void)
+{
+    if (!s_client) return ESP_ERR_INVALID_STATE;
+
+    esp_err_t err = esp_mqtt_client_stop(s_client);
+    if (err != ESP_OK) return err;
+    atomic_store(&s_connected, false);
+    ESP_LOGI(TAG, "MQTT restarting");
+    return esp_mqtt_client_start(s_client);
 }
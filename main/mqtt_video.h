@@ -1,7 +1,86 @@
 #pragma once
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include "esp_err.h"
 
+typedef struct {
+    bool connected;
+    size_t outbox_bytes;        // bytes queued in the MQTT client outbox
+    uint32_t frames_in_flight;  // frames admitted but not fully handed to the client
+    uint32_t frames_sent;
+    uint32_t frames_dropped;    // rejected up front by mqtt_video_frame_begin()
+    uint32_t frames_partial;    // admitted but aborted mid-frame (connection lost)
+    uint32_t chunk_retries;
+} mqtt_video_status_t;
+
+typedef struct {
+    const char *key;
+    const char *value;
+} mqtt_video_user_prop_t;
+
 esp_err_t mqtt_video_init(void);
+
+/**
+ * Admit a frame of wire_bytes before any of its chunks is published.
+ * Returns ESP_ERR_INVALID_STATE when disconnected and ESP_ERR_NO_MEM when the
+ * in-flight budget is exhausted or the socket send buffer is still full
+ * (mqtt:// brokers); the caller drops the whole frame.
+ * Every ESP_OK must be paired with mqtt_video_frame_end().
+ */
+esp_err_t mqtt_video_frame_begin(size_t wire_bytes);
+void mqtt_video_frame_end(bool complete);
+
+/**
+ * The checks of mqtt_video_frame_begin() without admitting anything, for
+ * callers that can skip producing a frame that would be dropped (an H.264
+ * P frame encoded and then dropped leaves the next one referencing a
+ * picture receivers never got). A refusal counts as a dropped frame; a frame
+ * that passes can still be refused by mqtt_video_frame_begin() later.
+ */
+esp_err_t mqtt_video_frame_admissible(void);
+
 esp_err_t mqtt_video_publish_chunk(const uint8_t *data, size_t len);
+
+/**
+ * Same as mqtt_video_publish_chunk() but attaches MQTT 5 user properties.
+ * With MQTT 3.1.1 the properties are silently dropped.
+ */
+esp_err_t mqtt_video_publish_chunk_props(const uint8_t *data, size_t len,
+                                         const mqtt_video_user_prop_t *props, size_t prop_count);
+esp_err_t mqtt_video_get_status(mqtt_video_status_t *out);
+
+/**
+ * Publish a small side-channel message (stats, traces) to topic at QoS 0.
+ * Not subject to the frame admission budget; returns ESP_ERR_INVALID_STATE
+ * when disconnected.
+ */
+esp_err_t mqtt_video_publish_aux(const char *topic, const void *data, size_t len);
+
+/**
+ * Called from the MQTT task with each complete message on the control topic;
+ * data is not NUL-terminated and is only valid during the call.
+ */
+typedef void (*mqtt_video_ctrl_cb_t)(const char *data, size_t len);
+
+/**
+ * Subscribe to topic (QoS 0), now and after every reconnect, and hand its
+ * messages to cb. One handler; a second call replaces the first.
+ */
+esp_err_t mqtt_video_set_ctrl_handler(const char *topic, mqtt_video_ctrl_cb_t cb);
+
+/** Block until connected or timeout_ms passes; true when connected. */
+bool mqtt_video_wait_connected(uint32_t timeout_ms);
+
+/**
+ * Block until the outbox is empty and no frame is in flight, i.e. everything
+ * published so far was written to the socket. False on timeout or when the
+ * connection drops while waiting.
+ */
+bool mqtt_video_wait_idle(uint32_t timeout_ms);
+
+/**
+ * Stop the client and start it again, dropping the broker connection and
+ * anything still queued. Must not be called from MQTT event handlers.
+ */
+esp_err_t mqtt_video_reconnect(void);
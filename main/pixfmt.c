@@ -0,0 +1,156 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "pixfmt.h"
+
+#include <stdbool.h>
+
+#include "linux/videodev2.h"
+
+size_t pixfmt_frame_size(uint32_t fmt, uint32_t width, uint32_t height)
+{
+    size_t px = (size_t)width * height;
+    switch (fmt) {
+    case V4L2_PIX_FMT_RGB565:
+    case V4L2_PIX_FMT_YUV422P:
+        return px * 2;
+    case V4L2_PIX_FMT_YUV420:
+        return px * 3 / 2;
+    default:
+        return 0;
+    }
+}
+
+const char *pixfmt_name(uint32_t fmt)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_RGB565: return "rgb565";
+    case V4L2_PIX_FMT_YUV422P: return "yuv422";
+    case V4L2_PIX_FMT_YUV420: return "yuv420";
+    default: return "?";
+    }
+}
+
+static inline void expand(uint16_t p, int *r, int *g, int *b)
+{
+    *r = (p >> 11) & 0x1F;
+    *g = (p >> 5) & 0x3F;
+    *b = p & 0x1F;
+    *r = (*r << 3) | (*r >> 2);
+    *g = (*g << 2) | (*g >> 4);
+    *b = (*b << 3) | (*b >> 2);
+}
+
+static inline uint8_t clamp_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// Full-range BT.601; the chroma helpers take sums over 1 << shift pixels.
+static inline uint8_t luma(int r, int g, int b)
+{
+    return (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+static inline uint8_t cb(int sr, int sg, int sb, int shift)
+{
+    return clamp_u8(((-43 * sr - 85 * sg + 128 * sb + (128 << shift)) >> (8 + shift)) + 128);
+}
+
+static inline uint8_t cr(int sr, int sg, int sb, int shift)
+{
+    return clamp_u8(((128 * sr - 107 * sg - 21 * sb + (128 << shift)) >> (8 + shift)) + 128);
+}
+
+esp_err_t pixfmt_from_rgb565(uint32_t fmt, const uint16_t *src, uint8_t *dst,
+                             uint32_t width, uint32_t height)
+{
+    if (!src || !dst || width == 0 || height == 0) return ESP_ERR_INVALID_ARG;
+    const uint32_t W = width, H = height;
+
+    switch (fmt) {
+    case V4L2_PIX_FMT_RGB565:
+        for (size_t i = 0; i < (size_t)W * H; i++) {
+            dst[2 * i] = (uint8_t)src[i];
+            dst[2 * i + 1] = (uint8_t)(src[i] >> 8);
+        }
+        return ESP_OK;
+
+    case V4L2_PIX_FMT_YUV422P:
+        if (W & 1) return ESP_ERR_INVALID_ARG;
+        for (uint32_t y = 0; y < H; y++) {
+            const uint16_t *s = src + (size_t)y * W;
+            uint8_t *d = dst + (size_t)y * W * 2;
+            for (uint32_t x = 0; x < W; x += 2) {
+                int r0, g0, b0, r1, g1, b1;
+                expand(s[x], &r0, &g0, &b0);
+                expand(s[x + 1], &r1, &g1, &b1);
+                *d++ = luma(r0, g0, b0);
+                *d++ = cb(r0 + r1, g0 + g1, b0 + b1, 1);
+                *d++ = luma(r1, g1, b1);
+                *d++ = cr(r0 + r1, g0 + g1, b0 + b1, 1);
+            }
+        }
+        return ESP_OK;
+
+    case V4L2_PIX_FMT_YUV420:
+        if ((W | H) & 1) return ESP_ERR_INVALID_ARG;
+        for (uint32_t y = 0; y < H; y += 2) {
+            uint8_t *l0 = dst + (size_t)y * W * 3 / 2;
+            uint8_t *l1 = l0 + W * 3 / 2;
+            for (uint32_t x = 0; x < W; x += 2) {
+                int sr = 0, sg = 0, sb = 0;
+                uint8_t yy[4];
+                for (int k = 0; k < 4; k++) {
+                    int r, g, b;
+                    expand(src[(size_t)(y + (k >> 1)) * W + x + (k & 1)], &r, &g, &b);
+                    yy[k] = luma(r, g, b);
+                    sr += r;
+                    sg += g;
+                    sb += b;
+                }
+                *l0++ = cb(sr, sg, sb, 2);
+                *l0++ = yy[0];
+                *l0++ = yy[1];
+                *l1++ = cr(sr, sg, sb, 2);
+                *l1++ = yy[2];
+                *l1++ = yy[3];
+            }
+        }
+        return ESP_OK;
+
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+void pixfmt_limited_luts(const uint8_t **y_lut, const uint8_t **c_lut)
+{
+    static uint8_t s_luma[256], s_chroma[256];
+    static bool s_built;
+    if (!s_built) {
+        for (int v = 0; v < 256; v++) {
+            s_luma[v] = (uint8_t)(16 + (v * 219 + 127) / 255);
+            s_chroma[v] = (uint8_t)(16 + (v * 224 + 127) / 255);
+        }
+        s_built = true;
+    }
+    *y_lut = s_luma;
+    *c_lut = s_chroma;
+}
+
+void pixfmt_yuv420_to_limited(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height)
+{
+    const uint8_t *ly, *lc;
+    pixfmt_limited_luts(&ly, &lc);
+
+    // Every third byte is chroma in both line types.
+    size_t n = (size_t)width * height * 3 / 2;
+    for (size_t i = 0; i < n; i += 3) {
+        dst[i] = lc[src[i]];
+        dst[i + 1] = ly[src[i + 1]];
+        dst[i + 2] = ly[src[i + 2]];
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef PIXFMT_H
+#define PIXFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Capture pixel formats the encoders take, by their APP_VIDEO_FMT_* (V4L2)
+ * code, laid out the way esp_video delivers them:
+ *
+ *   RGB565   2 B/px, little endian
+ *   YUV422   2 B/px, packed Y0 U Y1 V (what the JPEG engine reads as YUV422)
+ *   YUV420   1.5 B/px, packed O_UYY_E_VYY: each pair of lines is
+ *            "U Y Y U Y Y ..." then "V Y Y V Y Y ...", one U and V per 2x2
+ *
+ * YUV samples are full-range BT.601 (JFIF), which is what the ISP produces
+ * and what JPEG expects; H.264 encoders narrow them to limited range.
+ */
+
+/** @brief Bytes per frame, 0 for a format not listed above. */
+size_t pixfmt_frame_size(uint32_t fmt, uint32_t width, uint32_t height);
+
+/** @brief Short lower-case name ("rgb565", "yuv422", "yuv420", "?"). */
+const char *pixfmt_name(uint32_t fmt);
+
+/**
+ * @brief Convert an RGB565 frame to @p fmt, the way the ISP would.
+ *
+ * Used where frames do not come from the ISP: the simulated camera, the
+ * benchmark test frame and encoders that have no RGB input of their own.
+ * Width and height must be even for the YUV formats.
+ */
+esp_err_t pixfmt_from_rgb565(uint32_t fmt, const uint16_t *src, uint8_t *dst,
+                             uint32_t width, uint32_t height);
+
+/** @brief Full to limited range lookup tables, 256 entries each. */
+void pixfmt_limited_luts(const uint8_t **y_lut, const uint8_t **c_lut);
+
+/**
+ * @brief Full to limited range (Y 16..235, U/V 16..240) over a YUV420
+ *        frame in the layout above. @p dst may equal @p src.
+ */
+void pixfmt_yuv420_to_limited(const uint8_t *src, uint8_t *dst, uint32_t width, uint32_t height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "time_sync.h"
+
+#include <stdatomic.h>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_netif_sntp.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "time_sync";
+#endif
+
+static atomic_bool s_synced;
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void on_sync(struct timeval *tv)
+{
+    (void)tv;
+    if (!atomic_exchange(&s_synced, true)) {
+        ESP_LOGI(TAG, "Clock synced to %s", CONFIG_P4_SNTP_SERVER);
+    }
+}
+#endif
+
+esp_err_t time_sync_start(uint32_t timeout_ms)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    (void)timeout_ms;
+    atomic_store(&s_synced, true);
+    return ESP_OK;
+#else
+    esp_sntp_config_t cfg = ESP_NETIF_SNTP_DEFAULT_CONFIG(CONFIG_P4_SNTP_SERVER);
+    cfg.sync_cb = on_sync;
+    esp_err_t err = esp_netif_sntp_init(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SNTP init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_netif_sntp_sync_wait(pdMS_TO_TICKS(timeout_ms));
+    if (err == ESP_OK) {
+        atomic_store(&s_synced, true);
+    } else {
+        ESP_LOGW(TAG, "No SNTP sync after %u ms; stage times start once synced", (unsigned)timeout_ms);
+    }
+    return err;
+#endif
+}
+
+bool time_sync_to_unix_us(int64_t timer_us, uint64_t *unix_us)
+{
+    if (!atomic_load(&s_synced) || !unix_us) return false;
+
+    // Offset between the wall clock and esp_timer, taken now so SNTP slews
+    // apply; both reads are a few microseconds apart.
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t now_timer = esp_timer_get_time();
+    int64_t now_unix = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    *unix_us = (uint64_t)(now_unix - now_timer + timer_us);
+    return true;
+}
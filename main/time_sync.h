@@ -0,0 +1,39 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start SNTP against CONFIG_P4_SNTP_SERVER and wait up to
+ *        timeout_ms for the first sync.
+ *
+ * Returns ESP_ERR_TIMEOUT if the clock is not synced yet; SNTP keeps
+ * running and time_sync_to_unix_us() starts succeeding once it is. The host
+ * build uses the host clock and always succeeds.
+ */
+esp_err_t time_sync_start(uint32_t timeout_ms);
+
+/**
+ * @brief Convert an esp_timer_get_time() stamp to Unix time in microseconds.
+ *
+ * @return false while the wall clock is not synced.
+ */
+bool time_sync_to_unix_us(int64_t timer_us, uint64_t *unix_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef VID_WIRE_H
+#define VID_WIRE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * VID1 chunk layout (little endian, no ESP-IDF dependencies so host tools
+ * can build this file as is):
+ *
+ *   u8     'V'
+ *   u8     version << 4 | flags        version = 1
+ *   varint frame_id
+ *   varint chunk_id
+ *   -- only when flags & VID1_FLAG_META (chunk 0) --
+ *   varint clip_id, ts_ms, chunk_count, frame_size
+ *   u32    fourcc
+ *   varint width, height
+ *   -- only when flags & VID1_FLAG_TIMES (last chunk) --
+ *   u64    dqbuf_us                    Unix time, SNTP synced
+ *   varint enc_start, enc_end, first_send, last_send   (us after dqbuf_us)
+ *   -- every chunk --
+ *   u32    CRC32C over all header bytes above and the payload
+ *   payload
+ */
+#define VID1_MAGIC          0x56u
+#define VID1_VERSION        1u
+#define VID1_FLAG_META      0x01u
+#define VID1_FLAG_TIMES     0x02u
+#define VID1_FLAG_KEY       0x04u   // every chunk of a keyframe
+
+// Worst case header, CRC included: every varint at its longest (5 bytes for
+// u32 fields, 3 for u16), 42 bytes with metadata, 70 with the stage times.
+#define VID1_VARINT_MAX_U16 3u
+#define VID1_VARINT_MAX_U32 5u
+#define VID1_MAX_HDR_BASE   (2u + VID1_VARINT_MAX_U32 + VID1_VARINT_MAX_U16)
+#define VID1_MAX_HDR_META   (3u * VID1_VARINT_MAX_U32 + 3u * VID1_VARINT_MAX_U16 + 4u)
+#define VID1_MAX_HDR_TIMES  (8u + 4u * VID1_VARINT_MAX_U32)
+#define VID1_MAX_HDR        (VID1_MAX_HDR_BASE + VID1_MAX_HDR_META + VID1_MAX_HDR_TIMES + 4u)
+
+#define VID_FOURCC(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define VID_FOURCC_MJPG     VID_FOURCC('M', 'J', 'P', 'G')
+#define VID_FOURCC_H264     VID_FOURCC('H', '2', '6', '4')  // Annex B, SPS/PPS before each IDR
+
+// Per-stage timestamps of one frame. Sent on the last chunk, when the last
+// send time is known; receivers add their own arrival time.
+typedef struct {
+    uint64_t dqbuf_us;
+    uint32_t enc_start;
+    uint32_t enc_end;
+    uint32_t first_send;
+    uint32_t last_send;
+} vid1_times_t;
+
+typedef struct {
+    uint32_t frame_id;
+    uint16_t chunk_id;
+    bool keyframe;
+    bool has_meta;
+    // Valid when has_meta is set.
+    uint32_t clip_id;
+    uint32_t ts_ms;
+    uint16_t chunk_count;
+    uint32_t frame_size;
+    uint32_t fourcc;
+    uint16_t width;
+    uint16_t height;
+    bool has_times;
+    vid1_times_t times;     // valid when has_times is set
+} vid1_hdr_t;
+
+typedef enum {
+    VID1_OK = 0,
+    VID1_ERR_SHORT = -1,
+    VID1_ERR_MAGIC = -2,
+    VID1_ERR_VERSION = -3,
+    VID1_ERR_VARINT = -4,
+    VID1_ERR_RANGE = -5,
+    VID1_ERR_CRC = -6,
+} vid1_err_t;
+
+/** @brief CRC32C (Castagnoli), table driven. Pass 0 as the initial crc. */
+uint32_t vid_crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Write a VID1 header followed by its CRC, covering the payload.
+ *
+ * @param out Buffer of at least VID1_MAX_HDR bytes; the payload goes right after.
+ * @return Bytes written (header + CRC), i.e. the payload offset.
+ */
+size_t vid1_write(uint8_t *out, const vid1_hdr_t *hdr, const uint8_t *payload, size_t payload_len);
+
+/**
+ * @brief Validate and decode one VID1 chunk.
+ *
+ * Never reads outside [pkt, pkt + len). On success payload points into pkt.
+ */
+vid1_err_t vid1_parse(const uint8_t *pkt, size_t len, vid1_hdr_t *out,
+                      const uint8_t **payload, size_t *payload_len);
+
+/**
+ * @brief True when an Annex B H.264 access unit contains an IDR slice
+ *        (NAL type 5). For senders and receivers without VID1's key flag.
+ */
+bool vid_h264_is_keyframe(const uint8_t *au, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
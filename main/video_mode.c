@@ -0,0 +1,62 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "video_mode.h"
+
+#include "pixfmt.h"
+
+uint32_t video_mode_mb_s(const video_mode_t *mode, uint32_t fps)
+{
+    if (mode->fps) fps = mode->fps;
+    uint64_t bytes = (uint64_t)pixfmt_frame_size(mode->pixfmt, mode->width, mode->height) * fps;
+    return (uint32_t)((bytes + 999999) / 1000000);
+}
+
+static int fmt_rank(const uint32_t *fmts, size_t nfmts, uint32_t pixfmt)
+{
+    for (size_t i = 0; i < nfmts; i++) {
+        if (fmts[i] == pixfmt) return (int)i;
+    }
+    return -1;
+}
+
+static bool covers(const video_mode_t *m, const video_mode_req_t *req)
+{
+    return m->width >= req->width && m->height >= req->height;
+}
+
+// True when a is the better pick of two modes that both qualify.
+static bool better(const video_mode_t *a, const video_mode_t *b, const video_mode_req_t *req,
+                   const uint32_t *fmts, size_t nfmts)
+{
+    bool ca = covers(a, req), cb = covers(b, req);
+    if (ca != cb) return ca;
+    uint64_t area_a = (uint64_t)a->width * a->height;
+    uint64_t area_b = (uint64_t)b->width * b->height;
+    if (area_a != area_b) return ca ? area_a < area_b : area_a > area_b;
+    int ra = fmt_rank(fmts, nfmts, a->pixfmt), rb = fmt_rank(fmts, nfmts, b->pixfmt);
+    if (ra != rb) return ra < rb;
+    return a->fps > b->fps;
+}
+
+esp_err_t video_mode_pick(const video_mode_t *modes, size_t count, const video_mode_req_t *req,
+                          const uint32_t *fmts, size_t nfmts, video_mode_t *out)
+{
+    if (!modes || !req || !fmts || !out) return ESP_ERR_INVALID_ARG;
+
+    const video_mode_t *best = NULL;
+    for (size_t i = 0; i < count; i++) {
+        const video_mode_t *m = &modes[i];
+        if (fmt_rank(fmts, nfmts, m->pixfmt) < 0) continue;
+        if (req->pixfmt && m->pixfmt != req->pixfmt) continue;
+        // An unknown frame rate is taken to meet the request.
+        if (req->fps && m->fps && m->fps < req->fps) continue;
+        if (req->max_mb_s && video_mode_mb_s(m, req->fps) > req->max_mb_s) continue;
+        if (!best || better(m, best, req, fmts, nfmts)) best = m;
+    }
+    if (!best) return ESP_ERR_NOT_FOUND;
+    *out = *best;
+    return ESP_OK;
+}
@@ -0,0 +1,59 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef VIDEO_MODE_H
+#define VIDEO_MODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIDEO_MODE_MAX  32      // modes kept from one enumeration
+
+/** @brief One capture mode: format, frame size and best frame rate. */
+typedef struct {
+    uint32_t pixfmt;            // APP_VIDEO_FMT_*
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;               // 0 when the driver does not report it
+} video_mode_t;
+
+/** @brief What the capture should be; zero fields are "don't care". */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;               // minimum frame rate
+    uint32_t max_mb_s;          // cap on raw capture traffic, frame bytes x fps
+    uint32_t pixfmt;            // only this format
+} video_mode_req_t;
+
+/**
+ * @brief Pick the mode that best serves @p req.
+ *
+ * Only formats in @p fmts (and only req->pixfmt, when set) are considered.
+ * Modes that are too slow or would exceed the traffic cap are dropped; of
+ * the rest, the smallest one that covers the requested size wins, else the
+ * largest one below it. Ties go to the earlier format in @p fmts, then to
+ * the higher frame rate.
+ *
+ * @return ESP_ERR_NOT_FOUND when nothing qualifies.
+ */
+esp_err_t video_mode_pick(const video_mode_t *modes, size_t count, const video_mode_req_t *req,
+                          const uint32_t *fmts, size_t nfmts, video_mode_t *out);
+
+/** @brief Raw capture traffic of a mode in MB/s (fps 0 counts as @p fps). */
+uint32_t video_mode_mb_s(const video_mode_t *mode, uint32_t fps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,21 +5,28 @@
  */
 #include "video_packetizer.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
 #include "mqtt_video.h"
+#include "frame_pool.h"
+#include "vid_wire.h"
+#include "cam_stats.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#if CONFIG_P4_STAGE_TIMES
+#include "time_sync.h"
+#endif
 
 static const char *TAG = "pkt";
 
 #define VID_MAGIC 0x56494430u   // 'VID0'
 #define CHUNK_MAX 2048
 
-// FourCC helper (MJPG)
-#define FCC(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b)<<8) | ((uint32_t)(c)<<16) | ((uint32_t)(d)<<24))
-#define FOURCC_MJPG FCC('M','J','P','G')
-
 #pragma pack(push, 1)
 typedef struct {
     uint32_t magic;
@@ -33,8 +40,203 @@ typedef struct {
     uint16_t width;
     uint16_t height;
 } vid_hdr_t;
+
+// MQTT 5 mode: chunk 0 carries the frame metadata as user properties, every
+// chunk carries only this compact header and the topic goes as an alias.
+typedef struct {
+    uint16_t magic;
+    uint16_t chunk_id;
+    uint32_t frame_id;
+} vid_chdr_t;
 #pragma pack(pop)
 
+#define VID_COMPACT_MAGIC 0x3556u  // 'V5'
+
+#if CONFIG_P4_WIRE_MQTT5
+#define HDR_SIZE sizeof(vid_chdr_t)
+#elif CONFIG_P4_WIRE_VID1
+#define HDR_SIZE VID1_MAX_HDR
+#else
+#define HDR_SIZE sizeof(vid_hdr_t)
+#endif
+
+// put_header() writes the chunk header for the configured wire format and
+// returns the payload offset. VID1 needs the payload for its CRC.
+#if CONFIG_P4_WIRE_VID1
+static size_t put_header(uint8_t *pkt, const video_frame_meta_t *meta,
+                         uint16_t chunk_id, uint16_t chunk_count, uint32_t frame_size,
+                         const uint8_t *payload, size_t payload_len, const vid1_times_t *times)
+{
+    vid1_hdr_t hdr = {
+        .frame_id = meta->frame_id,
+        .chunk_id = chunk_id,
+        .keyframe = meta->keyframe,
+        .has_meta = chunk_id == 0,
+        .clip_id = meta->clip_id,
+        .ts_ms = meta->ts_ms,
+        .chunk_count = chunk_count,
+        .frame_size = frame_size,
+        .fourcc = meta->fourcc,
+        .width = meta->width,
+        .height = meta->height,
+        .has_times = times != NULL,
+    };
+    if (times) {
+        hdr.times = *times;
+    }
+    return vid1_write(pkt, &hdr, payload, payload_len);
+}
+#elif CONFIG_P4_WIRE_MQTT5
+static size_t put_header(uint8_t *pkt, const video_frame_meta_t *meta,
+                         uint16_t chunk_id, uint16_t chunk_count, uint32_t frame_size,
+                         const uint8_t *payload, size_t payload_len, const vid1_times_t *times)
+{
+    (void)chunk_count;
+    (void)frame_size;
+    (void)payload;
+    (void)payload_len;
+    (void)times;
+    vid_chdr_t hdr = {
+        .magic = VID_COMPACT_MAGIC,
+        .chunk_id = chunk_id,
+        .frame_id = meta->frame_id,
+    };
+    memcpy(pkt, &hdr, sizeof(hdr));
+    return sizeof(hdr);
+}
+#else
+static size_t put_header(uint8_t *pkt, const video_frame_meta_t *meta,
+                         uint16_t chunk_id, uint16_t chunk_count, uint32_t frame_size,
+                         const uint8_t *payload, size_t payload_len, const vid1_times_t *times)
+{
+    (void)payload;
+    (void)payload_len;
+    (void)times;
+    vid_hdr_t hdr = {
+        .magic = VID_MAGIC,
+        .clip_id = meta->clip_id,
+        .frame_id = meta->frame_id,
+        .ts_ms = meta->ts_ms,
+        .chunk_id = chunk_id,
+        .chunk_count = chunk_count,
+        .frame_size = frame_size,
+        .fourcc = meta->fourcc,
+        .width = meta->width,
+        .height = meta->height,
+    };
+    memcpy(pkt, &hdr, sizeof(hdr));
+    return sizeof(hdr);
+}
+#endif
+
+#if CONFIG_P4_STAGE_TIMES
+static uint32_t since(int64_t from_us, int64_t to_us)
+{
+    return to_us > from_us ? (uint32_t)(to_us - from_us) : 0;
+}
+
+// Fill the stage times for the last chunk; false until SNTP has synced or
+// when the capture side did not stamp the frame.
+static bool stage_times(const video_frame_meta_t *meta, int64_t first_send_us, vid1_times_t *t)
+{
+    if (meta->dqbuf_us == 0 || !time_sync_to_unix_us(meta->dqbuf_us, &t->dqbuf_us)) {
+        return false;
+    }
+    t->enc_start = since(meta->dqbuf_us, meta->enc_start_us);
+    t->enc_end = since(meta->dqbuf_us, meta->enc_end_us);
+    t->first_send = since(meta->dqbuf_us, first_send_us);
+    t->last_send = since(meta->dqbuf_us, esp_timer_get_time());
+    return true;
+}
+#endif
+
+esp_err_t video_packetizer_emit(const video_frame_meta_t *meta,
+                                const uint8_t *jpeg,
+                                uint32_t jpeg_size,
+                                size_t chunk_max,
+                                video_packetizer_sink_t sink,
+                                void *ctx)
+{
+    if (!meta || !jpeg || jpeg_size == 0 || !sink || chunk_max == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t chunk_count = (jpeg_size + chunk_max - 1) / chunk_max;
+    if (chunk_count > UINT16_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Keep the packet scratch off the (small) video task stack.
+    const size_t pkt_cap = HDR_SIZE + chunk_max;
+    uint8_t *pkt = (uint8_t *)frame_pool_alloc(FRAME_POOL_INTERNAL, pkt_cap);
+    if (!pkt) {
+        pkt = (uint8_t *)malloc(pkt_cap);
+        if (!pkt) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    esp_err_t err = ESP_OK;
+
+#if CONFIG_P4_STAGE_TIMES
+    int64_t first_send_us = 0;
+    vid1_times_t times;
+#endif
+
+    for (uint16_t chunk_id = 0; chunk_id < chunk_count; chunk_id++) {
+        size_t off = (size_t)chunk_id * chunk_max;
+        size_t remain = jpeg_size - off;
+        size_t take = remain > chunk_max ? chunk_max : remain;
+
+        const vid1_times_t *tp = NULL;
+#if CONFIG_P4_STAGE_TIMES
+        if (chunk_id == 0) {
+            first_send_us = esp_timer_get_time();
+        }
+        if (chunk_id == chunk_count - 1 && stage_times(meta, first_send_us, &times)) {
+            tp = &times;
+        }
+#endif
+        size_t hdr_len = put_header(pkt, meta, chunk_id, (uint16_t)chunk_count, jpeg_size, jpeg + off, take, tp);
+        memcpy(pkt + hdr_len, jpeg + off, take);
+
+        err = sink(pkt, hdr_len + take, chunk_id, ctx);
+        if (err != ESP_OK) {
+            break;
+        }
+    }
+
+    frame_pool_free(pkt);
+    return err;
+}
+
+#if CONFIG_P4_WIRE_MQTT5
+typedef struct {
+    const mqtt_video_user_prop_t *props;
+    size_t count;
+} chunk0_props_t;
+#endif
+
+// ctx: chunk0_props_t with MQTT 5, unused otherwise.
+static esp_err_t mqtt_sink(const uint8_t *pkt, size_t len, uint16_t chunk_id, void *ctx)
+{
+    esp_err_t err;
+#if CONFIG_P4_WIRE_MQTT5
+    const chunk0_props_t *chunk0 = (const chunk0_props_t *)ctx;
+    if (chunk_id == 0) {
+        err = mqtt_video_publish_chunk_props(pkt, len, chunk0->props, chunk0->count);
+    } else {
+        err = mqtt_video_publish_chunk(pkt, len);
+    }
+#else
+    (void)ctx;
+    (void)chunk_id;
+    err = mqtt_video_publish_chunk(pkt, len);
+#endif
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "MQTT publish failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
 esp_err_t video_packetizer_publish_jpeg(const video_frame_meta_t *meta,
                                         const uint8_t *jpeg,
                                         uint32_t jpeg_size)
@@ -43,36 +245,43 @@ esp_err_t video_packetizer_publish_jpeg(const video_frame_meta_t *meta,
         return ESP_ERR_INVALID_ARG;
     }
 
+    int64_t start_us = esp_timer_get_time();
     uint16_t chunk_count = (jpeg_size + CHUNK_MAX - 1) / CHUNK_MAX;
 
-    for (uint16_t chunk_id = 0; chunk_id < chunk_count; chunk_id++) {
-        size_t off = (size_t)chunk_id * CHUNK_MAX;
-        size_t remain = jpeg_size - off;
-        size_t take = remain > CHUNK_MAX ? CHUNK_MAX : remain;
-
-        uint8_t pkt[sizeof(vid_hdr_t) + CHUNK_MAX];
-        vid_hdr_t hdr = {
-            .magic = VID_MAGIC,
-            .clip_id = meta->clip_id,
-            .frame_id = meta->frame_id,
-            .ts_ms = meta->ts_ms,
-            .chunk_id = chunk_id,
-            .chunk_count = chunk_count,
-            .frame_size = jpeg_size,
-            .fourcc = FOURCC_MJPG,
-            .width = meta->width,
-            .height = meta->height,
-        };
-
-        memcpy(pkt, &hdr, sizeof(hdr));
-        memcpy(pkt + sizeof(hdr), jpeg + off, take);
-
-        esp_err_t err = mqtt_video_publish_chunk(pkt, sizeof(hdr) + take);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "MQTT publish failed: %s", esp_err_to_name(err));
-            return err;
-        }
+    // Admit or drop the frame as a whole before the first chunk goes out.
+    // VID1 headers are variable length; HDR_SIZE is their upper bound.
+    esp_err_t err = mqtt_video_frame_begin((size_t)jpeg_size + (size_t)chunk_count * HDR_SIZE);
+    if (err != ESP_OK) {
+        return err;
     }
 
-    return ESP_OK;
+    void *ctx = NULL;
+
+#if CONFIG_P4_WIRE_MQTT5
+    char vals[9][12];
+    snprintf(vals[0], sizeof(vals[0]), "%u", (unsigned)meta->clip_id);
+    snprintf(vals[1], sizeof(vals[1]), "%u", (unsigned)meta->frame_id);
+    snprintf(vals[2], sizeof(vals[2]), "%u", (unsigned)meta->ts_ms);
+    snprintf(vals[3], sizeof(vals[3]), "%u", (unsigned)chunk_count);
+    snprintf(vals[4], sizeof(vals[4]), "%u", (unsigned)jpeg_size);
+    snprintf(vals[5], sizeof(vals[5]), "%u", (unsigned)meta->fourcc);
+    snprintf(vals[6], sizeof(vals[6]), "%u", (unsigned)meta->width);
+    snprintf(vals[7], sizeof(vals[7]), "%u", (unsigned)meta->height);
+    snprintf(vals[8], sizeof(vals[8]), "%u", meta->keyframe ? 1u : 0u);
+    const mqtt_video_user_prop_t props[] = {
+        { "clip", vals[0] }, { "frame", vals[1] }, { "ts", vals[2] }, { "chunks", vals[3] },
+        { "size", vals[4] }, { "fourcc", vals[5] }, { "w", vals[6] }, { "h", vals[7] },
+        { "key", vals[8] },
+    };
+    chunk0_props_t chunk0 = { props, sizeof(props) / sizeof(props[0]) };
+    ctx = &chunk0;
+#endif
+
+    esp_err_t ret = video_packetizer_emit(meta, jpeg, jpeg_size, CHUNK_MAX, mqtt_sink, ctx);
+
+    mqtt_video_frame_end(ret == ESP_OK);
+    if (ret == ESP_OK) {
+        cam_stats_record_us(CAM_STAT_HIST_PUBLISH, (uint32_t)(esp_timer_get_time() - start_us));
+    }
+    return ret;
 }
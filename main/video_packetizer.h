@@ -6,6 +6,8 @@
 #ifndef VIDEO_PACKETIZER_H
 #define VIDEO_PACKETIZER_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "esp_err.h"
@@ -20,12 +22,39 @@ typedef struct {
     uint32_t ts_ms;
     uint16_t width;
     uint16_t height;
+    uint32_t fourcc;        // VID_FOURCC_MJPG or VID_FOURCC_H264
+    bool keyframe;          // always set for MJPEG
+    // esp_timer stamps for CONFIG_P4_STAGE_TIMES; 0 when not taken.
+    int64_t dqbuf_us;
+    int64_t enc_start_us;
+    int64_t enc_end_us;
 } video_frame_meta_t;
 
+/**
+ * Publish one encoded frame, JPEG or H.264 access unit (meta->fourcc), as
+ * chunks in the CONFIG_P4_WIRE_FORMAT wire format: VID0, VID1 or MQTT 5
+ * compact. Returns ESP_ERR_NO_MEM or ESP_ERR_INVALID_STATE without sending
+ * anything when MQTT backpressure rejects the frame.
+ */
 esp_err_t video_packetizer_publish_jpeg(const video_frame_meta_t *meta,
                                         const uint8_t *jpeg,
                                         uint32_t jpeg_size);
 
+/** Receives one finished chunk packet (header + payload); non-ESP_OK stops the frame. */
+typedef esp_err_t (*video_packetizer_sink_t)(const uint8_t *pkt, size_t len, uint16_t chunk_id, void *ctx);
+
+/**
+ * Split a frame into chunk_max-byte chunks with the configured wire header
+ * and hand each packet to sink, without admission control or MQTT. The
+ * packet buffer is reused for the next chunk once sink returns.
+ */
+esp_err_t video_packetizer_emit(const video_frame_meta_t *meta,
+                                const uint8_t *jpeg,
+                                uint32_t jpeg_size,
+                                size_t chunk_max,
+                                video_packetizer_sink_t sink,
+                                void *ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,197 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "video_sender.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "frame_pool.h"
+#include "mqtt_video.h"
+#include "cam_stats.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "sender";
+
+#define SENDER_TASK_STACK_SIZE  (4 * 1024)
+#define SENDER_TASK_PRIORITY    (5)
+
+typedef struct {
+    video_frame_meta_t meta;
+    uint8_t *data;
+    uint32_t size;
+    int64_t capture_us;
+} sender_item_t;
+
+static QueueHandle_t s_queue;
+static TaskHandle_t s_task;
+static volatile uint32_t s_busy;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static video_sender_stats_t s_stats;
+static atomic_bool s_failed;
+
+static void sender_task(void *arg)
+{
+    (void)arg;
+    sender_item_t item;
+
+    while (true) {
+        if (xQueueReceive(s_queue, &item, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        esp_err_t err = video_packetizer_publish_jpeg(&item.meta, item.data, item.size);
+        frame_pool_free(item.data);
+
+        uint32_t latency_us = (uint32_t)(esp_timer_get_time() - item.capture_us);
+
+        portENTER_CRITICAL(&s_lock);
+        if (err == ESP_OK) {
+            s_stats.frames_sent++;
+            s_stats.latency_us_total += latency_us;
+            if (latency_us > s_stats.latency_us_max) {
+                s_stats.latency_us_max = latency_us;
+            }
+        } else {
+            s_stats.frames_failed++;
+        }
+        s_busy--;
+        portEXIT_CRITICAL(&s_lock);
+
+        // Frames after a lost H.264 frame do not decode until the next IDR.
+        if (err != ESP_OK) {
+            atomic_store(&s_failed, true);
+        }
+    }
+}
+
+esp_err_t video_sender_start(int core_id)
+{
+    if (s_task) return ESP_OK;
+
+    s_queue = xQueueCreate(CONFIG_P4_SENDER_QUEUE_DEPTH, sizeof(sender_item_t));
+    if (!s_queue) return ESP_ERR_NO_MEM;
+
+    // The host build's POSIX port is single core.
+    if (core_id >= portNUM_PROCESSORS) {
+        core_id = tskNO_AFFINITY;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(sender_task, "video sender", SENDER_TASK_STACK_SIZE,
+                                            NULL, SENDER_TASK_PRIORITY, &s_task, core_id);
+    if (ok != pdPASS) {
+        vQueueDelete(s_queue);
+        s_queue = NULL;
+        s_task = NULL;
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Sender task on core %d, queue depth %d", core_id, CONFIG_P4_SENDER_QUEUE_DEPTH);
+    return ESP_OK;
+}
+
+esp_err_t video_sender_submit(const video_frame_meta_t *meta,
+                              const uint8_t *jpeg,
+                              uint32_t jpeg_size,
+                              int64_t capture_us)
+{
+    if (!meta || !jpeg || jpeg_size == 0) return ESP_ERR_INVALID_ARG;
+    if (!s_queue) return ESP_ERR_INVALID_STATE;
+
+    sender_item_t item = {
+        .meta = *meta,
+        .data = (uint8_t *)frame_pool_alloc(FRAME_POOL_PSRAM, jpeg_size),
+        .size = jpeg_size,
+        .capture_us = capture_us,
+    };
+    if (!item.data && jpeg_size > frame_pool_block_size(FRAME_POOL_PSRAM)) {
+        // Oversized frames bypass the pool; an exhausted pool is backpressure.
+        item.data = (uint8_t *)malloc(jpeg_size);
+    }
+    if (!item.data) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.frames_dropped++;
+        portEXIT_CRITICAL(&s_lock);
+        cam_stats_inc(CAM_STAT_DROP_SENDER_QUEUE);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(item.data, jpeg, jpeg_size);
+
+    portENTER_CRITICAL(&s_lock);
+    s_busy++;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (xQueueSend(s_queue, &item, 0) != pdTRUE) {
+        frame_pool_free(item.data);
+        portENTER_CRITICAL(&s_lock);
+        s_busy--;
+        s_stats.frames_dropped++;
+        portEXIT_CRITICAL(&s_lock);
+        cam_stats_inc(CAM_STAT_DROP_SENDER_QUEUE);
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.frames_queued++;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t video_sender_admissible(void)
+{
+    if (!s_queue) return ESP_ERR_INVALID_STATE;
+    if (!mqtt_video_wait_connected(0)) {
+        cam_stats_inc(CAM_STAT_DROP_DISCONNECTED);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (uxQueueSpacesAvailable(s_queue) == 0) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.frames_dropped++;
+        portEXIT_CRITICAL(&s_lock);
+        cam_stats_inc(CAM_STAT_DROP_SENDER_QUEUE);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool video_sender_take_failed(void)
+{
+    return atomic_exchange(&s_failed, false);
+}
+
+esp_err_t video_sender_flush(uint32_t timeout_ms)
+{
+    if (!s_queue) return ESP_OK;
+
+    int64_t end_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (s_busy > 0) {
+        if (esp_timer_get_time() >= end_us) {
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_OK;
+}
+
+esp_err_t video_sender_get_stats(video_sender_stats_t *out)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+void video_sender_reset_stats(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    memset(&s_stats, 0, sizeof(s_stats));
+    portEXIT_CRITICAL(&s_lock);
+}
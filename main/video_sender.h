@@ -0,0 +1,71 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef VIDEO_SENDER_H
+#define VIDEO_SENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "video_packetizer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t frames_queued;
+    uint32_t frames_sent;
+    uint32_t frames_dropped;     // no pool block or queue full at submit time
+    uint32_t frames_failed;      // rejected by the packetizer/MQTT layer
+    uint64_t latency_us_total;   // capture callback entry -> last chunk handed to MQTT
+    uint32_t latency_us_max;
+} video_sender_stats_t;
+
+/**
+ * @brief Start the network task that packetizes and publishes queued frames.
+ *
+ * @param core_id Core the task is pinned to, normally the one not running capture.
+ */
+esp_err_t video_sender_start(int core_id);
+
+/**
+ * @brief Copy a frame into a PSRAM pool block and queue it without blocking.
+ *
+ * @param capture_us esp_timer time the frame entered the pipeline, for latency.
+ * @return ESP_ERR_NO_MEM when the pool or queue is full; the frame is dropped whole.
+ */
+esp_err_t video_sender_submit(const video_frame_meta_t *meta,
+                              const uint8_t *jpeg,
+                              uint32_t jpeg_size,
+                              int64_t capture_us);
+
+/**
+ * @brief Whether video_sender_submit() would take a frame now: MQTT is
+ *        connected and the queue has room. Lets the capture path skip
+ *        encoding a frame that would be dropped; a refusal counts as one.
+ *
+ * @return ESP_ERR_INVALID_STATE when disconnected, ESP_ERR_NO_MEM when full.
+ */
+esp_err_t video_sender_admissible(void);
+
+/**
+ * @brief True once after the sender lost a queued frame (refused or cut
+ *        short by MQTT), so the capture path can ask for a keyframe.
+ */
+bool video_sender_take_failed(void);
+
+/** @brief Wait until every queued frame has been handed to MQTT. */
+esp_err_t video_sender_flush(uint32_t timeout_ms);
+
+esp_err_t video_sender_get_stats(video_sender_stats_t *out);
+void video_sender_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,17 +3,25 @@
 #include "app_video.h"
 #include "flash_store.h"
 #include "video_packetizer.h"
+#include "frame_pool.h"
+#include "video_sender.h"
+#include "frame_encoder.h"
+#include "frame_crop.h"
+#include "pixfmt.h"
+#include "vid_wire.h"
+#include "cam_stats.h"
+#include "cam_trace.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <inttypes.h>
 
-#include "driver/gpio.h"
-#include "esp_video_device.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_video_init.h"
-#include "driver/jpeg_encode.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_timer.h"
@@ -22,134 +30,370 @@
 
 static const char *TAG = "vid";
 
+#define MODE_SWITCH_TIMEOUT_MS  2000
+
+#if CONFIG_P4_CODEC_H264
+#define LOSS_IDR_MIN_US         ((int64_t)CONFIG_P4_H264_LOSS_IDR_MIN_MS * 1000)
+#else
+#define LOSS_IDR_MIN_US         0   // every JPEG stands alone
+#endif
+
+// One encoded stream: the whole frame, or a region of it (CONFIG_P4_ROI)
+// with its own clip_id so receivers keep it apart.
+typedef struct {
+    uint32_t clip_id;
+    uint32_t frame_id;
+    bool crop;
+    frame_roi_t roi;             // as configured
+    frame_roi_t fit;             // roi fitted to the frame below; w == 0 when it does not fit
+    uint32_t fit_fmt;
+    uint32_t fit_width;
+    uint32_t fit_height;
+    uint8_t *buf;                // cropped frame
+    size_t buf_size;
+} stream_t;
+
 typedef struct {
     int video_fd;
+    bool capturing;              // video_fd is streaming; under s_mode_lock
+    uint32_t pixfmt;             // negotiated capture format, APP_VIDEO_FMT_*
     int64_t start_us;
     uint32_t clip_id;
-    uint32_t frame_id;
-    uint32_t width;
-    uint32_t height;
-    uint8_t *jpeg_buf;
-    size_t jpeg_buf_size;
-    jpeg_encoder_handle_t encoder;
-    bool encoder_ready;
+    uint32_t frame_id;           // camera frames handled by at least one stream
+    stream_t streams[FRAME_ROI_MAX];
+    int stream_count;
     bool record_to_flash;
+    uint32_t published;
+    uint64_t publish_us_total;   // camera task time spent handing frames to the network
+    uint32_t publish_us_max;
+    uint64_t latency_us_total;   // sync mode only; the sender task tracks its own
+    uint32_t latency_us_max;
+    bool frame_lost;             // an encoded frame never made it; wants an IDR
+    int64_t loss_idr_us;         // when the last one was asked for
 } capture_ctx_t;
 
 static capture_ctx_t s_cap;
 
+// Serialises mode changes from the control task against capture start/stop.
+static SemaphoreHandle_t s_mode_lock;
+
 static uint32_t new_clip_id(void) { return (uint32_t)esp_random(); }
 
-static esp_err_t jpeg_encoder_init(uint32_t width, uint32_t height)
+static esp_err_t camera_init(void)
 {
-    jpeg_encode_engine_cfg_t eng_cfg = {
-        .intr_priority = 0,
-        .timeout_ms = 200,
-    };
-
-    esp_err_t err = jpeg_new_encoder_engine(&eng_cfg, &s_cap.encoder);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "JPEG encoder init failed: %s", esp_err_to_name(err));
-        return err;
+#if CONFIG_IDF_TARGET_LINUX
+    // The simulated device in app_video_sim.c needs no bring-up.
+    return ESP_OK;
+#else
+    // The CSI video device lives until reboot; later captures reuse it.
+    static bool s_inited;
+    if (s_inited) {
+        return ESP_OK;
     }
 
-    size_t out_size = 0;
-    jpeg_encode_memory_alloc_cfg_t out_cfg = {
-        .buffer_direction = JPEG_ENC_ALLOC_OUTPUT_BUFFER,
+    esp_video_init_csi_config_t csi_config = {
+        .sccb_config = {
+            .init_sccb = true,
+            .i2c_config = {
+                .port = 1,
+                .scl_pin = 8,
+                .sda_pin = 7,
+            },
+            .freq = 400000,
+        },
+        .reset_pin = -1,
+        .pwdn_pin = -1,
     };
 
-    s_cap.jpeg_buf = jpeg_alloc_encoder_mem((size_t)width * height * 2, &out_cfg, &out_size);
-    if (!s_cap.jpeg_buf || out_size == 0) {
-        ESP_LOGE(TAG, "JPEG output buffer alloc failed");
-        jpeg_del_encoder_engine(s_cap.encoder);
-        s_cap.encoder = NULL;
-        return ESP_ERR_NO_MEM;
-    }
+    esp_video_init_config_t video_cfg = {
+        .csi = &csi_config,
+    };
 
-    s_cap.jpeg_buf_size = out_size;
-    s_cap.width = width;
-    s_cap.height = height;
-    s_cap.encoder_ready = true;
-    return ESP_OK;
+    esp_err_t err = esp_video_init(&video_cfg);
+    s_inited = err == ESP_OK;
+    return err;
+#endif
 }
 
-static void jpeg_encoder_deinit(void)
+// Asks for an IDR after an encoded frame was lost, at most once per
+// CONFIG_P4_H264_LOSS_IDR_MIN_MS; a loss inside that time gets one when it
+// is over.
+static void recover_from_loss(int64_t now_us)
 {
-    if (s_cap.encoder) {
-        jpeg_del_encoder_engine(s_cap.encoder);
-        s_cap.encoder = NULL;
+#if CONFIG_P4_MQTT_PUBLISH_SENDER_TASK
+    if (video_sender_take_failed()) {
+        s_cap.frame_lost = true;
     }
-    if (s_cap.jpeg_buf) {
-        free(s_cap.jpeg_buf);
-        s_cap.jpeg_buf = NULL;
+#endif
+    if (s_cap.frame_lost && now_us - s_cap.loss_idr_us >= LOSS_IDR_MIN_US) {
+        frame_encoder_request_keyframe();
+        s_cap.frame_lost = false;
+        s_cap.loss_idr_us = now_us;
     }
-    s_cap.jpeg_buf_size = 0;
-    s_cap.encoder_ready = false;
 }
 
-static void camera_frame_cb(uint8_t *camera_buf, uint8_t camera_buf_index, uint32_t camera_buf_hes, uint32_t camera_buf_ves, size_t camera_buf_len)
+// Whether the network would take a frame now, asked before encoding it: a
+// frame refused here is never encoded, so the next H.264 P frame still
+// references the last frame that went out and needs no IDR.
+static esp_err_t admit_frame(void)
 {
-    (void)camera_buf_index;
+#if CONFIG_P4_MQTT_PUBLISH_SENDER_TASK
+    return video_sender_admissible();
+#else
+    return mqtt_video_frame_admissible();
+#endif
+}
 
-    if (!s_cap.encoder_ready || s_cap.width != camera_buf_hes || s_cap.height != camera_buf_ves) {
-        jpeg_encoder_deinit();
-        if (jpeg_encoder_init(camera_buf_hes, camera_buf_ves) != ESP_OK) {
-            ESP_LOGE(TAG, "JPEG encoder setup failed");
-            return;
+// Encodes and sends one stream's frame; true when it counts as sent, which
+// includes frames dropped whole by backpressure.
+static bool send_frame(stream_t *st, const uint8_t *camera_buf, uint32_t camera_buf_hes, uint32_t camera_buf_ves,
+                       size_t camera_buf_len, const app_video_frame_info_t *info, uint32_t ts_ms,
+                       int64_t frame_start_us)
+{
+    if (!s_cap.record_to_flash) {
+        esp_err_t err = admit_frame();
+        if (err != ESP_OK) {
+            // Keep the id so receivers see the gap.
+            ESP_LOGD(TAG, "Frame %" PRIu32 " not encoded: %s", st->frame_id, esp_err_to_name(err));
+            st->frame_id++;
+            return true;
         }
     }
 
-    jpeg_encode_cfg_t enc_cfg = {
-        .src_type = JPEG_ENCODE_IN_FORMAT_RGB565,
-        .sub_sample = CONFIG_P4_JPEG_SUBSAMPLE_420 ? JPEG_DOWN_SAMPLING_YUV420 : JPEG_DOWN_SAMPLING_YUV422,
-        .image_quality = CONFIG_P4_JPEG_QUALITY,
-        .width = camera_buf_hes,
-        .height = camera_buf_ves,
-    };
+    if (frame_encoder_open(camera_buf_hes, camera_buf_ves, s_cap.pixfmt) != ESP_OK) {
+        ESP_LOGE(TAG, "Encoder setup failed");
+        cam_stats_inc(CAM_STAT_DROP_ENCODE);
+        return false;
+    }
+    recover_from_loss(frame_start_us);
 
+    const uint8_t *jpeg = NULL;
     uint32_t jpeg_size = 0;
-    esp_err_t err = jpeg_encoder_process(
-        s_cap.encoder,
-        &enc_cfg,
-        camera_buf,
-        camera_buf_len,
-        s_cap.jpeg_buf,
-        s_cap.jpeg_buf_size,
-        &jpeg_size
-    );
-
+    bool keyframe = false;
+    int64_t enc_start_us = esp_timer_get_time();
+    CAM_TRACE_BEGIN(ENCODE);
+    esp_err_t err = frame_encoder_encode(camera_buf, camera_buf_len, &jpeg, &jpeg_size, &keyframe);
+    CAM_TRACE_END(ENCODE, jpeg_size);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "JPEG encode failed: %s", esp_err_to_name(err));
-        return;
+        ESP_LOGE(TAG, "Encode failed: %s", esp_err_to_name(err));
+        cam_stats_inc(CAM_STAT_DROP_ENCODE);
+        return false;
     }
+    int64_t enc_end_us = esp_timer_get_time();
+    cam_stats_inc(CAM_STAT_FRAMES_ENCODED);
+    cam_stats_record_us(CAM_STAT_HIST_ENCODE, (uint32_t)(enc_end_us - enc_start_us));
 
-    uint32_t ts_ms = (uint32_t)((esp_timer_get_time() - s_cap.start_us) / 1000);
     video_frame_meta_t meta = {
-        .clip_id = s_cap.clip_id,
-        .frame_id = s_cap.frame_id,
+        .clip_id = st->clip_id,
+        .frame_id = st->frame_id,
         .ts_ms = ts_ms,
         .width = (uint16_t)camera_buf_hes,
         .height = (uint16_t)camera_buf_ves,
+        .fourcc = frame_encoder_fourcc(),
+        .keyframe = keyframe,
+        .dqbuf_us = info->dqbuf_us,
+        .enc_start_us = enc_start_us,
+        .enc_end_us = enc_end_us,
     };
 
     if (s_cap.record_to_flash) {
         esp_err_t err = flash_store_write_frame(
             meta.clip_id, meta.frame_id, meta.ts_ms, meta.width, meta.height,
-            s_cap.jpeg_buf, jpeg_size
+            jpeg, jpeg_size
         );
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Flash write failed: %s", esp_err_to_name(err));
-            return;
+            cam_stats_inc(CAM_STAT_DROP_FLASH);
+            s_cap.frame_lost = true;
+            return false;
         }
     } else {
-        esp_err_t err = video_packetizer_publish_jpeg(&meta, s_cap.jpeg_buf, jpeg_size);
-        if (err != ESP_OK) {
+        int64_t pub_start_us = esp_timer_get_time();
+#if CONFIG_P4_MQTT_PUBLISH_SENDER_TASK
+        esp_err_t err = video_sender_submit(&meta, jpeg, jpeg_size, frame_start_us);
+#else
+        esp_err_t err = video_packetizer_publish_jpeg(&meta, jpeg, jpeg_size);
+#endif
+        int64_t pub_end_us = esp_timer_get_time();
+        uint32_t pub_us = (uint32_t)(pub_end_us - pub_start_us);
+        s_cap.published++;
+        s_cap.publish_us_total += pub_us;
+        if (pub_us > s_cap.publish_us_max) s_cap.publish_us_max = pub_us;
+#if !CONFIG_P4_MQTT_PUBLISH_SENDER_TASK
+        if (err == ESP_OK) {
+            uint32_t lat_us = (uint32_t)(pub_end_us - frame_start_us);
+            s_cap.latency_us_total += lat_us;
+            if (lat_us > s_cap.latency_us_max) s_cap.latency_us_max = lat_us;
+        }
+#endif
+
+        if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_STATE) {
+            // Admitted above but refused now that it is encoded; keep the id
+            // so receivers see the gap.
+            ESP_LOGD(TAG, "Frame %" PRIu32 " dropped: %s", meta.frame_id, esp_err_to_name(err));
+            s_cap.frame_lost = true;
+        } else if (err != ESP_OK) {
             ESP_LOGE(TAG, "MQTT publish failed: %s", esp_err_to_name(err));
-            return;
+            s_cap.frame_lost = true;
+            return false;
         }
     }
 
-    s_cap.frame_id++;
+    st->frame_id++;
+    return true;
+}
+
+// Fits the region to the frame as it is now; a mode switch changes it.
+static bool prepare_crop(stream_t *st, int index, uint32_t width, uint32_t height)
+{
+    if (st->fit_fmt != s_cap.pixfmt || st->fit_width != width || st->fit_height != height) {
+        st->fit_fmt = s_cap.pixfmt;
+        st->fit_width = width;
+        st->fit_height = height;
+        st->fit = st->roi;
+        esp_err_t err = frame_roi_fit(&st->fit, s_cap.pixfmt, width, height);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "ROI %d outside the %" PRIu32 "x%" PRIu32 " frame, not sent", index, width, height);
+            st->fit.w = 0;
+            return false;
+        }
+        size_t need = pixfmt_frame_size(s_cap.pixfmt, st->fit.out_w, st->fit.out_h);
+        if (need > st->buf_size) {
+            frame_crop_free(st->buf);
+            st->buf = frame_crop_alloc(need);
+            st->buf_size = st->buf ? need : 0;
+        }
+        ESP_LOGI(TAG, "ROI %d: %" PRIu32 ",%" PRIu32 " %" PRIu32 "x%" PRIu32 " -> %" PRIu32 "x%" PRIu32
+                 " clip_id=%" PRIu32, index, st->fit.x, st->fit.y, st->fit.w, st->fit.h,
+                 st->fit.out_w, st->fit.out_h, st->clip_id);
+    }
+    if (st->fit.w == 0) return false;
+    if (!st->buf) {
+        ESP_LOGE(TAG, "No memory for ROI %d", index);
+        return false;
+    }
+    return true;
+}
+
+static void process_frame(uint8_t *camera_buf, uint32_t camera_buf_hes, uint32_t camera_buf_ves,
+                          size_t camera_buf_len, const app_video_frame_info_t *info)
+{
+    int64_t frame_start_us = esp_timer_get_time();
+    cam_stats_inc(CAM_STAT_FRAMES_CAPTURED);
+
+    // Capture time, not send time: encode and queueing jitter stay out of
+    // the timeline, and every ROI of one frame carries the same stamp.
+    int64_t since_start_us = info->ts_us - s_cap.start_us;
+    uint32_t ts_ms = since_start_us > 0 ? (uint32_t)(since_start_us / 1000) : 0;
+
+    // A mode switch changes the format between two callbacks.
+    video_mode_t mode;
+    app_video_get_mode(&mode);
+    s_cap.pixfmt = mode.pixfmt;
+
+    bool sent = false;
+    for (int i = 0; i < s_cap.stream_count; i++) {
+        stream_t *st = &s_cap.streams[i];
+        if (!st->crop) {
+            sent |= send_frame(st, camera_buf, camera_buf_hes, camera_buf_ves, camera_buf_len, info, ts_ms,
+                               frame_start_us);
+            continue;
+        }
+        if (!prepare_crop(st, i, camera_buf_hes, camera_buf_ves)) continue;
+        esp_err_t err = frame_crop(camera_buf, s_cap.pixfmt, camera_buf_hes, camera_buf_ves, &st->fit,
+                                   st->buf, st->buf_size);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "ROI %d crop failed: %s", i, esp_err_to_name(err));
+            cam_stats_inc(CAM_STAT_DROP_ENCODE);
+            continue;
+        }
+        sent |= send_frame(st, st->buf, st->fit.out_w, st->fit.out_h,
+                           pixfmt_frame_size(s_cap.pixfmt, st->fit.out_w, st->fit.out_h), info, ts_ms,
+                           frame_start_us);
+    }
+    if (sent) s_cap.frame_id++;
+}
+
+// CONFIG_P4_ROI, or the whole frame when it is empty.
+static esp_err_t setup_streams(void)
+{
+    frame_roi_t rois[FRAME_ROI_MAX];
+    int n = frame_roi_parse(CONFIG_P4_ROI, rois, FRAME_ROI_MAX);
+    if (n < 0) {
+        ESP_LOGE(TAG, "Bad ROI list \"%s\"", CONFIG_P4_ROI);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (n == 0) {
+        s_cap.streams[0].clip_id = s_cap.clip_id;
+        s_cap.stream_count = 1;
+        return ESP_OK;
+    }
+    // The H.264 encoder holds one stream's reference frames.
+    if (n > 1 && frame_encoder_fourcc() == VID_FOURCC_H264) {
+        ESP_LOGW(TAG, "H.264 encodes one stream, using only the first ROI");
+        n = 1;
+    }
+    for (int i = 0; i < n; i++) {
+        s_cap.streams[i].crop = true;
+        s_cap.streams[i].roi = rois[i];
+        s_cap.streams[i].clip_id = i == 0 ? s_cap.clip_id : new_clip_id();
+    }
+    s_cap.stream_count = n;
+    return ESP_OK;
+}
+
+static void free_streams(void)
+{
+    for (int i = 0; i < s_cap.stream_count; i++) {
+        frame_crop_free(s_cap.streams[i].buf);
+        s_cap.streams[i].buf = NULL;
+        s_cap.streams[i].buf_size = 0;
+    }
+    frame_crop_close();
+}
+
+static void camera_frame_cb(uint8_t *camera_buf, uint8_t camera_buf_index, uint32_t camera_buf_hes, uint32_t camera_buf_ves, size_t camera_buf_len,
+                            const app_video_frame_info_t *info)
+{
+    (void)camera_buf_index;
+    CAM_TRACE_BEGIN(FRAME);
+    process_frame(camera_buf, camera_buf_hes, camera_buf_ves, camera_buf_len, info);
+    CAM_TRACE_END(FRAME, s_cap.frame_id);
+}
+
+static void log_publish_benchmark(void)
+{
+    uint32_t lat_frames = 0;
+    uint64_t lat_total = 0;
+    uint32_t lat_max = 0;
+    const char *mode;
+
+#if CONFIG_P4_MQTT_PUBLISH_SENDER_TASK
+    mode = "sender";
+    if (video_sender_flush(2000) != ESP_OK) {
+        ESP_LOGW(TAG, "Sender queue not drained");
+    }
+    video_sender_stats_t st;
+    video_sender_get_stats(&st);
+    lat_frames = st.frames_sent;
+    lat_total = st.latency_us_total;
+    lat_max = st.latency_us_max;
+    ESP_LOGI(TAG, "Sender: queued=%" PRIu32 " sent=%" PRIu32 " dropped=%" PRIu32 " failed=%" PRIu32,
+             st.frames_queued, st.frames_sent, st.frames_dropped, st.frames_failed);
+#else
+    mode = "sync";
+    lat_frames = s_cap.published;
+    lat_total = s_cap.latency_us_total;
+    lat_max = s_cap.latency_us_max;
+#endif
+
+    ESP_LOGI(TAG, "Publish bench: mode=%s cam_task_us avg=%" PRIu32 " max=%" PRIu32
+             " latency_us avg=%" PRIu32 " max=%" PRIu32,
+             mode,
+             s_cap.published ? (uint32_t)(s_cap.publish_us_total / s_cap.published) : 0,
+             s_cap.publish_us_max,
+             lat_frames ? (uint32_t)(lat_total / lat_frames) : 0,
+             lat_max);
 }
 
 static esp_err_t capture_common(int seconds, bool record_to_flash, uint32_t *out_frames, float *out_fps)
@@ -162,38 +406,45 @@ static esp_err_t capture_common(int seconds, bool record_to_flash, uint32_t *out
         return ESP_ERR_INVALID_ARG;
     }
 
+    if (!s_mode_lock) {
+        s_mode_lock = xSemaphoreCreateMutex();
+        if (!s_mode_lock) return ESP_ERR_NO_MEM;
+    }
+
     memset(&s_cap, 0, sizeof(s_cap));
     s_cap.clip_id = new_clip_id();
     s_cap.start_us = esp_timer_get_time();
     s_cap.record_to_flash = record_to_flash;
+    esp_err_t err = setup_streams();
+    if (err != ESP_OK) {
+        return err;
+    }
+    // Every clip starts decodable on its own.
+    frame_encoder_request_keyframe();
+
+#if CONFIG_P4_MQTT_PUBLISH_SENDER_TASK
+    if (!record_to_flash) {
+        esp_err_t serr = video_sender_start(CONFIG_P4_SENDER_TASK_CORE);
+        if (serr != ESP_OK) {
+            ESP_LOGE(TAG, "Sender task start failed: %s", esp_err_to_name(serr));
+            return serr;
+        }
+        video_sender_reset_stats();
+        video_sender_take_failed();     // a loss from the last clip; it starts with an IDR anyway
+    }
+#endif
 
-    esp_video_init_csi_config_t csi_config = {
-        .sccb_config = {
-            .init_sccb = true,
-            .i2c_config = {
-                .port = 1,
-                .scl_pin = 8,
-                .sda_pin = 7,
-            },
-            .freq = 400000,
-        },
-        .reset_pin = -1,
-        .pwdn_pin = -1,
-    };
-
-    esp_video_init_config_t video_cfg = {
-        .csi = &csi_config,
-    };
-
-    esp_err_t err = esp_video_init(&video_cfg);
+    err = camera_init();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Camera init failed: %s", esp_err_to_name(err));
         return err;
     }
 
-    int fd = app_video_open(ESP_VIDEO_MIPI_CSI_DEVICE_NAME, APP_VIDEO_FMT_RGB565);
+    const uint32_t *fmts = NULL;
+    size_t nfmts = frame_encoder_input_formats(&fmts);
+    int fd = app_video_open_any(APP_VIDEO_DEVICE_NAME, fmts, nfmts, &s_cap.pixfmt);
     if (fd < 0) {
-        ESP_LOGE(TAG, "Failed to open %s", ESP_VIDEO_MIPI_CSI_DEVICE_NAME);
+        ESP_LOGE(TAG, "Failed to open %s", APP_VIDEO_DEVICE_NAME);
         ESP_LOGW(TAG, "Try selecting a different camera sensor in menuconfig.");
         return ESP_FAIL;
     }
@@ -213,16 +464,26 @@ static esp_err_t capture_common(int seconds, bool record_to_flash, uint32_t *out
         return err;
     }
 
+#if CONFIG_P4_OUTPUT_FPS > 0
+    bool decimating = false;
+    app_video_set_frame_rate(fd, CONFIG_P4_OUTPUT_FPS, &decimating);
+    ESP_LOGI(TAG, "Output %d fps, %s", CONFIG_P4_OUTPUT_FPS,
+             decimating ? "dropping surplus frames" : "set on the sensor");
+#endif
+
     err = app_video_stream_task_start(fd, 0);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Video stream start failed: %s", esp_err_to_name(err));
         app_video_close(fd);
         return err;
     }
+    xSemaphoreTake(s_mode_lock, portMAX_DELAY);
+    s_cap.capturing = true;
+    xSemaphoreGive(s_mode_lock);
 
-    ESP_LOGI(TAG, "Capture start: clip_id=%" PRIu32 " seconds=%d frames=%d dev=%s mode=%s",
-             s_cap.clip_id, seconds, frames_limit, ESP_VIDEO_MIPI_CSI_DEVICE_NAME,
-             record_to_flash ? "flash" : "mqtt");
+    ESP_LOGI(TAG, "Capture start: clip_id=%" PRIu32 " seconds=%d frames=%d dev=%s fmt=%s mode=%s rois=%d",
+             s_cap.clip_id, seconds, frames_limit, APP_VIDEO_DEVICE_NAME, pixfmt_name(s_cap.pixfmt),
+             record_to_flash ? "flash" : "mqtt", s_cap.streams[0].crop ? s_cap.stream_count : 0);
 
     int64_t end_us = 0;
     if (use_time_limit) {
@@ -238,13 +499,40 @@ static esp_err_t capture_common(int seconds, bool record_to_flash, uint32_t *out
         }
         vTaskDelay(pdMS_TO_TICKS(20));
     }
+    xSemaphoreTake(s_mode_lock, portMAX_DELAY);
+    s_cap.capturing = false;
+    xSemaphoreGive(s_mode_lock);
     app_video_stream_task_stop(fd);
     app_video_wait_video_stop();
 
     ESP_LOGI(TAG, "Capture end: frames=%" PRIu32, s_cap.frame_id);
+    if (!record_to_flash) {
+        log_publish_benchmark();
+    }
+    mqtt_video_status_t ms;
+    if (!record_to_flash && mqtt_video_get_status(&ms) == ESP_OK) {
+        ESP_LOGI(TAG, "MQTT: sent=%" PRIu32 " dropped=%" PRIu32 " partial=%" PRIu32 " retries=%" PRIu32 " outbox=%u",
+                 ms.frames_sent, ms.frames_dropped, ms.frames_partial, ms.chunk_retries,
+                 (unsigned)ms.outbox_bytes);
+    }
+    for (int i = 0; i < FRAME_POOL_COUNT; i++) {
+        frame_pool_stats_t ps;
+        if (frame_pool_get_stats((frame_pool_id_t)i, &ps) == ESP_OK) {
+            ESP_LOGI(TAG, "Pool %d: in_use=%" PRIu32 " high_water=%" PRIu32 "/%" PRIu32 " fail=%" PRIu32,
+                     i, ps.in_use, ps.high_water, ps.block_count, ps.alloc_fail);
+        }
+    }
 
     app_video_close(fd);
-    jpeg_encoder_deinit();
+    frame_encoder_close();
+    free_streams();
+
+#if CONFIG_P4_TRACE
+    err = cam_trace_dump_to_sink();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Trace dump failed: %s", esp_err_to_name(err));
+    }
+#endif
 
     if (out_frames) {
         *out_frames = s_cap.frame_id;
@@ -266,3 +554,55 @@ esp_err_t record_video_seconds_to_flash(int seconds, uint32_t *out_frames, float
 {
     return capture_common(seconds, true, out_frames, out_fps);
 }
+
+esp_err_t video_streamer_set_mode(const video_mode_req_t *req, video_mode_t *out)
+{
+    if (!req) return ESP_ERR_INVALID_ARG;
+    app_video_set_mode_request(req);
+    if (out) memset(out, 0, sizeof(*out));
+    if (!s_mode_lock) return ESP_OK;
+
+    xSemaphoreTake(s_mode_lock, portMAX_DELAY);
+    if (!s_cap.capturing) {
+        xSemaphoreGive(s_mode_lock);
+        return ESP_OK;
+    }
+
+    video_mode_t modes[VIDEO_MODE_MAX];
+    size_t n = app_video_enum_modes(s_cap.video_fd, modes, VIDEO_MODE_MAX);
+    const uint32_t *fmts = NULL;
+    size_t nfmts = frame_encoder_input_formats(&fmts);
+    video_mode_t mode;
+    esp_err_t err = video_mode_pick(modes, n, req, fmts, nfmts, &mode);
+    if (err == ESP_OK) {
+        err = app_video_switch_mode(s_cap.video_fd, &mode, MODE_SWITCH_TIMEOUT_MS);
+    }
+    if (err == ESP_OK) {
+        // Receivers need a decodable frame at the new size right away.
+        frame_encoder_request_keyframe();
+        app_video_get_mode(&mode);
+        if (out) *out = mode;
+        ESP_LOGI(TAG, "Mode now %" PRIu32 "x%" PRIu32 " %s", mode.width, mode.height, pixfmt_name(mode.pixfmt));
+    }
+    xSemaphoreGive(s_mode_lock);
+    return err;
+}
+
+size_t video_streamer_list_modes(video_mode_t *modes, size_t max)
+{
+    if (!s_mode_lock) return 0;
+    xSemaphoreTake(s_mode_lock, portMAX_DELAY);
+    size_t n = s_cap.capturing ? app_video_enum_modes(s_cap.video_fd, modes, max) : 0;
+    xSemaphoreGive(s_mode_lock);
+    return n;
+}
+
+bool video_streamer_get_mode(video_mode_t *out)
+{
+    if (!s_mode_lock) return false;
+    xSemaphoreTake(s_mode_lock, portMAX_DELAY);
+    bool capturing = s_cap.capturing;
+    if (capturing) app_video_get_mode(out);
+    xSemaphoreGive(s_mode_lock);
+    return capturing;
+}
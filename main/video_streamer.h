@@ -1,6 +1,23 @@
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "esp_err.h"
+#include "video_mode.h"
 
 esp_err_t capture_video_seconds(int seconds);
 esp_err_t record_video_seconds_to_flash(int seconds, uint32_t *out_frames, float *out_fps);
+
+/**
+ * Set the capture mode request (see app_video_set_mode_request()). During a
+ * capture the device is switched to the best mode for it right away, and
+ * out is set to that mode; otherwise the next capture starts with it and
+ * out is zeroed. ESP_ERR_NOT_FOUND when no mode fits the request.
+ */
+esp_err_t video_streamer_set_mode(const video_mode_req_t *req, video_mode_t *out);
+
+/** Modes the capture device offers; 0 when no capture is running. */
+size_t video_streamer_list_modes(video_mode_t *modes, size_t max);
+
+/** Current capture mode; false when no capture is running. */
+bool video_streamer_get_mode(video_mode_t *out);
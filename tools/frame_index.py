@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""Indexed frame store: one append-only data file and one index per clip.
+
+  <outdir>/clip<ID>.h264 or .mjpeg   frames back to back, as received
+                                     (plays as a raw stream in ffplay)
+  <outdir>/clip<ID>.idx              header + one fixed-size record per frame
+
+The index header names the camera (MQTT topic), clip, codec and size;
+each record holds frame_id, ts_ms, offset and size in the data file and
+a keyframe flag. Records are in frame and timestamp order, so readers
+mmap the index and binary-search by time or frame_id without touching
+the data file or listing the directory beyond the .idx files.
+
+  frame_index.py list --outdir out
+  frame_index.py extract --outdir out --clip-id 123 --from-ms 5000 --to-ms 9000 --out cut.mp4
+  frame_index.py extract --outdir out --clip-id 123 --from-ms 5000 --frames cut/
+"""
+import argparse
+import glob
+import mmap
+import os
+import re
+import struct
+
+from vid_wire import FOURCC_H264, FOURCC_MJPG, h264_is_keyframe
+
+MAGIC = b"VIDX"
+VERSION = 1
+HDR_FMT = "<4sHHHxxIIHH60s"  # magic, version, header size, record size, clip_id, fourcc, w, h, camera
+HDR_SIZE = struct.calcsize(HDR_FMT)
+REC_FMT = "<IIQII"  # frame_id, ts_ms, offset, size, flags
+REC_SIZE = struct.calcsize(REC_FMT)
+FLAG_KEY = 0x01
+
+IDX_RE = re.compile(r"^clip(\d+)\.idx$")
+DATA_EXT = {FOURCC_MJPG: ".mjpeg", FOURCC_H264: ".h264"}
+
+
+def index_path(outdir, clip_id):
+    return os.path.join(outdir, f"clip{clip_id}.idx")
+
+
+def data_path(outdir, clip_id, fourcc):
+    return os.path.join(outdir, f"clip{clip_id}{DATA_EXT.get(fourcc, '.bin')}")
+
+
+class IndexWriter:
+    """Appends one clip's frames and their index records.
+
+    The frame goes to the data file before its record goes to the index,
+    so after a crash every record points at complete data. Reopening a
+    clip continues it. Frames older than the last one (by frame_id or
+    ts_ms) are not stored, which keeps the index sorted for the readers.
+    """
+
+    def __init__(self, outdir, clip_id, camera, fourcc, width, height):
+        self.clip_id = clip_id
+        self.skipped = 0
+        self.last_frame_id = None
+        self.last_ts_ms = None
+        path = index_path(outdir, clip_id)
+        self._idx = open(path, "a+b")
+        size = self._idx.seek(0, os.SEEK_END)
+        if size < HDR_SIZE:
+            self._idx.truncate(0)
+            self._idx.write(struct.pack(HDR_FMT, MAGIC, VERSION, HDR_SIZE, REC_SIZE, clip_id, fourcc,
+                                        width, height, camera.encode()[:60]))
+        else:
+            hdr = _parse_header(self._idx, path)
+            fourcc = hdr["fourcc"]
+            # Drop a record cut short by a crash.
+            whole = HDR_SIZE + (size - HDR_SIZE) // REC_SIZE * REC_SIZE
+            if whole != size:
+                self._idx.truncate(whole)
+            if whole > HDR_SIZE:
+                self._idx.seek(whole - REC_SIZE)
+                self.last_frame_id, self.last_ts_ms = struct.unpack(REC_FMT, self._idx.read(REC_SIZE))[:2]
+        self.fourcc = fourcc
+        self._data = open(data_path(outdir, clip_id, fourcc), "ab")
+        self._offset = self._data.seek(0, os.SEEK_END)
+
+    def add(self, frame_id, ts_ms, frame, keyframe=None):
+        """Store one frame; False when it arrived too late to keep the order."""
+        if self.last_frame_id is not None and (frame_id <= self.last_frame_id or ts_ms < self.last_ts_ms):
+            self.skipped += 1
+            return False
+        if keyframe is None:
+            keyframe = self.fourcc != FOURCC_H264 or h264_is_keyframe(frame)
+        self._data.write(frame)
+        self._data.flush()
+        self._idx.write(struct.pack(REC_FMT, frame_id, ts_ms, self._offset, len(frame),
+                                    FLAG_KEY if keyframe else 0))
+        self._idx.flush()
+        self._offset += len(frame)
+        self.last_frame_id = frame_id
+        self.last_ts_ms = ts_ms
+        return True
+
+    def close(self):
+        self._data.close()
+        self._idx.close()
+
+
+class FrameStore:
+    """IndexWriter per clip, for receivers."""
+
+    def __init__(self, outdir):
+        self.outdir = outdir
+        self.writers = {}
+
+    def add(self, camera, hdr, frame):
+        """hdr needs clip_id, frame_id, ts_ms, fourcc, width and height."""
+        w = self.writers.get(hdr["clip_id"])
+        if w is None:
+            w = self.writers[hdr["clip_id"]] = IndexWriter(
+                self.outdir, hdr["clip_id"], camera, hdr["fourcc"], hdr["width"], hdr["height"]
+            )
+        # The bitstream decides: VID0 and the native path carry no key flag.
+        return w.add(hdr["frame_id"], hdr["ts_ms"], frame)
+
+    def close(self):
+        for w in self.writers.values():
+            w.close()
+        self.writers.clear()
+
+
+def _parse_header(f, path):
+    f.seek(0)
+    raw = f.read(HDR_SIZE)
+    if len(raw) < HDR_SIZE:
+        raise ValueError(f"{path}: short header")
+    magic, version, hdr_size, rec_size, clip_id, fourcc, width, height, camera = struct.unpack(HDR_FMT, raw)
+    if magic != MAGIC or version != VERSION or hdr_size != HDR_SIZE or rec_size != REC_SIZE:
+        raise ValueError(f"{path}: not a version {VERSION} frame index")
+    return {
+        "clip_id": clip_id,
+        "fourcc": fourcc,
+        "width": width,
+        "height": height,
+        "camera": camera.rstrip(b"\0").decode(errors="replace"),
+    }
+
+
+class _Column:
+    """One record field as a read-only sequence over the mmap, for bisect."""
+
+    def __init__(self, reader, field):
+        self._r = reader
+        self._field = field
+
+    def __len__(self):
+        return len(self._r)
+
+    def __getitem__(self, i):
+        return struct.unpack_from(REC_FMT, self._r._map, HDR_SIZE + i * REC_SIZE)[self._field]
+
+
+class IndexReader:
+    """Memory-mapped view of one clip's index; lookups are O(log n)."""
+
+    def __init__(self, path):
+        self.path = path
+        with open(path, "rb") as f:
+            self.header = _parse_header(f, path)
+            size = f.seek(0, os.SEEK_END)
+            self._count = (size - HDR_SIZE) // REC_SIZE
+            self._map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) if self._count else None
+        self.data_path = data_path(os.path.dirname(path), self.header["clip_id"], self.header["fourcc"])
+        self._data = None
+
+    def __len__(self):
+        return self._count
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def record(self, i):
+        frame_id, ts_ms, offset, size, flags = struct.unpack_from(REC_FMT, self._map, HDR_SIZE + i * REC_SIZE)
+        return {"frame_id": frame_id, "ts_ms": ts_ms, "offset": offset, "size": size,
+                "keyframe": bool(flags & FLAG_KEY)}
+
+    def find_ts(self, ts_ms):
+        """Index of the first frame at or after ts_ms (len() when none)."""
+        return _bisect(_Column(self, 1), ts_ms)
+
+    def find_frame(self, frame_id):
+        """Index of frame_id, or None when it is not stored."""
+        i = _bisect(_Column(self, 0), frame_id)
+        return i if i < self._count and _Column(self, 0)[i] == frame_id else None
+
+    def keyframe_before(self, i):
+        """Nearest keyframe at or before i, where decoding can start."""
+        while i > 0 and not self.record(i)["keyframe"]:
+            i -= 1
+        return i
+
+    def range(self, from_ms, to_ms=None):
+        """Records with from_ms <= ts_ms < to_ms (to the end when to_ms is None)."""
+        start = self.find_ts(from_ms)
+        end = self._count if to_ms is None else self.find_ts(to_ms)
+        return range(start, end)
+
+    def frame(self, rec):
+        """Bytes of one record's frame."""
+        if self._data is None:
+            self._data = open(self.data_path, "rb")
+        self._data.seek(rec["offset"])
+        data = self._data.read(rec["size"])
+        if len(data) != rec["size"]:
+            raise ValueError(f"{self.data_path}: frame {rec['frame_id']} truncated")
+        return data
+
+    def close(self):
+        if self._map is not None:
+            self._map.close()
+            self._map = None
+        if self._data is not None:
+            self._data.close()
+            self._data = None
+
+
+def _bisect(seq, value):
+    lo, hi = 0, len(seq)
+    while lo < hi:
+        mid = (lo + hi) // 2
+        if seq[mid] < value:
+            lo = mid + 1
+        else:
+            hi = mid
+    return lo
+
+
+def list_indexes(outdir):
+    """{clip_id: path} of every index in outdir."""
+    out = {}
+    for path in glob.glob(os.path.join(glob.escape(outdir), "clip*.idx")):
+        m = IDX_RE.match(os.path.basename(path))
+        if m:
+            out[int(m.group(1))] = path
+    return out
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="List and cut clips from the receiver's frame index.")
+    ap.add_argument("--outdir", default="out", help="Directory with clip<ID>.idx files")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    ls = sub.add_parser("list", help="List indexed clips")
+    ls.add_argument("--camera", help="Only clips from this camera (MQTT topic)")
+    ex = sub.add_parser("extract", help="Cut a time range out of a clip")
+    ex.add_argument("--clip-id", type=int, required=True)
+    ex.add_argument("--from-ms", type=int, default=0, help="Start, in the clip's ts_ms")
+    ex.add_argument("--to-ms", type=int, default=None, help="End (exclusive); default: end of clip")
+    ex.add_argument("--out", help="Write an MP4 of the range here")
+    ex.add_argument("--frames", metavar="DIR", help="Write the range as clip<ID>_frame<N> files here")
+    return ap.parse_args()
+
+
+def cmd_list(args):
+    for clip_id, path in sorted(list_indexes(args.outdir).items()):
+        with IndexReader(path) as r:
+            h = r.header
+            if args.camera and h["camera"] != args.camera:
+                continue
+            span = f"{r.record(0)['ts_ms']}..{r.record(len(r) - 1)['ts_ms']} ms" if len(r) else "empty"
+            codec = {FOURCC_MJPG: "mjpeg", FOURCC_H264: "h264"}.get(h["fourcc"], hex(h["fourcc"]))
+            print(f"{h['camera'] or '-'} clip {clip_id}: {len(r)} frames {codec} {h['width']}x{h['height']} {span}")
+
+
+def cmd_extract(args):
+    if not args.out and not args.frames:
+        raise SystemExit("extract needs --out and/or --frames")
+    path = index_path(args.outdir, args.clip_id)
+    if not os.path.exists(path):
+        raise SystemExit(f"no index for clip {args.clip_id} in {args.outdir}")
+    with IndexReader(path) as r:
+        span = r.range(args.from_ms, args.to_ms)
+        if not span:
+            raise SystemExit("no frames in that range")
+        start = span.start
+        if r.header["fourcc"] == FOURCC_H264:
+            # P frames need everything back to the previous IDR.
+            start = r.keyframe_before(start)
+        mux = None
+        if args.out:
+            from mp4_mux import Mp4Writer
+
+            mux = Mp4Writer(args.out, r.header["fourcc"], r.header["width"], r.header["height"])
+        if args.frames:
+            os.makedirs(args.frames, exist_ok=True)
+        ext = ".h264" if r.header["fourcc"] == FOURCC_H264 else ".jpg"
+        for i in range(start, span.stop):
+            rec = r.record(i)
+            frame = r.frame(rec)
+            if mux:
+                mux.add(frame, rec["ts_ms"], frame_id=rec["frame_id"])
+            if args.frames:
+                name = f"clip{args.clip_id}_frame{rec['frame_id']}{ext}"
+                with open(os.path.join(args.frames, name), "wb") as f:
+                    f.write(frame)
+        print(f"clip {args.clip_id}: frames {r.record(start)['frame_id']}..{r.record(span.stop - 1)['frame_id']} "
+              f"({span.stop - start}), ts {r.record(start)['ts_ms']}..{r.record(span.stop - 1)['ts_ms']} ms")
+        if mux:
+            used = mux.close()
+            print(f"wrote {args.out}: {used} frames" + (f", {mux.skipped} skipped" if mux.skipped else ""))
+
+
+def main():
+    args = parse_args()
+    if args.cmd == "list":
+        cmd_list(args)
+    else:
+        cmd_extract(args)
+
+
+if __name__ == "__main__":
+    main()
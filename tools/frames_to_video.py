@@ -2,19 +2,33 @@
 import argparse
 import os
 import re
-import shutil
-import subprocess
 import sys
+import time
 
+from frame_index import IndexReader, list_indexes
+from mp4_mux import Mp4Writer
+from vid_wire import FOURCC_H264, FOURCC_MJPG
 
-FRAME_RE = re.compile(r"^clip(\d+)_frame(\d+)\.jpg$")
+FRAME_RE = re.compile(r"^clip(\d+)_frame(\d+)\.(jpg|h264)$")
 
 
 def parse_args():
-    ap = argparse.ArgumentParser(description="Build an MP4 from saved MJPEG frames.")
-    ap.add_argument("--outdir", default="out", help="Directory containing clip*_frame*.jpg")
+    ap = argparse.ArgumentParser(
+        description="Build an MP4 from saved frames. MJPEG and H.264 are stored as they are, "
+        "timed by the camera's timestamps when the receiver recorded them."
+    )
+    ap.add_argument(
+        "--outdir",
+        default="out",
+        help="Directory with clip<ID>.idx frame indexes, or clip*_frame*.jpg / .h264 files",
+    )
     ap.add_argument("--clip-id", type=int, default=None, help="Clip id to render (default: auto)")
-    ap.add_argument("--fps", type=int, default=10, help="Frames per second (default: 10)")
+    ap.add_argument(
+        "--fps",
+        type=int,
+        default=10,
+        help="Frame rate to assume when the clip has no clip<ID>_times.txt (default: 10)",
+    )
     ap.add_argument("--out", default=None, help="Output mp4 path (default: out/clip<ID>.mp4)")
     return ap.parse_args()
 
@@ -32,7 +46,7 @@ def scan_frames(outdir):
             continue
         clip_id = int(m.group(1))
         frame_id = int(m.group(2))
-        clips.setdefault(clip_id, []).append(frame_id)
+        clips.setdefault(clip_id, {})[frame_id] = m.group(3)
     return clips
 
 
@@ -40,7 +54,7 @@ def select_clip(clips, wanted):
     if not clips:
         return None, None
     if wanted is not None:
-        return wanted, clips.get(wanted, [])
+        return wanted, clips.get(wanted, {})
     if len(clips) == 1:
         clip_id = next(iter(clips.keys()))
         return clip_id, clips[clip_id]
@@ -48,11 +62,48 @@ def select_clip(clips, wanted):
     return clip_id, clips[clip_id]
 
 
+def times_path(outdir, clip_id):
+    return os.path.join(outdir, f"clip{clip_id}_times.txt")
+
+
+def load_times(outdir, clip_id):
+    """frame_id -> ts_ms from the receiver's "frame_id ts_ms" lines, or {}."""
+    times = {}
+    try:
+        with open(times_path(outdir, clip_id)) as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) >= 2:
+                    times[int(fields[0])] = int(fields[1])
+    except (OSError, ValueError):
+        return {}
+    return times
+
+
+def render_index(args, clip_id, path):
+    """Whole clip from its frame index: no directory scan, one file read."""
+    out_path = args.out or os.path.join(args.outdir, f"clip{clip_id}.mp4")
+    start = time.monotonic()
+    with IndexReader(path) as r:
+        mux = Mp4Writer(out_path, r.header["fourcc"], r.header["width"], r.header["height"])
+        for i in range(len(r)):
+            rec = r.record(i)
+            mux.add(r.frame(rec), rec["ts_ms"], frame_id=rec["frame_id"])
+    used = mux.close()
+    if not used:
+        raise SystemExit(f"No decodable frame in clip {clip_id}")
+    if mux.skipped:
+        print(f"skipped {mux.skipped} frames after gaps until the next IDR")
+    print(f"Wrote {out_path}: {used} frames in {(time.monotonic() - start) * 1000:.0f} ms")
+
+
 def main():
     args = parse_args()
 
-    if shutil.which("ffmpeg") is None:
-        raise SystemExit("ffmpeg not found in PATH.")
+    indexes = list_indexes(args.outdir)
+    if indexes and (args.clip_id is None or args.clip_id in indexes):
+        clip_id = args.clip_id if args.clip_id is not None else max(indexes)
+        return render_index(args, clip_id, indexes[clip_id])
 
     clips = scan_frames(args.outdir)
     clip_id, frames = select_clip(clips, args.clip_id)
@@ -61,33 +112,33 @@ def main():
     if not frames:
         raise SystemExit(f"No frames found for clip {clip_id}")
 
-    start_number = min(frames)
     out_path = args.out or os.path.join(args.outdir, f"clip{clip_id}.mp4")
-    pattern = os.path.join(args.outdir, f"clip{clip_id}_frame%d.jpg")
-
-    cmd = [
-        "ffmpeg",
-        "-y",
-        "-framerate",
-        str(args.fps),
-        "-start_number",
-        str(start_number),
-        "-i",
-        pattern,
-        "-c:v",
-        "libx264",
-        "-pix_fmt",
-        "yuv420p",
-        out_path,
-    ]
-
-    print("Running:", " ".join(cmd))
-    try:
-        subprocess.run(cmd, check=True)
-    except subprocess.CalledProcessError as exc:
-        raise SystemExit(f"ffmpeg failed with code {exc.returncode}") from exc
-
-    print(f"Wrote {out_path}")
+    h264 = sorted(frame_id for frame_id, ext in frames.items() if ext == "h264")
+    if h264:
+        if len(h264) != len(frames):
+            print(f"clip {clip_id} mixes .jpg and .h264 frames; using the .h264 ones")
+        fourcc, ext, frame_ids = FOURCC_H264, "h264", h264
+    else:
+        fourcc, ext, frame_ids = FOURCC_MJPG, "jpg", sorted(frames)
+
+    times = load_times(args.outdir, clip_id)
+    if not times:
+        print(f"no {times_path(args.outdir, clip_id)}, assuming {args.fps} fps")
+
+    start = time.monotonic()
+    mux = Mp4Writer(out_path, fourcc)
+    for frame_id in frame_ids:
+        ts_ms = times.get(frame_id)
+        if ts_ms is None:
+            ts_ms = (frame_id - frame_ids[0]) * 1000 // max(args.fps, 1)
+        with open(os.path.join(args.outdir, f"clip{clip_id}_frame{frame_id}.{ext}"), "rb") as f:
+            mux.add(f.read(), ts_ms, frame_id=frame_id)
+    used = mux.close()
+    if not used:
+        raise SystemExit(f"No decodable frame in clip {clip_id}")
+    if mux.skipped:
+        print(f"skipped {mux.skipped} of {len(frame_ids)} frames (out of order, or after a gap until the next IDR)")
+    print(f"Wrote {out_path}: {used} frames in {(time.monotonic() - start) * 1000:.0f} ms")
 
 
 if __name__ == "__main__":
@@ -0,0 +1,150 @@
+"""Live HLS from received frames: fMP4 segments and a sliding-window playlist per clip.
+
+H.264 access units go into the segments as they are, no re-encode. A
+segment closes at the first IDR at least segment_ms after its start, so
+segments start on frame timestamps and play on their own, and a segment can
+run up to one IDR interval (gop_ms) past segment_ms. EXT-X-TARGETDURATION
+covers that and never changes in a live playlist (RFC 8216). Each clip gets
+<root>/clip<ID>/ with init.mp4, seg<N>.m4s and index.m3u8; serve the root
+over HTTP (python3 -m http.server) and open index.m3u8 in any HLS player.
+"""
+import math
+import os
+import time
+
+from mp4_mux import Fragmenter
+from vid_wire import FOURCC_H264
+
+
+def _write_atomic(path, data):
+    tmp = path + ".tmp"
+    with open(tmp, "wb") as f:
+        f.write(data)
+    os.replace(tmp, path)
+
+
+class HlsStream:
+    """One clip's segments and playlist."""
+
+    def __init__(self, outdir, fourcc, width, height, segment_ms, window, gop_ms):
+        self.outdir = outdir
+        self.segment_ms = segment_ms
+        self.window = window
+        self.frag = Fragmenter(fourcc, width, height, segment_ms)
+        self.segments = []  # (sequence, seconds), oldest first
+        # Fixed for the life of the playlist.
+        self.target = max(1, math.ceil((segment_ms + gop_ms) / 1000))
+        self.warned = False
+        self.last_frame = time.monotonic()
+        self.ended = False
+        os.makedirs(outdir, exist_ok=True)
+
+    @property
+    def playlist(self):
+        return os.path.join(self.outdir, "index.m3u8")
+
+    def add(self, frame, ts_ms, frame_id=None):
+        """Queue one frame; False when it was skipped (late, or no IDR yet)."""
+        self.last_frame = time.monotonic()
+        started = self.frag.started
+        accepted, done = self.frag.add(frame, ts_ms, frame_id)
+        if accepted and not started:
+            _write_atomic(os.path.join(self.outdir, "init.mp4"), self.frag.init_segment())
+        if done:
+            self._segment(done)
+        return accepted
+
+    def end(self):
+        """Publish the frames still queued and mark the playlist complete."""
+        if self.ended:
+            return
+        done = self.frag.flush()
+        if done:
+            self._segment(done)
+        self.ended = True
+        if self.segments:
+            self._write_playlist()
+
+    def _segment(self, done):
+        data, _start_ms, duration_ms = done
+        seq = self.frag.sequence
+        _write_atomic(os.path.join(self.outdir, f"seg{seq}.m4s"), data)
+        seconds = duration_ms / 1000
+        self.segments.append((seq, seconds))
+        if round(seconds) > self.target and not self.warned:
+            self.warned = True
+            print(
+                f"HLS: segment {seq} is {seconds:.1f}s, over the {self.target}s target duration; "
+                "the IDR interval is longer than gop_ms (--hls-gop-ms)"
+            )
+        # Players may still fetch what just left the playlist; keep as many
+        # again on disk.
+        while len(self.segments) > self.window:
+            old, _ = self.segments.pop(0)
+            stale = os.path.join(self.outdir, f"seg{old - self.window}.m4s")
+            if os.path.exists(stale):
+                os.remove(stale)
+        self._write_playlist()
+
+    def _write_playlist(self):
+        lines = [
+            "#EXTM3U",
+            "#EXT-X-VERSION:7",
+            f"#EXT-X-TARGETDURATION:{self.target}",
+            f"#EXT-X-MEDIA-SEQUENCE:{self.segments[0][0]}",
+            "#EXT-X-INDEPENDENT-SEGMENTS",
+            '#EXT-X-MAP:URI="init.mp4"',
+        ]
+        for seq, seconds in self.segments:
+            lines += [f"#EXTINF:{seconds:.3f},", f"seg{seq}.m4s"]
+        if self.ended:
+            lines.append("#EXT-X-ENDLIST")
+        _write_atomic(self.playlist, ("\n".join(lines) + "\n").encode())
+
+
+class HlsSegmenter:
+    """Routes frames to one HlsStream per clip_id.
+
+    Only H.264 clips are segmented; browsers cannot play MJPEG in HLS. A
+    clip without frames for idle_seconds is ended (EXT-X-ENDLIST).
+    """
+
+    def __init__(self, root, segment_ms=2000, window=6, idle_seconds=10.0, gop_ms=2000):
+        self.root = root
+        self.segment_ms = segment_ms
+        self.window = window
+        self.gop_ms = gop_ms
+        self.idle_seconds = idle_seconds
+        self.streams = {}
+        self.ignored = set()
+
+    def add(self, hdr, frame):
+        """hdr needs clip_id, frame_id, ts_ms, fourcc, width and height."""
+        clip_id = hdr["clip_id"]
+        st = self.streams.get(clip_id)
+        if st is None:
+            if clip_id in self.ignored:
+                return False
+            if hdr["fourcc"] != FOURCC_H264:
+                print(f"HLS: clip {clip_id} is not H.264 (CONFIG_P4_CODEC_H264), not segmented")
+                self.ignored.add(clip_id)
+                return False
+            st = self.streams[clip_id] = HlsStream(
+                os.path.join(self.root, f"clip{clip_id}"), hdr["fourcc"], hdr["width"], hdr["height"],
+                self.segment_ms, self.window, self.gop_ms,
+            )
+            print(f"HLS: clip {clip_id} live at {st.playlist}")
+        if st.ended:
+            return False
+        return st.add(frame, hdr["ts_ms"], hdr["frame_id"])
+
+    def expire(self):
+        now = time.monotonic()
+        for clip_id, st in list(self.streams.items()):
+            if not st.ended and now - st.last_frame > self.idle_seconds:
+                st.end()
+                print(f"HLS: clip {clip_id} ended, {len(st.segments)} segments in the window")
+
+    def close(self):
+        for st in self.streams.values():
+            st.end()
@@ -0,0 +1,497 @@
+"""Minimal MP4 writer for camera frames: MJPEG and H.264 stored as received, no re-encode.
+
+Frames are appended to the file as they are added, each with its own
+timestamp, so variable frame rates, drops and decimation show up in the
+timeline as they happened; the first frame is time zero. close() only
+writes the index (moov), which takes milliseconds however long the clip is.
+
+MJPEG goes in an 'mp4v' sample entry with the JPEG object type, as ffmpeg
+writes it; H.264 is converted from Annex B to length-prefixed NAL units
+with the first IDR's SPS/PPS in 'avcC'. Parameter sets stay in band too,
+so a mid-clip mode switch still decodes.
+"""
+import os
+import struct
+
+from vid_wire import FOURCC_H264, FOURCC_MJPG
+
+TIMESCALE = 90000  # media ticks per second
+MOVIE_TIMESCALE = 1000
+DEFAULT_FRAME_MS = 33  # duration of a lone or last frame without a better guess
+TRACK_ID = 1
+
+_MATRIX = struct.pack(">9I", 0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000)
+
+
+def _box(kind, *payload):
+    body = b"".join(payload)
+    return struct.pack(">I4s", 8 + len(body), kind) + body
+
+
+def _full_box(kind, version, flags, *payload):
+    return _box(kind, struct.pack(">I", version << 24 | flags), *payload)
+
+
+def _descriptor(tag, body):
+    return bytes((tag, len(body))) + body
+
+
+def split_annexb(au):
+    """NAL units of an Annex B access unit, start codes removed."""
+    nals = []
+    starts = []
+    pos = au.find(b"\x00\x00\x01")
+    while pos >= 0:
+        starts.append(pos + 3)
+        pos = au.find(b"\x00\x00\x01", pos + 3)
+    for i, start in enumerate(starts):
+        end = starts[i + 1] - 3 if i + 1 < len(starts) else len(au)
+        # A 4-byte start code leaves its leading zero on the previous NAL.
+        if i + 1 < len(starts) and end > start and au[end - 1] == 0:
+            end -= 1
+        if end > start:
+            nals.append(au[start:end])
+    return nals
+
+
+class _Bits:
+    """Reads an RBSP: emulation prevention bytes removed."""
+
+    def __init__(self, nal):
+        self.data = nal.replace(b"\x00\x00\x03", b"\x00\x00")
+        self.pos = 0
+
+    def u(self, n):
+        value = 0
+        for _ in range(n):
+            byte = self.data[self.pos >> 3]
+            value = value << 1 | (byte >> (7 - (self.pos & 7))) & 1
+            self.pos += 1
+        return value
+
+    def ue(self):
+        zeros = 0
+        while self.u(1) == 0:
+            zeros += 1
+        return (1 << zeros) - 1 + self.u(zeros)
+
+    def se(self):
+        v = self.ue()
+        return (v + 1) // 2 if v & 1 else -(v // 2)
+
+
+def h264_sps_size(sps):
+    """(width, height) from an SPS NAL unit, cropping applied."""
+    b = _Bits(sps[1:])
+    profile = b.u(8)
+    b.u(16)  # constraint flags, level
+    b.ue()  # seq_parameter_set_id
+    chroma = 1
+    if profile in (100, 110, 122, 244, 44, 83, 86, 118, 128, 138, 139, 134, 135):
+        chroma = b.ue()
+        if chroma == 3:
+            b.u(1)
+        b.ue()
+        b.ue()
+        b.u(1)
+        if b.u(1):  # seq_scaling_matrix_present_flag
+            for i in range(12 if chroma == 3 else 8):
+                if b.u(1):
+                    last = nxt = 8
+                    for _ in range(16 if i < 6 else 64):
+                        if nxt:
+                            nxt = (last + b.se()) % 256
+                        last = nxt or last
+    b.ue()  # log2_max_frame_num_minus4
+    poc_type = b.ue()
+    if poc_type == 0:
+        b.ue()
+    elif poc_type == 1:
+        b.u(1)
+        b.se()
+        b.se()
+        for _ in range(b.ue()):
+            b.se()
+    b.ue()  # max_num_ref_frames
+    b.u(1)
+    width_mbs = b.ue() + 1
+    height_units = b.ue() + 1
+    frame_mbs_only = b.u(1)
+    if not frame_mbs_only:
+        b.u(1)
+    b.u(1)
+    crop = (0, 0, 0, 0)
+    if b.u(1):
+        crop = (b.ue(), b.ue(), b.ue(), b.ue())
+    # Crop offsets count chroma samples.
+    unit_x = 2 if chroma in (1, 2) else 1
+    unit_y = (2 if chroma == 1 else 1) * (2 - frame_mbs_only)
+    width = width_mbs * 16 - unit_x * (crop[0] + crop[1])
+    height = (2 - frame_mbs_only) * height_units * 16 - unit_y * (crop[2] + crop[3])
+    return width, height
+
+
+def jpeg_size(jpeg):
+    """(width, height) from a JPEG's SOF marker, or None."""
+    pos = 2
+    while pos + 9 <= len(jpeg):
+        if jpeg[pos] != 0xFF:
+            return None
+        marker = jpeg[pos + 1]
+        if 0xC0 <= marker <= 0xCF and marker not in (0xC4, 0xC8, 0xCC):
+            height, width = struct.unpack_from(">HH", jpeg, pos + 5)
+            return width, height
+        pos += 2 + struct.unpack_from(">H", jpeg, pos + 2)[0]
+    return None
+
+
+class Track:
+    """One camera stream turned into MP4 samples.
+
+    H.264 keyframes are found from the NAL types; every MJPEG frame is one.
+    With frame_id, frames older than the last one are skipped and an H.264
+    gap waits for the next IDR, since P frames reference the frame before
+    them. A width or height of 0 is taken from the first frame's JPEG or
+    SPS header.
+    """
+
+    def __init__(self, fourcc, width=0, height=0):
+        if fourcc not in (FOURCC_MJPG, FOURCC_H264):
+            raise ValueError(f"unsupported fourcc {fourcc:#x}")
+        self.fourcc = fourcc
+        self.width = width
+        self.height = height
+        self.sps = None
+        self.pps = None
+        self.skipped = 0  # late frames and H.264 frames that could not be decoded
+        self.last_ts_ms = None
+        self._last_frame_id = None
+        self._decodable = False
+
+    def sample(self, frame, ts_ms, frame_id=None):
+        """(sample, keyframe) for one frame, or (None, False) when it is skipped."""
+        if frame_id is not None and self._last_frame_id is not None:
+            if frame_id <= self._last_frame_id:
+                self.skipped += 1
+                return None, False
+            if frame_id != self._last_frame_id + 1:
+                self._decodable = False
+        if frame_id is not None:
+            self._last_frame_id = frame_id
+        if self.last_ts_ms is not None and ts_ms < self.last_ts_ms:
+            self.skipped += 1
+            return None, False
+
+        if self.fourcc == FOURCC_H264:
+            sample, keyframe = self._h264_sample(frame)
+            if sample is None:
+                self.skipped += 1
+                return None, False
+        else:
+            sample = frame
+            keyframe = True
+            if not self.width or not self.height:
+                self.width, self.height = jpeg_size(frame) or (0, 0)
+        self.last_ts_ms = ts_ms
+        return sample, keyframe
+
+    def _h264_sample(self, au):
+        nals = split_annexb(au)
+        types = [nal[0] & 0x1F for nal in nals]
+        keyframe = 5 in types
+        if not self._decodable:
+            if not keyframe:
+                return None, False
+            self._decodable = True
+        for nal, kind in zip(nals, types):
+            if kind == 7 and self.sps is None:
+                self.sps = nal
+                if not self.width or not self.height:
+                    self.width, self.height = h264_sps_size(nal)
+            elif kind == 8 and self.pps is None:
+                self.pps = nal
+        if self.sps is None or self.pps is None:
+            self._decodable = False
+            return None, False
+        # Access unit delimiters have no place in MP4 samples.
+        sample = b"".join(struct.pack(">I", len(nal)) + nal for nal, kind in zip(nals, types) if kind != 9)
+        return sample, keyframe
+
+    def stsd(self):
+        if self.fourcc == FOURCC_H264:
+            kind, name = b"avc1", b"H.264"
+            sps, pps = self.sps, self.pps
+            config = _box(
+                b"avcC",
+                bytes((1, sps[1], sps[2], sps[3], 0xFF, 0xE1)), struct.pack(">H", len(sps)), sps,
+                b"\x01", struct.pack(">H", len(pps)), pps,
+            )
+        else:
+            kind, name = b"mp4v", b"Motion JPEG"
+            # JPEG object type 0x6C, visual stream.
+            dcd = _descriptor(0x04, struct.pack(">BB3sII", 0x6C, 0x11, bytes(3), 0, 0))
+            es = _descriptor(0x03, struct.pack(">HB", 1, 0) + dcd + _descriptor(0x06, b"\x02"))
+            config = _full_box(b"esds", 0, 0, es)
+        entry = _box(
+            kind,
+            bytes(6), struct.pack(">H", 1), bytes(16),
+            struct.pack(">HHIII", self.width, self.height, 0x480000, 0x480000, 0),
+            struct.pack(">H", 1), bytes((len(name),)) + name.ljust(31, b"\0"),
+            struct.pack(">Hh", 0x18, -1), config,
+        )
+        return _full_box(b"stsd", 0, 0, struct.pack(">I", 1), entry)
+
+    def moov(self, media_duration, stbl_boxes, mvex=b""):
+        movie_duration = media_duration * MOVIE_TIMESCALE // TIMESCALE
+        mvhd = _full_box(
+            b"mvhd", 0, 0,
+            struct.pack(">IIII", 0, 0, MOVIE_TIMESCALE, movie_duration),
+            struct.pack(">IH10x", 0x10000, 0x100), _MATRIX, bytes(24), struct.pack(">I", TRACK_ID + 1),
+        )
+        tkhd = _full_box(
+            b"tkhd", 0, 3,
+            struct.pack(">IIII", 0, 0, TRACK_ID, 0), struct.pack(">I8x", movie_duration),
+            struct.pack(">hhhH", 0, 0, 0, 0), _MATRIX, struct.pack(">II", self.width << 16, self.height << 16),
+        )
+        mdhd = _full_box(b"mdhd", 0, 0, struct.pack(">IIIIHH", 0, 0, TIMESCALE, media_duration, 0x55C4, 0))
+        hdlr = _full_box(b"hdlr", 0, 0, struct.pack(">I4s12x", 0, b"vide"), b"VideoHandler\0")
+        vmhd = _full_box(b"vmhd", 0, 1, bytes(8))
+        dinf = _box(b"dinf", _full_box(b"dref", 0, 0, struct.pack(">I", 1), _full_box(b"url ", 0, 1)))
+        stbl = _box(b"stbl", self.stsd(), *stbl_boxes)
+        mdia = _box(b"mdia", mdhd, hdlr, _box(b"minf", vmhd, dinf, stbl))
+        return _box(b"moov", mvhd, _box(b"trak", tkhd, mdia), mvex)
+
+
+def ticks(ts_ms):
+    return ts_ms * TIMESCALE // 1000
+
+
+class Mp4Writer:
+    """Append frames to an MP4 file; call close() to make it playable.
+
+    The file is written as path + ".part" and renamed on close, so a
+    complete path is always a finished clip.
+    """
+
+    def __init__(self, path, fourcc, width=0, height=0):
+        self.track = Track(fourcc, width, height)
+        self.path = path
+        self.sizes = []
+        self.ts_ms = []
+        self.keys = []
+        self._tmp = path + ".part"
+        self._f = open(self._tmp, "wb")
+        self._f.write(_box(b"ftyp", b"isom", struct.pack(">I", 0x200), b"isom", b"iso2", b"avc1", b"mp41"))
+        # 64-bit mdat header, size patched in close().
+        self._mdat_pos = self._f.tell()
+        self._f.write(struct.pack(">I4sQ", 1, b"mdat", 0))
+        self._data_len = 0
+
+    @property
+    def skipped(self):
+        return self.track.skipped
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def add(self, frame, ts_ms, frame_id=None):
+        """Append one frame; False when it was skipped (see Track)."""
+        sample, keyframe = self.track.sample(frame, ts_ms, frame_id)
+        if sample is None:
+            return False
+        self._f.write(sample)
+        self._data_len += len(sample)
+        self.sizes.append(len(sample))
+        self.ts_ms.append(ts_ms)
+        self.keys.append(keyframe)
+        return True
+
+    def durations(self):
+        """Sample durations in TIMESCALE ticks, from the timestamp deltas."""
+        t = [ticks(ts) for ts in self.ts_ms]
+        out = [max(1, b - a) for a, b in zip(t, t[1:])]
+        out.append(out[-1] if out else ticks(DEFAULT_FRAME_MS))
+        return out
+
+    def close(self):
+        """Write the index and publish the file. Returns the frame count;
+        a clip without frames leaves no file behind."""
+        if self._f is None:
+            return len(self.sizes)
+        if not self.sizes:
+            self._f.close()
+            self._f = None
+            os.remove(self._tmp)
+            return 0
+        durations = self.durations()
+        self._f.write(self.track.moov(sum(durations), self._stbl(durations)))
+        self._f.seek(self._mdat_pos + 8)
+        self._f.write(struct.pack(">Q", 16 + self._data_len))
+        self._f.close()
+        self._f = None
+        os.replace(self._tmp, self.path)
+        return len(self.sizes)
+
+    def _stbl(self, durations):
+        runs = []
+        for d in durations:
+            if runs and runs[-1][1] == d:
+                runs[-1][0] += 1
+            else:
+                runs.append([1, d])
+        boxes = [_full_box(b"stts", 0, 0, struct.pack(">I", len(runs)),
+                           b"".join(struct.pack(">II", n, d) for n, d in runs))]
+        if not all(self.keys):
+            sync = [i + 1 for i, key in enumerate(self.keys) if key]
+            boxes.append(_full_box(b"stss", 0, 0, struct.pack(">I", len(sync)),
+                                   struct.pack(f">{len(sync)}I", *sync)))
+        # Samples sit back to back in mdat: one chunk holds them all.
+        n = len(self.sizes)
+        boxes.append(_full_box(b"stsc", 0, 0, struct.pack(">IIII", 1, 1, n, 1)))
+        boxes.append(_full_box(b"stsz", 0, 0, struct.pack(">II", 0, n), struct.pack(f">{n}I", *self.sizes)))
+        boxes.append(_full_box(b"co64", 0, 0, struct.pack(">IQ", 1, self._mdat_pos + 16)))
+        return boxes
+
+
+class Fragmenter:
+    """Cuts a track into fragmented MP4: one init segment, then moof+mdat
+    fragments that each play on their own after it.
+
+    A fragment closes at the first keyframe at least fragment_ms after its
+    start, so every fragment starts with a sync sample and its start time
+    is a frame timestamp. A sample's duration is only known when the next
+    frame arrives, so the last one waits for it (or for flush()).
+    """
+
+    def __init__(self, fourcc, width=0, height=0, fragment_ms=1000):
+        self.track = Track(fourcc, width, height)
+        self.fragment_ms = fragment_ms
+        self.sequence = 0
+        self._ts0 = None
+        self._pending = []  # (sample, ts_ms, keyframe)
+        self._last_duration = ticks(DEFAULT_FRAME_MS)
+
+    def init_segment(self):
+        """ftyp + moov; valid once add() has accepted a frame."""
+        ftyp = _box(b"ftyp", b"iso6", struct.pack(">I", 0), b"iso6", b"isom", b"avc1", b"mp41")
+        empty = [
+            _full_box(b"stts", 0, 0, bytes(4)),
+            _full_box(b"stsc", 0, 0, bytes(4)),
+            _full_box(b"stsz", 0, 0, bytes(8)),
+            _full_box(b"stco", 0, 0, bytes(4)),
+        ]
+        trex = _full_box(b"trex", 0, 0, struct.pack(">IIIII", TRACK_ID, 1, 0, 0, 0))
+        return ftyp + self.track.moov(0, empty, _box(b"mvex", trex))
+
+    @property
+    def started(self):
+        return self._ts0 is not None
+
+    def add(self, frame, ts_ms, frame_id=None):
+        """Queue one frame. Returns (accepted, fragment), where fragment is
+        a finished (bytes, start_ms, duration_ms) or None. Times are
+        relative to the first frame."""
+        sample, keyframe = self.track.sample(frame, ts_ms, frame_id)
+        if sample is None:
+            return False, None
+        if self._ts0 is None:
+            self._ts0 = ts_ms
+        done = None
+        if self._pending and keyframe and ts_ms - self._pending[0][1] >= self.fragment_ms:
+            done = self._fragment(ts_ms)
+        self._pending.append((sample, ts_ms, keyframe))
+        return True, done
+
+    def flush(self):
+        """The queued frames as a last fragment, or None."""
+        return self._fragment(None) if self._pending else None
+
+    def _fragment(self, next_ts_ms):
+        samples, self._pending = self._pending, []
+        t = [ticks(ts - self._ts0) for _, ts, _ in samples]
+        durations = [max(1, b - a) for a, b in zip(t, t[1:])]
+        durations.append(max(1, ticks(next_ts_ms - self._ts0) - t[-1]) if next_ts_ms is not None
+                         else self._last_duration)
+        self._last_duration = durations[-1]
+        self.sequence += 1
+
+        # tfhd default-base-is-moof: trun's data_offset counts from moof.
+        n = len(samples)
+        flags = 0x000001 | 0x000100 | 0x000200 | 0x000400
+        entries = b"".join(
+            struct.pack(">III", d, len(s), 0x02000000 if key else 0x01010000)
+            for d, (s, _, key) in zip(durations, samples)
+        )
+        mfhd = _full_box(b"mfhd", 0, 0, struct.pack(">I", self.sequence))
+        tfhd = _full_box(b"tfhd", 0, 0x020000, struct.pack(">I", TRACK_ID))
+        tfdt = _full_box(b"tfdt", 1, 0, struct.pack(">Q", t[0]))
+
+        def moof(data_offset):
+            trun = _full_box(b"trun", 0, flags, struct.pack(">Ii", n, data_offset), entries)
+            return _box(b"moof", mfhd, _box(b"traf", tfhd, tfdt, trun))
+
+        # The samples start right after moof and the mdat header.
+        moof = moof(len(moof(0)) + 8)
+        data = b"".join(s for s, _, _ in samples)
+        out = moof + struct.pack(">I4s", 8 + len(data), b"mdat") + data
+        start_ms = samples[0][1] - self._ts0
+        return out, start_ms, (t[-1] + durations[-1] - t[0]) * 1000 / TIMESCALE
+
+
+class FragmentedMp4Writer:
+    """Append frames to a fragmented MP4 file.
+
+    Each finished fragment is one sequential append, and the file plays up
+    to its last complete fragment at any time, also while recording or
+    after a crash. close() writes the frames still queued.
+    """
+
+    def __init__(self, path, fourcc, width=0, height=0, fragment_ms=1000):
+        self.path = path
+        self.frag = Fragmenter(fourcc, width, height, fragment_ms)
+        self.frames = 0
+        self._f = open(path, "wb")
+
+    @property
+    def skipped(self):
+        return self.frag.track.skipped
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def add(self, frame, ts_ms, frame_id=None):
+        """Queue one frame; False when it was skipped (see Track)."""
+        started = self.frag.started
+        accepted, done = self.frag.add(frame, ts_ms, frame_id)
+        if not accepted:
+            return False
+        if not started:
+            self._f.write(self.frag.init_segment())
+        if done:
+            self._write(done[0])
+        self.frames += 1
+        return True
+
+    def _write(self, data):
+        self._f.write(data)
+        self._f.flush()
+
+    def close(self):
+        """Write the last fragment. Returns the frame count; a clip without
+        frames leaves no file behind."""
+        if self._f is None:
+            return self.frames
+        done = self.frag.flush()
+        if done:
+            self._write(done[0])
+        self._f.close()
+        self._f = None
+        if not self.frames:
+            os.remove(self.path)
+        return self.frames
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Collect a CONFIG_P4_BENCH report and compare it against a baseline.
+
+The camera prints the JSON report between "=== CAM BENCH BEGIN/END ===" lines
+and publishes it to CONFIG_P4_BENCH_TOPIC. Take it from either, save it with
+--out, and pass an earlier report as --baseline to flag regressions: the
+exit status is 1 when any metric is worse than --threshold percent.
+"""
+import argparse
+import json
+import sys
+from urllib.parse import urlparse
+
+UART_BEGIN = "=== CAM BENCH BEGIN ==="
+UART_END = "=== CAM BENCH END ==="
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="Collect and compare ESP32-P4 camera benchmark reports.")
+    ap.add_argument("--broker", help="Broker URI, e.g. mqtt://192.168.1.10:1883")
+    ap.add_argument("--topic", default="cam/bench", help="Benchmark report topic")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version",
+    )
+    ap.add_argument("--uart", metavar="LOGFILE", help="Take the last report from a console log")
+    ap.add_argument("--report", metavar="FILE", help="Use an already saved report")
+    ap.add_argument("--out", help="Save the report to FILE")
+    ap.add_argument("--baseline", metavar="FILE", help="Earlier report to compare against")
+    ap.add_argument("--threshold", type=float, default=5.0, help="Regression threshold in percent")
+    args = ap.parse_args()
+    if sum(bool(x) for x in (args.broker, args.uart, args.report)) != 1:
+        ap.error("exactly one of --broker, --uart or --report is required")
+    return args
+
+
+def from_uart(path):
+    report = None
+    lines = None
+    with open(path, "r", encoding="utf-8", errors="replace") as f:
+        for line in f:
+            stripped = line.strip()
+            if stripped.endswith(UART_BEGIN):
+                lines = []
+            elif stripped.endswith(UART_END) and lines is not None:
+                report = "".join(lines)
+                lines = None
+            elif lines is not None:
+                lines.append(line)
+    if report is None:
+        raise SystemExit(f"no '{UART_BEGIN}' block in {path}")
+    return json.loads(report)
+
+
+def from_mqtt(args):
+    try:
+        import paho.mqtt.client as mqtt
+    except ImportError as exc:
+        raise SystemExit(
+            "Missing dependency: paho-mqtt. Install with:\n"
+            "  python3 -m pip install -r requirements.txt\n"
+            "If you are not in a virtualenv, you can also use:\n"
+            "  python3 -m pip install --user paho-mqtt"
+        ) from exc
+
+    result = {}
+
+    def on_message(client, userdata, msg):
+        try:
+            result["report"] = json.loads(msg.payload)
+        except ValueError:
+            print(f"ignoring {len(msg.payload)} byte message that is not JSON")
+            return
+        client.disconnect()
+
+    def on_connect(client, userdata, flags, reason_code, properties=None):
+        if reason_code == 0:
+            client.subscribe(args.topic, qos=0)
+            print(f"subscribed to {args.topic}, waiting for a report")
+        else:
+            print(f"connect failed: {reason_code}")
+
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
+    client.on_connect = on_connect
+    client.on_message = on_message
+
+    url = urlparse(args.broker)
+    host = url.hostname or args.broker
+    port = url.port or 1883
+    try:
+        client.connect(host, port, 60)
+    except Exception as exc:
+        raise SystemExit(f"MQTT connect failed to {host}:{port} ({exc})") from exc
+
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        pass
+    if "report" not in result:
+        raise SystemExit("no report received")
+    return result["report"]
+
+
+def metrics(report):
+    """Flatten a report to {name: (value, higher_is_better)}."""
+    out = {}
+    for e in report.get("encode", []):
+        if "mean_us" in e:
+            # Reports from before format negotiation only timed RGB565 input.
+            fmt = e.get("fmt", "rgb565")
+            out[f"encode {e['w']}x{e['h']} {fmt} {e['ss']} q{e['q']} mean_us"] = (e["mean_us"], False)
+    for e in report.get("packetize", []):
+        if "mb_s" in e:
+            out[f"packetize chunk {e['chunk']} mb_s"] = (e["mb_s"], True)
+    for stage, key in (("flash", "mb_s"), ("upload", "mb_s"), ("mqtt", "goodput_mbps"), ("e2e", "sent_fps")):
+        value = report.get(stage, {}).get(key)
+        if value is not None:
+            out[f"{stage} {key}"] = (value, True)
+    return out
+
+
+def print_summary(report):
+    print(
+        f"target {report.get('target')} idf {report.get('idf')} app {report.get('app')} "
+        f"codec {report.get('codec', 'mjpeg')} wire {report.get('wire')} publish {report.get('publish')}"
+    )
+    for name, (value, _) in metrics(report).items():
+        print(f"  {name:<48} {value:>12.2f}")
+    print_format_gain(report)
+    for stage in ("upload", "mqtt", "e2e"):
+        reason = report.get(stage, {}).get("skipped")
+        if reason:
+            print(f"  {stage:<48} skipped ({reason})")
+
+
+def print_format_gain(report):
+    """Encode time of each YUV input relative to RGB565 at the same settings."""
+    rgb = {}
+    yuv = []
+    for e in report.get("encode", []):
+        if "mean_us" not in e:
+            continue
+        key = (e["w"], e["h"], e["ss"], e["q"])
+        if e.get("fmt", "rgb565") == "rgb565":
+            rgb[key] = e
+        else:
+            yuv.append((key, e))
+    for key, e in yuv:
+        base = rgb.get(key)
+        if not base or not base["mean_us"]:
+            continue
+        gain = (base["mean_us"] - e["mean_us"]) / base["mean_us"] * 100.0
+        print(
+            f"  {e['fmt']} vs rgb565 {e['w']}x{e['h']} {e['ss']} q{e['q']}: "
+            f"{gain:+.1f}% encode time saved, input {e.get('in_bytes')} vs "
+            f"{base.get('in_bytes', e['w'] * e['h'] * 2)} bytes"
+        )
+
+
+def compare(report, baseline, threshold):
+    cur = metrics(report)
+    base = metrics(baseline)
+    regressions = 0
+    print(f"vs baseline app {baseline.get('app')} (threshold {threshold:.1f}%)")
+    codecs = (report.get("codec", "mjpeg"), baseline.get("codec", "mjpeg"))
+    if codecs[0] != codecs[1]:
+        print(f"  note: codec {codecs[0]} vs {codecs[1]} in the baseline, sizes and times will differ")
+    for name, (value, higher_better) in cur.items():
+        if name not in base or base[name][0] == 0:
+            continue
+        old = base[name][0]
+        change = (value - old) / old * 100.0
+        worse = -change if higher_better else change
+        flag = "REGRESSION" if worse > threshold else ""
+        regressions += bool(flag)
+        print(f"  {name:<48} {old:>12.2f} -> {value:>12.2f} {change:+7.1f}% {flag}")
+    for name in sorted(set(base) - set(cur)):
+        print(f"  {name:<48} missing from this run")
+    return regressions
+
+
+def main():
+    args = parse_args()
+    if args.report:
+        with open(args.report, "r", encoding="utf-8") as f:
+            report = json.load(f)
+    elif args.uart:
+        report = from_uart(args.uart)
+    else:
+        report = from_mqtt(args)
+
+    if args.out:
+        with open(args.out, "w", encoding="utf-8") as f:
+            json.dump(report, f, indent=1)
+            f.write("\n")
+        print(f"wrote {args.out}")
+
+    print_summary(report)
+    if args.baseline:
+        with open(args.baseline, "r", encoding="utf-8") as f:
+            baseline = json.load(f)
+        regressions = compare(report, baseline, args.threshold)
+        if regressions:
+            print(f"{regressions} regression(s)")
+            return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Send a command to the camera control topic (CONFIG_P4_MQTT_CTRL_TOPIC) and print the reply.
+
+  mqtt_cam_ctl.py --broker mqtt://host modes
+  mqtt_cam_ctl.py --broker mqtt://host mode --size 1280x720 --fps 30 --fmt yuv420
+
+"mode" changes the capture mode request; keys left out keep their value and
+0 (or --fmt any) lifts a constraint. During a capture the camera switches
+right away and replies with the mode it picked.
+"""
+import argparse
+import json
+import time
+from urllib.parse import urlparse
+
+try:
+    import paho.mqtt.client as mqtt
+except ImportError as exc:
+    raise SystemExit(
+        "Missing dependency: paho-mqtt. Install with:\n"
+        "  python3 -m pip install -r requirements.txt\n"
+        "If you are not in a virtualenv, you can also use:\n"
+        "  python3 -m pip install --user paho-mqtt"
+    ) from exc
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="Control an ESP32-P4 camera over MQTT.")
+    ap.add_argument("--broker", required=True, help="Broker URI, e.g. mqtt://192.168.1.10:1883")
+    ap.add_argument("--topic", default="cam/ctl", help="Control topic")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version",
+    )
+    ap.add_argument("--timeout", type=float, default=5.0, help="Seconds to wait for the reply")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    sub.add_parser("modes", help="List the capture modes and the current request")
+    mode = sub.add_parser("mode", help="Change the capture mode request")
+    mode.add_argument("--size", help="WxH, e.g. 1280x720 (0x0 = sensor default)")
+    mode.add_argument("--fps", type=int, help="Minimum frame rate")
+    mode.add_argument("--max-mb-s", type=int, help="Cap on raw capture traffic in MB/s")
+    mode.add_argument("--fmt", choices=("any", "rgb565", "yuv422", "yuv420"), help="Force a capture format")
+    return ap.parse_args()
+
+
+def build_command(args):
+    cmd = {"cmd": args.cmd}
+    if args.cmd != "mode":
+        return cmd
+    if args.size:
+        try:
+            w, h = (int(v) for v in args.size.lower().split("x"))
+        except ValueError as exc:
+            raise SystemExit(f"bad --size {args.size!r}, expected WxH") from exc
+        cmd.update(w=w, h=h)
+    if args.fps is not None:
+        cmd["fps"] = args.fps
+    if args.max_mb_s is not None:
+        cmd["max_mb_s"] = args.max_mb_s
+    if args.fmt:
+        cmd["fmt"] = args.fmt
+    return cmd
+
+
+def print_reply(reply):
+    if reply.get("ok") is False:
+        print(f"{reply.get('event')}: failed, {reply.get('err')}")
+        return
+    if reply.get("event") == "mode":
+        state = "switched to" if reply.get("active") else "request stored, not capturing:"
+        print(f"{state} {reply['fmt']} {reply['w']}x{reply['h']} @ {reply['fps']} fps ({reply['mb_s']} MB/s)")
+        return
+    req = reply.get("req", {})
+    print(f"request: {req.get('fmt')} {req.get('w')}x{req.get('h')} fps>={req.get('fps')} "
+          f"max_mb_s={req.get('max_mb_s')}")
+    cur = reply.get("cur")
+    if cur:
+        print(f"current: {cur['fmt']} {cur['w']}x{cur['h']} @ {cur['fps']} fps")
+    modes = reply.get("modes", [])
+    if not modes:
+        print("no modes listed (the camera only enumerates while capturing)")
+    for m in modes:
+        print(f"  {m['fmt']:<7} {m['w']:>5}x{m['h']:<5} {m['fps']:>3} fps {m['mb_s']:>4} MB/s")
+
+
+def main():
+    args = parse_args()
+    cmd = build_command(args)
+    replies = []
+
+    def on_connect(client, userdata, flags, reason_code, properties=None):
+        if reason_code == 0:
+            client.subscribe(args.topic, qos=0)
+        else:
+            print(f"connect failed: {reason_code}")
+
+    def on_subscribe(client, userdata, mid, reason_codes, properties=None):
+        client.publish(args.topic, json.dumps(cmd, separators=(",", ":")), qos=0)
+
+    def on_message(client, userdata, msg):
+        try:
+            payload = json.loads(msg.payload)
+        except ValueError:
+            return
+        # Our own command comes back too; the camera answers with "event".
+        if payload.get("event") == args.cmd:
+            replies.append(payload)
+
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
+    client.on_connect = on_connect
+    client.on_subscribe = on_subscribe
+    client.on_message = on_message
+
+    url = urlparse(args.broker)
+    host = url.hostname or args.broker
+    port = url.port or 1883
+    try:
+        client.connect(host, port, 60)
+    except Exception as exc:
+        raise SystemExit(f"MQTT connect failed to {host}:{port} ({exc})") from exc
+
+    end = time.time() + args.timeout
+    while not replies and time.time() < end:
+        client.loop(timeout=0.1)
+    client.disconnect()
+    if not replies:
+        raise SystemExit(f"no reply on {args.topic} within {args.timeout:.0f}s")
+    print_reply(replies[0])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Synthetic camera load generator.
+
+Publishes JPEG sequences (e.g. the frames saved in out/) or synthetic frames
+as N cameras, framed exactly like main/video_packetizer.c, so receivers and
+brokers can be benchmarked without boards:
+
+  docker compose -f tools/docker-compose.yml up -d
+  python3 tools/mqtt_cam_loadgen.py --broker mqtt://127.0.0.1:1883 --cameras 64 --fps 30
+  python3 tools/mqtt_cam_ingest.py --broker mqtt://127.0.0.1:1883
+
+Each camera has its own MQTT connection, clip_id and topic (cam/<n>/vid by
+default), and cameras are phase-shifted across the frame interval like
+independent boards. --loss drops chunks and --reorder swaps adjacent chunks
+before publishing. ts_ms is wall-clock milliseconds modulo 2^32.
+"""
+import argparse
+import multiprocessing as mp
+import os
+import random
+import re
+import time
+from urllib.parse import urlparse
+
+try:
+    import paho.mqtt.client as mqtt
+    from paho.mqtt.packettypes import PacketTypes
+    from paho.mqtt.properties import Properties
+except ImportError as exc:
+    raise SystemExit(
+        "Missing dependency: paho-mqtt. Install with:\n"
+        "  python3 -m pip install -r requirements.txt\n"
+        "If you are not in a virtualenv, you can also use:\n"
+        "  python3 -m pip install --user paho-mqtt"
+    ) from exc
+
+from vid_wire import CHUNK_MAX, packetize
+
+
+def parse_size(text):
+    m = re.fullmatch(r"(\d+)x(\d+)", text)
+    if not m:
+        raise argparse.ArgumentTypeError("expected WIDTHxHEIGHT, e.g. 1280x720")
+    return int(m.group(1)), int(m.group(2))
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="Publish synthetic camera traffic over MQTT.")
+    ap.add_argument("--broker", required=True, help="Broker URI, e.g. mqtt://127.0.0.1:1883")
+    ap.add_argument("--topic", default="cam/{cam}/vid", help="Topic template; {cam} is the camera index")
+    ap.add_argument("--cameras", type=int, default=1, help="Number of simulated cameras")
+    ap.add_argument("--fps", type=float, default=30.0, help="Frames per second per camera")
+    ap.add_argument("--duration", type=float, default=10.0, help="Seconds to run")
+    ap.add_argument(
+        "--frames",
+        help="Directory of JPEGs to replay in frame order (default: synthetic frames)",
+    )
+    ap.add_argument(
+        "--size",
+        type=parse_size,
+        default=(1280, 720),
+        help="Resolution WxH; JPEGs are resized when Pillow is installed",
+    )
+    ap.add_argument(
+        "--frame-bytes",
+        type=int,
+        default=0,
+        help="Synthetic frame size (default: about 1 bit per pixel)",
+    )
+    ap.add_argument("--wire", choices=("vid0", "vid1", "mqtt5"), default="vid0", help="Chunk wire format")
+    ap.add_argument("--chunk", type=int, default=CHUNK_MAX, help="Payload bytes per chunk")
+    ap.add_argument("--loss", type=float, default=0.0, help="Probability of dropping each chunk")
+    ap.add_argument("--reorder", type=float, default=0.0, help="Probability of swapping a chunk with the next")
+    ap.add_argument("--procs", type=int, default=os.cpu_count() or 1, help="Publisher processes")
+    ap.add_argument("--seed", type=int, default=1, help="Random seed for loss/reorder and clip ids")
+    return ap.parse_args()
+
+
+def frame_number(name):
+    m = re.search(r"frame(\d+)", name)
+    return int(m.group(1)) if m else 0
+
+
+def load_frames(args):
+    width, height = args.size
+    if not args.frames:
+        size = args.frame_bytes or max(width * height // 8, 1024)
+        rnd = random.Random(args.seed)
+        # A few distinct frames so receivers cannot dedupe; SOI/EOI for looks.
+        return [b"\xff\xd8" + rnd.randbytes(size - 4) + b"\xff\xd9" for _ in range(8)]
+
+    names = sorted((n for n in os.listdir(args.frames) if n.lower().endswith(".jpg")), key=frame_number)
+    if not names:
+        raise SystemExit(f"no .jpg files in {args.frames}")
+    frames = []
+    resize = None
+    for name in names:
+        with open(os.path.join(args.frames, name), "rb") as f:
+            data = f.read()
+        if resize is None:
+            resize = _needs_resize(data, args.size)
+        if resize:
+            data = _resize_jpeg(data, args.size)
+        frames.append(data)
+    return frames
+
+
+def _needs_resize(data, size):
+    try:
+        from PIL import Image
+    except ImportError:
+        print("Pillow not installed; JPEGs are sent as is and --size only sets the header")
+        return False
+    import io
+
+    return Image.open(io.BytesIO(data)).size != tuple(size)
+
+
+def _resize_jpeg(data, size):
+    import io
+
+    from PIL import Image
+
+    out = io.BytesIO()
+    Image.open(io.BytesIO(data)).resize(size).save(out, format="JPEG", quality=85)
+    return out.getvalue()
+
+
+def impair(chunks, rnd, loss, reorder):
+    if loss > 0:
+        chunks = [c for c in chunks if rnd.random() >= loss]
+    if reorder > 0:
+        i = 0
+        while i + 1 < len(chunks):
+            if rnd.random() < reorder:
+                chunks[i], chunks[i + 1] = chunks[i + 1], chunks[i]
+                i += 1
+            i += 1
+    return chunks
+
+
+def publisher_main(proc_idx, cams, args, frames, result):
+    width, height = args.size
+    url = urlparse(args.broker)
+    host = url.hostname or args.broker
+    port = url.port or 1883
+    protocol = mqtt.MQTTv5 if args.wire == "mqtt5" else mqtt.MQTTv311
+    rnd = random.Random(args.seed * 1000 + proc_idx)
+
+    clients = []
+    for cam in cams:
+        c = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
+        c.connect(host, port, 60)
+        c.loop_start()
+        clients.append(c)
+
+    clip_base = random.Random(args.seed).randrange(1, 1 << 30)
+    period = 1.0 / args.fps
+    n_frames = int(args.duration * args.fps)
+    # Spread cameras over the frame interval like independent boards.
+    phase = {cam: (cam % args.cameras) * period / args.cameras for cam in cams}
+    t0 = time.monotonic() + 0.5
+    sent_msgs = sent_bytes = sent_frames = late = 0
+
+    for frame_id in range(n_frames):
+        for cam, client in zip(cams, clients):
+            due = t0 + frame_id * period + phase[cam]
+            delay = due - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+            elif delay < -period:
+                late += 1
+            meta = {
+                "clip_id": clip_base + cam,
+                "frame_id": frame_id,
+                "ts_ms": int(time.time() * 1000) & 0xFFFFFFFF,
+                "width": width,
+                "height": height,
+            }
+            frame = frames[(frame_id + cam) % len(frames)]
+            chunks = impair(list(packetize(meta, frame, args.wire, args.chunk)), rnd, args.loss, args.reorder)
+            topic = args.topic.format(cam=cam)
+            for payload, user_props in chunks:
+                props = None
+                if user_props:
+                    props = Properties(PacketTypes.PUBLISH)
+                    props.UserProperty = user_props
+                client.publish(topic, payload, qos=0, properties=props)
+                sent_msgs += 1
+                sent_bytes += len(payload)
+            sent_frames += 1
+
+    for c in clients:
+        # Let the network threads drain their queues before disconnecting.
+        while c.want_write():
+            time.sleep(0.01)
+        c.disconnect()
+        c.loop_stop()
+    result.put((sent_frames, sent_msgs, sent_bytes, late))
+
+
+def main():
+    args = parse_args()
+    frames = load_frames(args)
+    avg = sum(len(f) for f in frames) / len(frames)
+    procs = max(1, min(args.procs, args.cameras))
+    print(
+        f"{args.cameras} cameras x {args.fps:g} fps, {len(frames)} frames avg {avg / 1024:.1f} KiB, "
+        f"wire={args.wire} loss={args.loss:g} reorder={args.reorder:g}, {procs} processes"
+    )
+
+    result = mp.Queue()
+    workers = []
+    for i in range(procs):
+        cams = list(range(i, args.cameras, procs))
+        p = mp.Process(target=publisher_main, args=(i, cams, args, frames, result))
+        p.start()
+        workers.append(p)
+
+    start = time.monotonic()
+    totals = [0, 0, 0, 0]
+    for _ in workers:
+        for i, v in enumerate(result.get()):
+            totals[i] += v
+    for p in workers:
+        p.join()
+    elapsed = time.monotonic() - start
+
+    frames_sent, msgs, nbytes, late = totals
+    print(
+        f"sent {frames_sent} frames, {msgs} messages, {nbytes / 1e6:.1f} MB in {elapsed:.1f}s: "
+        f"{frames_sent / elapsed:.1f} fps, {msgs / elapsed:.0f} msg/s, {nbytes / elapsed / 1e6:.2f} MB/s"
+    )
+    if late:
+        print(f"{late} frames were published more than one frame interval late (generator overloaded)")
+
+
+if __name__ == "__main__":
+    main()
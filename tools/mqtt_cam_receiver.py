@@ -1,7 +1,6 @@
 #!/usr/bin/env python3
 import argparse
 import os
-import struct
 import time
 import hashlib
 from urllib.parse import urlparse
@@ -16,9 +15,19 @@ except ImportError as exc:
         "  python3 -m pip install --user paho-mqtt"
     ) from exc
 
-VID_MAGIC = 0x56494430  # 'VID0'
-HDR_FMT = "<IIIIHHIIHH"
-HDR_SIZE = struct.calcsize(HDR_FMT)
+from frame_index import FrameStore
+from hls_segmenter import HlsSegmenter
+from stage_latency import StageLatency
+from vid_wire import (
+    VID1_FLAG_TIMES,
+    VID1_MAGIC,
+    WireDecoder,
+    decode_vid1,
+    frame_ext,
+    is_self_contained,
+    user_properties,
+)
+from vidrx import CaptureWriter, Reassembler
 
 
 class FrameBuffer:
@@ -26,6 +35,8 @@ class FrameBuffer:
         self.meta = meta
         self.chunks = {}
         self.last_ts = time.time()
+        self.times = None
+        self.rx_us = None
 
     def add_chunk(self, chunk_id, data):
         self.chunks[chunk_id] = data
@@ -42,6 +53,12 @@ def parse_args():
     ap = argparse.ArgumentParser(description="Receive ESP32-P4 video chunks over MQTT.")
     ap.add_argument("--broker", required=True, help="Broker URI, e.g. mqtt://192.168.1.10:1883")
     ap.add_argument("--topic", default="cam/vid", help="MQTT topic to subscribe to")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version; 5 is needed for the compact wire format",
+    )
     ap.add_argument("--outdir", default="out", help="Output directory for frames")
     ap.add_argument("--keep-seconds", type=int, default=10, help="Drop incomplete frames after this time")
     ap.add_argument(
@@ -50,6 +67,39 @@ def parse_args():
         default=0,
         help="Print FPS over the last N frames (0 disables)",
     )
+    ap.add_argument(
+        "--native",
+        action="store_true",
+        help="Reassemble and write frames with the native library (tools/native)",
+    )
+    ap.add_argument("--capture", help="Also record raw traffic to FILE for replay with vidrx_cli")
+    ap.add_argument(
+        "--latency",
+        type=float,
+        default=0,
+        metavar="SECONDS",
+        help="Print per-stage latency histograms every N seconds and at exit; needs "
+        "CONFIG_P4_STAGE_TIMES on the camera and this host synced to the same SNTP server",
+    )
+    ap.add_argument(
+        "--index",
+        action="store_true",
+        help="Append frames to one clip<ID>.h264/.mjpeg per clip with a clip<ID>.idx index "
+        "(see frame_index.py) instead of a file per frame",
+    )
+    ap.add_argument(
+        "--hls",
+        metavar="DIR",
+        help="Also publish H.264 clips as live HLS under DIR/clip<ID>/index.m3u8 (serve DIR over HTTP)",
+    )
+    ap.add_argument("--hls-segment-ms", type=int, default=2000, help="Target HLS segment length")
+    ap.add_argument("--hls-window", type=int, default=6, help="Segments kept in the live playlist")
+    ap.add_argument(
+        "--hls-gop-ms",
+        type=int,
+        default=2000,
+        help="Longest IDR interval expected (CONFIG_P4_H264_GOP frames); sets the fixed HLS target duration",
+    )
     return ap.parse_args()
 
 
@@ -57,61 +107,120 @@ def ensure_outdir(path):
     os.makedirs(path, exist_ok=True)
 
 
-def decode_hdr(payload):
-    if len(payload) < HDR_SIZE:
-        return None, None
-    fields = struct.unpack(HDR_FMT, payload[:HDR_SIZE])
-    hdr = {
-        "magic": fields[0],
-        "clip_id": fields[1],
-        "frame_id": fields[2],
-        "ts_ms": fields[3],
-        "chunk_id": fields[4],
-        "chunk_count": fields[5],
-        "frame_size": fields[6],
-        "fourcc": fields[7],
-        "width": fields[8],
-        "height": fields[9],
-    }
-    return hdr, payload[HDR_SIZE:]
-
-
 def main():
     args = parse_args()
     ensure_outdir(args.outdir)
 
     frames = {}
+    decoder = WireDecoder()
     fps_window = args.fps
     fps_ts = []
     fps_start_ms = None
     fps_frames = 0
 
-    def on_message(client, userdata, msg):
+    def report_fps(ts_ms):
         nonlocal fps_start_ms, fps_frames
-        hdr, body = decode_hdr(msg.payload)
-        if not hdr or hdr["magic"] != VID_MAGIC:
+        if fps_window <= 1:
             return
+        if fps_start_ms is None:
+            fps_start_ms = ts_ms
+        fps_frames += 1
+        fps_ts.append(ts_ms)
+        if len(fps_ts) >= fps_window:
+            delta_ms = fps_ts[-1] - fps_ts[-fps_window]
+            if delta_ms > 0:
+                fps = (fps_window - 1) / (delta_ms / 1000.0)
+                total_ms = fps_ts[-1] - fps_start_ms
+                total_fps = (fps_frames - 1) / (total_ms / 1000.0) if total_ms > 0 else 0.0
+                print(f"fps_window={fps:.2f} fps_total={total_fps:.2f}")
+
+    latency = StageLatency() if args.latency > 0 else None
+    latency_next = time.monotonic() + args.latency
+
+    def unix_us():
+        return time.time_ns() // 1000
+
+    hls = None
+    if args.hls:
+        hls = HlsSegmenter(args.hls, args.hls_segment_ms, args.hls_window, args.keep_seconds, args.hls_gop_ms)
+
+    store = FrameStore(args.outdir) if args.index else None
+
+    capture = CaptureWriter(args.capture) if args.capture else None
+    rx = None
+    if args.native:
+        # Frames go to disk from the library's writer thread; only log here.
+        def on_native_frame(info, data):
+            print(
+                f"saved clip{info['clip_id']}_frame{info['frame_id']} size={info['size']} "
+                f"{info['width']}x{info['height']} ts={info['ts_ms']}ms"
+            )
+            report_fps(info["ts_ms"])
+            if store:
+                store.add(rx.topic(info["stream"]) or "", info, data)
+            if hls:
+                hls.add(info, data)
 
+        # With --index the callback stores frames; the library writes none.
+        rx = Reassembler(
+            outdir=None if store else args.outdir, timeout_ms=args.keep_seconds * 1000, on_frame=on_native_frame
+        )
+
+    def on_native_message(msg):
+        payload = msg.payload
+        now_ms = int(time.monotonic() * 1000)
+        if is_self_contained(payload):
+            if latency and payload[0] == VID1_MAGIC and payload[1] & VID1_FLAG_TIMES:
+                # Frames are written by the library; stop the clock at arrival.
+                hdr, _ = decode_vid1(payload)
+                if hdr:
+                    latency.add(hdr["times"], unix_us())
+            rx.feed(msg.topic, payload, now_ms)
+            return
+        for hdr, body in decoder.decode_chunks(msg.topic, payload, user_properties(msg)):
+            if rx.feed_hdr(msg.topic, hdr, body, now_ms) == 1:
+                decoder.forget(msg.topic, hdr["frame_id"])
+
+    def on_message(client, userdata, msg):
+        if capture:
+            capture.write(int(time.monotonic() * 1e6), msg.topic, msg.payload)
+        if rx:
+            on_native_message(msg)
+            return
+        for hdr, body in decoder.decode_chunks(msg.topic, msg.payload, user_properties(msg)):
+            on_chunk(msg.topic, hdr, body)
+
+    def on_chunk(topic, hdr, body):
         key = (hdr["clip_id"], hdr["frame_id"])
         fb = frames.get(key)
         if fb is None:
             frames[key] = fb = FrameBuffer(hdr)
 
         fb.add_chunk(hdr["chunk_id"], body)
+        if "times" in hdr:
+            fb.times = hdr["times"]
+            fb.rx_us = unix_us()
 
         if fb.is_complete():
             frame = fb.assemble()
             del frames[key]
+            decoder.forget(topic, hdr["frame_id"])
 
             if len(frame) != hdr["frame_size"]:
                 print(f"frame size mismatch clip={hdr['clip_id']} frame={hdr['frame_id']}")
                 return
 
-            ext = ".jpg" if hdr["fourcc"] == 0x47504A4D else ".bin"
-            fname = f"clip{hdr['clip_id']}_frame{hdr['frame_id']}{ext}"
-            out_path = os.path.join(args.outdir, fname)
-            with open(out_path, "wb") as f:
-                f.write(frame)
+            if store:
+                store.add(topic, hdr, frame)
+                out_path = f"clip{hdr['clip_id']} frame {hdr['frame_id']}"
+            else:
+                ext = frame_ext(hdr["fourcc"])
+                fname = f"clip{hdr['clip_id']}_frame{hdr['frame_id']}{ext}"
+                out_path = os.path.join(args.outdir, fname)
+                with open(out_path, "wb") as f:
+                    f.write(frame)
+            if latency and fb.times:
+                latency.add(fb.times, fb.rx_us, unix_us())
 
             md5 = hashlib.md5(frame).hexdigest()
             avg = sum(frame) / len(frame)
@@ -119,18 +228,9 @@ def main():
                 f"saved {out_path} size={len(frame)} md5={md5} avg_byte={avg:.1f} "
                 f"{hdr['width']}x{hdr['height']} ts={hdr['ts_ms']}ms"
             )
-            if fps_window > 1:
-                if fps_start_ms is None:
-                    fps_start_ms = hdr["ts_ms"]
-                fps_frames += 1
-                fps_ts.append(hdr["ts_ms"])
-                if len(fps_ts) >= fps_window:
-                    delta_ms = fps_ts[-1] - fps_ts[-fps_window]
-                    if delta_ms > 0:
-                        fps = (fps_window - 1) / (delta_ms / 1000.0)
-                        total_ms = fps_ts[-1] - fps_start_ms
-                        total_fps = (fps_frames - 1) / (total_ms / 1000.0) if total_ms > 0 else 0.0
-                        print(f"fps_window={fps:.2f} fps_total={total_fps:.2f}")
+            report_fps(hdr["ts_ms"])
+            if hls:
+                hls.add(hdr, frame)
 
     def on_connect(client, userdata, flags, reason_code, properties=None):
         if reason_code == 0:
@@ -140,12 +240,18 @@ def main():
             print(f"connect failed: {reason_code}")
 
     def cleanup_stale():
+        if hls:
+            hls.expire()
+        if rx:
+            rx.expire(int(time.monotonic() * 1000))
+            return
         now = time.time()
         stale = [k for k, fb in frames.items() if now - fb.last_ts > args.keep_seconds]
         for k in stale:
             del frames[k]
 
-    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2)
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
     client.on_connect = on_connect
     client.on_message = on_message
 
@@ -161,8 +267,24 @@ def main():
         while True:
             client.loop(timeout=0.2)
             cleanup_stale()
+            if latency and time.monotonic() >= latency_next:
+                latency_next += args.latency
+                print(latency.report())
     except KeyboardInterrupt:
         pass
+    finally:
+        if capture:
+            capture.close()
+        if latency:
+            print(latency.report())
+        if rx:
+            rx.flush()
+            print(f"native stats: {rx.stats()}")
+            rx.close()
+        if store:
+            store.close()
+        if hls:
+            hls.close()
 
 
 if __name__ == "__main__":
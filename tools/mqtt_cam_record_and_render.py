@@ -3,9 +3,6 @@ import argparse
 import hashlib
 import json
 import os
-import struct
-import subprocess
-import sys
 import time
 from urllib.parse import urlparse
 
@@ -19,9 +16,8 @@ except ImportError as exc:
         "  python3 -m pip install --user paho-mqtt"
     ) from exc
 
-VID_MAGIC = 0x56494430  # 'VID0'
-HDR_FMT = "<IIIIHHIIHH"
-HDR_SIZE = struct.calcsize(HDR_FMT)
+from mp4_mux import FragmentedMp4Writer, Mp4Writer
+from vid_wire import WireDecoder, frame_ext, user_properties
 
 
 class FrameBuffer:
@@ -42,12 +38,32 @@ class FrameBuffer:
 
 
 def parse_args():
-    ap = argparse.ArgumentParser(description="Receive frames and auto-render MP4 on control end.")
+    ap = argparse.ArgumentParser(
+        description="Receive frames straight into clip<ID>.mp4 and finish the file on control end."
+    )
     ap.add_argument("--broker", required=True, help="Broker URI, e.g. mqtt://192.168.1.10:1883")
     ap.add_argument("--topic", default="cam/vid", help="MQTT topic for video chunks")
     ap.add_argument("--ctrl-topic", default="cam/ctl", help="MQTT control topic")
-    ap.add_argument("--outdir", default="out", help="Output directory for frames")
-    ap.add_argument("--fps", type=int, default=30, help="FPS for ffmpeg output")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version; 5 is needed for the compact wire format",
+    )
+    ap.add_argument("--outdir", default="out", help="Output directory for clips")
+    ap.add_argument(
+        "--fragment-ms",
+        type=int,
+        default=1000,
+        help="Write fragmented MP4, one fragment per N ms starting at a keyframe; the file plays "
+        "while recording and survives a crash. 0 writes a plain MP4, indexed when the clip ends",
+    )
+    ap.add_argument(
+        "--save-frames",
+        action="store_true",
+        help="Also save every frame as clip<ID>_frame<N>.jpg/.h264 plus clip<ID>_times.txt, "
+        "for frames_to_video.py",
+    )
     ap.add_argument("--idle-seconds", type=float, default=2.0, help="Render if idle after end")
     ap.add_argument("--keep-seconds", type=int, default=10, help="Drop incomplete frames after this time")
     ap.add_argument("--clean-on-start", action="store_true", help="Delete existing frames for a clip on start")
@@ -58,41 +74,14 @@ def ensure_outdir(path):
     os.makedirs(path, exist_ok=True)
 
 
-def decode_hdr(payload):
-    if len(payload) < HDR_SIZE:
-        return None, None
-    fields = struct.unpack(HDR_FMT, payload[:HDR_SIZE])
-    hdr = {
-        "magic": fields[0],
-        "clip_id": fields[1],
-        "frame_id": fields[2],
-        "ts_ms": fields[3],
-        "chunk_id": fields[4],
-        "chunk_count": fields[5],
-        "frame_size": fields[6],
-        "fourcc": fields[7],
-        "width": fields[8],
-        "height": fields[9],
-    }
-    return hdr, payload[HDR_SIZE:]
-
-
-def run_ffmpeg(outdir, clip_id, fps):
-    out_path = os.path.join(outdir, f"clip{clip_id}.mp4")
-    cmd = [
-        sys.executable,
-        os.path.join(os.path.dirname(__file__), "frames_to_video.py"),
-        "--outdir",
-        outdir,
-        "--clip-id",
-        str(clip_id),
-        "--fps",
-        str(fps),
-        "--out",
-        out_path,
-    ]
-    print("running:", " ".join(cmd))
-    return subprocess.run(cmd, check=False).returncode
+def save_frame(outdir, hdr, frame):
+    fname = f"clip{hdr['clip_id']}_frame{hdr['frame_id']}{frame_ext(hdr['fourcc'])}"
+    out_path = os.path.join(outdir, fname)
+    with open(out_path, "wb") as f:
+        f.write(frame)
+    with open(os.path.join(outdir, f"clip{hdr['clip_id']}_times.txt"), "a") as f:
+        f.write(f"{hdr['frame_id']} {hdr['ts_ms']}\n")
+    return out_path
 
 
 def main():
@@ -100,14 +89,16 @@ def main():
     ensure_outdir(args.outdir)
 
     frames = {}
+    decoder = WireDecoder()
     clip_state = {}
     rendered = set()
+    writers = {}  # clip_id -> Mp4Writer, open until the clip is rendered
 
     def on_video(msg):
-        hdr, body = decode_hdr(msg.payload)
-        if not hdr or hdr["magic"] != VID_MAGIC:
-            return
+        for hdr, body in decoder.decode_chunks(msg.topic, msg.payload, user_properties(msg)):
+            on_chunk(msg.topic, hdr, body)
 
+    def on_chunk(topic, hdr, body):
         key = (hdr["clip_id"], hdr["frame_id"])
         fb = frames.get(key)
         if fb is None:
@@ -118,21 +109,35 @@ def main():
         if fb.is_complete():
             frame = fb.assemble()
             del frames[key]
+            decoder.forget(topic, hdr["frame_id"])
 
             if len(frame) != hdr["frame_size"]:
                 print(f"frame size mismatch clip={hdr['clip_id']} frame={hdr['frame_id']}")
                 return
 
-            ext = ".jpg" if hdr["fourcc"] == 0x47504A4D else ".bin"
-            fname = f"clip{hdr['clip_id']}_frame{hdr['frame_id']}{ext}"
-            out_path = os.path.join(args.outdir, fname)
-            with open(out_path, "wb") as f:
-                f.write(frame)
-
+            clip_id = hdr["clip_id"]
+            if clip_id in rendered:
+                return
+            mux = writers.get(clip_id)
+            if mux is None:
+                path = os.path.join(args.outdir, f"clip{clip_id}.mp4")
+                try:
+                    if args.fragment_ms > 0:
+                        mux = FragmentedMp4Writer(path, hdr["fourcc"], hdr["width"], hdr["height"],
+                                                  args.fragment_ms)
+                    else:
+                        mux = Mp4Writer(path, hdr["fourcc"], hdr["width"], hdr["height"])
+                    writers[clip_id] = mux
+                except ValueError as exc:
+                    print(f"clip {clip_id}: {exc}")
+                    rendered.add(clip_id)
+                    return
+            added = mux.add(frame, hdr["ts_ms"], frame_id=hdr["frame_id"])
+
+            saved = save_frame(args.outdir, hdr, frame) if args.save_frames else f"clip{clip_id}"
             md5 = hashlib.md5(frame).hexdigest()
-            avg = sum(frame) / len(frame)
             print(
-                f"saved {out_path} size={len(frame)} md5={md5} avg_byte={avg:.1f} "
+                f"{'added' if added else 'skipped'} {saved} frame={hdr['frame_id']} size={len(frame)} md5={md5} "
                 f"{hdr['width']}x{hdr['height']} ts={hdr['ts_ms']}ms"
             )
 
@@ -160,12 +165,22 @@ def main():
             if time.time() - st.get("last_frame", 0) < args.idle_seconds:
                 return
 
-        rc = run_ffmpeg(args.outdir, clip_id, args.fps)
-        if rc == 0:
-            rendered.add(clip_id)
-            print(f"rendered clip{clip_id}.mp4")
-        else:
-            print(f"ffmpeg failed for clip {clip_id}")
+        rendered.add(clip_id)
+        finish(clip_id)
+
+    def finish(clip_id):
+        mux = writers.pop(clip_id, None)
+        if mux is None:
+            print(f"clip {clip_id}: no frames")
+            return
+        start = time.monotonic()
+        count = mux.close()
+        if not count:
+            print(f"clip {clip_id}: no decodable frames")
+            return
+        skipped = f", {mux.skipped} skipped" if mux.skipped else ""
+        print(f"rendered {mux.path}: {count} frames{skipped}, closed in "
+              f"{(time.monotonic() - start) * 1000:.1f} ms")
 
     def on_ctrl(msg):
         try:
@@ -182,7 +197,9 @@ def main():
         if event == "start":
             if args.clean_on_start:
                 for name in os.listdir(args.outdir):
-                    if name.startswith(f"clip{clip_id}_frame") and name.endswith(".jpg"):
+                    if name == f"clip{clip_id}_times.txt" or (
+                        name.startswith(f"clip{clip_id}_frame") and name.endswith((".jpg", ".h264"))
+                    ):
                         try:
                             os.remove(os.path.join(args.outdir, name))
                         except OSError:
@@ -218,7 +235,8 @@ def main():
         for clip_id in list(clip_state.keys()):
             try_render(clip_id)
 
-    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2)
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
 
     def on_connect(client, userdata, flags, reason_code, properties=None):
         if reason_code == 0:
@@ -250,7 +268,9 @@ def main():
             client.loop(timeout=0.2)
             cleanup_stale()
     except KeyboardInterrupt:
-        pass
+        # Whatever arrived is still a playable clip.
+        for clip_id in list(writers):
+            finish(clip_id)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Follow a CONFIG_P4_SOAK run and report its phases.
+
+The camera prints one JSON line per phase, prefixed "SOAK ", and publishes
+the same JSON to CONFIG_P4_SOAK_TOPIC; the last message is a summary. Read
+either (--uart - reads stdin, e.g. piped from the host build), print a line
+per phase, optionally keep them all with --jsonl, and exit with status 1
+when the run failed or ended without a summary.
+"""
+import argparse
+import json
+import sys
+from urllib.parse import urlparse
+
+UART_PREFIX = "SOAK "
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="Follow an ESP32-P4 camera soak run.")
+    ap.add_argument("--broker", help="Broker URI, e.g. mqtt://192.168.1.10:1883")
+    ap.add_argument("--topic", default="cam/soak", help="Soak report topic")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version",
+    )
+    ap.add_argument("--uart", metavar="LOGFILE", help="Read the phases from a console log ('-' for stdin)")
+    ap.add_argument("--jsonl", metavar="FILE", help="Append every phase as a JSON line to FILE")
+    args = ap.parse_args()
+    if bool(args.broker) == bool(args.uart):
+        ap.error("exactly one of --broker or --uart is required")
+    return args
+
+
+def fmt_kb(n):
+    return f"{n / 1024:.1f}K"
+
+
+class Follower:
+    def __init__(self, jsonl):
+        self.jsonl = open(jsonl, "a", encoding="utf-8") if jsonl else None
+        self.first = None
+        self.summary = None
+
+    def feed(self, msg):
+        """Handle one report; True once the summary arrived."""
+        if self.jsonl:
+            self.jsonl.write(json.dumps(msg) + "\n")
+            self.jsonl.flush()
+        if msg.get("summary"):
+            self.summary = msg
+            return True
+
+        heap = msg.get("heap", {})
+        if self.first is None:
+            self.first = heap
+        grown = heap.get("internal_used", 0) - self.first.get("internal_used", 0)
+        line = (
+            f"phase {msg.get('phase'):>4} cycle {msg.get('cycle'):>3} {msg.get('elapsed_s'):>7}s "
+            f"{msg.get('w')}x{msg.get('h')} q{msg.get('q'):<3} {msg.get('transport'):<9} "
+            f"{msg.get('fps', 0):6.1f} fps  drop {msg.get('dropped', 0):>5}  "
+            f"heap {fmt_kb(heap.get('internal_used', 0))} ({grown:+d})  "
+            f"largest {fmt_kb(heap.get('internal_largest', 0))}  "
+            f"psram {fmt_kb(heap.get('psram_used', 0))}"
+        )
+        if msg.get("status") == "fail":
+            line += f"  FAIL: {msg.get('fail')}"
+        print(line, flush=True)
+        return False
+
+
+def from_uart(args, follower):
+    f = sys.stdin if args.uart == "-" else open(args.uart, "r", encoding="utf-8", errors="replace")
+    with f:
+        for line in f:
+            idx = line.find(UART_PREFIX + "{")
+            if idx < 0:
+                continue
+            try:
+                msg = json.loads(line[idx + len(UART_PREFIX):])
+            except ValueError:
+                continue
+            if follower.feed(msg):
+                return
+
+
+def from_mqtt(args, follower):
+    try:
+        import paho.mqtt.client as mqtt
+    except ImportError as exc:
+        raise SystemExit(
+            "Missing dependency: paho-mqtt. Install with:\n"
+            "  python3 -m pip install -r requirements.txt\n"
+            "If you are not in a virtualenv, you can also use:\n"
+            "  python3 -m pip install --user paho-mqtt"
+        ) from exc
+
+    def on_message(client, userdata, msg):
+        try:
+            report = json.loads(msg.payload)
+        except ValueError:
+            print(f"ignoring {len(msg.payload)} byte message that is not JSON")
+            return
+        if follower.feed(report):
+            client.disconnect()
+
+    def on_connect(client, userdata, flags, reason_code, properties=None):
+        if reason_code == 0:
+            client.subscribe(args.topic, qos=0)
+            print(f"subscribed to {args.topic}, waiting for phases")
+        else:
+            print(f"connect failed: {reason_code}")
+
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
+    client.on_connect = on_connect
+    client.on_message = on_message
+
+    url = urlparse(args.broker)
+    host = url.hostname or args.broker
+    port = url.port or 1883
+    try:
+        client.connect(host, port, 60)
+    except Exception as exc:
+        raise SystemExit(f"MQTT connect failed to {host}:{port} ({exc})") from exc
+
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    args = parse_args()
+    follower = Follower(args.jsonl)
+    if args.uart:
+        from_uart(args, follower)
+    else:
+        from_mqtt(args, follower)
+
+    s = follower.summary
+    if s is None:
+        print("no summary: the run did not finish")
+        return 1
+    print(f"{s.get('phases')} phases in {s.get('elapsed_s')}s: {s.get('status')}"
+          + (f" ({s.get('fail')})" if s.get("fail") else ""))
+    return 0 if s.get("status") == "ok" else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Follow the camera stats topic (CONFIG_P4_STATS_TOPIC) and print per-camera rates.
+
+Counters in the message are totals since boot, so rates come from the
+difference between consecutive messages of the same topic. --jsonl keeps
+every message with the receive time for later plotting.
+"""
+import argparse
+import json
+import time
+from urllib.parse import urlparse
+
+try:
+    import paho.mqtt.client as mqtt
+except ImportError as exc:
+    raise SystemExit(
+        "Missing dependency: paho-mqtt. Install with:\n"
+        "  python3 -m pip install -r requirements.txt\n"
+        "If you are not in a virtualenv, you can also use:\n"
+        "  python3 -m pip install --user paho-mqtt"
+    ) from exc
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="Print ESP32-P4 camera stats messages.")
+    ap.add_argument("--broker", required=True, help="Broker URI, e.g. mqtt://192.168.1.10:1883")
+    ap.add_argument("--topic", default="cam/stats", help="Stats topic; wildcards follow several cameras")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version",
+    )
+    ap.add_argument("--jsonl", help="Append every message to FILE as JSON lines")
+    return ap.parse_args()
+
+
+def rate_line(topic, cur, prev):
+    period_s = (cur["up_ms"] - prev["up_ms"]) / 1000.0 if prev else 0
+    if prev is None or period_s <= 0:
+        return f"{topic}: first message, up {cur['up_ms'] / 1000:.0f}s"
+
+    def d(*path):
+        a, b = cur, prev
+        for key in path:
+            a, b = a[key], b[key]
+        return a - b
+
+    drops = {k: d("dropped", k) for k in cur["dropped"]}
+    drop_text = " ".join(f"{k}={v}" for k, v in drops.items() if v) or "none"
+    enc = cur["encode_us"]
+    pub = cur["publish_us"]
+    line = (
+        f"{topic}: cap {d('frames', 'captured') / period_s:.1f} fps "
+        f"decimated {(cur['frames'].get('decimated', 0) - prev['frames'].get('decimated', 0)) / period_s:.1f} fps "
+        f"sent {d('frames', 'sent') / period_s:.1f} fps "
+        f"{d('bytes') * 8 / period_s / 1e6:.2f} Mbit/s "
+        f"enc p50/p99 {enc['p50'] / 1000:.1f}/{enc['p99'] / 1000:.1f} ms "
+        f"pub p50/p99 {pub['p50'] / 1000:.1f}/{pub['p99'] / 1000:.1f} ms "
+        f"drops {drop_text}"
+    )
+    heap = cur.get("heap")
+    if heap:
+        line += f" heap_min {heap['internal_min'] // 1024}K psram_min {heap['psram_min'] // 1024}K"
+    tasks = cur.get("tasks")
+    if tasks:
+        line += " cpu " + ",".join(f"{name}:{pct}%" for name, pct in tasks[:3])
+    return line
+
+
+def main():
+    args = parse_args()
+    last = {}
+    jsonl = open(args.jsonl, "a", encoding="utf-8") if args.jsonl else None
+
+    def on_message(client, userdata, msg):
+        try:
+            stats = json.loads(msg.payload)
+        except ValueError:
+            print(f"{msg.topic}: not JSON ({len(msg.payload)} bytes)")
+            return
+        prev = last.get(msg.topic)
+        if prev and stats["up_ms"] < prev["up_ms"]:
+            print(f"{msg.topic}: rebooted")
+            prev = None
+        print(rate_line(msg.topic, stats, prev))
+        last[msg.topic] = stats
+        if jsonl:
+            jsonl.write(json.dumps({"t": time.time(), "topic": msg.topic, "stats": stats}) + "\n")
+            jsonl.flush()
+
+    def on_connect(client, userdata, flags, reason_code, properties=None):
+        if reason_code == 0:
+            client.subscribe(args.topic, qos=0)
+            print(f"subscribed to {args.topic}")
+        else:
+            print(f"connect failed: {reason_code}")
+
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
+    client.on_connect = on_connect
+    client.on_message = on_message
+
+    url = urlparse(args.broker)
+    host = url.hostname or args.broker
+    port = url.port or 1883
+    try:
+        client.connect(host, port, 60)
+    except Exception as exc:
+        raise SystemExit(f"MQTT connect failed to {host}:{port} ({exc})") from exc
+
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if jsonl:
+            jsonl.close()
+
+
+if __name__ == "__main__":
+    main()
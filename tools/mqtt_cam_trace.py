@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Collect a CONFIG_P4_TRACE dump as Chrome trace-event JSON.
+
+With the MQTT sink the camera publishes the dump to CONFIG_P4_TRACE_TOPIC
+as fragments ('C','T', flags, u16 sequence) that are joined here until the
+last-fragment flag. With the console sink pass the captured UART log via
+--uart instead. Open the result in https://ui.perfetto.dev or chrome://tracing.
+"""
+import argparse
+import json
+import re
+import struct
+import sys
+from urllib.parse import urlparse
+
+TRACE_MAGIC = b"CT"
+TRACE_FLAG_LAST = 0x01
+UART_BEGIN = "=== CAM TRACE BEGIN ==="
+UART_END = "=== CAM TRACE END ==="
+# Other tasks keep logging while the dump is printed; their lines are dropped.
+ESP_LOG_LINE = re.compile(r"^(\x1b\[[0-9;]*m)?[EWIDV] \(\d+\) ")
+
+
+def parse_args():
+    ap = argparse.ArgumentParser(description="Save an ESP32-P4 camera trace dump as trace-event JSON.")
+    ap.add_argument("--broker", help="Broker URI, e.g. mqtt://192.168.1.10:1883")
+    ap.add_argument("--topic", default="cam/trace", help="Trace topic")
+    ap.add_argument(
+        "--protocol",
+        choices=("5", "311"),
+        default="5",
+        help="MQTT protocol version",
+    )
+    ap.add_argument("--uart", metavar="LOGFILE", help="Extract the dump from a console log instead of MQTT")
+    ap.add_argument("--out", default="trace.json", help="Output file; several dumps get .1, .2, ... suffixes")
+    ap.add_argument("--count", type=int, default=1, help="Exit after this many dumps (0 = keep going)")
+    args = ap.parse_args()
+    if not args.broker and not args.uart:
+        ap.error("one of --broker or --uart is required")
+    return args
+
+
+def out_name(base, index):
+    if index == 0:
+        return base
+    stem, dot, ext = base.rpartition(".")
+    return f"{stem}.{index}.{ext}" if dot else f"{base}.{index}"
+
+
+def save(path, text):
+    try:
+        trace = json.loads(text)
+    except ValueError as exc:
+        print(f"dump is not valid JSON ({exc}); writing it anyway")
+        trace = None
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(text)
+    events = sum(1 for e in trace["traceEvents"] if e.get("ph") == "X") if trace else 0
+    print(f"wrote {path} ({events} events)")
+
+
+def from_uart(args):
+    dumps = []
+    lines = None
+    with open(args.uart, "r", encoding="utf-8", errors="replace") as f:
+        for line in f:
+            stripped = line.strip()
+            if stripped.endswith(UART_BEGIN):
+                lines = []
+            elif stripped.endswith(UART_END) and lines is not None:
+                dumps.append("".join(lines))
+                lines = None
+            elif lines is not None and not ESP_LOG_LINE.match(line):
+                lines.append(line)
+    if not dumps:
+        raise SystemExit(f"no '{UART_BEGIN}' block in {args.uart}")
+    if args.count:
+        dumps = dumps[-args.count:]
+    for i, text in enumerate(dumps):
+        save(out_name(args.out, i), text)
+
+
+def from_mqtt(args):
+    try:
+        import paho.mqtt.client as mqtt
+    except ImportError as exc:
+        raise SystemExit(
+            "Missing dependency: paho-mqtt. Install with:\n"
+            "  python3 -m pip install -r requirements.txt\n"
+            "If you are not in a virtualenv, you can also use:\n"
+            "  python3 -m pip install --user paho-mqtt"
+        ) from exc
+
+    state = {"parts": [], "next_seq": 0, "dumps": 0}
+
+    def on_message(client, userdata, msg):
+        payload = msg.payload
+        if len(payload) < 5 or payload[:2] != TRACE_MAGIC:
+            print(f"ignoring {len(payload)} byte message without trace header")
+            return
+        flags = payload[2]
+        (seq,) = struct.unpack_from("<H", payload, 3)
+        if seq == 0:
+            state["parts"] = []
+        elif seq != state["next_seq"]:
+            print(f"fragment {seq} out of order (expected {state['next_seq']}); dropping dump")
+            state["parts"] = None
+        state["next_seq"] = (seq + 1) & 0xFFFF
+        if state["parts"] is not None:
+            state["parts"].append(payload[5:])
+        if not flags & TRACE_FLAG_LAST:
+            return
+        if state["parts"] is not None:
+            save(out_name(args.out, state["dumps"]), b"".join(state["parts"]).decode("utf-8", "replace"))
+            state["dumps"] += 1
+        state["parts"] = None
+        state["next_seq"] = 0
+        if args.count and state["dumps"] >= args.count:
+            client.disconnect()
+
+    def on_connect(client, userdata, flags, reason_code, properties=None):
+        if reason_code == 0:
+            # QoS 1 so a dump is not lost to a slow subscriber.
+            client.subscribe(args.topic, qos=1)
+            print(f"subscribed to {args.topic}, waiting for a dump")
+        else:
+            print(f"connect failed: {reason_code}")
+
+    protocol = mqtt.MQTTv5 if args.protocol == "5" else mqtt.MQTTv311
+    client = mqtt.Client(callback_api_version=mqtt.CallbackAPIVersion.VERSION2, protocol=protocol)
+    client.on_connect = on_connect
+    client.on_message = on_message
+
+    url = urlparse(args.broker)
+    host = url.hostname or args.broker
+    port = url.port or 1883
+    try:
+        client.connect(host, port, 60)
+    except Exception as exc:
+        raise SystemExit(f"MQTT connect failed to {host}:{port} ({exc})") from exc
+
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+def main():
+    args = parse_args()
+    if args.uart:
+        from_uart(args)
+    else:
+        from_mqtt(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
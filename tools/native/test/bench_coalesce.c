@@ -0,0 +1,166 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host benchmark of coalesce_transport.c over a loopback socket: frames
+ * are split into chunk PUBLISH packets and written the way ESP-MQTT does
+ * (one transport write per out-buffer piece), once straight through and
+ * once coalesced. A reader thread drains and counts the bytes.
+ *
+ *   bench_coalesce [frames] [frame bytes] [chunk bytes] [batch bytes] [mqtt buffer]
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coalesce_transport.h"
+
+#define TOPIC "cam/vid"
+
+extern unsigned long host_transport_socket_writes;
+
+typedef struct {
+    int listen_fd;
+    unsigned long long bytes;
+} reader_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void *reader_thread(void *arg)
+{
+    reader_t *r = (reader_t *)arg;
+    int fd = accept(r->listen_fd, NULL, NULL);
+    if (fd < 0) return NULL;
+    static char buf[1 << 16];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        r->bytes += (unsigned long long)n;
+    }
+    close(fd);
+    return NULL;
+}
+
+// QoS 0 PUBLISH: fixed header, topic, payload.
+static size_t make_publish(uint8_t *out, size_t payload_len)
+{
+    size_t topic_len = strlen(TOPIC);
+    size_t remaining = 2 + topic_len + payload_len;
+    uint8_t *p = out;
+    *p++ = 0x30;
+    do {
+        uint8_t b = remaining & 0x7F;
+        remaining >>= 7;
+        *p++ = b | (remaining ? 0x80 : 0);
+    } while (remaining);
+    *p++ = (uint8_t)(topic_len >> 8);
+    *p++ = (uint8_t)topic_len;
+    memcpy(p, TOPIC, topic_len);
+    p += topic_len;
+    memset(p, 0xA5, payload_len);
+    return (size_t)(p - out) + payload_len;
+}
+
+static int run(const char *name, size_t batch, int frames, size_t frame_bytes, size_t chunk, size_t mqtt_buf)
+{
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t alen = sizeof(addr);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 1) != 0 ||
+        getsockname(lfd, (struct sockaddr *)&addr, &alen) != 0) {
+        perror("listen");
+        return 1;
+    }
+    reader_t r = { .listen_fd = lfd };
+    pthread_t th;
+    pthread_create(&th, NULL, reader_thread, &r);
+
+    esp_transport_handle_t t = coalesce_transport_create(batch);
+    if (!t || esp_transport_connect(t, "127.0.0.1", ntohs(addr.sin_port), 1000) < 0) {
+        fprintf(stderr, "connect failed\n");
+        return 1;
+    }
+    if (!coalesce_transport_writable(t)) {
+        fprintf(stderr, "FAIL %s: idle socket not writable\n", name);
+        return 1;
+    }
+
+    uint8_t *pkt = (uint8_t *)malloc(chunk + 16);
+    uint8_t *last = (uint8_t *)malloc(chunk + 16);
+    size_t full_len = make_publish(pkt, chunk);
+    size_t last_len = make_publish(last, frame_bytes % chunk ? frame_bytes % chunk : chunk);
+    unsigned long long sent = 0;
+    unsigned long publishes = 0;
+    unsigned long writes0 = host_transport_socket_writes;
+
+    uint64_t t0 = now_ns();
+    for (int f = 0; f < frames; f++) {
+        coalesce_transport_begin(t);
+        for (size_t off = 0; off < frame_bytes; off += chunk) {
+            const uint8_t *p = off + chunk < frame_bytes ? pkt : last;
+            size_t pkt_len = p == pkt ? full_len : last_len;
+            for (size_t w = 0; w < pkt_len; w += mqtt_buf) {
+                int piece = (int)(pkt_len - w < mqtt_buf ? pkt_len - w : mqtt_buf);
+                if (esp_transport_write(t, (const char *)p + w, piece, 1000) != piece) {
+                    fprintf(stderr, "write failed\n");
+                    return 1;
+                }
+            }
+            sent += pkt_len;
+            publishes++;
+        }
+        if (coalesce_transport_end(t) != ESP_OK) {
+            fprintf(stderr, "flush failed\n");
+            return 1;
+        }
+    }
+    uint64_t ns = now_ns() - t0;
+    unsigned long writes = host_transport_socket_writes - writes0;
+
+    esp_transport_close(t);
+    pthread_join(th, NULL);
+    esp_transport_destroy(t);
+    close(lfd);
+    free(pkt);
+    free(last);
+
+    if (r.bytes != sent) {
+        fprintf(stderr, "FAIL %s: sent %llu bytes, reader got %llu\n", name, sent, r.bytes);
+        return 1;
+    }
+    double s = (double)ns / 1e9;
+    printf("%-9s %8.1f MB/s  %9.0f publishes/s  %6.1f socket writes per frame\n",
+           name, (double)sent / s / 1e6, (double)publishes / s, (double)writes / frames);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t frame_bytes = argc > 2 ? strtoul(argv[2], NULL, 10) : 60000;
+    size_t chunk = argc > 3 ? strtoul(argv[3], NULL, 10) : 4096;
+    size_t batch = argc > 4 ? strtoul(argv[4], NULL, 10) : 17280;
+    size_t mqtt_buf = argc > 5 ? strtoul(argv[5], NULL, 10) : 1024;
+    if (frames <= 0 || frame_bytes == 0 || chunk == 0 || batch == 0 || mqtt_buf == 0) {
+        fprintf(stderr, "usage: %s [frames] [frame bytes] [chunk bytes] [batch bytes] [mqtt buffer]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%d frames of %zu bytes, %zu-byte chunks, %zu-byte MQTT buffer, %zu-byte batches\n",
+           frames, frame_bytes, chunk, mqtt_buf, batch);
+    if (run("direct", 0, frames, frame_bytes, chunk, mqtt_buf) != 0) return 1;
+    if (run("coalesced", batch, frames, frame_bytes, chunk, mqtt_buf) != 0) return 1;
+    return 0;
+}
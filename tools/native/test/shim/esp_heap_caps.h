@@ -0,0 +1,42 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MALLOC_CAP_DMA          (1 << 3)
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+static inline void *heap_caps_aligned_alloc(size_t align, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static inline void *heap_caps_aligned_calloc(size_t align, size_t n, size_t size, uint32_t caps)
+{
+    void *p = heap_caps_aligned_alloc(align, n * size, caps);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+static inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+#endif
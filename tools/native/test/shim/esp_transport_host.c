@@ -0,0 +1,189 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Transport dispatch plus a blocking TCP transport over host sockets, like
+// tcp_transport on the IDF linux target. Counts socket writes for the
+// benchmarks.
+#include "esp_transport.h"
+#include "esp_transport_tcp.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+struct esp_transport_item_t {
+    connect_func _connect;
+    io_read_func _read;
+    io_func _write;
+    trans_func _close;
+    poll_func _poll_read;
+    poll_func _poll_write;
+    trans_func _destroy;
+    void *data;
+    int port;
+    int sock;       // plain TCP only
+};
+
+unsigned long host_transport_socket_writes;
+
+esp_transport_handle_t esp_transport_init(void)
+{
+    esp_transport_handle_t t = (esp_transport_handle_t)calloc(1, sizeof(*t));
+    if (t) t->sock = -1;
+    return t;
+}
+
+esp_err_t esp_transport_destroy(esp_transport_handle_t t)
+{
+    if (!t) return ESP_ERR_INVALID_ARG;
+    if (t->_destroy) t->_destroy(t);
+    free(t);
+    return ESP_OK;
+}
+
+esp_err_t esp_transport_set_func(esp_transport_handle_t t, connect_func _connect, io_read_func _read,
+                                 io_func _write, trans_func _close, poll_func _poll_read,
+                                 poll_func _poll_write, trans_func _destroy)
+{
+    t->_connect = _connect;
+    t->_read = _read;
+    t->_write = _write;
+    t->_close = _close;
+    t->_poll_read = _poll_read;
+    t->_poll_write = _poll_write;
+    t->_destroy = _destroy;
+    return ESP_OK;
+}
+
+esp_err_t esp_transport_set_context_data(esp_transport_handle_t t, void *data)
+{
+    t->data = data;
+    return ESP_OK;
+}
+
+void *esp_transport_get_context_data(esp_transport_handle_t t)
+{
+    return t->data;
+}
+
+esp_err_t esp_transport_set_default_port(esp_transport_handle_t t, int port)
+{
+    t->port = port;
+    return ESP_OK;
+}
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    return t->_connect(t, host, port, timeout_ms);
+}
+
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    return t->_read(t, buffer, len, timeout_ms);
+}
+
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    return t->_write(t, buffer, len, timeout_ms);
+}
+
+int esp_transport_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return t->_poll_read(t, timeout_ms);
+}
+
+int esp_transport_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return t->_poll_write(t, timeout_ms);
+}
+
+int esp_transport_close(esp_transport_handle_t t)
+{
+    return t->_close(t);
+}
+
+int esp_transport_get_socket(esp_transport_handle_t t)
+{
+    return t->sock;
+}
+
+static int tcp_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    (void)timeout_ms;
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *ai = NULL;
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &ai) != 0) return -1;
+    int s = socket(ai->ai_family, ai->ai_socktype, 0);
+    if (s < 0 || connect(s, ai->ai_addr, ai->ai_addrlen) != 0) {
+        if (s >= 0) close(s);
+        freeaddrinfo(ai);
+        return -1;
+    }
+    freeaddrinfo(ai);
+    t->sock = s;
+    return 0;
+}
+
+static int tcp_poll(esp_transport_handle_t t, short events, int timeout_ms)
+{
+    struct pollfd p = { .fd = t->sock, .events = events };
+    int n = poll(&p, 1, timeout_ms);
+    if (n > 0 && (p.revents & (POLLERR | POLLHUP | POLLNVAL))) return -1;
+    return n;
+}
+
+static int tcp_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return tcp_poll(t, POLLIN, timeout_ms);
+}
+
+static int tcp_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return tcp_poll(t, POLLOUT, timeout_ms);
+}
+
+static int tcp_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    if (tcp_poll_read(t, timeout_ms) <= 0) return -1;
+    return (int)recv(t->sock, buffer, (size_t)len, 0);
+}
+
+static int tcp_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    (void)timeout_ms;
+    host_transport_socket_writes++;
+    return (int)send(t->sock, buffer, (size_t)len, MSG_NOSIGNAL);
+}
+
+static int tcp_close(esp_transport_handle_t t)
+{
+    int ret = t->sock >= 0 ? close(t->sock) : 0;
+    t->sock = -1;
+    return ret;
+}
+
+static int tcp_destroy(esp_transport_handle_t t)
+{
+    return tcp_close(t);
+}
+
+esp_transport_handle_t esp_transport_tcp_init(void)
+{
+    esp_transport_handle_t t = esp_transport_init();
+    if (t) {
+        esp_transport_set_func(t, tcp_connect, tcp_read, tcp_write, tcp_close, tcp_poll_read,
+                               tcp_poll_write, tcp_destroy);
+        t->port = 1883;
+    }
+    return t;
+}
@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef ESP_TRANSPORT_TCP_H
+#define ESP_TRANSPORT_TCP_H
+
+#include "esp_transport.h"
+
+esp_transport_handle_t esp_transport_tcp_init(void);
+
+#endif
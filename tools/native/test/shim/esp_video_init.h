@@ -0,0 +1,10 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host stand-in: app_video.c includes it but the tests open a fake device.
+#ifndef ESP_VIDEO_INIT_H
+#define ESP_VIDEO_INIT_H
+
+#endif
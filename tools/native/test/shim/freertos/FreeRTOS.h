@@ -0,0 +1,21 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host stand-in: ticks are milliseconds, semaphores are pthread based.
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFFu)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+
+// One type for mutexes and binary semaphores; a mutex starts given.
+typedef struct {
+    pthread_mutex_t m;
+    pthread_cond_t c;
+    int count;
+} host_sem_t;
+typedef host_sem_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t host_sem_create(int count)
+{
+    host_sem_t *s = (host_sem_t *)calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    pthread_mutex_init(&s->m, NULL);
+    pthread_cond_init(&s->c, NULL);
+    s->count = count;
+    return s;
+}
+
+#define xSemaphoreCreateMutex()     host_sem_create(1)
+#define xSemaphoreCreateBinary()    host_sem_create(0)
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_REALTIME, &end);
+    end.tv_sec += ticks / 1000;
+    end.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (end.tv_nsec >= 1000000000L) {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&s->m);
+    while (s->count == 0) {
+        if (ticks == 0) break;
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&s->c, &s->m);
+        } else if (pthread_cond_timedwait(&s->c, &s->m, &end) == ETIMEDOUT) {
+            break;
+        }
+    }
+    BaseType_t got = s->count > 0;
+    if (got) s->count--;
+    pthread_mutex_unlock(&s->m);
+    return got ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    pthread_mutex_lock(&s->m);
+    BaseType_t ok = s->count == 0;
+    s->count = 1;
+    pthread_cond_signal(&s->c);
+    pthread_mutex_unlock(&s->m);
+    return ok ? pdTRUE : pdFALSE;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t s)
+{
+    pthread_mutex_destroy(&s->m);
+    pthread_cond_destroy(&s->c);
+    free(s);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Host stand-in: a task is a detached pthread; priority and core are ignored.
+#ifndef TASK_H
+#define TASK_H
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct {
+    TaskFunction_t fn;
+    void *arg;
+} host_task_t;
+typedef host_task_t *TaskHandle_t;
+
+static __thread host_task_t *host_task_self;
+
+static inline void *host_task_main(void *p)
+{
+    host_task_self = (host_task_t *)p;
+    host_task_self->fn(host_task_self->arg);
+    return NULL;
+}
+
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                                 int prio, TaskHandle_t *out, int core)
+{
+    (void)name, (void)stack, (void)prio, (void)core;
+    host_task_t *t = (host_task_t *)calloc(1, sizeof(*t));
+    pthread_t th;
+    if (!t) return pdFALSE;
+    t->fn = fn;
+    t->arg = arg;
+    if (out) *out = t;
+    if (pthread_create(&th, NULL, host_task_main, t) != 0) {
+        if (out) *out = NULL;
+        free(t);
+        return pdFALSE;
+    }
+    pthread_detach(th);
+    return pdPASS;
+}
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, int prio,
+                                     TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, out, -1);
+}
+
+// Only deleting the calling task is supported.
+static inline void vTaskDelete(TaskHandle_t t)
+{
+    (void)t;
+    free(host_task_self);
+    pthread_exit(NULL);
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { .tv_sec = ticks / 1000, .tv_nsec = (long)(ticks % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+#endif
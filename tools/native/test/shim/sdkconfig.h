@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+// Configuration of the firmware modules in the host tests: the IDF linux
+// target, with pools small enough that the stress test runs them dry and
+// the default capture request.
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_IDF_TARGET_LINUX                 1
+
+#define CONFIG_P4_POOL_INTERNAL_BLOCK_SIZE      1460
+#define CONFIG_P4_POOL_INTERNAL_BLOCKS          16
+#define CONFIG_P4_POOL_PSRAM_BLOCK_SIZE         65536
+#define CONFIG_P4_POOL_PSRAM_BLOCKS             4
+
+#define CONFIG_P4_CAPTURE_WIDTH                 640
+#define CONFIG_P4_CAPTURE_HEIGHT                480
+#define CONFIG_P4_CAPTURE_FPS                   0
+#define CONFIG_P4_CAPTURE_MAX_MB_S              0
+
+#endif
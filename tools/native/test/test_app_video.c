@@ -0,0 +1,373 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host test of app_video.c against a fake V4L2 device: the output rate set
+ * with app_video_set_frame_rate() survives a mode switch, whether the
+ * sensor takes it as a frame interval or the stream task decimates to it.
+ * A switch that cannot get buffers back returns the error and leaves the
+ * stream stopped, and the next switch starts it again. A switch that times
+ * out is withdrawn, not applied later.
+ *
+ * app_video.c is included so the test can see its state; open(), ioctl(),
+ * mmap() and close() are redirected to the fake device below.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "linux/videodev2.h"
+#include "cam_stats.h"
+#include "pixfmt.h"
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define FAKE_FD         42
+#define FAKE_MAX_BUFS   8
+#define FAKE_PAGE       4096
+#define FAKE_FRAME_US   5000    // the sensor runs at 200 fps
+
+static struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixfmt;
+    bool timeperframe;          // S_PARM takes a frame interval
+    struct v4l2_fract interval;
+    bool streaming;
+    uint32_t nbufs;
+    uint8_t *buf[FAKE_MAX_BUFS];
+    size_t buf_len;
+    uint32_t queue[FAKE_MAX_BUFS];
+    uint32_t qhead;
+    uint32_t qlen;
+    uint32_t sequence;
+    int fail_reqbufs;           // REQBUFS with a count fails this many times
+} s_dev;
+
+static int fake_open(const char *path, int flags, ...)
+{
+    (void)path, (void)flags;
+    return FAKE_FD;
+}
+
+static void fake_free_bufs(void)
+{
+    for (uint32_t i = 0; i < s_dev.nbufs; i++) {
+        free(s_dev.buf[i]);
+        s_dev.buf[i] = NULL;
+    }
+    s_dev.nbufs = 0;
+    s_dev.qlen = 0;
+}
+
+static int fake_close(int fd)
+{
+    CHECK(fd == FAKE_FD);
+    s_dev.streaming = false;
+    fake_free_bufs();
+    return 0;
+}
+
+static void *fake_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+    (void)addr, (void)len, (void)prot, (void)flags;
+    CHECK(fd == FAKE_FD);
+    uint32_t i = (uint32_t)(offset / FAKE_PAGE);
+    return i < s_dev.nbufs ? s_dev.buf[i] : MAP_FAILED;
+}
+
+static int fail(int err)
+{
+    errno = err;
+    return -1;
+}
+
+static int fake_ioctl(int fd, unsigned long req, ...)
+{
+    CHECK(fd == FAKE_FD);
+    va_list ap;
+    va_start(ap, req);
+    void *arg = va_arg(ap, void *);
+    va_end(ap);
+
+    switch (req) {
+    case VIDIOC_QUERYCAP: {
+        struct v4l2_capability *cap = (struct v4l2_capability *)arg;
+        memset(cap, 0, sizeof(*cap));
+        strcpy((char *)cap->driver, "fake");
+        return 0;
+    }
+    case VIDIOC_G_FMT: {
+        struct v4l2_format *f = (struct v4l2_format *)arg;
+        f->fmt.pix.width = s_dev.width;
+        f->fmt.pix.height = s_dev.height;
+        f->fmt.pix.pixelformat = s_dev.pixfmt;
+        return 0;
+    }
+    case VIDIOC_S_FMT: {
+        const struct v4l2_format *f = (const struct v4l2_format *)arg;
+        if (s_dev.streaming || s_dev.nbufs) return fail(EBUSY);
+        s_dev.width = f->fmt.pix.width;
+        s_dev.height = f->fmt.pix.height;
+        s_dev.pixfmt = f->fmt.pix.pixelformat;
+        // Like most sensors, a new format starts at its default rate.
+        s_dev.interval = (struct v4l2_fract){ 1, 30 };
+        return 0;
+    }
+    case VIDIOC_REQBUFS: {
+        struct v4l2_requestbuffers *r = (struct v4l2_requestbuffers *)arg;
+        if (s_dev.streaming) return fail(EBUSY);
+        if (r->count == 0) {
+            fake_free_bufs();
+            return 0;
+        }
+        if (s_dev.nbufs || r->memory != V4L2_MEMORY_MMAP || r->count > FAKE_MAX_BUFS) return fail(EINVAL);
+        if (s_dev.fail_reqbufs > 0) {
+            s_dev.fail_reqbufs--;
+            return fail(ENOMEM);
+        }
+        s_dev.buf_len = pixfmt_frame_size(s_dev.pixfmt, s_dev.width, s_dev.height);
+        for (uint32_t i = 0; i < r->count; i++) {
+            s_dev.buf[i] = (uint8_t *)calloc(1, s_dev.buf_len);
+            CHECK(s_dev.buf[i] != NULL);
+        }
+        s_dev.nbufs = r->count;
+        return 0;
+    }
+    case VIDIOC_QUERYBUF: {
+        struct v4l2_buffer *b = (struct v4l2_buffer *)arg;
+        if (b->index >= s_dev.nbufs) return fail(EINVAL);
+        b->length = (uint32_t)s_dev.buf_len;
+        b->m.offset = b->index * FAKE_PAGE;
+        return 0;
+    }
+    case VIDIOC_QBUF: {
+        const struct v4l2_buffer *b = (const struct v4l2_buffer *)arg;
+        if (b->index >= s_dev.nbufs || s_dev.qlen == s_dev.nbufs) return fail(EINVAL);
+        s_dev.queue[(s_dev.qhead + s_dev.qlen++) % FAKE_MAX_BUFS] = b->index;
+        return 0;
+    }
+    case VIDIOC_DQBUF: {
+        struct v4l2_buffer *b = (struct v4l2_buffer *)arg;
+        if (!s_dev.streaming || s_dev.qlen == 0) return fail(EINVAL);
+        usleep(FAKE_FRAME_US);
+        b->index = s_dev.queue[s_dev.qhead];
+        s_dev.qhead = (s_dev.qhead + 1) % FAKE_MAX_BUFS;
+        s_dev.qlen--;
+        b->bytesused = (uint32_t)s_dev.buf_len;
+        b->sequence = s_dev.sequence++;
+        return 0;
+    }
+    case VIDIOC_STREAMON:
+        if (s_dev.nbufs == 0) return fail(EINVAL);
+        s_dev.streaming = true;
+        return 0;
+    case VIDIOC_STREAMOFF:
+        // Every buffer comes back to the application.
+        s_dev.streaming = false;
+        s_dev.qlen = 0;
+        return 0;
+    case VIDIOC_G_PARM: {
+        struct v4l2_streamparm *p = (struct v4l2_streamparm *)arg;
+        p->parm.capture.capability = s_dev.timeperframe ? V4L2_CAP_TIMEPERFRAME : 0;
+        p->parm.capture.timeperframe = s_dev.interval;
+        return 0;
+    }
+    case VIDIOC_S_PARM: {
+        const struct v4l2_streamparm *p = (const struct v4l2_streamparm *)arg;
+        if (!s_dev.timeperframe) return fail(ENOTTY);
+        if (s_dev.streaming) return fail(EBUSY);
+        s_dev.interval = p->parm.capture.timeperframe;
+        return 0;
+    }
+    default:
+        return fail(ENOTTY);
+    }
+}
+
+#define open    fake_open
+#define close   fake_close
+#define mmap    fake_mmap
+#define ioctl   fake_ioctl
+#include "app_video.c"
+#undef open
+#undef close
+#undef mmap
+#undef ioctl
+
+void cam_stats_add(cam_stat_t id, uint32_t n)
+{
+    (void)id, (void)n;
+}
+
+static atomic_int s_frames;
+static atomic_uint s_pacer_fps;
+static atomic_bool s_hold;      // keeps the stream task in the callback
+
+static void on_frame(uint8_t *camera_buf, uint8_t camera_buf_index, uint32_t camera_buf_hes,
+                     uint32_t camera_buf_ves, size_t camera_buf_len, const app_video_frame_info_t *info)
+{
+    (void)camera_buf, (void)camera_buf_index, (void)camera_buf_hes, (void)camera_buf_ves;
+    (void)camera_buf_len, (void)info;
+    while (atomic_load(&s_hold)) {
+        usleep(1000);
+    }
+    // Runs on the stream task, right after the pacer let the frame through.
+    atomic_store(&s_pacer_fps, app_camera_video.pacer.fps);
+    atomic_fetch_add(&s_frames, 1);
+}
+
+static bool wait_frames(int n)
+{
+    for (int i = 0; i < 200 && atomic_load(&s_frames) < n; i++) {
+        usleep(10000);
+    }
+    return atomic_load(&s_frames) >= n;
+}
+
+static int open_fake(bool timeperframe)
+{
+    memset(&s_dev, 0, sizeof(s_dev));
+    s_dev.width = 1280;
+    s_dev.height = 720;
+    s_dev.pixfmt = APP_VIDEO_FMT_RGB565;
+    s_dev.interval = (struct v4l2_fract){ 1, 30 };
+    s_dev.timeperframe = timeperframe;
+
+    int fd = app_video_open("/dev/fake", APP_VIDEO_FMT_RGB565);
+    CHECK(fd == FAKE_FD);
+    CHECK(app_video_set_bufs(fd, 3, NULL) == ESP_OK);
+    return fd;
+}
+
+static const video_mode_t s_small = { .pixfmt = APP_VIDEO_FMT_RGB565, .width = 320, .height = 240 };
+static const video_mode_t s_large = { .pixfmt = APP_VIDEO_FMT_RGB565, .width = 640, .height = 480 };
+
+// The sensor takes the rate; S_FMT resets it, so the switch must set it again.
+static void test_sensor_rate(void)
+{
+    int fd = open_fake(true);
+    bool decimating = true;
+    CHECK(app_video_set_frame_rate(fd, 15, &decimating) == ESP_OK);
+    CHECK(!decimating);
+    CHECK(s_dev.interval.numerator == 1 && s_dev.interval.denominator == 15);
+
+    CHECK(app_video_switch_mode(fd, &s_small, 1000) == ESP_OK);
+    CHECK(s_dev.width == 320 && s_dev.height == 240 && s_dev.nbufs == 3);
+    CHECK(app_camera_video.out_fps == 15);
+    CHECK(app_camera_video.decimate_fps == 0);
+    CHECK(s_dev.interval.numerator == 1 && s_dev.interval.denominator == 15);
+    CHECK(app_video_close(fd) == ESP_OK);
+}
+
+// No frame interval control: the stream task keeps pacing to the same rate.
+static void test_decimated_rate(void)
+{
+    int fd = open_fake(false);
+    bool decimating = false;
+    CHECK(app_video_set_frame_rate(fd, 50, &decimating) == ESP_OK);
+    CHECK(decimating);
+
+    atomic_store(&s_frames, 0);
+    CHECK(app_video_register_frame_operation_cb(on_frame) == ESP_OK);
+    CHECK(app_video_stream_task_start(fd, 0) == ESP_OK);
+    CHECK(wait_frames(3));
+    CHECK(atomic_load(&s_pacer_fps) == 50);
+
+    CHECK(app_video_switch_mode(fd, &s_large, 1000) == ESP_OK);
+    CHECK(s_dev.width == 640 && s_dev.height == 480 && s_dev.streaming);
+    CHECK(app_camera_video.out_fps == 50);
+    CHECK(app_camera_video.decimate_fps == 50);
+    CHECK(wait_frames(atomic_load(&s_frames) + 3));
+    CHECK(atomic_load(&s_pacer_fps) == 50);
+
+    CHECK(app_video_stream_task_stop(fd) == ESP_OK);
+    CHECK(app_video_wait_video_stop() == pdTRUE);
+    CHECK(!s_dev.streaming);
+    CHECK(app_video_close(fd) == ESP_OK);
+}
+
+// No buffers after the switch: an error, not an abort, and a retry recovers.
+static void test_failed_switch(void)
+{
+    int fd = open_fake(false);
+    atomic_store(&s_frames, 0);
+    CHECK(app_video_register_frame_operation_cb(on_frame) == ESP_OK);
+    CHECK(app_video_stream_task_start(fd, 0) == ESP_OK);
+    CHECK(wait_frames(3));
+
+    s_dev.fail_reqbufs = 1;
+    CHECK(app_video_switch_mode(fd, &s_small, 1000) == ESP_FAIL);
+    CHECK(!s_dev.streaming && !app_camera_video.streaming);
+    CHECK(app_camera_video.buf_count == 3);
+    int frames = atomic_load(&s_frames);
+    usleep(50000);
+    CHECK(atomic_load(&s_frames) == frames);
+
+    CHECK(app_video_switch_mode(fd, &s_large, 1000) == ESP_OK);
+    CHECK(s_dev.width == 640 && s_dev.height == 480 && s_dev.nbufs == 3 && s_dev.streaming);
+    CHECK(wait_frames(frames + 3));
+
+    CHECK(app_video_stream_task_stop(fd) == ESP_OK);
+    CHECK(app_video_wait_video_stop() == pdTRUE);
+    CHECK(app_video_close(fd) == ESP_OK);
+}
+
+// The stream task is busy past the timeout: the caller gets ESP_ERR_TIMEOUT
+// and the mode must not change under it afterwards.
+static void test_switch_timeout(void)
+{
+    int fd = open_fake(false);
+    atomic_store(&s_frames, 0);
+    CHECK(app_video_register_frame_operation_cb(on_frame) == ESP_OK);
+    CHECK(app_video_stream_task_start(fd, 0) == ESP_OK);
+    CHECK(wait_frames(3));
+
+    uint32_t width = s_dev.width, height = s_dev.height;
+    atomic_store(&s_hold, true);
+    usleep(20000);
+    CHECK(app_video_switch_mode(fd, &s_small, 20) == ESP_ERR_TIMEOUT);
+    atomic_store(&s_hold, false);
+    CHECK(wait_frames(atomic_load(&s_frames) + 3));
+    CHECK(s_dev.width == width && s_dev.height == height && s_dev.streaming);
+
+    CHECK(app_video_switch_mode(fd, &s_small, 1000) == ESP_OK);
+    CHECK(s_dev.width == 320 && s_dev.height == 240);
+
+    CHECK(app_video_stream_task_stop(fd) == ESP_OK);
+    CHECK(app_video_wait_video_stop() == pdTRUE);
+    CHECK(app_video_close(fd) == ESP_OK);
+}
+
+int main(void)
+{
+    test_sensor_rate();
+    test_decimated_rate();
+    test_failed_switch();
+    test_switch_timeout();
+    printf("ok\n");
+    return 0;
+}
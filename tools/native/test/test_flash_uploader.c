@@ -0,0 +1,119 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host test of flash_uploader.c: recorded frames are published in
+ * (clip_id, frame_id) order whatever order the directory lists them in,
+ * and a pass stopped by backpressure resumes where it left off.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "flash_uploader.h"
+#include "video_packetizer.h"
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define MAX_SENT    64
+
+static struct {
+    uint32_t clip_id;
+    uint32_t frame_id;
+} s_sent[MAX_SENT];
+static int s_nsent;
+static int s_refuse_at = -1;     // publish number that hits backpressure
+
+esp_err_t video_packetizer_publish_jpeg(const video_frame_meta_t *meta, const uint8_t *jpeg, uint32_t jpeg_size)
+{
+    (void)jpeg, (void)jpeg_size;
+    if (s_nsent == s_refuse_at) {
+        s_refuse_at = -1;
+        return ESP_ERR_NO_MEM;
+    }
+    CHECK(s_nsent < MAX_SENT);
+    s_sent[s_nsent].clip_id = meta->clip_id;
+    s_sent[s_nsent].frame_id = meta->frame_id;
+    s_nsent++;
+    return ESP_OK;
+}
+
+static void record(uint32_t clip_id, uint32_t frame_id)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/clip%u_frame%u_ts%u_w64_h48.jpg", CONFIG_P4_FLASH_MOUNT_PATH,
+             (unsigned)clip_id, (unsigned)frame_id, (unsigned)frame_id * 33);
+    FILE *f = fopen(path, "wb");
+    CHECK(f != NULL);
+    fputs("\xff\xd8 frame \xff\xd9", f);
+    fclose(f);
+}
+
+static int files_left(void)
+{
+    DIR *d = opendir(CONFIG_P4_FLASH_MOUNT_PATH);
+    CHECK(d != NULL);
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        n += strncmp(e->d_name, "clip", 4) == 0;
+    }
+    closedir(d);
+    return n;
+}
+
+int main(void)
+{
+    mkdir(CONFIG_P4_FLASH_MOUNT_PATH, 0755);
+    // Left over from an earlier run.
+    DIR *d = opendir(CONFIG_P4_FLASH_MOUNT_PATH);
+    CHECK(d != NULL);
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", CONFIG_P4_FLASH_MOUNT_PATH, e->d_name);
+        unlink(path);
+    }
+    closedir(d);
+
+    // Written out of order, with frame ids that sort wrongly as text.
+    static const uint32_t frames[] = { 7, 2, 11, 0, 19, 3, 10, 1, 18, 9, 4, 12, 6, 15, 5, 8, 17, 14, 16, 13 };
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        record(900, frames[i]);
+        if (frames[i] < 4) record(12, frames[i]);
+    }
+    FILE *junk = fopen(CONFIG_P4_FLASH_MOUNT_PATH "/notes.txt", "w");
+    CHECK(junk != NULL);
+    fclose(junk);
+
+    uint32_t sent = 0;
+    size_t bytes = 0;
+    s_refuse_at = 9;
+    CHECK(flash_uploader_run_once(&sent, &bytes) == ESP_ERR_NO_MEM);
+    CHECK(sent == 9 && s_nsent == 9 && bytes > 0);
+    CHECK(files_left() == 24 - 9);
+    CHECK(flash_uploader_run_once(&sent, &bytes) == ESP_OK);
+    CHECK(sent == 24 - 9 && s_nsent == 24);
+    CHECK(files_left() == 0);
+
+    for (int i = 0; i < s_nsent; i++) {
+        uint32_t clip = i < 4 ? 12 : 900;
+        uint32_t frame = i < 4 ? (uint32_t)i : (uint32_t)(i - 4);
+        CHECK(s_sent[i].clip_id == clip && s_sent[i].frame_id == frame);
+    }
+    unlink(CONFIG_P4_FLASH_MOUNT_PATH "/notes.txt");
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host test of frame_pool.c: threads hammer the internal pool, which is
+ * small enough to run dry, and every block they get must be theirs alone.
+ * Then alloc/free pairs per second against malloc(), single and multi
+ * threaded.
+ *
+ *   test_frame_pool [iterations per thread]
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_pool.h"
+#include "sdkconfig.h"
+
+#define THREADS         8
+#define HOLD_MAX        3       // blocks one thread holds at once
+#define BENCH_PAIRS     2000000
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+static _Atomic uint32_t s_owner[CONFIG_P4_POOL_INTERNAL_BLOCKS];
+static uint8_t *s_base;
+static size_t s_block;
+static uint32_t s_iterations = 200000;
+static atomic_bool s_go;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t block_index(const uint8_t *p)
+{
+    CHECK(p >= s_base && (size_t)(p - s_base) % s_block == 0);
+    uint32_t idx = (uint32_t)((size_t)(p - s_base) / s_block);
+    CHECK(idx < CONFIG_P4_POOL_INTERNAL_BLOCKS);
+    return idx;
+}
+
+static void *stress_thread(void *arg)
+{
+    const uint32_t me = (uint32_t)(uintptr_t)arg + 1;
+    uint8_t *held[HOLD_MAX];
+    uint32_t seed = me * 2654435761u;
+
+    while (!atomic_load(&s_go)) {
+    }
+    for (uint32_t it = 0; it < s_iterations; it++) {
+        seed = seed * 1103515245u + 12345u;
+        int want = 1 + (int)((seed >> 16) % HOLD_MAX);
+        int n = 0;
+        while (n < want) {
+            uint8_t *p = (uint8_t *)frame_pool_alloc(FRAME_POOL_INTERNAL, s_block);
+            if (!p) break;
+            uint32_t idx = block_index(p);
+            // Nobody else may hold it: a lost ABA race hands one block out twice.
+            CHECK(atomic_exchange(&s_owner[idx], me) == 0);
+            memset(p, (int)me, s_block);
+            held[n++] = p;
+        }
+        for (int i = 0; i < n; i++) {
+            uint32_t idx = block_index(held[i]);
+            CHECK(held[i][0] == (uint8_t)me && held[i][s_block - 1] == (uint8_t)me);
+            CHECK(atomic_exchange(&s_owner[idx], 0) == me);
+            frame_pool_free(held[i]);
+        }
+    }
+    return NULL;
+}
+
+static void run_threads(void *(*fn)(void *), int count)
+{
+    pthread_t th[THREADS];
+    atomic_store(&s_go, false);
+    for (int i = 0; i < count; i++) {
+        CHECK(pthread_create(&th[i], NULL, fn, (void *)(uintptr_t)i) == 0);
+    }
+    atomic_store(&s_go, true);
+    for (int i = 0; i < count; i++) {
+        pthread_join(th[i], NULL);
+    }
+}
+
+static void test_stress(void)
+{
+    run_threads(stress_thread, THREADS);
+
+    frame_pool_stats_t st;
+    CHECK(frame_pool_get_stats(FRAME_POOL_INTERNAL, &st) == ESP_OK);
+    CHECK(st.in_use == 0);
+    CHECK(st.high_water <= st.block_count);
+    printf("stress: %d threads x %u iterations, high water %u/%u, %u times empty\n",
+           THREADS, s_iterations, st.high_water, st.block_count, st.alloc_fail);
+
+    // Every block made it back onto the free-list exactly once.
+    uint8_t *all[CONFIG_P4_POOL_INTERNAL_BLOCKS];
+    for (int i = 0; i < CONFIG_P4_POOL_INTERNAL_BLOCKS; i++) {
+        all[i] = (uint8_t *)frame_pool_alloc(FRAME_POOL_INTERNAL, 1);
+        CHECK(all[i] != NULL);
+        for (int j = 0; j < i; j++) {
+            CHECK(all[j] != all[i]);
+        }
+    }
+    CHECK(frame_pool_alloc(FRAME_POOL_INTERNAL, 1) == NULL);
+    for (int i = 0; i < CONFIG_P4_POOL_INTERNAL_BLOCKS; i++) {
+        frame_pool_free(all[i]);
+    }
+}
+
+static void test_edges(void)
+{
+    CHECK(frame_pool_alloc(FRAME_POOL_INTERNAL, s_block + 1) == NULL);
+    CHECK(frame_pool_alloc(FRAME_POOL_COUNT, 1) == NULL);
+    // Heap pointers go back to the heap.
+    frame_pool_free(malloc(16));
+    frame_pool_free(NULL);
+}
+
+static _Atomic uint64_t s_bench_ns;
+
+static void *bench_pool_thread(void *arg)
+{
+    (void)arg;
+    while (!atomic_load(&s_go)) {
+    }
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < BENCH_PAIRS; i++) {
+        void *p = frame_pool_alloc(FRAME_POOL_INTERNAL, s_block);
+        if (p) frame_pool_free(p);
+    }
+    atomic_fetch_add(&s_bench_ns, now_ns() - t0);
+    return NULL;
+}
+
+static void *bench_malloc_thread(void *arg)
+{
+    (void)arg;
+    while (!atomic_load(&s_go)) {
+    }
+    uint64_t t0 = now_ns();
+    for (uint32_t i = 0; i < BENCH_PAIRS; i++) {
+        void *p = malloc(s_block);
+        // Keep the compiler from pairing the calls away.
+        __asm__ volatile("" : : "r"(p) : "memory");
+        free(p);
+    }
+    atomic_fetch_add(&s_bench_ns, now_ns() - t0);
+    return NULL;
+}
+
+static void bench(const char *name, void *(*fn)(void *), int threads)
+{
+    atomic_store(&s_bench_ns, 0);
+    run_threads(fn, threads);
+    double ns = (double)atomic_load(&s_bench_ns) / ((double)BENCH_PAIRS * threads);
+    printf("bench: %-6s %d thread%s  %6.1f ns per alloc/free  %6.2f M pairs/s per thread\n",
+           name, threads, threads == 1 ? " " : "s", ns, 1000.0 / ns);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) s_iterations = (uint32_t)strtoul(argv[1], NULL, 10);
+
+    CHECK(frame_pool_init() == ESP_OK);
+    s_block = frame_pool_block_size(FRAME_POOL_INTERNAL);
+    CHECK(s_block >= CONFIG_P4_POOL_INTERNAL_BLOCK_SIZE);
+    s_base = (uint8_t *)frame_pool_alloc(FRAME_POOL_INTERNAL, 1);
+    CHECK(s_base != NULL);
+    frame_pool_free(s_base);
+    // LIFO: the block just freed is the first one, index 0.
+    CHECK(block_index(s_base) == 0);
+
+    test_edges();
+    test_stress();
+
+    bench("pool", bench_pool_thread, 1);
+    bench("malloc", bench_malloc_thread, 1);
+    bench("pool", bench_pool_thread, 4);
+    bench("malloc", bench_malloc_thread, 4);
+    printf("ok\n");
+    return 0;
+}
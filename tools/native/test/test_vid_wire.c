@@ -0,0 +1,108 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host test of vid_wire.c: the largest header vid1_write() can produce must
+ * fit VID1_MAX_HDR, which the packetizer sizes its packet buffer by, and
+ * every header must survive a round trip through vid1_parse().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vid_wire.h"
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+static const vid1_hdr_t s_max = {
+    .frame_id = UINT32_MAX,
+    .chunk_id = UINT16_MAX - 1,
+    .keyframe = true,
+    .has_meta = true,
+    .clip_id = UINT32_MAX,
+    .ts_ms = UINT32_MAX,
+    .chunk_count = UINT16_MAX,
+    .frame_size = UINT32_MAX,
+    .fourcc = VID_FOURCC_H264,
+    .width = UINT16_MAX,
+    .height = UINT16_MAX,
+    .has_times = true,
+    .times = {
+        .dqbuf_us = UINT64_MAX,
+        .enc_start = UINT32_MAX,
+        .enc_end = UINT32_MAX,
+        .first_send = UINT32_MAX,
+        .last_send = UINT32_MAX,
+    },
+};
+
+static bool same(const vid1_hdr_t *a, const vid1_hdr_t *b)
+{
+    return a->frame_id == b->frame_id && a->chunk_id == b->chunk_id && a->keyframe == b->keyframe &&
+           a->has_meta == b->has_meta && a->clip_id == b->clip_id && a->ts_ms == b->ts_ms &&
+           a->chunk_count == b->chunk_count && a->frame_size == b->frame_size && a->fourcc == b->fourcc &&
+           a->width == b->width && a->height == b->height && a->has_times == b->has_times &&
+           a->times.dqbuf_us == b->times.dqbuf_us && a->times.enc_start == b->times.enc_start &&
+           a->times.enc_end == b->times.enc_end && a->times.first_send == b->times.first_send &&
+           a->times.last_send == b->times.last_send;
+}
+
+// Writes hdr with a guard zone after VID1_MAX_HDR and parses it back.
+static size_t round_trip(const vid1_hdr_t *hdr)
+{
+    static const uint8_t payload[] = "payload";
+    uint8_t pkt[VID1_MAX_HDR + sizeof(payload) + 16];
+    memset(pkt, 0xEE, sizeof(pkt));
+
+    size_t n = vid1_write(pkt, hdr, payload, sizeof(payload));
+    CHECK(n <= VID1_MAX_HDR);
+    for (size_t i = n; i < sizeof(pkt); i++) {
+        CHECK(pkt[i] == 0xEE);
+    }
+    memcpy(pkt + n, payload, sizeof(payload));
+
+    vid1_hdr_t got;
+    const uint8_t *body = NULL;
+    size_t body_len = 0;
+    CHECK(vid1_parse(pkt, n + sizeof(payload), &got, &body, &body_len) == VID1_OK);
+    CHECK(same(&got, hdr));
+    CHECK(body_len == sizeof(payload) && memcmp(body, payload, body_len) == 0);
+
+    // Any cut or any flipped bit is refused.
+    for (size_t cut = 0; cut < n + sizeof(payload); cut++) {
+        CHECK(vid1_parse(pkt, cut, &got, &body, &body_len) != VID1_OK);
+    }
+    for (size_t bit = 0; bit < (n + sizeof(payload)) * 8; bit++) {
+        pkt[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+        CHECK(vid1_parse(pkt, n + sizeof(payload), &got, &body, &body_len) != VID1_OK);
+        pkt[bit / 8] ^= (uint8_t)(1u << (bit % 8));
+    }
+    return n;
+}
+
+int main(void)
+{
+    vid1_hdr_t h = s_max;
+
+    CHECK(round_trip(&h) == VID1_MAX_HDR);
+    CHECK(VID1_MAX_HDR == 70);
+
+    h.has_times = false;
+    h.times = (vid1_times_t){ 0 };
+    CHECK(round_trip(&h) == VID1_MAX_HDR - VID1_MAX_HDR_TIMES);
+    CHECK(VID1_MAX_HDR - VID1_MAX_HDR_TIMES == 42);
+
+    h = (vid1_hdr_t){ .frame_id = 7, .chunk_id = 3 };
+    CHECK(round_trip(&h) == 2 + 1 + 1 + 4);
+
+    printf("ok: worst case header %u bytes\n", (unsigned)VID1_MAX_HDR);
+    return 0;
+}
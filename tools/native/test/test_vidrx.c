@@ -0,0 +1,135 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Host test of the native reassembler: frames complete from chunks in any
+ * order, and chunks whose size does not fit the frame's split are refused
+ * instead of leaving holes in a frame that counts as complete. With VID1
+ * and MQTT 5, where only chunk 0 carries the metadata, chunks that arrive
+ * before it are kept until it does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vidrx.h"
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+#define FRAME_SIZE  1000u
+#define CHUNK       400u    // 400 + 400 + 200
+
+static uint8_t s_frame[FRAME_SIZE];
+static int s_completed;
+static int s_intact;
+
+static void on_frame(const vidrx_frame_t *fr, void *user)
+{
+    (void)user;
+    s_completed++;
+    s_intact += fr->size == FRAME_SIZE && memcmp(fr->data, s_frame, FRAME_SIZE) == 0;
+}
+
+static int feed(vidrx_t *rx, uint32_t frame_id, uint32_t chunk_id, size_t off, size_t len)
+{
+    vidrx_chunk_t c = {
+        .frame_id = frame_id,
+        .chunk_id = chunk_id,
+        .has_meta = 1,
+        .clip_id = 1,
+        .chunk_count = (FRAME_SIZE + CHUNK - 1) / CHUNK,
+        .frame_size = FRAME_SIZE,
+    };
+    return vidrx_feed_chunk(rx, 0, &c, s_frame + off, len, 0);
+}
+
+// Metadata on chunk 0 only.
+static int feed_bare(vidrx_t *rx, uint32_t frame_id, uint32_t chunk_id, size_t off, size_t len)
+{
+    if (chunk_id == 0) return feed(rx, frame_id, chunk_id, off, len);
+    vidrx_chunk_t c = { .frame_id = frame_id, .chunk_id = chunk_id };
+    return vidrx_feed_chunk(rx, 0, &c, s_frame + off, len, 0);
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < FRAME_SIZE; i++) s_frame[i] = (uint8_t)(i * 7 + 3);
+
+    vidrx_config_t cfg = VIDRX_CONFIG_DEFAULT();
+    cfg.slots = 4;
+    cfg.max_frame_bytes = 4096;
+    vidrx_t *rx = vidrx_create(&cfg);
+    CHECK(rx != NULL);
+    vidrx_set_callback(rx, on_frame, NULL);
+    vidrx_stats_t st;
+
+    // In order and reversed.
+    CHECK(feed(rx, 1, 0, 0, CHUNK) == 0);
+    CHECK(feed(rx, 1, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed(rx, 1, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 1);
+    CHECK(feed(rx, 2, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 0);
+    CHECK(feed(rx, 2, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed(rx, 2, 0, 0, CHUNK) == 1);
+    CHECK(s_completed == 2 && s_intact == 2);
+
+    // A short middle chunk after a full-size one.
+    CHECK(feed(rx, 3, 0, 0, CHUNK) == 0);
+    CHECK(feed(rx, 3, 1, CHUNK, CHUNK - 1) < 0);
+    // A first chunk that cannot split the frame into three.
+    CHECK(feed(rx, 4, 0, 0, 300) < 0);
+    CHECK(feed(rx, 4, 0, 0, 600) < 0);
+    // The last chunk first, then a full-size chunk that disagrees with it.
+    CHECK(feed(rx, 5, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 0);
+    CHECK(feed(rx, 5, 1, CHUNK, 450) < 0);
+    // A last chunk that disagrees with the full-size ones.
+    CHECK(feed(rx, 3, 2, 2 * CHUNK + 10, FRAME_SIZE - 2 * CHUNK - 10) < 0);
+    vidrx_get_stats(rx, &st);
+    CHECK(st.chunks_bad == 5);
+    CHECK(s_completed == 2);
+
+    // The frames refused chunks for still complete from good ones.
+    CHECK(feed(rx, 3, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed(rx, 3, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 1);
+    CHECK(feed(rx, 5, 0, 0, CHUNK) == 0);
+    CHECK(feed(rx, 5, 1, CHUNK, CHUNK) == 1);
+    CHECK(s_completed == 4 && s_intact == 4);
+
+    // Chunk 0 last, and chunk 0 between the others.
+    CHECK(feed_bare(rx, 6, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed_bare(rx, 6, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed_bare(rx, 6, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 0);
+    CHECK(feed_bare(rx, 6, 0, 0, CHUNK) == 1);
+    CHECK(feed_bare(rx, 7, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed_bare(rx, 7, 0, 0, CHUNK) == 0);
+    CHECK(feed_bare(rx, 7, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 1);
+    CHECK(s_completed == 6 && s_intact == 6);
+    vidrx_get_stats(rx, &st);
+    CHECK(st.chunks_dup == 1 && st.chunks_orphan == 0);
+
+    // A staged chunk that does not fit the split is refused once chunk 0
+    // shows it, and the frame still completes from good ones.
+    CHECK(feed_bare(rx, 8, 1, CHUNK, CHUNK - 1) == 0);
+    CHECK(feed_bare(rx, 8, 0, 0, CHUNK) == 0);
+    CHECK(feed_bare(rx, 8, 1, CHUNK, CHUNK) == 0);
+    CHECK(feed_bare(rx, 8, 2, 2 * CHUNK, FRAME_SIZE - 2 * CHUNK) == 1);
+    CHECK(s_completed == 7 && s_intact == 7);
+
+    // More early chunks than the slab can keep: ten fit in 4096 bytes.
+    for (uint32_t i = 1; i <= 12; i++) {
+        CHECK(feed_bare(rx, 9, i, 0, CHUNK) == (i <= 10 ? 0 : -1));
+    }
+    vidrx_get_stats(rx, &st);
+    CHECK(st.chunks_bad == 6 && st.chunks_orphan == 2);
+
+    vidrx_destroy(rx);
+    printf("ok\n");
+    return 0;
+}
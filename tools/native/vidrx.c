@@ -0,0 +1,574 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "vidrx.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vid_wire.h"
+
+#define VID0_MAGIC      0x56494430u
+#define VID0_HDR_SIZE   32u
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_ASSEMBLING,
+    SLOT_WRITING,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    uint32_t stream;
+    vidrx_chunk_t meta;
+    uint32_t received;
+    uint32_t chunk_size;        // of every chunk but the last, 0 until one arrives
+    uint32_t last_len;          // of the last chunk, 0 until it arrives
+    uint32_t staged;            // bytes of chunks parked in data until chunk 0
+    uint64_t last_ms;
+    uint64_t *bitmap;
+    uint8_t *data;
+} slot_t;
+
+struct vidrx {
+    vidrx_config_t cfg;
+    slot_t *slots;
+    uint8_t *slab;
+    uint64_t *bitmaps;
+    size_t bitmap_words;
+    uint8_t *scratch;           // staged chunks while they are placed
+
+    // Open-addressing map (stream, frame_id) -> slot index + 1.
+    uint32_t *map;
+    uint32_t map_mask;
+
+    vidrx_frame_cb_t cb;
+    void *cb_user;
+    vidrx_stats_t stats;
+
+    // Shared with the writer thread.
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_cond_t idle;
+    uint32_t *free_list;
+    uint32_t free_count;
+    uint32_t *wq;
+    uint32_t wq_head;
+    uint32_t wq_count;
+    uint32_t writing;
+    bool stop;
+    bool has_writer;
+    pthread_t writer;
+    char *outdir;
+};
+
+static inline uint64_t slot_key(uint32_t stream, uint32_t frame_id)
+{
+    return ((uint64_t)stream << 32) | frame_id;
+}
+
+static inline uint32_t hash_key(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    return (uint32_t)k;
+}
+
+static uint32_t map_find(vidrx_t *rx, uint32_t stream, uint32_t frame_id)
+{
+    uint64_t k = slot_key(stream, frame_id);
+    for (uint32_t i = hash_key(k) & rx->map_mask; ; i = (i + 1) & rx->map_mask) {
+        uint32_t v = rx->map[i];
+        if (v == 0) return UINT32_MAX;
+        const slot_t *s = &rx->slots[v - 1];
+        if (slot_key(s->stream, s->meta.frame_id) == k) return v - 1;
+    }
+}
+
+static void map_insert(vidrx_t *rx, uint32_t idx)
+{
+    const slot_t *s = &rx->slots[idx];
+    uint32_t i = hash_key(slot_key(s->stream, s->meta.frame_id)) & rx->map_mask;
+    while (rx->map[i] != 0) i = (i + 1) & rx->map_mask;
+    rx->map[i] = idx + 1;
+}
+
+static void map_remove(vidrx_t *rx, uint32_t idx)
+{
+    const slot_t *s = &rx->slots[idx];
+    uint32_t i = hash_key(slot_key(s->stream, s->meta.frame_id)) & rx->map_mask;
+    while (rx->map[i] != idx + 1) i = (i + 1) & rx->map_mask;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones.
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & rx->map_mask;
+        uint32_t v = rx->map[j];
+        if (v == 0) break;
+        const slot_t *o = &rx->slots[v - 1];
+        uint32_t home = hash_key(slot_key(o->stream, o->meta.frame_id)) & rx->map_mask;
+        if (((j - home) & rx->map_mask) >= ((j - i) & rx->map_mask)) {
+            rx->map[i] = v;
+            i = j;
+        }
+    }
+    rx->map[i] = 0;
+}
+
+static void release_slot_locked(vidrx_t *rx, uint32_t idx)
+{
+    rx->slots[idx].state = SLOT_FREE;
+    rx->free_list[rx->free_count++] = idx;
+}
+
+static void drop_slot(vidrx_t *rx, uint32_t idx)
+{
+    map_remove(rx, idx);
+    pthread_mutex_lock(&rx->lock);
+    release_slot_locked(rx, idx);
+    pthread_mutex_unlock(&rx->lock);
+    rx->stats.frames_dropped++;
+}
+
+static uint32_t take_slot(vidrx_t *rx)
+{
+    uint32_t idx = UINT32_MAX;
+    pthread_mutex_lock(&rx->lock);
+    if (rx->free_count > 0) {
+        idx = rx->free_list[--rx->free_count];
+    }
+    pthread_mutex_unlock(&rx->lock);
+    if (idx != UINT32_MAX) return idx;
+
+    // Evict the oldest incomplete frame; only happens when slots are short.
+    // Frames still waiting for chunk 0 go first: they may be late
+    // duplicates of a frame that already completed.
+    for (uint32_t i = 0; i < rx->cfg.slots; i++) {
+        const slot_t *s = &rx->slots[i];
+        if (s->state != SLOT_ASSEMBLING) continue;
+        const slot_t *o = idx != UINT32_MAX ? &rx->slots[idx] : NULL;
+        if (!o || (o->meta.has_meta && !s->meta.has_meta) ||
+            (o->meta.has_meta == s->meta.has_meta && s->last_ms < o->last_ms)) {
+            idx = i;
+        }
+    }
+    if (idx == UINT32_MAX) return idx;
+    map_remove(rx, idx);
+    rx->stats.frames_dropped++;
+    return idx;
+}
+
+static void write_frame(vidrx_t *rx, const slot_t *s)
+{
+    char path[1024];
+    const char *ext = s->meta.fourcc == VID_FOURCC_MJPG   ? ".jpg"
+                      : s->meta.fourcc == VID_FOURCC_H264 ? ".h264"
+                                                          : ".bin";
+    snprintf(path, sizeof(path), "%s/clip%u_frame%u%s", rx->outdir,
+             (unsigned)s->meta.clip_id, (unsigned)s->meta.frame_id, ext);
+
+    bool ok = false;
+    FILE *f = fopen(path, "wb");
+    if (f) {
+        ok = fwrite(s->data, 1, s->meta.frame_size, f) == s->meta.frame_size;
+        ok = (fclose(f) == 0) && ok;
+    }
+
+    pthread_mutex_lock(&rx->lock);
+    if (ok) {
+        rx->stats.frames_written++;
+        rx->stats.bytes_written += s->meta.frame_size;
+    } else {
+        rx->stats.write_errors++;
+    }
+    pthread_mutex_unlock(&rx->lock);
+}
+
+static void *writer_main(void *arg)
+{
+    vidrx_t *rx = (vidrx_t *)arg;
+    uint32_t *batch = (uint32_t *)malloc(sizeof(uint32_t) * rx->cfg.write_batch);
+    if (!batch) return NULL;
+
+    pthread_mutex_lock(&rx->lock);
+    while (true) {
+        while (rx->wq_count == 0 && !rx->stop) {
+            pthread_cond_wait(&rx->cond, &rx->lock);
+        }
+        if (rx->wq_count == 0 && rx->stop) break;
+
+        uint32_t n = 0;
+        while (rx->wq_count > 0 && n < rx->cfg.write_batch) {
+            batch[n++] = rx->wq[rx->wq_head];
+            rx->wq_head = (rx->wq_head + 1) % rx->cfg.slots;
+            rx->wq_count--;
+        }
+        rx->writing = n;
+        pthread_mutex_unlock(&rx->lock);
+
+        for (uint32_t i = 0; i < n; i++) {
+            write_frame(rx, &rx->slots[batch[i]]);
+        }
+
+        pthread_mutex_lock(&rx->lock);
+        for (uint32_t i = 0; i < n; i++) {
+            release_slot_locked(rx, batch[i]);
+        }
+        rx->writing = 0;
+        if (rx->wq_count == 0) pthread_cond_broadcast(&rx->idle);
+    }
+    pthread_mutex_unlock(&rx->lock);
+    free(batch);
+    return NULL;
+}
+
+vidrx_t *vidrx_create(const vidrx_config_t *cfg)
+{
+    if (!cfg || cfg->slots == 0 || cfg->max_frame_bytes == 0 || cfg->max_chunks == 0) return NULL;
+
+    vidrx_t *rx = (vidrx_t *)calloc(1, sizeof(*rx));
+    if (!rx) return NULL;
+    rx->cfg = *cfg;
+    if (rx->cfg.write_batch == 0) rx->cfg.write_batch = 1;
+    pthread_mutex_init(&rx->lock, NULL);
+    pthread_cond_init(&rx->cond, NULL);
+    pthread_cond_init(&rx->idle, NULL);
+
+    uint32_t map_size = 1;
+    while (map_size < cfg->slots * 2) map_size <<= 1;
+    rx->map_mask = map_size - 1;
+    rx->bitmap_words = (cfg->max_chunks + 63) / 64;
+
+    rx->slots = (slot_t *)calloc(cfg->slots, sizeof(slot_t));
+    rx->slab = (uint8_t *)malloc((size_t)cfg->slots * cfg->max_frame_bytes);
+    rx->bitmaps = (uint64_t *)calloc((size_t)cfg->slots * rx->bitmap_words, sizeof(uint64_t));
+    rx->map = (uint32_t *)calloc(map_size, sizeof(uint32_t));
+    rx->free_list = (uint32_t *)malloc(sizeof(uint32_t) * cfg->slots);
+    rx->wq = (uint32_t *)malloc(sizeof(uint32_t) * cfg->slots);
+    rx->scratch = (uint8_t *)malloc(cfg->max_frame_bytes);
+    if (!rx->slots || !rx->slab || !rx->bitmaps || !rx->map || !rx->free_list || !rx->wq || !rx->scratch) {
+        vidrx_destroy(rx);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < cfg->slots; i++) {
+        rx->slots[i].data = rx->slab + (size_t)i * cfg->max_frame_bytes;
+        rx->slots[i].bitmap = rx->bitmaps + (size_t)i * rx->bitmap_words;
+        rx->free_list[i] = cfg->slots - 1 - i;
+    }
+    rx->free_count = cfg->slots;
+
+    if (cfg->outdir) {
+        rx->outdir = strdup(cfg->outdir);
+        if (!rx->outdir || pthread_create(&rx->writer, NULL, writer_main, rx) != 0) {
+            vidrx_destroy(rx);
+            return NULL;
+        }
+        rx->has_writer = true;
+    }
+    return rx;
+}
+
+void vidrx_destroy(vidrx_t *rx)
+{
+    if (!rx) return;
+    if (rx->has_writer) {
+        pthread_mutex_lock(&rx->lock);
+        rx->stop = true;
+        pthread_cond_signal(&rx->cond);
+        pthread_mutex_unlock(&rx->lock);
+        pthread_join(rx->writer, NULL);
+    }
+    pthread_mutex_destroy(&rx->lock);
+    pthread_cond_destroy(&rx->cond);
+    pthread_cond_destroy(&rx->idle);
+    free(rx->outdir);
+    free(rx->scratch);
+    free(rx->wq);
+    free(rx->free_list);
+    free(rx->map);
+    free(rx->bitmaps);
+    free(rx->slab);
+    free(rx->slots);
+    free(rx);
+}
+
+void vidrx_set_callback(vidrx_t *rx, vidrx_frame_cb_t cb, void *user)
+{
+    rx->cb = cb;
+    rx->cb_user = user;
+}
+
+static void complete_frame(vidrx_t *rx, uint32_t idx)
+{
+    slot_t *s = &rx->slots[idx];
+    map_remove(rx, idx);
+    rx->stats.frames_completed++;
+
+    if (rx->cb) {
+        vidrx_frame_t fr = {
+            .stream = s->stream,
+            .clip_id = s->meta.clip_id,
+            .frame_id = s->meta.frame_id,
+            .ts_ms = s->meta.ts_ms,
+            .fourcc = s->meta.fourcc,
+            .width = s->meta.width,
+            .height = s->meta.height,
+            .size = s->meta.frame_size,
+            .data = s->data,
+        };
+        rx->cb(&fr, rx->cb_user);
+    }
+
+    pthread_mutex_lock(&rx->lock);
+    if (rx->has_writer) {
+        s->state = SLOT_WRITING;
+        rx->wq[(rx->wq_head + rx->wq_count) % rx->cfg.slots] = idx;
+        rx->wq_count++;
+        pthread_cond_signal(&rx->cond);
+    } else {
+        release_slot_locked(rx, idx);
+    }
+    pthread_mutex_unlock(&rx->lock);
+}
+
+// Copies one chunk into a slot that has its metadata.
+static int place_chunk(vidrx_t *rx, uint32_t idx, uint32_t chunk_id, const uint8_t *body, size_t len,
+                       uint64_t now_ms)
+{
+    slot_t *s = &rx->slots[idx];
+    if (chunk_id >= s->meta.chunk_count) {
+        rx->stats.chunks_bad++;
+        return -1;
+    }
+
+    // Every chunk but the last is full size, so the last one is placed from
+    // the end of the frame and the others by index. The first full-size
+    // chunk fixes the size, which must split frame_size into exactly
+    // chunk_count chunks; a chunk that disagrees would leave a hole of
+    // stale slab data in a frame that still counts as complete.
+    const uint64_t frame_size = s->meta.frame_size;
+    const uint32_t last = s->meta.chunk_count - 1;
+    size_t off;
+    if (chunk_id == last) {
+        uint64_t want = s->chunk_size ? frame_size - (uint64_t)s->chunk_size * last
+                                      : last == 0 ? frame_size : 0;
+        if (len == 0 || len > frame_size || (want && len != want)) {
+            rx->stats.chunks_bad++;
+            return -1;
+        }
+        off = frame_size - len;
+    } else {
+        if (s->chunk_size ? len != s->chunk_size
+                          : len == 0 || (uint64_t)len * last >= frame_size ||
+                            (uint64_t)len * (last + 1) < frame_size ||
+                            (s->last_len && s->last_len != frame_size - (uint64_t)len * last)) {
+            rx->stats.chunks_bad++;
+            return -1;
+        }
+        off = (size_t)chunk_id * len;
+    }
+
+    uint64_t bit = 1ULL << (chunk_id & 63);
+    uint64_t *word = &s->bitmap[chunk_id >> 6];
+    if (*word & bit) {
+        rx->stats.chunks_dup++;
+        return 0;
+    }
+    *word |= bit;
+    if (chunk_id == last) {
+        s->last_len = (uint32_t)len;
+    } else {
+        s->chunk_size = (uint32_t)len;
+    }
+    memcpy(s->data + off, body, len);
+    s->last_ms = now_ms;
+
+    if (++s->received == s->meta.chunk_count) {
+        complete_frame(rx, idx);
+        return 1;
+    }
+    return 0;
+}
+
+// Chunks that beat chunk 0 (MQTT reorders across connections and QoS 1
+// redeliveries) are parked at the start of the slab as chunk id, length and
+// body until the geometry is known, then placed like any other chunk.
+static int stage_chunk(vidrx_t *rx, uint32_t idx, uint32_t chunk_id, const uint8_t *body, size_t len,
+                       uint64_t now_ms)
+{
+    slot_t *s = &rx->slots[idx];
+    const uint32_t rec[2] = { chunk_id, (uint32_t)len };
+    if (len == 0 || chunk_id >= rx->cfg.max_chunks) {
+        rx->stats.chunks_bad++;
+        return -1;
+    }
+    if (rx->cfg.max_frame_bytes - s->staged < sizeof(rec) + len) {
+        rx->stats.chunks_orphan++;
+        return -1;
+    }
+    memcpy(s->data + s->staged, rec, sizeof(rec));
+    memcpy(s->data + s->staged + sizeof(rec), body, len);
+    s->staged += (uint32_t)(sizeof(rec) + len);
+    s->last_ms = now_ms;
+    return 0;
+}
+
+// Places the staged chunks moved to rx->scratch; stops once the frame is
+// complete, since the slot is gone then.
+static bool place_staged(vidrx_t *rx, uint32_t idx, uint32_t staged, uint64_t now_ms)
+{
+    for (uint32_t off = 0; off < staged;) {
+        uint32_t rec[2];
+        memcpy(rec, rx->scratch + off, sizeof(rec));
+        off += sizeof(rec);
+        if (place_chunk(rx, idx, rec[0], rx->scratch + off, rec[1], now_ms) > 0) {
+            return true;
+        }
+        off += rec[1];
+    }
+    return false;
+}
+
+int vidrx_feed_chunk(vidrx_t *rx, uint32_t stream, const vidrx_chunk_t *c,
+                     const uint8_t *body, size_t len, uint64_t now_ms)
+{
+    rx->stats.chunks++;
+    rx->stats.bytes += len;
+
+    uint32_t idx = map_find(rx, stream, c->frame_id);
+    slot_t *s = idx != UINT32_MAX ? &rx->slots[idx] : NULL;
+
+    if (c->has_meta) {
+        if (c->chunk_count == 0 || c->chunk_count > rx->cfg.max_chunks ||
+            c->frame_size == 0 || c->frame_size > rx->cfg.max_frame_bytes ||
+            c->chunk_id >= c->chunk_count) {
+            rx->stats.chunks_bad++;
+            return -1;
+        }
+        // Same frame id but different clip or geometry: the old one is stale.
+        if (s && s->meta.has_meta &&
+            (s->meta.clip_id != c->clip_id || s->meta.frame_size != c->frame_size ||
+             s->meta.chunk_count != c->chunk_count)) {
+            drop_slot(rx, idx);
+            s = NULL;
+        }
+    }
+    if (!s) {
+        idx = take_slot(rx);
+        if (idx == UINT32_MAX) {
+            rx->stats.frames_dropped++;
+            return -1;
+        }
+        s = &rx->slots[idx];
+        s->state = SLOT_ASSEMBLING;
+        s->stream = stream;
+        s->meta = *c;
+        s->received = 0;
+        s->chunk_size = 0;
+        s->last_len = 0;
+        s->staged = 0;
+        s->last_ms = now_ms;
+        memset(s->bitmap, 0, rx->bitmap_words * sizeof(uint64_t));
+        map_insert(rx, idx);
+    }
+
+    uint32_t staged = 0;
+    if (!s->meta.has_meta) {
+        if (!c->has_meta) {
+            return stage_chunk(rx, idx, c->chunk_id, body, len, now_ms);
+        }
+        // The geometry is known now; chunk 0 goes where the staged ones are.
+        s->meta = *c;
+        staged = s->staged;
+        s->staged = 0;
+        memcpy(rx->scratch, s->data, staged);
+    }
+    int ret = place_chunk(rx, idx, c->chunk_id, body, len, now_ms);
+    if (ret != 1 && staged && place_staged(rx, idx, staged, now_ms)) {
+        ret = 1;
+    }
+    return ret;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+int vidrx_feed(vidrx_t *rx, uint32_t stream, const uint8_t *payload, size_t len, uint64_t now_ms)
+{
+    vidrx_chunk_t c;
+
+    if (len >= VID0_HDR_SIZE && get_u32(payload) == VID0_MAGIC) {
+        c.clip_id = get_u32(payload + 4);
+        c.frame_id = get_u32(payload + 8);
+        c.ts_ms = get_u32(payload + 12);
+        c.chunk_id = get_u16(payload + 16);
+        c.chunk_count = get_u16(payload + 18);
+        c.frame_size = get_u32(payload + 20);
+        c.fourcc = get_u32(payload + 24);
+        c.width = get_u16(payload + 28);
+        c.height = get_u16(payload + 30);
+        c.has_meta = 1;
+        return vidrx_feed_chunk(rx, stream, &c, payload + VID0_HDR_SIZE, len - VID0_HDR_SIZE, now_ms);
+    }
+
+    vid1_hdr_t h;
+    const uint8_t *body = NULL;
+    size_t body_len = 0;
+    if (vid1_parse(payload, len, &h, &body, &body_len) != VID1_OK) {
+        rx->stats.chunks++;
+        rx->stats.chunks_bad++;
+        return -1;
+    }
+    c.frame_id = h.frame_id;
+    c.chunk_id = h.chunk_id;
+    c.has_meta = h.has_meta;
+    c.clip_id = h.clip_id;
+    c.ts_ms = h.ts_ms;
+    c.chunk_count = h.chunk_count;
+    c.frame_size = h.frame_size;
+    c.fourcc = h.fourcc;
+    c.width = h.width;
+    c.height = h.height;
+    return vidrx_feed_chunk(rx, stream, &c, body, body_len, now_ms);
+}
+
+void vidrx_expire(vidrx_t *rx, uint64_t now_ms)
+{
+    for (uint32_t i = 0; i < rx->cfg.slots; i++) {
+        slot_t *s = &rx->slots[i];
+        if (s->state == SLOT_ASSEMBLING && now_ms - s->last_ms > rx->cfg.timeout_ms) {
+            drop_slot(rx, i);
+        }
+    }
+}
+
+void vidrx_flush(vidrx_t *rx)
+{
+    if (!rx->has_writer) return;
+    pthread_mutex_lock(&rx->lock);
+    while (rx->wq_count > 0 || rx->writing > 0) {
+        pthread_cond_wait(&rx->idle, &rx->lock);
+    }
+    pthread_mutex_unlock(&rx->lock);
+}
+
+void vidrx_get_stats(vidrx_t *rx, vidrx_stats_t *out)
+{
+    pthread_mutex_lock(&rx->lock);
+    *out = rx->stats;
+    pthread_mutex_unlock(&rx->lock);
+}
@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef VIDRX_H
+#define VIDRX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Host-side reassembler for camera video chunks (VID0 and VID1).
+ *
+ * Every in-flight frame owns a preallocated slab and a bitmap of received
+ * chunks; a per-frame counter makes completion detection O(1). Chunks may
+ * arrive in any order: ones that come before chunk 0 and its metadata are
+ * kept in the frame's slab until it arrives. Completed
+ * frames are handed to an optional callback and, when an output directory is
+ * set, to a writer thread that drains them to disk in batches.
+ *
+ * A vidrx_t is not thread safe; use one per worker/shard.
+ */
+
+typedef struct vidrx vidrx_t;
+
+typedef struct {
+    uint32_t slots;             // frames in flight (including frames waiting for the writer)
+    uint32_t max_frame_bytes;   // slab size per slot
+    uint32_t max_chunks;        // chunks per frame tracked by the bitmap
+    uint32_t timeout_ms;        // incomplete frames older than this are dropped
+    const char *outdir;         // NULL disables disk writes
+    uint32_t write_batch;       // frames the writer takes per wakeup
+} vidrx_config_t;
+
+#define VIDRX_CONFIG_DEFAULT() {        \
+    .slots = 64,                        \
+    .max_frame_bytes = 512 * 1024,      \
+    .max_chunks = 1024,                 \
+    .timeout_ms = 10000,                \
+    .outdir = NULL,                     \
+    .write_batch = 16,                  \
+}
+
+/* Chunk header after wire decoding. Metadata fields are valid when has_meta. */
+typedef struct {
+    uint32_t frame_id;
+    uint32_t chunk_id;
+    uint32_t has_meta;
+    uint32_t clip_id;
+    uint32_t ts_ms;
+    uint32_t chunk_count;
+    uint32_t frame_size;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+} vidrx_chunk_t;
+
+typedef struct {
+    uint32_t stream;
+    uint32_t clip_id;
+    uint32_t frame_id;
+    uint32_t ts_ms;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;
+    const uint8_t *data;        // valid for the duration of the callback only
+} vidrx_frame_t;
+
+typedef struct {
+    uint64_t chunks;
+    uint64_t bytes;
+    uint64_t frames_completed;
+    uint64_t frames_dropped;    // expired or evicted before completion
+    uint64_t chunks_bad;        // malformed, CRC mismatch or out of range
+    uint64_t chunks_orphan;     // before chunk 0, with no room left to keep it
+    uint64_t chunks_dup;
+    uint64_t frames_written;
+    uint64_t bytes_written;
+    uint64_t write_errors;
+} vidrx_stats_t;
+
+typedef void (*vidrx_frame_cb_t)(const vidrx_frame_t *frame, void *user);
+
+vidrx_t *vidrx_create(const vidrx_config_t *cfg);
+void vidrx_destroy(vidrx_t *rx);
+
+void vidrx_set_callback(vidrx_t *rx, vidrx_frame_cb_t cb, void *user);
+
+/**
+ * Decode one MQTT payload (VID0 or VID1) for the given stream (camera).
+ * @return 1 if a frame completed, 0 if the chunk was accepted, <0 if rejected.
+ */
+int vidrx_feed(vidrx_t *rx, uint32_t stream, const uint8_t *payload, size_t len, uint64_t now_ms);
+
+/** Same as vidrx_feed() for chunks decoded elsewhere (e.g. MQTT 5 compact). */
+int vidrx_feed_chunk(vidrx_t *rx, uint32_t stream, const vidrx_chunk_t *chunk,
+                     const uint8_t *body, size_t len, uint64_t now_ms);
+
+/** Drop incomplete frames older than the configured timeout. */
+void vidrx_expire(vidrx_t *rx, uint64_t now_ms);
+
+/** Block until the writer has drained every completed frame. */
+void vidrx_flush(vidrx_t *rx);
+
+void vidrx_get_stats(vidrx_t *rx, vidrx_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
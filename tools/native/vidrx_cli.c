@@ -0,0 +1,223 @@
+/*
+ * SPDX-FileCopyrightText: 2025
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+/*
+ * Replay a capture recorded by `mqtt_cam_receiver.py --capture FILE` through
+ * the native reassembler and report throughput.
+ *
+ * Capture layout (little endian): "VRXC", u32 version = 1, then per message
+ *   u64 t_us, u16 topic_len, u32 payload_len, topic, payload
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vidrx.h"
+
+#define CAPTURE_MAGIC   "VRXC"
+#define CAPTURE_VERSION 1u
+#define MAX_TOPICS      256
+
+typedef struct {
+    uint64_t t_us;
+    uint32_t stream;
+    const uint8_t *payload;
+    uint32_t len;
+} record_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint8_t *read_file(const char *path, size_t *out_len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    uint8_t *buf = NULL;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        long n = ftell(f);
+        if (n > 0 && fseek(f, 0, SEEK_SET) == 0) {
+            buf = (uint8_t *)malloc((size_t)n);
+            if (buf && fread(buf, 1, (size_t)n, f) != (size_t)n) {
+                free(buf);
+                buf = NULL;
+            }
+            *out_len = (size_t)n;
+        }
+    }
+    fclose(f);
+    return buf;
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t parse_capture(const uint8_t *buf, size_t len, record_t **out, uint32_t *topics)
+{
+    if (len < 8 || memcmp(buf, CAPTURE_MAGIC, 4) != 0 || rd32(buf + 4) != CAPTURE_VERSION) {
+        fprintf(stderr, "not a vidrx capture (version %u expected)\n", CAPTURE_VERSION);
+        return 0;
+    }
+
+    const char *names[MAX_TOPICS];
+    uint16_t name_len[MAX_TOPICS];
+    uint32_t n_topics = 0;
+    size_t cap = 1024, n = 0;
+    record_t *recs = (record_t *)malloc(cap * sizeof(record_t));
+
+    size_t pos = 8;
+    while (recs && pos + 14 <= len) {
+        uint64_t t_us = (uint64_t)rd32(buf + pos) | ((uint64_t)rd32(buf + pos + 4) << 32);
+        uint16_t tlen = (uint16_t)(buf[pos + 8] | (buf[pos + 9] << 8));
+        uint32_t plen = rd32(buf + pos + 10);
+        pos += 14;
+        if (pos + tlen + plen > len) {
+            fprintf(stderr, "truncated capture at offset %zu\n", pos - 14);
+            break;
+        }
+        const char *topic = (const char *)buf + pos;
+
+        uint32_t stream = 0;
+        while (stream < n_topics && !(name_len[stream] == tlen && memcmp(names[stream], topic, tlen) == 0)) {
+            stream++;
+        }
+        if (stream == n_topics) {
+            if (n_topics == MAX_TOPICS) {
+                fprintf(stderr, "more than %d topics in capture\n", MAX_TOPICS);
+                break;
+            }
+            names[n_topics] = topic;
+            name_len[n_topics] = tlen;
+            n_topics++;
+        }
+
+        if (n == cap) {
+            cap *= 2;
+            record_t *grown = (record_t *)realloc(recs, cap * sizeof(record_t));
+            if (!grown) break;
+            recs = grown;
+        }
+        recs[n++] = (record_t){ .t_us = t_us, .stream = stream, .payload = buf + pos + tlen, .len = plen };
+        pos += tlen + plen;
+    }
+
+    *out = recs;
+    *topics = n_topics;
+    return n;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s CAPTURE [--streams N] [--loops N] [--outdir DIR] [--slots N]\n"
+            "  --streams N   replay every recorded camera N times as distinct streams\n"
+            "  --loops N     replay the capture N times\n"
+            "  --outdir DIR  write completed frames (exercises the writer thread)\n"
+            "  --slots N     frames in flight\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    uint32_t streams = 1, loops = 1;
+    vidrx_config_t cfg = VIDRX_CONFIG_DEFAULT();
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--streams") && i + 1 < argc) {
+            streams = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--loops") && i + 1 < argc) {
+            loops = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--outdir") && i + 1 < argc) {
+            cfg.outdir = argv[++i];
+        } else if (!strcmp(argv[i], "--slots") && i + 1 < argc) {
+            cfg.slots = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!path || streams == 0 || loops == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    size_t file_len = 0;
+    uint8_t *file = read_file(path, &file_len);
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    record_t *recs = NULL;
+    uint32_t topics = 0;
+    size_t n = parse_capture(file, file_len, &recs, &topics);
+    if (n == 0) {
+        free(recs);
+        free(file);
+        return 1;
+    }
+
+    // Keep enough slots for every replicated stream to have a few frames open.
+    if (cfg.slots < topics * streams * 4) cfg.slots = topics * streams * 4;
+    vidrx_t *rx = vidrx_create(&cfg);
+    if (!rx) {
+        fprintf(stderr, "vidrx_create failed (slots=%u)\n", cfg.slots);
+        free(recs);
+        free(file);
+        return 1;
+    }
+
+    const uint64_t span_us = recs[n - 1].t_us - recs[0].t_us;
+    uint64_t t0 = now_ns();
+    for (uint32_t loop = 0; loop < loops; loop++) {
+        for (size_t i = 0; i < n; i++) {
+            const record_t *r = &recs[i];
+            // Synthetic clock so frame expiry behaves as it did live.
+            uint64_t now_ms = (r->t_us - recs[0].t_us + loop * (span_us + 1000)) / 1000;
+            for (uint32_t s = 0; s < streams; s++) {
+                vidrx_feed(rx, r->stream * streams + s, r->payload, r->len, now_ms);
+            }
+        }
+    }
+    uint64_t feed_ns = now_ns() - t0;
+    vidrx_flush(rx);
+    uint64_t total_ns = now_ns() - t0;
+
+    vidrx_stats_t st;
+    vidrx_get_stats(rx, &st);
+    double feed_s = feed_ns / 1e9;
+    double total_s = total_ns / 1e9;
+    double fps = feed_s > 0 ? st.frames_completed / feed_s : 0.0;
+
+    printf("capture: %zu messages, %u topics, %.2f s\n", n, topics, span_us / 1e6);
+    printf("replay:  streams=%u loops=%u slots=%u\n", streams, loops, cfg.slots);
+    printf("chunks=%llu bytes=%llu frames=%llu dropped=%llu bad=%llu orphan=%llu dup=%llu\n",
+           (unsigned long long)st.chunks, (unsigned long long)st.bytes,
+           (unsigned long long)st.frames_completed, (unsigned long long)st.frames_dropped,
+           (unsigned long long)st.chunks_bad, (unsigned long long)st.chunks_orphan,
+           (unsigned long long)st.chunks_dup);
+    printf("feed:    %.3f s  %.0f chunks/s  %.1f MB/s  %.0f frames/s  (%.1f cameras @ 30 fps)\n",
+           feed_s, feed_s > 0 ? st.chunks / feed_s : 0.0, feed_s > 0 ? st.bytes / feed_s / 1e6 : 0.0,
+           fps, fps / 30.0);
+    if (cfg.outdir) {
+        printf("written: %llu frames %llu bytes, %llu errors, %.3f s including disk\n",
+               (unsigned long long)st.frames_written, (unsigned long long)st.bytes_written,
+               (unsigned long long)st.write_errors, total_s);
+    }
+
+    vidrx_destroy(rx);
+    free(recs);
+    free(file);
+    return 0;
+}
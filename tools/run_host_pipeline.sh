@@ -0,0 +1,60 @@
+#!/usr/bin/env bash
+# Build the firmware for the IDF linux target and run it against a local
+# broker while the receiver counts frames, e.g. on a CI box:
+#   tools/run_host_pipeline.sh                 # 30 fps test pattern
+#   SIM_FPS=0 tools/run_host_pipeline.sh       # free-run throughput
+#   BENCH=1 BASELINE=bench.json tools/run_host_pipeline.sh
+#                                              # benchmark report, compared
+#   SOAK=1 SOAK_MINUTES=60 tools/run_host_pipeline.sh
+#                                              # soak run, fails on drift
+set -euo pipefail
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD="${BUILD:-$ROOT/build_linux}"
+BROKER="${BROKER:-mqtt://127.0.0.1:1883}"
+SIM_FPS="${SIM_FPS:-30}"
+SIM_FRAMES="${SIM_FRAMES:-}"
+BENCH="${BENCH:-0}"
+BASELINE="${BASELINE:-}"
+SOAK="${SOAK:-0}"
+SOAK_MINUTES="${SOAK_MINUTES:-240}"
+
+# Per-run overrides; the sdkconfig is regenerated so they always apply.
+mkdir -p "$BUILD"
+rm -f "$BUILD/sdkconfig"
+cat > "$BUILD/sdkconfig.defaults.run" <<CFG
+CONFIG_P4_MQTT_BROKER_URI="$BROKER"
+CONFIG_P4_SIM_FPS=$SIM_FPS
+CONFIG_P4_SIM_FRAMES_FILE="$SIM_FRAMES"
+CFG
+if [ "$BENCH" = "1" ]; then
+  echo "CONFIG_P4_BENCH=y" >> "$BUILD/sdkconfig.defaults.run"
+fi
+if [ "$SOAK" = "1" ]; then
+  printf 'CONFIG_P4_SOAK=y\nCONFIG_P4_SOAK_MINUTES=%s\n' "$SOAK_MINUTES" >> "$BUILD/sdkconfig.defaults.run"
+fi
+
+idf.py -C "$ROOT" -B "$BUILD" -D SDKCONFIG="$BUILD/sdkconfig" \
+  -D SDKCONFIG_DEFAULTS="$ROOT/sdkconfig.defaults.linux;$BUILD/sdkconfig.defaults.run" \
+  --preview set-target linux build
+
+if [ "$BENCH" = "1" ]; then
+  "$BUILD/p4_mqtt_cam.elf" | tee "$BUILD/bench.log"
+  exec python3 "$ROOT/tools/mqtt_cam_bench.py" --uart "$BUILD/bench.log" --out "$BUILD/bench.json" \
+    ${BASELINE:+--baseline "$BASELINE"}
+fi
+
+if [ "$SOAK" = "1" ]; then
+  "$BUILD/p4_mqtt_cam.elf" | tee "$BUILD/soak.log" | \
+    python3 -u "$ROOT/tools/mqtt_cam_soak.py" --uart - --jsonl "$BUILD/soak.jsonl"
+  exit 0
+fi
+
+python3 -u "$ROOT/tools/mqtt_cam_receiver.py" --broker "$BROKER" --topic cam/vid \
+  --outdir "$BUILD/out" --fps 30 &
+RX=$!
+trap 'kill $RX 2>/dev/null || true' EXIT
+sleep 1
+
+"$BUILD/p4_mqtt_cam.elf"
+sleep 2
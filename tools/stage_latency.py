@@ -0,0 +1,98 @@
+"""Per-stage latency histograms from the VID1 stage timestamps.
+
+The camera stamps DQBUF, encode start/end and first/last chunk send on its
+SNTP clock (CONFIG_P4_STAGE_TIMES); the receiver adds the arrival of the
+timed chunk and the time the frame hit disk. Stages whose ends are on
+different hosts (network, total) are only as good as the two clocks' sync.
+"""
+import math
+
+# (name, start, end) over the points of one frame, all in Unix microseconds.
+STAGES = (
+    ("dqbuf>enc", "dqbuf", "enc_start"),
+    ("encode", "enc_start", "enc_end"),
+    ("enc>send", "enc_end", "first_send"),
+    ("publish", "first_send", "last_send"),
+    ("network", "last_send", "rx"),
+    ("rx>disk", "rx", "written"),
+    ("total", "dqbuf", "written"),
+)
+
+# Power-of-two buckets from 64 us to about 67 s; the last bucket is open.
+_BUCKET_MIN_LOG2 = 6
+_BUCKETS = 21
+
+
+def _bucket(us):
+    if us <= 0:
+        return 0
+    return min(_BUCKETS - 1, max(0, math.ceil(math.log2(us)) - _BUCKET_MIN_LOG2))
+
+
+def _bucket_hi_us(i):
+    return 1 << (i + _BUCKET_MIN_LOG2)
+
+
+class Histogram:
+    def __init__(self):
+        self.counts = [0] * _BUCKETS
+        self.n = 0
+        self.total = 0
+        self.max = 0
+        self.negative = 0
+
+    def add(self, us):
+        if us < 0:
+            # Clock skew between camera and receiver; counted, not binned.
+            self.negative += 1
+            return
+        self.counts[_bucket(us)] += 1
+        self.n += 1
+        self.total += us
+        self.max = max(self.max, us)
+
+    def percentile(self, p):
+        """Upper bucket edge holding the p-th percentile, in microseconds."""
+        if not self.n:
+            return 0
+        want = math.ceil(self.n * p / 100.0)
+        seen = 0
+        for i, c in enumerate(self.counts):
+            seen += c
+            if seen >= want:
+                return min(_bucket_hi_us(i), self.max)
+        return self.max
+
+
+class StageLatency:
+    def __init__(self):
+        self.hists = {name: Histogram() for name, _, _ in STAGES}
+
+    def add(self, times, rx_us, written_us=None):
+        """Record one frame; times is hdr["times"] from vid_wire.decode_vid1."""
+        base = times["dqbuf_us"]
+        points = {"dqbuf": base, "rx": rx_us, "written": written_us}
+        for name in ("enc_start", "enc_end", "first_send", "last_send"):
+            points[name] = base + times[name]
+        for name, start, end in STAGES:
+            if points[start] is not None and points[end] is not None:
+                self.hists[name].add(points[end] - points[start])
+
+    def report(self):
+        lines = [f"{'stage':<10} {'n':>6} {'avg_ms':>8} {'p50_ms':>8} {'p90_ms':>8} {'p99_ms':>8} {'max_ms':>8}  histogram"]
+        for name, _, _ in STAGES:
+            h = self.hists[name]
+            if not h.n and not h.negative:
+                continue
+            avg = h.total / h.n if h.n else 0
+            peak = max(h.counts) or 1
+            bars = "".join(" .:-=+*#%@"[min(9, math.ceil(9 * c / peak))] for c in h.counts)
+            line = (
+                f"{name:<10} {h.n:>6} {avg / 1000:>8.2f} {h.percentile(50) / 1000:>8.2f} "
+                f"{h.percentile(90) / 1000:>8.2f} {h.percentile(99) / 1000:>8.2f} {h.max / 1000:>8.2f}  |{bars}|"
+            )
+            if h.negative:
+                line += f" skew={h.negative}"
+            lines.append(line)
+        lines.append(f"{'':<10} buckets: 64us x2 per step to {_bucket_hi_us(_BUCKETS - 1) / 1e6:.0f}s")
+        return "\n".join(lines)
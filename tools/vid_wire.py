@@ -0,0 +1,361 @@
+"""Encoders and decoders for the video chunk wire formats published by the camera.
+
+VID0: every chunk starts with the packed 32-byte vid_hdr_t.
+VID1: 'V', version/flags, varint header (full metadata on chunk 0 only) and
+a CRC32C over header and payload; see main/vid_wire.h for the layout.
+MQTT 5 compact: every chunk starts with an 8-byte header (magic 'V5',
+chunk_id, frame_id); chunk 0 carries the frame metadata as user properties.
+"""
+import struct
+from collections import OrderedDict
+
+VID_MAGIC = 0x56494430  # 'VID0'
+HDR_FMT = "<IIIIHHIIHH"
+HDR_SIZE = struct.calcsize(HDR_FMT)
+
+COMPACT_MAGIC = 0x3556  # 'V5'
+COMPACT_FMT = "<HHI"
+COMPACT_SIZE = struct.calcsize(COMPACT_FMT)
+
+VID1_MAGIC = 0x56
+VID1_VERSION = 1
+VID1_FLAG_META = 0x01
+VID1_FLAG_TIMES = 0x02
+VID1_FLAG_KEY = 0x04  # every chunk of a keyframe
+VID1_TIME_FIELDS = ("enc_start", "enc_end", "first_send", "last_send")  # us after dqbuf_us
+
+FOURCC_MJPG = 0x47504A4D
+FOURCC_H264 = 0x34363248  # Annex B, SPS/PPS before every IDR
+
+CHUNK_MAX = 2048  # payload bytes per chunk, as in main/video_packetizer.c
+
+
+def _crc32c_table():
+    table = []
+    for i in range(256):
+        c = i
+        for _ in range(8):
+            c = (c >> 1) ^ 0x82F63B78 if c & 1 else c >> 1
+        table.append(c)
+    return table
+
+
+_CRC32C_TABLE = _crc32c_table()
+
+
+def _crc32c_py(data, crc=0):
+    crc ^= 0xFFFFFFFF
+    table = _CRC32C_TABLE
+    for b in data:
+        crc = table[(crc ^ b) & 0xFF] ^ (crc >> 8)
+    return crc ^ 0xFFFFFFFF
+
+
+try:
+    from crc32c import crc32c as _crc32c_native  # optional: pip install crc32c
+
+    def crc32c(data, crc=0):
+        return _crc32c_native(data, crc)
+except ImportError:
+    crc32c = _crc32c_py
+
+
+def decode_hdr(payload):
+    """Decode a VID0 chunk. Returns (hdr, body) or (None, None)."""
+    if len(payload) < HDR_SIZE:
+        return None, None
+    fields = struct.unpack(HDR_FMT, payload[:HDR_SIZE])
+    hdr = {
+        "magic": fields[0],
+        "clip_id": fields[1],
+        "frame_id": fields[2],
+        "ts_ms": fields[3],
+        "chunk_id": fields[4],
+        "chunk_count": fields[5],
+        "frame_size": fields[6],
+        "fourcc": fields[7],
+        "width": fields[8],
+        "height": fields[9],
+    }
+    return hdr, payload[HDR_SIZE:]
+
+
+def _varint(buf, pos):
+    value = 0
+    for shift in range(0, 35, 7):
+        if pos >= len(buf):
+            raise ValueError("short varint")
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            if value > 0xFFFFFFFF:
+                raise ValueError("varint overflow")
+            return value, pos
+    raise ValueError("bad varint")
+
+
+def decode_vid1(payload):
+    """Decode and CRC-check one VID1 chunk.
+
+    Returns (hdr, body); hdr has frame_id, chunk_id, keyframe and, on chunk 0,
+    the full metadata. A chunk with stage timestamps (the last one,
+    CONFIG_P4_STAGE_TIMES) also has hdr["times"]: dqbuf_us in Unix
+    microseconds plus VID1_TIME_FIELDS.
+    Returns (None, None) for anything malformed or corrupt.
+    """
+    if len(payload) < 8 or payload[0] != VID1_MAGIC or payload[1] >> 4 != VID1_VERSION:
+        return None, None
+    try:
+        hdr = {"keyframe": bool(payload[1] & VID1_FLAG_KEY)}
+        hdr["frame_id"], pos = _varint(payload, 2)
+        hdr["chunk_id"], pos = _varint(payload, pos)
+        if payload[1] & VID1_FLAG_META:
+            for name in ("clip_id", "ts_ms", "chunk_count", "frame_size"):
+                hdr[name], pos = _varint(payload, pos)
+            if pos + 4 > len(payload):
+                return None, None
+            hdr["fourcc"] = struct.unpack_from("<I", payload, pos)[0]
+            pos += 4
+            hdr["width"], pos = _varint(payload, pos)
+            hdr["height"], pos = _varint(payload, pos)
+            if hdr["chunk_count"] == 0 or hdr["chunk_id"] >= hdr["chunk_count"]:
+                return None, None
+        if payload[1] & VID1_FLAG_TIMES:
+            if pos + 8 > len(payload):
+                return None, None
+            times = {"dqbuf_us": struct.unpack_from("<Q", payload, pos)[0]}
+            pos += 8
+            for name in VID1_TIME_FIELDS:
+                times[name], pos = _varint(payload, pos)
+            hdr["times"] = times
+    except ValueError:
+        return None, None
+    if hdr["chunk_id"] > 0xFFFF or pos + 4 > len(payload):
+        return None, None
+    want = struct.unpack_from("<I", payload, pos)[0]
+    body = payload[pos + 4:]
+    if crc32c(body, crc32c(payload[:pos])) != want:
+        return None, None
+    return hdr, body
+
+
+def _put_varint(out, value):
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def encode_vid1(hdr, body):
+    """Encode one VID1 chunk; hdr needs the full metadata on chunk 0."""
+    flags = VID1_FLAG_META if hdr["chunk_id"] == 0 else 0
+    if hdr.get("keyframe"):
+        flags |= VID1_FLAG_KEY
+    times = hdr.get("times")
+    if times:
+        flags |= VID1_FLAG_TIMES
+    out = bytearray((VID1_MAGIC, VID1_VERSION << 4 | flags))
+    _put_varint(out, hdr["frame_id"])
+    _put_varint(out, hdr["chunk_id"])
+    if hdr["chunk_id"] == 0:
+        for name in ("clip_id", "ts_ms", "chunk_count", "frame_size"):
+            _put_varint(out, hdr[name])
+        out += struct.pack("<I", hdr["fourcc"])
+        _put_varint(out, hdr["width"])
+        _put_varint(out, hdr["height"])
+    if times:
+        out += struct.pack("<Q", times["dqbuf_us"])
+        for name in VID1_TIME_FIELDS:
+            _put_varint(out, times[name])
+    out += struct.pack("<I", crc32c(body, crc32c(out)))
+    return bytes(out) + body
+
+
+def packetize(meta, frame, wire="vid0", chunk_max=CHUNK_MAX):
+    """Split a frame exactly like video_packetizer_publish_jpeg().
+
+    meta needs clip_id, frame_id, ts_ms, width and height; fourcc defaults
+    to MJPG and keyframe to True. An optional meta["times"] goes on the last
+    VID1 chunk. Yields (payload, user_props) per chunk; user_props is only
+    set for chunk 0 of the MQTT 5 compact format.
+    """
+    count = (len(frame) + chunk_max - 1) // chunk_max
+    fourcc = meta.get("fourcc", FOURCC_MJPG)
+    keyframe = meta.get("keyframe", True)
+    for chunk_id in range(count):
+        body = frame[chunk_id * chunk_max:(chunk_id + 1) * chunk_max]
+        if wire == "vid1":
+            hdr = dict(meta, chunk_id=chunk_id, chunk_count=count, frame_size=len(frame), fourcc=fourcc,
+                       keyframe=keyframe)
+            if chunk_id != count - 1:
+                hdr.pop("times", None)
+            yield encode_vid1(hdr, body), None
+        elif wire == "mqtt5":
+            props = None
+            if chunk_id == 0:
+                props = [
+                    ("clip", str(meta["clip_id"])),
+                    ("frame", str(meta["frame_id"])),
+                    ("ts", str(meta["ts_ms"])),
+                    ("chunks", str(count)),
+                    ("size", str(len(frame))),
+                    ("fourcc", str(fourcc)),
+                    ("w", str(meta["width"])),
+                    ("h", str(meta["height"])),
+                    ("key", "1" if keyframe else "0"),
+                ]
+            yield struct.pack(COMPACT_FMT, COMPACT_MAGIC, chunk_id, meta["frame_id"]) + body, props
+        else:
+            hdr = struct.pack(
+                HDR_FMT,
+                VID_MAGIC,
+                meta["clip_id"],
+                meta["frame_id"],
+                meta["ts_ms"],
+                chunk_id,
+                count,
+                len(frame),
+                fourcc,
+                meta["width"],
+                meta["height"],
+            )
+            yield hdr + body, None
+
+
+def h264_is_keyframe(frame):
+    """True when an Annex B access unit contains an IDR slice (NAL type 5)."""
+    pos = frame.find(b"\x00\x00\x01")
+    while pos >= 0 and pos + 3 < len(frame):
+        if frame[pos + 3] & 0x1F == 5:
+            return True
+        pos = frame.find(b"\x00\x00\x01", pos + 3)
+    return False
+
+
+def is_keyframe(hdr, frame):
+    """Keyframe flag of an assembled frame; VID0 has none, so H.264 is scanned."""
+    if "keyframe" in hdr:
+        return hdr["keyframe"]
+    return hdr.get("fourcc") != FOURCC_H264 or h264_is_keyframe(frame)
+
+
+def frame_ext(fourcc):
+    """File extension receivers use for a frame of this fourcc."""
+    return {FOURCC_MJPG: ".jpg", FOURCC_H264: ".h264"}.get(fourcc, ".bin")
+
+
+def is_self_contained(payload):
+    """True for VID0/VID1 chunks, which decode without MQTT properties or state."""
+    if len(payload) < 4:
+        return False
+    return struct.unpack_from("<I", payload)[0] == VID_MAGIC or (
+        payload[0] == VID1_MAGIC and payload[1] >> 4 == VID1_VERSION
+    )
+
+
+def user_properties(msg):
+    props = getattr(msg, "properties", None)
+    if props is None:
+        return {}
+    return dict(getattr(props, "UserProperty", None) or [])
+
+
+_PROP_KEYS = (
+    ("clip", "clip_id"),
+    ("frame", "frame_id"),
+    ("ts", "ts_ms"),
+    ("chunks", "chunk_count"),
+    ("size", "frame_size"),
+    ("fourcc", "fourcc"),
+    ("w", "width"),
+    ("h", "height"),
+)
+
+
+class WireDecoder:
+    """Stateful decoder that normalises every format to a VID0-style hdr dict.
+
+    VID1 and compact chunks after chunk 0 only carry (frame_id, chunk_id); the
+    metadata from chunk 0 is remembered per topic until the frame is
+    forgotten or evicted. Chunks that arrive before their chunk 0 are held
+    back and returned along with it; those that do not fit (max_early per
+    frame, max_frames frames) are counted in orphans. Corrupt VID1 chunks are
+    counted in crc_errors.
+    """
+
+    def __init__(self, max_frames=256, max_early=1024):
+        self.max_frames = max_frames
+        self.max_early = max_early
+        self.meta = OrderedDict()
+        self.early = OrderedDict()
+        self.crc_errors = 0
+        self.orphans = 0
+
+    def decode_chunks(self, topic, payload, props=None):
+        """Return the (hdr, body) pairs this payload makes decodable: none while
+        its frame's chunk 0 is missing, several when chunk 0 releases the
+        chunks that came before it."""
+        if len(payload) >= 4 and struct.unpack_from("<I", payload)[0] == VID_MAGIC:
+            hdr, body = decode_hdr(payload)
+            return [(hdr, body)] if hdr else []
+        if len(payload) >= 2 and payload[0] == VID1_MAGIC and payload[1] >> 4 == VID1_VERSION:
+            hdr, body = decode_vid1(payload)
+            if hdr is None:
+                self.crc_errors += 1
+                return []
+            return self._resolve(topic, hdr, body)
+        if len(payload) >= COMPACT_SIZE:
+            magic, chunk_id, frame_id = struct.unpack_from(COMPACT_FMT, payload)
+            if magic == COMPACT_MAGIC:
+                return self._decode_compact(topic, chunk_id, frame_id, payload[COMPACT_SIZE:], props or {})
+        return []
+
+    def forget(self, topic, frame_id):
+        self.meta.pop((topic, frame_id), None)
+        self.early.pop((topic, frame_id), None)
+
+    def _decode_compact(self, topic, chunk_id, frame_id, body, props):
+        hdr = {"frame_id": frame_id, "chunk_id": chunk_id}
+        if chunk_id == 0:
+            try:
+                hdr.update({dst: int(props[src]) for src, dst in _PROP_KEYS})
+            except (KeyError, ValueError):
+                return []
+            hdr["keyframe"] = props.get("key", "1") != "0"
+        return self._resolve(topic, hdr, body)
+
+    def _resolve(self, topic, hdr, body):
+        # Chunks without metadata borrow it from their frame's chunk 0.
+        key = (topic, hdr["frame_id"])
+        chunks = [(hdr, body)]
+        if "chunk_count" in hdr:
+            meta = dict(hdr)
+            del meta["chunk_id"]
+            meta.pop("times", None)
+            self.meta[key] = meta
+            while len(self.meta) > self.max_frames:
+                self.meta.popitem(last=False)
+            chunks += self.early.pop(key, [])
+        meta = self.meta.get(key)
+        if meta is None:
+            self._hold(key, hdr, body)
+            return []
+        out = []
+        for h, b in chunks:
+            o = dict(meta)
+            o["chunk_id"] = h["chunk_id"]
+            if "times" in h:
+                o["times"] = h["times"]
+            out.append((o, b))
+        return out
+
+    def _hold(self, key, hdr, body):
+        waiting = self.early.setdefault(key, [])
+        if len(waiting) < self.max_early:
+            waiting.append((hdr, body))
+        else:
+            self.orphans += 1
+        while len(self.early) > self.max_frames:
+            _, dropped = self.early.popitem(last=False)
+            self.orphans += len(dropped)
@@ -0,0 +1,215 @@
+"""ctypes binding for the native chunk reassembler in tools/native.
+
+Build the library first:
+  cmake -S tools/native -B tools/native/build && cmake --build tools/native/build
+or point VIDRX_LIB at a prebuilt libvidrx.so.
+"""
+import ctypes
+import os
+import struct
+
+_HERE = os.path.dirname(os.path.abspath(__file__))
+
+CAPTURE_MAGIC = b"VRXC"
+CAPTURE_VERSION = 1
+
+
+class Config(ctypes.Structure):
+    _fields_ = [
+        ("slots", ctypes.c_uint32),
+        ("max_frame_bytes", ctypes.c_uint32),
+        ("max_chunks", ctypes.c_uint32),
+        ("timeout_ms", ctypes.c_uint32),
+        ("outdir", ctypes.c_char_p),
+        ("write_batch", ctypes.c_uint32),
+    ]
+
+
+class Chunk(ctypes.Structure):
+    _fields_ = [
+        (name, ctypes.c_uint32)
+        for name in (
+            "frame_id",
+            "chunk_id",
+            "has_meta",
+            "clip_id",
+            "ts_ms",
+            "chunk_count",
+            "frame_size",
+            "fourcc",
+            "width",
+            "height",
+        )
+    ]
+
+
+class Frame(ctypes.Structure):
+    _fields_ = [
+        ("stream", ctypes.c_uint32),
+        ("clip_id", ctypes.c_uint32),
+        ("frame_id", ctypes.c_uint32),
+        ("ts_ms", ctypes.c_uint32),
+        ("fourcc", ctypes.c_uint32),
+        ("width", ctypes.c_uint32),
+        ("height", ctypes.c_uint32),
+        ("size", ctypes.c_uint32),
+        ("data", ctypes.POINTER(ctypes.c_uint8)),
+    ]
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [
+        (name, ctypes.c_uint64)
+        for name in (
+            "chunks",
+            "bytes",
+            "frames_completed",
+            "frames_dropped",
+            "chunks_bad",
+            "chunks_orphan",
+            "chunks_dup",
+            "frames_written",
+            "bytes_written",
+            "write_errors",
+        )
+    ]
+
+
+FRAME_CB = ctypes.CFUNCTYPE(None, ctypes.POINTER(Frame), ctypes.c_void_p)
+
+
+def _load():
+    candidates = [os.environ.get("VIDRX_LIB"), os.path.join(_HERE, "native", "build", "libvidrx.so")]
+    for path in candidates:
+        if path and os.path.exists(path):
+            lib = ctypes.CDLL(path)
+            break
+    else:
+        raise OSError("libvidrx.so not found; build tools/native or set VIDRX_LIB")
+
+    lib.vidrx_create.restype = ctypes.c_void_p
+    lib.vidrx_create.argtypes = [ctypes.POINTER(Config)]
+    lib.vidrx_destroy.argtypes = [ctypes.c_void_p]
+    lib.vidrx_set_callback.argtypes = [ctypes.c_void_p, FRAME_CB, ctypes.c_void_p]
+    lib.vidrx_feed.restype = ctypes.c_int
+    lib.vidrx_feed.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_uint64]
+    lib.vidrx_feed_chunk.restype = ctypes.c_int
+    lib.vidrx_feed_chunk.argtypes = [
+        ctypes.c_void_p,
+        ctypes.c_uint32,
+        ctypes.POINTER(Chunk),
+        ctypes.c_char_p,
+        ctypes.c_size_t,
+        ctypes.c_uint64,
+    ]
+    lib.vidrx_expire.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.vidrx_flush.argtypes = [ctypes.c_void_p]
+    lib.vidrx_get_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(Stats)]
+    return lib
+
+
+_lib = None
+
+
+class Reassembler:
+    """One native reassembler. Not thread safe; use one per worker.
+
+    on_frame(frame_dict, data_bytes) is called for every completed frame;
+    with outdir set, frames are also written to disk by a native thread.
+    """
+
+    def __init__(self, outdir=None, slots=64, max_frame_bytes=512 * 1024, max_chunks=1024,
+                 timeout_ms=10000, write_batch=16, on_frame=None):
+        global _lib
+        if _lib is None:
+            _lib = _load()
+        self._outdir = outdir.encode() if outdir else None
+        cfg = Config(slots, max_frame_bytes, max_chunks, timeout_ms, self._outdir, write_batch)
+        self._rx = _lib.vidrx_create(ctypes.byref(cfg))
+        if not self._rx:
+            raise MemoryError("vidrx_create failed")
+        self._streams = {}
+        self._cb = None
+        if on_frame is not None:
+            def trampoline(frame_p, _user):
+                fr = frame_p.contents
+                info = {name: getattr(fr, name) for name, _ in Frame._fields_ if name != "data"}
+                on_frame(info, ctypes.string_at(fr.data, fr.size))
+
+            self._cb = FRAME_CB(trampoline)
+            _lib.vidrx_set_callback(self._rx, self._cb, None)
+
+    def stream_id(self, topic):
+        sid = self._streams.get(topic)
+        if sid is None:
+            sid = self._streams[topic] = len(self._streams)
+        return sid
+
+    def topic(self, stream_id):
+        """Topic a frame's "stream" number stands for."""
+        for topic, sid in self._streams.items():
+            if sid == stream_id:
+                return topic
+        return None
+
+    def feed(self, topic, payload, now_ms):
+        """Feed one VID0/VID1 payload. Returns 1 on frame completion, 0 accepted, <0 rejected."""
+        return _lib.vidrx_feed(self._rx, self.stream_id(topic), payload, len(payload), now_ms)
+
+    def feed_hdr(self, topic, hdr, body, now_ms):
+        """Feed a chunk already decoded by vid_wire.WireDecoder (e.g. MQTT 5 compact)."""
+        c = Chunk(
+            hdr["frame_id"],
+            hdr["chunk_id"],
+            1,
+            hdr["clip_id"],
+            hdr["ts_ms"],
+            hdr["chunk_count"],
+            hdr["frame_size"],
+            hdr["fourcc"],
+            hdr["width"],
+            hdr["height"],
+        )
+        return _lib.vidrx_feed_chunk(self._rx, self.stream_id(topic), ctypes.byref(c), body, len(body), now_ms)
+
+    def expire(self, now_ms):
+        _lib.vidrx_expire(self._rx, now_ms)
+
+    def flush(self):
+        _lib.vidrx_flush(self._rx)
+
+    def stats(self):
+        st = Stats()
+        _lib.vidrx_get_stats(self._rx, ctypes.byref(st))
+        return {name: getattr(st, name) for name, _ in Stats._fields_}
+
+    def close(self):
+        if self._rx:
+            _lib.vidrx_destroy(self._rx)
+            self._rx = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+
+class CaptureWriter:
+    """Record raw MQTT traffic for replay with tools/native/build/vidrx_cli."""
+
+    def __init__(self, path):
+        self._f = open(path, "wb")
+        self._f.write(CAPTURE_MAGIC + struct.pack("<I", CAPTURE_VERSION))
+
+    def write(self, t_us, topic, payload):
+        t = topic.encode()
+        self._f.write(struct.pack("<QHI", t_us, len(t), len(payload)))
+        self._f.write(t)
+        self._f.write(payload)
+
+    def close(self):
+        self._f.close()